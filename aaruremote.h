@@ -67,7 +67,27 @@
 #define AARUREMOTE_PACKET_TYPE_COMMAND_REOPEN 30
 #define AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD 31
 #define AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD 32
+#define AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_VECTOR 33
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD_VECTOR 34
+#define AARUREMOTE_PACKET_TYPE_COMMAND_GET_STATS 35
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_STATS 36
+#define AARUREMOTE_PACKET_TYPE_COMMAND_ECHO 37
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_ECHO 38
+#define AARUREMOTE_PACKET_TYPE_COMMAND_SINK 39
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_SINK 40
+#define AARUREMOTE_PACKET_TYPE_COMMAND_SOURCE 41
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_SOURCE 42
+#define AARUREMOTE_PACKET_TYPE_COMPRESSED 43
+#define AARUREMOTE_PACKET_TYPE_ZERO_RUNS 44
+#define AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_MAP 45
+#define AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD_MAP 46
 #define AARUREMOTE_PROTOCOL_MAX 2
+#define AARUREMOTE_CAPABILITY_TIMING 0x01
+#define AARUREMOTE_CAPABILITY_COMPRESSION 0x02
+#define AARUREMOTE_CAPABILITY_ZERO_RUNS 0x04
+#define AARUREMOTE_CAPABILITIES                                                                                        \
+    (AARUREMOTE_CAPABILITY_TIMING | AARUREMOTE_CAPABILITY_COMPRESSION | AARUREMOTE_CAPABILITY_ZERO_RUNS)
+#define AARUREMOTE_COMPRESSION_LZ4 1
 #define AARUREMOTE_PACKET_NOP_REASON_OOO 0
 #define AARUREMOTE_PACKET_NOP_REASON_NOT_IMPLEMENTED 1
 #define AARUREMOTE_PACKET_NOP_REASON_NOT_RECOGNIZED 2
@@ -76,6 +96,8 @@
 #define AARUREMOTE_PACKET_NOP_REASON_OPEN_ERROR 5
 #define AARUREMOTE_PACKET_NOP_REASON_REOPEN_OK 6
 #define AARUREMOTE_PACKET_NOP_REASON_CLOSE_ERROR 5
+#define AARUREMOTE_PACKET_NOP_REASON_INVALID_PACKET 7
+#define AARUREMOTE_PACKET_NOP_REASON_OUT_OF_MEMORY 8
 #define AARUREMOTE_DEVICE_TYPE_UNKNOWN -1
 #define AARUREMOTE_DEVICE_TYPE_ATA 1
 #define AARUREMOTE_DEVICE_TYPE_ATAPI 2
@@ -161,7 +183,8 @@ typedef struct
     char             application[128];
     char             version[64];
     uint8_t          max_protocol;
-    char             spare[3];
+    uint8_t          capabilities;
+    char             spare[2];
     char             sysname[256];
     char             release[256];
     char             machine[256];
@@ -527,6 +550,226 @@ typedef struct
     uint32_t         duration;
 } AaruPacketResOsRead;
 
+typedef struct
+{
+    uint64_t offset;
+    uint32_t length;
+} AaruCmdOsReadExtent;
+
+typedef struct
+{
+    AaruPacketHeader    hdr;
+    uint64_t            extent_count;
+    AaruCmdOsReadExtent extents[0];
+} AaruPacketCmdOsReadVector;
+
+typedef struct
+{
+    int32_t  error_no;
+    uint32_t duration;
+    uint32_t length;
+} AaruResOsReadExtent;
+
+// Data of every extent follows the results, back to back, each one as long as its result says
+typedef struct
+{
+    AaruPacketHeader    hdr;
+    uint64_t            extent_count;
+    AaruResOsReadExtent results[0];
+} AaruPacketResOsReadVector;
+
+#define AARUREMOTE_OSREAD_MAP_DATA 0
+#define AARUREMOTE_OSREAD_MAP_HOLE 1
+#define AARUREMOTE_OSREAD_MAP_ZERO 2
+
+// Data the device reports is read to find the zeros in it too, without this only holes are found when the device
+// can tell them apart, and every block read when it cannot
+#define AARUREMOTE_OSREAD_MAP_SCAN_ZEROS 0x01
+#define AARUREMOTE_OSREAD_MAP_MAX_EXTENTS 65536
+#define AARUREMOTE_OSREAD_MAP_DEFAULT_BLOCK 512
+#define AARUREMOTE_OSREAD_MAP_MAX_BLOCK (1024 * 1024)
+
+// Zeros are looked for in blocks of block_size from the offset, 0 uses AARUREMOTE_OSREAD_MAP_DEFAULT_BLOCK. max_extents
+// of 0 or over AARUREMOTE_OSREAD_MAP_MAX_EXTENTS uses that.
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint64_t         offset;
+    uint64_t         length;
+    uint32_t         block_size;
+    uint32_t         flags;
+    uint32_t         max_extents;
+    uint32_t         spare;
+} AaruPacketCmdOsReadMap;
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t length;
+    uint32_t type;
+    uint32_t spare;
+} AaruOsReadMapExtent;
+
+// Extents follow, adjoining from the offset asked for up to end. end falls short of the range when the device ended,
+// the extents ran out or error_no stopped the map.
+typedef struct
+{
+    AaruPacketHeader    hdr;
+    int32_t             error_no;
+    uint32_t            extent_count;
+    uint64_t            end;
+    AaruOsReadMapExtent extents[0];
+} AaruPacketResOsReadMap;
+
+// Appended to device command responses when both sides have AARUREMOTE_CAPABILITY_TIMING, and counted in hdr.len.
+// Microseconds of the server's monotonic clock, previous_sent is when the previous response finished sending.
+typedef struct
+{
+    uint64_t received;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t previous_sent;
+} AaruResponseTiming;
+
+// Biggest echo and source chunk, both are held in memory whole
+#define AARUREMOTE_DIAGNOSTICS_MAX_CHUNK (16 * 1024 * 1024)
+#define AARUREMOTE_DIAGNOSTICS_DEFAULT_CHUNK (256 * 1024)
+
+// Echo packets are a header and a payload, answered by the same packet as AARUREMOTE_PACKET_TYPE_RESPONSE_ECHO.
+// Sink packets carry a payload the server throws away, elapsed counts microseconds from the header to the last byte.
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint64_t         bytes;
+    uint64_t         elapsed;
+} AaruPacketResSink;
+
+// chunk_size of 0 uses AARUREMOTE_DIAGNOSTICS_DEFAULT_CHUNK
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint64_t         length;
+    uint32_t         chunk_size;
+    uint32_t         spare;
+} AaruPacketCmdSource;
+
+// As many as needed to send the length asked, each followed by its generated data. elapsed counts microseconds from
+// the command until this chunk was handed to the network, so the last one tells how long sending took on the server.
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint64_t         offset;
+    uint64_t         elapsed;
+} AaruPacketResSource;
+
+// Sent instead of a device command response when both sides have AARUREMOTE_CAPABILITY_COMPRESSION and it gets
+// smaller. What follows is the whole response, header and timing trailer included, as an LZ4 block.
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint32_t         uncompressed_len;
+    uint8_t          algorithm;
+    uint8_t          spare[3];
+} AaruPacketCompressed;
+
+// Zero runs shorter than two of these may be missed, one of them aligned to the start of the response is looked for
+#define AARUREMOTE_ZERO_RUN_WINDOW 256
+
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+} AaruZeroRun;
+
+// Sent instead of a device command response when both sides have AARUREMOTE_CAPABILITY_ZERO_RUNS and it has long runs
+// of zeros. The runs follow, in order and with offsets in the whole response, then the response without their bytes.
+// When compression is negotiated too this packet may be compressed in turn.
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint32_t         original_len;
+    uint32_t         run_count;
+    AaruZeroRun      runs[0];
+} AaruPacketZeroRuns;
+
+#define AARUREMOTE_STATS_BUCKETS 240
+#define AARUREMOTE_STATS_NO_OPCODE -1
+#define AARUREMOTE_STATS_NO_DEVICE -1
+
+// Latencies in microseconds. Buckets 0 to 7 hold that exact value, from there on bucket b holds values from
+// (8 + b % 8) << (b / 8 - 1) up to the next bucket, so every power of two is split in 8 linear steps.
+typedef struct
+{
+    int8_t   packet_type;
+    uint8_t  spare;
+    int16_t  opcode;
+    int32_t  device;
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t total_time;
+    uint32_t max_time;
+    uint32_t buckets[AARUREMOTE_STATS_BUCKETS];
+} AaruStatsEntry;
+
+typedef struct
+{
+    char device_path[1024];
+} AaruStatsDevice;
+
+// Devices follow the header, then the entries, whose device field indexes the devices
+typedef struct
+{
+    AaruPacketHeader hdr;
+    uint64_t         uptime;
+    uint64_t         dropped;
+    uint32_t         device_count;
+    uint32_t         entry_count;
+} AaruPacketResStats;
+
+#define AARUREMOTE_TRACE_MAGIC "AARUTRAC"
+#define AARUREMOTE_TRACE_VERSION 1
+#define AARUREMOTE_TRACE_COMMAND_SIZE 32
+#define AARUREMOTE_TRACE_SENSE_SIZE 32
+
+#define AARUREMOTE_TRACE_FLAG_ERROR 0x01
+#define AARUREMOTE_TRACE_FLAG_HASH 0x02
+
+// Trace files are this header followed by records, all little endian. start_time is seconds since the epoch.
+typedef struct
+{
+    char     magic[8];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t spare;
+    uint64_t start_time;
+} AaruTraceHeader;
+
+// Times in microseconds, started counts from the start of the trace. duration is what the device took and elapsed the
+// whole request, sending included. command holds the start of the command packet after its header as sent by the
+// client, the SCSI one ending with the CDB. sense holds sense data, ATA error registers or the SD response.
+// data_hash is FNV-1a of the data moved.
+typedef struct
+{
+    uint64_t sequence;
+    uint64_t started;
+    uint32_t duration;
+    uint32_t elapsed;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint32_t data_len;
+    int32_t  error_no;
+    int8_t   packet_type;
+    uint8_t  flags;
+    uint8_t  command_len;
+    uint8_t  sense_len;
+    uint32_t spare;
+    uint64_t data_hash;
+    uint8_t  command[AARUREMOTE_TRACE_COMMAND_SIZE];
+    uint8_t  sense[AARUREMOTE_TRACE_SENSE_SIZE];
+} AaruTraceRecord;
+
 #pragma pack(pop)
 
 typedef struct
@@ -543,6 +786,203 @@ typedef struct
     uint8_t  write;
 } MmcSingleCommand;
 
+typedef struct
+{
+    uint8_t  direct_io;
+    uint8_t  huge_pages;
+    size_t   pool_cap;
+    uint16_t port;
+    uint16_t metrics_port;
+    char*    trace_path;
+    uint32_t trace_ring;
+    uint8_t  trace_hash;
+    char*    fault_path;
+    uint32_t net_delay;
+    uint32_t net_jitter;
+    uint32_t net_rate;
+    uint32_t net_coalesce;
+} AaruRemoteOptions;
+
+extern AaruRemoteOptions server_options;
+
+// Traffic to a client waits in order until a slower, farther link would have delivered it
+#define IMPAIR_IDLE ((uint64_t)-1)
+#define IMPAIR_SEND_DUE 0
+#define IMPAIR_SEND_UNTIL_READABLE 1
+#define IMPAIR_SEND_ALL 2
+#define IMPAIR_SEND_ROOM 3
+
+typedef struct Impairment
+{
+    struct ImpairChunk* head;
+    struct ImpairChunk* tail;
+    uint64_t            out_free;
+    uint64_t            in_free;
+    uint64_t            last_due;
+    uint64_t            random;
+    uint64_t            queued;
+} Impairment;
+
+// Per session scratch memory for packets, released all at once after each response
+#define ARENA_INITIAL_SIZE (64 * 1024)
+#define ARENA_MAX_RETAINED (32 * 1024 * 1024)
+
+typedef struct
+{
+    struct ArenaChunk* head;
+    struct ArenaChunk* overflow;
+    size_t             used;
+} Arena;
+
+// Large transfer buffers shared by every session, kept around instead of being mapped and unmapped per packet
+#define POOL_MIN_SIZE (128 * 1024)
+#define POOL_MAX_BUFFERS 32
+#define POOL_DEFAULT_CAP (256 * 1024 * 1024)
+
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t failures;
+    size_t   in_use;
+    size_t   cached;
+    size_t   peak;
+} PoolStats;
+
+// Requests are accounted per packet type, SCSI opcode and device, up to this many combinations
+#define STATS_MAX_ENTRIES 256
+#define STATS_MAX_DEVICES 8
+
+typedef struct
+{
+    uint64_t uptime;
+    uint64_t dropped;
+    uint64_t sessions;
+    uint32_t sessions_active;
+    uint32_t device_count;
+    uint32_t entry_count;
+} StatsSummary;
+
+// Pieces of a single response that are sent together without copying them into one buffer
+#define NET_MAX_BUFFERS 8
+
+typedef struct
+{
+    const void* data;
+    uint32_t    len;
+} NetBuffer;
+
+// Device functions a session goes through, the platform ones or those of an emulated device
+typedef struct
+{
+    void* (*open)(const char* device_path);
+    void (*close)(void* device_ctx);
+    int32_t (*get_device_type)(void* device_ctx);
+    int32_t (*send_scsi_command)(void*     device_ctx,
+                                 char*     cdb,
+                                 char*     buffer,
+                                 char**    sense_buffer,
+                                 uint32_t  timeout,
+                                 int32_t   direction,
+                                 uint32_t* duration,
+                                 uint32_t* sense,
+                                 uint32_t  cdb_len,
+                                 uint32_t* buf_len,
+                                 uint32_t* sense_len);
+    char* (*get_scsi_data_in_buffer)(void* device_ctx, uint32_t length);
+    int32_t (*get_sdhci_registers)(void*     device_ctx,
+                                   char**    csd,
+                                   char**    cid,
+                                   char**    ocr,
+                                   char**    scr,
+                                   uint32_t* csd_len,
+                                   uint32_t* cid_len,
+                                   uint32_t* ocr_len,
+                                   uint32_t* scr_len);
+    uint8_t (*get_usb_data)(void*     device_ctx,
+                            uint16_t* desc_len,
+                            char*     descriptors,
+                            uint16_t* id_vendor,
+                            uint16_t* id_product,
+                            char*     manufacturer,
+                            char*     product,
+                            char*     serial);
+    uint8_t (*get_firewire_data)(void*     device_ctx,
+                                 uint32_t* id_model,
+                                 uint32_t* id_vendor,
+                                 uint64_t* guid,
+                                 char*     vendor,
+                                 char*     model);
+    uint8_t (*get_pcmcia_data)(void* device_ctx, uint16_t* cis_len, char* cis);
+    int32_t (*send_ata_chs_command)(void*                 device_ctx,
+                                    AtaRegistersChs       registers,
+                                    AtaErrorRegistersChs* error_registers,
+                                    uint8_t               protocol,
+                                    uint8_t               transfer_register,
+                                    char*                 buffer,
+                                    uint32_t              timeout,
+                                    uint8_t               transfer_blocks,
+                                    uint32_t*             duration,
+                                    uint32_t*             sense,
+                                    uint32_t*             buf_len);
+    int32_t (*send_ata_lba28_command)(void*                   device_ctx,
+                                      AtaRegistersLba28       registers,
+                                      AtaErrorRegistersLba28* error_registers,
+                                      uint8_t                 protocol,
+                                      uint8_t                 transfer_register,
+                                      char*                   buffer,
+                                      uint32_t                timeout,
+                                      uint8_t                 transfer_blocks,
+                                      uint32_t*               duration,
+                                      uint32_t*               sense,
+                                      uint32_t*               buf_len);
+    int32_t (*send_ata_lba48_command)(void*                   device_ctx,
+                                      AtaRegistersLba48       registers,
+                                      AtaErrorRegistersLba48* error_registers,
+                                      uint8_t                 protocol,
+                                      uint8_t                 transfer_register,
+                                      char*                   buffer,
+                                      uint32_t                timeout,
+                                      uint8_t                 transfer_blocks,
+                                      uint32_t*               duration,
+                                      uint32_t*               sense,
+                                      uint32_t*               buf_len);
+    int32_t (*send_sdhci_command)(void*     device_ctx,
+                                  uint8_t   command,
+                                  uint8_t   write,
+                                  uint8_t   application,
+                                  uint32_t  flags,
+                                  uint32_t  argument,
+                                  uint32_t  block_size,
+                                  uint32_t  blocks,
+                                  char*     buffer,
+                                  uint32_t  buf_len,
+                                  uint32_t  timeout,
+                                  uint32_t* response,
+                                  uint32_t* duration,
+                                  uint32_t* sense);
+    int32_t (*send_multi_sdhci_command)(void*            device_ctx,
+                                        uint64_t         count,
+                                        MmcSingleCommand commands[],
+                                        uint32_t*        duration,
+                                        uint32_t*        sense);
+    int32_t (*reopen)(void* device_ctx, uint32_t* closeFailed);
+    int32_t (*os_read)(void*     device_ctx,
+                       char*     buffer,
+                       uint64_t  offset,
+                       uint32_t  length,
+                       uint32_t* read_length,
+                       uint32_t* duration);
+    int32_t (*os_seek_data)(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole);
+} DeviceBackend;
+
+extern const DeviceBackend platform_backend;
+
+const DeviceBackend* GetDeviceBackend(const char* device_path);
+const DeviceBackend* EmuGetBackend(const char* device_path);
+const DeviceBackend* FaultWrap(const DeviceBackend* backend);
+
 DeviceInfoList*  ListDevices();
 void             FreeDeviceInfoList(DeviceInfoList* start);
 uint16_t         DeviceInfoListCount(DeviceInfoList* start);
@@ -638,7 +1078,14 @@ int32_t          SendMultiSdhciCommand(void*            device_ctx,
                                        MmcSingleCommand commands[],
                                        uint32_t*        duration,
                                        uint32_t*        sense);
-int32_t          OsRead(void* device_ctx, char* buffer, uint64_t offset, uint32_t length, uint32_t* duration);
+int32_t          OsRead(void*     device_ctx,
+                        char*     buffer,
+                        uint64_t  offset,
+                        uint32_t  length,
+                        uint32_t* read_length,
+                        uint32_t* duration);
+int32_t          OsSeekData(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole);
+char*            GetScsiDataInBuffer(void* device_ctx, uint32_t length);
 AaruPacketHello* GetHello();
 int              PrintNetworkAddresses();
 char*            PrintIpv4Address(struct in_addr addr);
@@ -648,10 +1095,61 @@ int32_t          NetListen(void* net_ctx, uint32_t backlog);
 void*            NetAccept(void* net_ctx, struct sockaddr* addr, socklen_t* addrlen);
 int32_t          NetRecv(void* net_ctx, void* buf, int32_t len, uint32_t flags);
 int32_t          NetWrite(void* net_ctx, const void* buf, int32_t size);
+int32_t          NetWriteV(void* net_ctx, const NetBuffer* buffers, int32_t count);
 int32_t          NetClose(void* net_ctx);
+void             NetImpair(void* net_ctx);
 void             Initialize();
 void             PlatformLoop(AaruPacketHello* pkt_server_hello);
 void*            WorkingLoop(void* arguments);
 uint8_t          AmIRoot();
 int32_t          ReOpen(void* device_ctx, uint32_t* closeFailed);
+Arena*           ArenaNew(size_t size);
+void*            ArenaAlloc(Arena* arena, size_t size);
+void             ArenaReset(Arena* arena);
+void             ArenaFree(Arena* arena);
+void*            PoolGet(size_t size, size_t* granted);
+void             PoolPut(void* buffer);
+void             PoolGetStats(PoolStats* stats);
+uint64_t         GetMonotonicMicroseconds();
+void             SleepMicroseconds(uint64_t microseconds);
+void             MemoryFence();
+void             StatsInit();
+void             StatsSetDevice(const char* device_path);
+void             StatsRecord(int8_t   packet_type,
+                             int16_t  opcode,
+                             uint32_t bytes_in,
+                             uint32_t bytes_out,
+                             uint64_t time,
+                             uint8_t  error);
+uint32_t         StatsSize();
+void             StatsSnapshot(AaruPacketResStats* pkt_res_stats);
+void             StatsSessionStarted();
+void             StatsSessionEnded();
+void             StatsCopy(StatsSummary* summary, AaruStatsDevice* devices, AaruStatsEntry* entries);
+void*            MetricsLoop(void* arguments);
+int              TraceInit();
+uint8_t          TraceEnabled();
+uint64_t         TraceHash(const void* data, uint32_t len);
+void             TraceRecord(AaruTraceRecord* record);
+void             TraceFlush();
+void             TraceDump();
+void             OsReadMap(const DeviceBackend*          backend,
+                           void*                         device_ctx,
+                           const AaruPacketCmdOsReadMap* pkt_cmd_map,
+                           AaruPacketResOsReadMap*       pkt_res_map);
+uint8_t          CompressWorthTrying(const uint8_t* in, uint32_t len);
+uint32_t         CompressBlock(const uint8_t* in, uint32_t len, uint8_t* out, uint32_t out_len);
+uint8_t          CompressIsZero(const uint8_t* in, uint32_t len);
+uint32_t         CompressZeroRuns(const uint8_t* in, uint32_t len, AaruZeroRun* runs, uint32_t* zero_bytes);
+int              FaultInit();
+uint8_t          ImpairEnabled();
+Impairment*      ImpairNew();
+void             ImpairFree(Impairment* impair);
+uint64_t         ImpairRoom(Impairment* impair);
+int32_t          ImpairQueue(Impairment* impair, const NetBuffer* buffers, int32_t count, uint32_t offset);
+int32_t          ImpairDue(Impairment* impair, NetBuffer* buffers, int32_t max, uint64_t* wait);
+void             ImpairSent(Impairment* impair, uint32_t len);
+uint64_t         ImpairReceived(Impairment* impair, int32_t len);
+void*            AllocateLargeBuffer(size_t size, uint8_t huge_pages);
+void             FreeLargeBuffer(void* buffer, size_t size);
 #endif
@@ -0,0 +1,162 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aaruremote.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+struct ArenaChunk
+{
+    struct ArenaChunk* next;
+    size_t             size;
+    size_t             used;
+    uint8_t            pooled;
+};
+
+// Chunk header is rounded so the data that follows it keeps the arena alignment
+#define ARENA_CHUNK_HEADER ARENA_ROUND(sizeof(struct ArenaChunk))
+
+static struct ArenaChunk* ArenaNewChunk(size_t size)
+{
+    struct ArenaChunk* chunk   = NULL;
+    size_t             granted = 0;
+
+    // Big chunks come from the shared transfer pool, whatever the size class has spare is ours to use
+    if(ARENA_CHUNK_HEADER + size >= POOL_MIN_SIZE) chunk = PoolGet(ARENA_CHUNK_HEADER + size, &granted);
+
+    // Over the pool cap the chunk is not cached, it goes straight back to the heap
+    if(chunk)
+        size = granted - ARENA_CHUNK_HEADER;
+    else
+    {
+        granted = 0;
+        chunk   = malloc(ARENA_CHUNK_HEADER + size);
+    }
+
+    if(!chunk) return NULL;
+
+    chunk->next   = NULL;
+    chunk->size   = size;
+    chunk->used   = 0;
+    chunk->pooled = granted > 0;
+
+    return chunk;
+}
+
+static void ArenaFreeChunk(struct ArenaChunk* chunk)
+{
+    if(chunk->pooled)
+        PoolPut(chunk);
+    else
+        free(chunk);
+}
+
+Arena* ArenaNew(size_t size)
+{
+    Arena* arena = malloc(sizeof(Arena));
+
+    if(!arena) return NULL;
+
+    memset(arena, 0, sizeof(Arena));
+
+    arena->head = ArenaNewChunk(ARENA_ROUND(size));
+
+    if(!arena->head)
+    {
+        free(arena);
+        return NULL;
+    }
+
+    return arena;
+}
+
+void* ArenaAlloc(Arena* arena, size_t size)
+{
+    struct ArenaChunk* chunk;
+    void*              ptr;
+
+    size = ARENA_ROUND(size);
+
+    if(size == 0) size = ARENA_ALIGNMENT;
+
+    // Latest chunk is always first in the list
+    chunk = arena->overflow ? arena->overflow : arena->head;
+
+    if(chunk->size - chunk->used < size)
+    {
+        chunk = ArenaNewChunk(size > chunk->size ? size : chunk->size);
+
+        if(!chunk) return NULL;
+
+        chunk->next     = arena->overflow;
+        arena->overflow = chunk;
+    }
+
+    ptr = (char*)chunk + ARENA_CHUNK_HEADER + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+
+    return ptr;
+}
+
+void ArenaReset(Arena* arena)
+{
+    struct ArenaChunk* chunk;
+    size_t             size;
+
+    if(!arena) return;
+
+    // Packet did not fit, grow the main chunk so the next one like it does without touching the heap
+    if(arena->overflow)
+    {
+        while(arena->overflow)
+        {
+            chunk           = arena->overflow;
+            arena->overflow = chunk->next;
+            ArenaFreeChunk(chunk);
+        }
+
+        size = arena->used > ARENA_MAX_RETAINED ? ARENA_MAX_RETAINED : arena->used;
+
+        if(size > arena->head->size)
+        {
+            chunk = ArenaNewChunk(size);
+
+            if(chunk)
+            {
+                ArenaFreeChunk(arena->head);
+                arena->head = chunk;
+            }
+        }
+    }
+
+    arena->head->used = 0;
+    arena->used       = 0;
+}
+
+void ArenaFree(Arena* arena)
+{
+    if(!arena) return;
+
+    ArenaReset(arena);
+    ArenaFreeChunk(arena->head);
+    free(arena);
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+
+// What every port implements for real devices
+const DeviceBackend platform_backend = {DeviceOpen,
+                                        DeviceClose,
+                                        GetDeviceType,
+                                        SendScsiCommand,
+                                        GetScsiDataInBuffer,
+                                        GetSdhciRegisters,
+                                        GetUsbData,
+                                        GetFireWireData,
+                                        GetPcmciaData,
+                                        SendAtaChsCommand,
+                                        SendAtaLba28Command,
+                                        SendAtaLba48Command,
+                                        SendSdhciCommand,
+                                        SendMultiSdhciCommand,
+                                        ReOpen,
+                                        OsRead,
+                                        OsSeekData};
+
+const DeviceBackend* GetDeviceBackend(const char* device_path)
+{
+    const DeviceBackend* backend = device_path ? EmuGetBackend(device_path) : NULL;
+
+    return FaultWrap(backend ? backend : &platform_backend);
+}
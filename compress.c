@@ -0,0 +1,257 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+#include "endian.h"
+
+#define COMPRESS_HASH_BITS 12
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_MAX_OFFSET 65535
+// LZ4 blocks end in at least 5 literals, and the last match starts 12 bytes or more before the end
+#define COMPRESS_LAST_LITERALS 5
+#define COMPRESS_MATCH_LIMIT 12
+// Bytes looked at to guess how well a block compresses, in slices spread over all of it
+#define COMPRESS_SAMPLE_SLICES 64
+#define COMPRESS_SAMPLE_SLICE 64
+
+// Only the worker compresses, one response at a time
+static uint32_t compress_table[1 << COMPRESS_HASH_BITS];
+
+static uint32_t CompressRead32(const uint8_t* in)
+{
+    uint32_t value;
+
+    memcpy(&value, in, sizeof(uint32_t));
+
+    return value;
+}
+
+static uint32_t CompressHash(uint32_t sequence) { return (sequence * 2654435761U) >> (32 - COMPRESS_HASH_BITS); }
+
+// Lengths that do not fit in the token nibble go on in bytes of 255 until one is smaller
+static uint8_t* CompressLength(uint8_t* op, uint32_t len)
+{
+    while(len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+
+    *op++ = (uint8_t)len;
+
+    return op;
+}
+
+// Literals from the anchor and, unless this is the end of the block, the match that follows them
+static uint8_t* CompressSequence(uint8_t*       op,
+                                 const uint8_t* out_end,
+                                 const uint8_t* literals,
+                                 uint32_t       literal_len,
+                                 uint32_t       offset,
+                                 uint32_t       match_len)
+{
+    uint8_t* token;
+
+    // Token, both lengths going long, literals and offset
+    if(op + 1 + literal_len / 255 + 1 + literal_len + 2 + match_len / 255 + 1 > out_end) return NULL;
+
+    token  = op++;
+    *token = (uint8_t)((literal_len >= 15 ? 15 : literal_len) << 4);
+
+    if(literal_len >= 15) op = CompressLength(op, literal_len - 15);
+
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if(match_len == 0) return op;
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+
+    match_len -= COMPRESS_MIN_MATCH;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+
+    if(match_len >= 15) op = CompressLength(op, match_len - 15);
+
+    return op;
+}
+
+// Guesses from a sample whether the block is worth compressing. Bytes of random or already compressed data are spread
+// evenly, then two sampled bytes match about once in 256 times, anything that matches twice as often is tried.
+uint8_t CompressWorthTrying(const uint8_t* in, uint32_t len)
+{
+    uint32_t counts[256];
+    uint64_t collisions = 0;
+    uint64_t sampled    = 0;
+    uint32_t slice;
+    uint32_t start;
+    uint32_t i;
+
+    memset(counts, 0, sizeof(counts));
+
+    if(len <= COMPRESS_SAMPLE_SLICES * COMPRESS_SAMPLE_SLICE)
+    {
+        for(i = 0; i < len; i++) counts[in[i]]++;
+
+        sampled = len;
+    }
+    else
+    {
+        for(slice = 0; slice < COMPRESS_SAMPLE_SLICES; slice++)
+        {
+            start = (uint32_t)((uint64_t)(len - COMPRESS_SAMPLE_SLICE) * slice / (COMPRESS_SAMPLE_SLICES - 1));
+
+            for(i = 0; i < COMPRESS_SAMPLE_SLICE; i++) counts[in[start + i]]++;
+        }
+
+        sampled = COMPRESS_SAMPLE_SLICES * COMPRESS_SAMPLE_SLICE;
+    }
+
+    for(i = 0; i < 256; i++)
+        if(counts[i] > 1) collisions += (uint64_t)counts[i] * (counts[i] - 1);
+
+    return collisions * 128 >= sampled * (sampled - 1);
+}
+
+// Compresses in the LZ4 block format, so clients can use any LZ4 library to get the data back. Returns the compressed
+// length, or 0 if it would not fit in out_len.
+uint32_t CompressBlock(const uint8_t* in, uint32_t len, uint8_t* out, uint32_t out_len)
+{
+    const uint8_t* out_end = out + out_len;
+    uint8_t*       op      = out;
+    uint32_t       anchor  = 0;
+    uint32_t       ip      = 0;
+    uint32_t       candidate;
+    uint32_t       match_len;
+    uint32_t       sequence;
+    uint32_t       hash;
+
+    memset(compress_table, 0, sizeof(compress_table));
+
+    while(len > COMPRESS_MATCH_LIMIT && ip < len - COMPRESS_MATCH_LIMIT)
+    {
+        sequence             = CompressRead32(in + ip);
+        hash                 = CompressHash(sequence);
+        candidate            = compress_table[hash];
+        compress_table[hash] = ip;
+
+        if(candidate >= ip || ip - candidate > COMPRESS_MAX_OFFSET || CompressRead32(in + candidate) != sequence)
+        {
+            // Gets faster the longer nothing matches, so incompressible stretches cost little
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        while(ip > anchor && candidate > 0 && in[ip - 1] == in[candidate - 1])
+        {
+            ip--;
+            candidate--;
+        }
+
+        match_len = COMPRESS_MIN_MATCH;
+
+        // Word by word first, runs of zeros and the like go on for a long while
+        while(ip + match_len + 4 <= len - COMPRESS_LAST_LITERALS &&
+              CompressRead32(in + ip + match_len) == CompressRead32(in + candidate + match_len))
+            match_len += 4;
+
+        while(ip + match_len < len - COMPRESS_LAST_LITERALS && in[ip + match_len] == in[candidate + match_len])
+            match_len++;
+
+        op = CompressSequence(op, out_end, in + anchor, ip - anchor, ip - candidate, match_len);
+
+        if(!op) return 0;
+
+        ip += match_len;
+        anchor = ip;
+
+        // What comes right before the next search is a good match for what follows it
+        if(ip >= 2 && ip < len - COMPRESS_MATCH_LIMIT)
+            compress_table[CompressHash(CompressRead32(in + ip - 2))] = ip - 2;
+    }
+
+    op = CompressSequence(op, out_end, in + anchor, len - anchor, 0, 0);
+
+    return op ? (uint32_t)(op - out) : 0;
+}
+
+// Whole words at a time, simple enough for the compiler to vectorize
+uint8_t CompressIsZero(const uint8_t* in, uint32_t len)
+{
+    uint64_t word;
+    uint64_t bits = 0;
+    uint32_t i;
+
+    for(i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        memcpy(&word, in + i, sizeof(uint64_t));
+        bits |= word;
+    }
+
+    for(; i < len; i++) bits |= in[i];
+
+    return bits == 0;
+}
+
+// Finds the runs of zeros that hold a whole window aligned to the start of the block, then follows them byte by byte
+// to both ends. runs needs room for one run per window, their offsets and lengths are little endian.
+uint32_t CompressZeroRuns(const uint8_t* in, uint32_t len, AaruZeroRun* runs, uint32_t* zero_bytes)
+{
+    uint32_t count    = 0;
+    uint32_t pos      = 0;
+    uint32_t previous = 0;
+    uint32_t start;
+    uint32_t end;
+
+    *zero_bytes = 0;
+
+    while(pos + AARUREMOTE_ZERO_RUN_WINDOW <= len)
+    {
+        if(!CompressIsZero(in + pos, AARUREMOTE_ZERO_RUN_WINDOW))
+        {
+            pos += AARUREMOTE_ZERO_RUN_WINDOW;
+            continue;
+        }
+
+        start = pos;
+        end   = pos + AARUREMOTE_ZERO_RUN_WINDOW;
+
+        while(start > previous && in[start - 1] == 0) start--;
+
+        while(end + AARUREMOTE_ZERO_RUN_WINDOW <= len && CompressIsZero(in + end, AARUREMOTE_ZERO_RUN_WINDOW))
+            end += AARUREMOTE_ZERO_RUN_WINDOW;
+
+        while(end < len && in[end] == 0) end++;
+
+        runs[count].offset = htole32(start);
+        runs[count].length = htole32(end - start);
+        count++;
+        *zero_bytes += end - start;
+
+        // The window holding the end is not all zeros
+        previous = end;
+        pos      = end - end % AARUREMOTE_ZERO_RUN_WINDOW + AARUREMOTE_ZERO_RUN_WINDOW;
+    }
+
+    return count;
+}
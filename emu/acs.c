@@ -0,0 +1,471 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "emu.h"
+
+#define ACS_READ_SECTORS 0x20
+#define ACS_READ_SECTORS_EXT 0x24
+#define ACS_READ_DMA_EXT 0x25
+#define ACS_READ_VERIFY_SECTORS 0x40
+#define ACS_READ_VERIFY_SECTORS_EXT 0x42
+#define ACS_READ_DMA 0xC8
+#define ACS_IDENTIFY_DEVICE 0xEC
+#define ACS_SET_FEATURES 0xEF
+
+#define ACS_FEATURE_ENABLE_WRITE_CACHE 0x02
+#define ACS_FEATURE_SET_TRANSFER_MODE 0x03
+#define ACS_FEATURE_DISABLE_READ_LOOK_AHEAD 0x55
+#define ACS_FEATURE_DISABLE_WRITE_CACHE 0x82
+#define ACS_FEATURE_ENABLE_READ_LOOK_AHEAD 0xAA
+
+#define ACS_STATUS_ERR 0x01
+#define ACS_STATUS_DSC 0x10
+#define ACS_STATUS_DRDY 0x40
+
+#define ACS_ERROR_ABRT 0x04
+#define ACS_ERROR_IDNF 0x10
+#define ACS_ERROR_UNC 0x40
+
+#define ACS_SECTOR 512
+
+// Default translation, as BIOSes set it up for disks of 8 GiB or more
+#define ACS_HEADS 16
+#define ACS_SECTORS_PER_TRACK 63
+#define ACS_MAX_CYLINDERS 16383
+
+#define ACS_MAX_LBA28 0x0FFFFFFF
+
+// Transfer modes as SET FEATURES takes them, the top bits select the kind
+#define ACS_MODE_PIO 0x08
+#define ACS_MODE_MWDMA 0x20
+#define ACS_MODE_UDMA 0x40
+
+typedef struct
+{
+    uint8_t transfer_mode;
+    uint8_t write_cache;
+    uint8_t read_look_ahead;
+} AcsDrive;
+
+// What a command needs from the taskfile whichever way it came, address is updated to where the command stopped
+typedef struct
+{
+    uint8_t  command;
+    uint16_t feature;
+    uint16_t sector_count;
+    uint64_t address;
+    uint8_t  status;
+    uint8_t  error;
+} AcsTaskfile;
+
+static void* AcsOpen(const char* device_path)
+{
+    EmuDevice* dev = EmuOpen(device_path, AARUREMOTE_DEVICE_TYPE_ATA, ACS_SECTOR, 0);
+    AcsDrive*  drive;
+
+    if(!dev) return NULL;
+
+    drive = malloc(sizeof(AcsDrive));
+
+    if(!drive)
+    {
+        EmuClose(dev);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    drive->transfer_mode   = ACS_MODE_UDMA | 5;
+    drive->write_cache     = 1;
+    drive->read_look_ahead = 1;
+    dev->model_data        = drive;
+
+    return dev;
+}
+
+static uint64_t AcsSectors(EmuDevice* dev) { return dev->size / ACS_SECTOR; }
+
+static uint32_t AcsCylinders(EmuDevice* dev)
+{
+    uint64_t cylinders = AcsSectors(dev) / (ACS_HEADS * ACS_SECTORS_PER_TRACK);
+
+    return cylinders > ACS_MAX_CYLINDERS ? ACS_MAX_CYLINDERS : (uint32_t)cylinders;
+}
+
+static void AcsPutWord(uint8_t* data, uint32_t word, uint16_t value)
+{
+    data[word * 2]     = (uint8_t)value;
+    data[word * 2 + 1] = (uint8_t)(value >> 8);
+}
+
+// ATA strings are space padded with the two characters of every word swapped
+static void AcsPutString(uint8_t* data, uint32_t word, const char* text, uint32_t words)
+{
+    uint32_t i;
+    size_t   len = strlen(text);
+
+    for(i = 0; i < words * 2; i++) data[word * 2 + (i ^ 1)] = i < len ? (uint8_t)text[i] : ' ';
+}
+
+static void AcsIdentify(EmuDevice* dev, AcsDrive* drive, uint8_t* data)
+{
+    uint64_t sectors   = AcsSectors(dev);
+    uint32_t cylinders = AcsCylinders(dev);
+    uint32_t chs       = cylinders * ACS_HEADS * ACS_SECTORS_PER_TRACK;
+    uint64_t serial    = TraceHash(dev->image_path, (uint32_t)strlen(dev->image_path));
+    uint8_t  kind      = drive->transfer_mode & 0xF8;
+    uint16_t selected  = (uint16_t)(0x0100 << (drive->transfer_mode & 0x07));
+    char     serial_text[17];
+    uint8_t  checksum = 0;
+    uint32_t i;
+
+    memset(data, 0, ACS_SECTOR);
+    sprintf(serial_text, "%08X%08X", (uint32_t)(serial >> 32), (uint32_t)serial);
+
+    AcsPutWord(data, 0, 0x0040);
+    AcsPutWord(data, 1, (uint16_t)cylinders);
+    AcsPutWord(data, 3, ACS_HEADS);
+    AcsPutWord(data, 6, ACS_SECTORS_PER_TRACK);
+    AcsPutString(data, 10, serial_text, 10);
+    AcsPutString(data, 23, "1.0", 4);
+    AcsPutString(data, 27, "AARU EMULATED DISK", 20);
+    AcsPutWord(data, 47, 0x8010);
+    AcsPutWord(data, 49, 0x0300);
+    AcsPutWord(data, 53, 0x0006);
+    AcsPutWord(data, 54, (uint16_t)cylinders);
+    AcsPutWord(data, 55, ACS_HEADS);
+    AcsPutWord(data, 56, ACS_SECTORS_PER_TRACK);
+    AcsPutWord(data, 57, (uint16_t)chs);
+    AcsPutWord(data, 58, (uint16_t)(chs >> 16));
+    AcsPutWord(data, 60, (uint16_t)(sectors > ACS_MAX_LBA28 ? ACS_MAX_LBA28 : sectors));
+    AcsPutWord(data, 61, (uint16_t)((sectors > ACS_MAX_LBA28 ? ACS_MAX_LBA28 : sectors) >> 16));
+
+    // Supported modes in the low byte, the selected one in the high byte
+    AcsPutWord(data, 63, (uint16_t)(0x0007 | (kind == ACS_MODE_MWDMA ? selected : 0)));
+    AcsPutWord(data, 64, 0x0003);
+    AcsPutWord(data, 80, 0x01F0);
+
+    // Look-ahead, write cache and 48-bit addressing, then whether the first two are enabled
+    AcsPutWord(data, 82, 0x4060);
+    AcsPutWord(data, 83, 0x4400);
+    AcsPutWord(data, 84, 0x4000);
+    AcsPutWord(data, 85, (uint16_t)((drive->read_look_ahead ? 0x0040 : 0) | (drive->write_cache ? 0x0020 : 0)));
+    AcsPutWord(data, 86, 0x0400);
+    AcsPutWord(data, 87, 0x4000);
+    AcsPutWord(data, 88, (uint16_t)(0x007F | (kind == ACS_MODE_UDMA ? selected : 0)));
+    AcsPutWord(data, 100, (uint16_t)sectors);
+    AcsPutWord(data, 101, (uint16_t)(sectors >> 16));
+    AcsPutWord(data, 102, (uint16_t)(sectors >> 32));
+    AcsPutWord(data, 103, (uint16_t)(sectors >> 48));
+    AcsPutWord(data, 106, 0x4000);
+
+    // Integrity word, signature and a checksum that makes every byte add up to zero
+    data[510] = 0xA5;
+
+    for(i = 0; i < ACS_SECTOR - 1; i++) checksum += data[i];
+
+    data[511] = (uint8_t)(0x100 - checksum);
+}
+
+static void AcsAbort(AcsTaskfile* task, uint8_t error)
+{
+    task->status |= ACS_STATUS_ERR;
+    task->error   = error;
+}
+
+static void AcsSetFeatures(AcsDrive* drive, AcsTaskfile* task)
+{
+    uint8_t mode = (uint8_t)task->sector_count;
+
+    switch(task->feature & 0xFF)
+    {
+        case ACS_FEATURE_ENABLE_WRITE_CACHE: drive->write_cache = 1; break;
+        case ACS_FEATURE_DISABLE_WRITE_CACHE: drive->write_cache = 0; break;
+        case ACS_FEATURE_ENABLE_READ_LOOK_AHEAD: drive->read_look_ahead = 1; break;
+        case ACS_FEATURE_DISABLE_READ_LOOK_AHEAD: drive->read_look_ahead = 0; break;
+        // PIO 0 to 4, multiword DMA 0 to 2 and Ultra DMA 0 to 6
+        case ACS_FEATURE_SET_TRANSFER_MODE:
+            if(mode <= 0x01 || ((mode & 0xF8) == ACS_MODE_PIO && (mode & 0x07) <= 4) ||
+               ((mode & 0xF8) == ACS_MODE_MWDMA && (mode & 0x07) <= 2) ||
+               ((mode & 0xF8) == ACS_MODE_UDMA && (mode & 0x07) <= 6))
+                drive->transfer_mode = mode;
+            else
+                AcsAbort(task, ACS_ERROR_ABRT);
+            break;
+        default: AcsAbort(task, ACS_ERROR_ABRT); break;
+    }
+}
+
+// Reads and verifies stop at the first bad sector and leave its address in the taskfile
+static uint32_t AcsRead(EmuDevice* dev, AcsTaskfile* task, char* buffer, uint32_t buf_len, uint64_t* offset)
+{
+    uint8_t  ext = task->command == ACS_READ_SECTORS_EXT || task->command == ACS_READ_DMA_EXT ||
+                  task->command == ACS_READ_VERIFY_SECTORS_EXT;
+    uint8_t  verify = task->command == ACS_READ_VERIFY_SECTORS || task->command == ACS_READ_VERIFY_SECTORS_EXT;
+    uint64_t count  = ext ? task->sector_count : task->sector_count & 0xFF;
+    uint64_t lba    = task->address;
+    uint64_t bad_lba;
+    uint32_t read_length;
+
+    // A count of zero is the most the command can transfer
+    if(count == 0) count = ext ? 65536 : 256;
+
+    if(lba > AcsSectors(dev) || count > AcsSectors(dev) - lba || (!ext && lba + count - 1 > ACS_MAX_LBA28))
+    {
+        AcsAbort(task, ACS_ERROR_IDNF);
+        return 0;
+    }
+
+    if(!verify && (count * ACS_SECTOR > buf_len || !buffer))
+    {
+        AcsAbort(task, ACS_ERROR_ABRT);
+        return 0;
+    }
+
+    *offset = lba * ACS_SECTOR;
+
+    if(EmuBadBlock(dev, lba, count, &bad_lba))
+    {
+        AcsAbort(task, ACS_ERROR_UNC);
+        count         = bad_lba - lba;
+        task->address = bad_lba;
+    }
+    else
+        task->address = lba + count - 1;
+
+    if(verify || count == 0) return (uint32_t)(count * ACS_SECTOR);
+
+    if(EmuReadImage(dev, buffer, *offset, (uint32_t)(count * ACS_SECTOR), &read_length))
+    {
+        task->status |= ACS_STATUS_ERR;
+        task->error   = ACS_ERROR_UNC;
+        task->address = lba + read_length / ACS_SECTOR;
+    }
+
+    return (uint32_t)(count * ACS_SECTOR);
+}
+
+static uint32_t AcsExecute(EmuDevice* dev, AcsTaskfile* task, char* buffer, uint32_t* buf_len)
+{
+    AcsDrive* drive  = dev->model_data;
+    uint64_t  offset = EMU_NO_MEDIA;
+    uint32_t  length = 0;
+
+    task->status = ACS_STATUS_DRDY | ACS_STATUS_DSC;
+    task->error  = 0;
+
+    EmuStart(dev);
+
+    switch(task->command)
+    {
+        case ACS_IDENTIFY_DEVICE:
+            if(*buf_len < ACS_SECTOR || !buffer)
+            {
+                AcsAbort(task, ACS_ERROR_ABRT);
+                break;
+            }
+
+            AcsIdentify(dev, drive, (uint8_t*)buffer);
+            break;
+        case ACS_READ_SECTORS:
+        case ACS_READ_SECTORS_EXT:
+        case ACS_READ_DMA:
+        case ACS_READ_DMA_EXT:
+        case ACS_READ_VERIFY_SECTORS:
+        case ACS_READ_VERIFY_SECTORS_EXT: length = AcsRead(dev, task, buffer, *buf_len, &offset); break;
+        case ACS_SET_FEATURES: AcsSetFeatures(drive, task); break;
+        default: AcsAbort(task, ACS_ERROR_ABRT); break;
+    }
+
+    return EmuFinish(dev, offset, length);
+}
+
+static int32_t AcsSendAtaChsCommand(void*                 device_ctx,
+                                    AtaRegistersChs       registers,
+                                    AtaErrorRegistersChs* error_registers,
+                                    uint8_t               protocol,
+                                    uint8_t               transfer_register,
+                                    char*                 buffer,
+                                    uint32_t              timeout,
+                                    uint8_t               transfer_blocks,
+                                    uint32_t*             duration,
+                                    uint32_t*             sense,
+                                    uint32_t*             buf_len)
+{
+    EmuDevice*  dev = device_ctx;
+    AcsTaskfile task;
+    uint32_t    cylinder;
+    uint32_t    head;
+    uint32_t    sector;
+    *duration = 0;
+    *sense    = 0;
+
+    if(!dev) return -1;
+
+    task.command      = registers.command;
+    task.feature      = registers.feature;
+    task.sector_count = registers.sector_count;
+    cylinder          = (uint32_t)registers.cylinder_high << 8 | registers.cylinder_low;
+
+    // With the LBA bit set the registers carry a 28-bit address, otherwise it goes through the default translation
+    if(registers.device_head & 0x40)
+        task.address = (uint32_t)(registers.device_head & 0x0F) << 24 | cylinder << 8 | registers.sector;
+    else if(registers.sector == 0)
+        task.address = (uint64_t)-1;
+    else
+        task.address = ((uint64_t)cylinder * ACS_HEADS + (registers.device_head & 0x0F)) * ACS_SECTORS_PER_TRACK +
+                       registers.sector - 1;
+
+    *duration = AcsExecute(dev, &task, buffer, buf_len);
+
+    if(registers.device_head & 0x40)
+    {
+        cylinder = (uint32_t)(task.address >> 8) & 0xFFFF;
+        head     = (uint32_t)(task.address >> 24) & 0x0F;
+        sector   = (uint32_t)task.address & 0xFF;
+    }
+    else
+    {
+        cylinder = (uint32_t)(task.address / (ACS_HEADS * ACS_SECTORS_PER_TRACK));
+        head     = (uint32_t)(task.address / ACS_SECTORS_PER_TRACK % ACS_HEADS);
+        sector   = (uint32_t)(task.address % ACS_SECTORS_PER_TRACK + 1);
+    }
+
+    error_registers->status        = task.status;
+    error_registers->error         = task.error;
+    error_registers->sector_count  = 0;
+    error_registers->sector        = (uint8_t)sector;
+    error_registers->cylinder_low  = (uint8_t)cylinder;
+    error_registers->cylinder_high = (uint8_t)(cylinder >> 8);
+    error_registers->device_head   = (uint8_t)((registers.device_head & 0xF0) | head);
+
+    *sense = task.error != 0 || (task.status & 0xA5) != 0;
+
+    return 0;
+}
+
+static int32_t AcsSendAtaLba28Command(void*                   device_ctx,
+                                      AtaRegistersLba28       registers,
+                                      AtaErrorRegistersLba28* error_registers,
+                                      uint8_t                 protocol,
+                                      uint8_t                 transfer_register,
+                                      char*                   buffer,
+                                      uint32_t                timeout,
+                                      uint8_t                 transfer_blocks,
+                                      uint32_t*               duration,
+                                      uint32_t*               sense,
+                                      uint32_t*               buf_len)
+{
+    EmuDevice*  dev = device_ctx;
+    AcsTaskfile task;
+    *duration = 0;
+    *sense    = 0;
+
+    if(!dev) return -1;
+
+    task.command      = registers.command;
+    task.feature      = registers.feature;
+    task.sector_count = registers.sector_count;
+
+    task.address = (uint32_t)(registers.device_head & 0x0F) << 24 | (uint32_t)registers.lba_high << 16 |
+                   (uint32_t)registers.lba_mid << 8 | registers.lba_low;
+
+    *duration = AcsExecute(dev, &task, buffer, buf_len);
+
+    error_registers->status       = task.status;
+    error_registers->error        = task.error;
+    error_registers->sector_count = 0;
+    error_registers->lba_low      = (uint8_t)task.address;
+    error_registers->lba_mid      = (uint8_t)(task.address >> 8);
+    error_registers->lba_high     = (uint8_t)(task.address >> 16);
+    error_registers->device_head  = (uint8_t)((registers.device_head & 0xF0) | ((task.address >> 24) & 0x0F));
+
+    *sense = task.error != 0 || (task.status & 0xA5) != 0;
+
+    return 0;
+}
+
+static int32_t AcsSendAtaLba48Command(void*                   device_ctx,
+                                      AtaRegistersLba48       registers,
+                                      AtaErrorRegistersLba48* error_registers,
+                                      uint8_t                 protocol,
+                                      uint8_t                 transfer_register,
+                                      char*                   buffer,
+                                      uint32_t                timeout,
+                                      uint8_t                 transfer_blocks,
+                                      uint32_t*               duration,
+                                      uint32_t*               sense,
+                                      uint32_t*               buf_len)
+{
+    EmuDevice*  dev = device_ctx;
+    AcsTaskfile task;
+    *duration = 0;
+    *sense    = 0;
+
+    if(!dev) return -1;
+
+    task.command      = registers.command;
+    task.feature      = registers.feature;
+    task.sector_count = registers.sector_count;
+
+    task.address = (uint64_t)registers.lba_high_prev << 40 | (uint64_t)registers.lba_mid_prev << 32 |
+                   (uint64_t)registers.lba_low_prev << 24 | (uint32_t)registers.lba_high_cur << 16 |
+                   (uint32_t)registers.lba_mid_cur << 8 | registers.lba_low_cur;
+
+    *duration = AcsExecute(dev, &task, buffer, buf_len);
+
+    error_registers->status        = task.status;
+    error_registers->error         = task.error;
+    error_registers->sector_count  = 0;
+    error_registers->lba_low_cur   = (uint8_t)task.address;
+    error_registers->lba_mid_cur   = (uint8_t)(task.address >> 8);
+    error_registers->lba_high_cur  = (uint8_t)(task.address >> 16);
+    error_registers->lba_low_prev  = (uint8_t)(task.address >> 24);
+    error_registers->lba_mid_prev  = (uint8_t)(task.address >> 32);
+    error_registers->lba_high_prev = (uint8_t)(task.address >> 40);
+    error_registers->device_head   = registers.device_head;
+
+    *sense = task.error != 0 || (task.status & 0xA5) != 0;
+
+    return 0;
+}
+
+const DeviceBackend emu_acs_backend = {AcsOpen,
+                                       EmuClose,
+                                       EmuGetDeviceType,
+                                       EmuNoScsiCommand,
+                                       EmuNoScsiDataInBuffer,
+                                       EmuNoSdhciRegisters,
+                                       EmuNoUsbData,
+                                       EmuNoFireWireData,
+                                       EmuNoPcmciaData,
+                                       AcsSendAtaChsCommand,
+                                       AcsSendAtaLba28Command,
+                                       AcsSendAtaLba48Command,
+                                       EmuNoSdhciCommand,
+                                       EmuNoMultiSdhciCommand,
+                                       EmuReOpen,
+                                       EmuOsRead,
+                                       EmuOsSeekData};
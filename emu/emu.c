@@ -0,0 +1,745 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#include <sys/types.h>
+#endif
+
+#include "emu.h"
+
+typedef struct
+{
+    const char*          name;
+    const DeviceBackend* backend;
+} EmuModel;
+
+static const EmuModel emu_models[] = {
+    {"sbc", &emu_sbc_backend}, {"mmc", &emu_mmc_backend}, {"ata", &emu_acs_backend}, {"sd", &emu_sd_backend}};
+
+static void* EmuOpenUnknown(const char* device_path);
+
+// Taken for unknown models, so the path never reaches the platform, which could create a file by that name
+static const DeviceBackend emu_unknown_backend = {EmuOpenUnknown,
+                                                  EmuClose,
+                                                  EmuGetDeviceType,
+                                                  EmuNoScsiCommand,
+                                                  EmuNoScsiDataInBuffer,
+                                                  EmuNoSdhciRegisters,
+                                                  EmuNoUsbData,
+                                                  EmuNoFireWireData,
+                                                  EmuNoPcmciaData,
+                                                  EmuNoAtaChsCommand,
+                                                  EmuNoAtaLba28Command,
+                                                  EmuNoAtaLba48Command,
+                                                  EmuNoSdhciCommand,
+                                                  EmuNoMultiSdhciCommand,
+                                                  EmuReOpen,
+                                                  EmuOsRead,
+                                                  EmuOsSeekData};
+
+const DeviceBackend* EmuGetBackend(const char* device_path)
+{
+    size_t name_len;
+    size_t i;
+
+    if(strncmp(device_path, EMU_PREFIX, strlen(EMU_PREFIX)) != 0) return NULL;
+
+    device_path += strlen(EMU_PREFIX);
+    name_len = strcspn(device_path, ",:");
+
+    for(i = 0; i < sizeof(emu_models) / sizeof(EmuModel); i++)
+        if(strlen(emu_models[i].name) == name_len && strncmp(emu_models[i].name, device_path, name_len) == 0)
+            return emu_models[i].backend;
+
+    return &emu_unknown_backend;
+}
+
+static void* EmuOpenUnknown(const char* device_path)
+{
+    printf("Unknown emulated device %s.\n", device_path);
+    errno = ENODEV;
+    return NULL;
+}
+
+static int EmuParseNumber(const char* text, size_t len, uint64_t* value)
+{
+    char  number[24];
+    char* end;
+
+    if(len == 0 || len >= sizeof(number)) return -1;
+
+    memcpy(number, text, len);
+    number[len] = 0;
+    *value      = strtoul(number, &end, 10);
+
+    return *end == 0 ? 0 : -1;
+}
+
+// Bad blocks are given as first[-last], one range per option
+static int EmuParseRange(EmuDevice* dev, const char* text, size_t len)
+{
+    const char* dash = memchr(text, '-', len);
+    EmuRange*   range;
+
+    if(dev->bad_count == EMU_MAX_BAD_RANGES) return -1;
+
+    range = &dev->bad[dev->bad_count];
+
+    if(EmuParseNumber(text, dash ? (size_t)(dash - text) : len, &range->first)) return -1;
+
+    if(!dash)
+        range->last = range->first;
+    else if(EmuParseNumber(dash + 1, len - (size_t)(dash + 1 - text), &range->last) || range->last < range->first)
+        return -1;
+
+    dev->bad_count++;
+
+    return 0;
+}
+
+// Options go between the model and the image path, separated by commas
+static int EmuParseOptions(EmuDevice* dev, const char* options, size_t len)
+{
+    const char* option;
+    const char* value;
+    size_t      option_len;
+    size_t      name_len;
+    uint64_t    number;
+
+    while(len > 0)
+    {
+        option     = options;
+        option_len = 0;
+
+        while(option_len < len && option[option_len] != ',') option_len++;
+
+        options += option_len < len ? option_len + 1 : option_len;
+        len -= option_len < len ? option_len + 1 : option_len;
+
+        if(option_len == 0) continue;
+
+        if(option_len == 2 && strncmp(option, "ro", 2) == 0)
+        {
+            dev->read_only = 1;
+            continue;
+        }
+
+        value = memchr(option, '=', option_len);
+
+        if(value && value - option == 3 && strncmp(option, "bad", 3) == 0)
+        {
+            if(EmuParseRange(dev, value + 1, option_len - 4)) return -1;
+
+            continue;
+        }
+
+        if(!value || EmuParseNumber(value + 1, option_len - (size_t)(value + 1 - option), &number) ||
+           number > UINT32_MAX)
+            return -1;
+
+        name_len = (size_t)(value - option);
+
+        if(name_len == 7 && strncmp(option, "latency", 7) == 0)
+            dev->model.latency = (uint32_t)number;
+        else if(name_len == 6 && strncmp(option, "jitter", 6) == 0)
+            dev->model.jitter = (uint32_t)number;
+        else if(name_len == 4 && strncmp(option, "seek", 4) == 0)
+            dev->model.seek = (uint32_t)number;
+        else if(name_len == 6 && strncmp(option, "access", 6) == 0)
+            dev->model.access = (uint32_t)number;
+        else if(name_len == 4 && strncmp(option, "rate", 4) == 0)
+            dev->model.rate = (uint32_t)number;
+        else if(name_len == 5 && strncmp(option, "speed", 5) == 0)
+            dev->model.speed = (uint32_t)number;
+        else if(name_len == 4 && strncmp(option, "seed", 4) == 0)
+            dev->model.seed = number;
+        else if(name_len == 5 && strncmp(option, "block", 5) == 0 && number >= 1)
+            dev->block_size = (uint32_t)number;
+        else
+            return -1;
+    }
+
+    return 0;
+}
+
+static int EmuOpenImage(EmuDevice* dev)
+{
+    dev->image = fopen(dev->image_path, dev->read_only ? "rb" : "r+b");
+
+    if(!dev->image && !dev->read_only && (errno == EACCES || errno == EROFS))
+    {
+        dev->read_only = 1;
+        dev->image     = fopen(dev->image_path, "rb");
+    }
+
+    if(!dev->image) return errno;
+
+    // Commands carry whole transfers, stdio buffering would only add a copy
+    setvbuf(dev->image, NULL, _IONBF, 0);
+
+    if(EmuSeek(dev->image, 0, SEEK_END) != 0)
+    {
+        fclose(dev->image);
+        dev->image = NULL;
+        return errno;
+    }
+
+    dev->size = EmuTell(dev->image);
+
+    return 0;
+}
+
+// Media that cannot be written, like optical discs, ask for read_only so the image is never opened for writing
+EmuDevice* EmuOpen(const char* device_path, int32_t device_type, uint32_t block_size, uint8_t read_only)
+{
+    EmuDevice*  dev;
+    const char* options;
+    const char* image_path;
+    int         ret;
+
+    options    = device_path + strlen(EMU_PREFIX) + strcspn(device_path + strlen(EMU_PREFIX), ",:");
+    image_path = strchr(options, ':');
+
+    if(!image_path || strlen(image_path + 1) >= sizeof(dev->image_path))
+    {
+        printf("Emulated device %s has no image.\n", device_path);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    dev = malloc(sizeof(EmuDevice));
+
+    if(!dev) return NULL;
+
+    memset(dev, 0, sizeof(EmuDevice));
+    dev->device_type = device_type;
+    dev->block_size  = block_size;
+    dev->read_only   = read_only;
+    dev->model.seed  = 1;
+    strcpy(dev->image_path, image_path + 1);
+
+    if(EmuParseOptions(dev, options, (size_t)(image_path - options)))
+    {
+        printf("Invalid options for emulated device %s.\n", device_path);
+        free(dev);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ret = EmuOpenImage(dev);
+
+    if(ret)
+    {
+        free(dev);
+        errno = ret;
+        return NULL;
+    }
+
+    // Jitter is the same on every run with the same seed
+    dev->random = dev->model.seed ? dev->model.seed : 1;
+
+    return dev;
+}
+
+void EmuClose(void* device_ctx)
+{
+    EmuDevice* dev = device_ctx;
+
+    if(!dev) return;
+
+    if(dev->image) fclose(dev->image);
+
+    free(dev->model_data);
+    free(dev);
+}
+
+int32_t EmuGetDeviceType(void* device_ctx)
+{
+    EmuDevice* dev = device_ctx;
+
+    if(!dev) return AARUREMOTE_DEVICE_TYPE_UNKNOWN;
+
+    return dev->device_type;
+}
+
+int32_t EmuReOpen(void* device_ctx, uint32_t* closeFailed)
+{
+    EmuDevice* dev = device_ctx;
+    *closeFailed   = 0;
+
+    if(!dev) return -1;
+
+    if(dev->image && fclose(dev->image) != 0)
+    {
+        dev->image   = NULL;
+        *closeFailed = 1;
+        return errno;
+    }
+
+    dev->image       = NULL;
+    dev->next_offset = 0;
+
+    return EmuOpenImage(dev);
+}
+
+// First bad block from lba on, for count blocks
+uint8_t EmuBadBlock(EmuDevice* dev, uint64_t lba, uint64_t count, uint64_t* bad_lba)
+{
+    uint32_t i;
+    uint64_t first;
+    uint8_t  found = 0;
+
+    for(i = 0; i < dev->bad_count; i++)
+    {
+        if(dev->bad[i].last < lba || dev->bad[i].first >= lba + count) continue;
+
+        first = dev->bad[i].first > lba ? dev->bad[i].first : lba;
+
+        if(!found || first < *bad_lba) *bad_lba = first;
+
+        found = 1;
+    }
+
+    return found;
+}
+
+void EmuStart(EmuDevice* dev) { dev->started = GetMonotonicMicroseconds(); }
+
+// Waits until the modelled time for the command has passed and returns how long it took in milliseconds
+uint32_t EmuFinish(EmuDevice* dev, uint64_t offset, uint32_t length)
+{
+    uint64_t deadline = dev->started + dev->model.latency + dev->delay;
+    uint64_t now;
+
+    dev->delay = 0;
+
+    if(dev->model.jitter)
+    {
+        dev->random ^= dev->random << 13;
+        dev->random ^= dev->random >> 7;
+        dev->random ^= dev->random << 17;
+        deadline += dev->random % ((uint64_t)dev->model.jitter + 1);
+    }
+
+    if(offset != EMU_NO_MEDIA)
+    {
+        if(offset != dev->next_offset) deadline += dev->model.seek;
+
+        if(dev->model.access)
+            deadline += ((uint64_t)length + dev->block_size - 1) / dev->block_size * dev->model.access;
+
+        if(dev->model.rate) deadline += (uint64_t)length * 1000000 / ((uint64_t)dev->model.rate * 1024);
+
+        dev->next_offset = offset + length;
+    }
+
+    now = GetMonotonicMicroseconds();
+
+    // Sleeps through most of the wait, then spins the rest so latencies stay exact without burning a core
+    if(deadline > now + EMU_SPIN_MICROSECONDS) SleepMicroseconds(deadline - now - EMU_SPIN_MICROSECONDS);
+
+    while(now < deadline) now = GetMonotonicMicroseconds();
+
+    return (uint32_t)((now - dev->started) / 1000);
+}
+
+// Stops at the end of the image, read_length says how much was really there
+int32_t EmuReadImage(EmuDevice* dev, char* buffer, uint64_t offset, uint32_t length, uint32_t* read_length)
+{
+    *read_length = 0;
+
+    if(!dev->image) return EBADF;
+
+    if(offset >= dev->size) return 0;
+
+    if(length > dev->size - offset) length = (uint32_t)(dev->size - offset);
+
+    if(EmuSeek(dev->image, offset, SEEK_SET) != 0) return errno;
+
+    *read_length = (uint32_t)fread(buffer, 1, length, dev->image);
+
+    return *read_length == length ? 0 : EIO;
+}
+
+int32_t EmuWriteImage(EmuDevice* dev, const char* buffer, uint64_t offset, uint32_t length)
+{
+    if(!dev->image) return EBADF;
+
+    if(dev->read_only) return EROFS;
+
+    if(EmuSeek(dev->image, offset, SEEK_SET) != 0) return errno;
+
+    if(fwrite(buffer, 1, length, dev->image) != length) return EIO;
+
+    if(offset + length > dev->size) dev->size = offset + length;
+
+    return 0;
+}
+
+int32_t EmuFlushImage(EmuDevice* dev)
+{
+    if(!dev->image) return EBADF;
+
+    return fflush(dev->image) == 0 ? 0 : errno;
+}
+
+int32_t EmuOsRead(void*     device_ctx,
+                  char*     buffer,
+                  uint64_t  offset,
+                  uint32_t  length,
+                  uint32_t* read_length,
+                  uint32_t* duration)
+{
+    EmuDevice* dev = device_ctx;
+    int32_t    ret;
+    *duration      = 0;
+    *read_length   = 0;
+
+    if(!dev) return -1;
+
+    EmuStart(dev);
+    ret       = EmuReadImage(dev, buffer, offset, length, read_length);
+    *duration = EmuFinish(dev, offset, *read_length);
+
+    return ret;
+}
+
+// Media have no holes, where the zeros are is found by reading them
+int32_t EmuOsSeekData(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole) { return EINVAL; }
+
+uint16_t EmuGetBe16(const uint8_t* bytes) { return (uint16_t)(bytes[0] << 8 | bytes[1]); }
+
+uint32_t EmuGetBe32(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+uint64_t EmuGetBe64(const uint8_t* bytes) { return (uint64_t)EmuGetBe32(bytes) << 32 | EmuGetBe32(bytes + 4); }
+
+void EmuPutBe16(uint8_t* bytes, uint16_t value)
+{
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+}
+
+void EmuPutBe32(uint8_t* bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+}
+
+void EmuPutBe64(uint8_t* bytes, uint64_t value)
+{
+    EmuPutBe32(bytes, (uint32_t)(value >> 32));
+    EmuPutBe32(bytes + 4, (uint32_t)value);
+}
+
+// From the group code in the top bits of the operation code, 0 for vendor specific groups
+uint32_t EmuScsiCdbLength(uint8_t opcode)
+{
+    switch(opcode >> 5)
+    {
+        case 0: return 6;
+        case 1:
+        case 2: return 10;
+        case 4: return 16;
+        case 5: return 12;
+        default: return 0;
+    }
+}
+
+// Standard data or the supported pages and unit serial number VPD pages, the serial is the same for the same image
+void EmuScsiInquiry(EmuDevice*     dev,
+                    const uint8_t* cdb,
+                    char*          buffer,
+                    uint32_t       buf_len,
+                    uint8_t        peripheral_type,
+                    uint8_t        removable,
+                    const char*    product)
+{
+    uint8_t  data[36];
+    uint16_t allocation = EmuGetBe16(cdb + 3);
+    uint64_t serial     = TraceHash(dev->image_path, (uint32_t)strlen(dev->image_path));
+
+    memset(data, 0, sizeof(data));
+    data[0] = peripheral_type;
+
+    if(cdb[1] & 0x01)
+    {
+        switch(cdb[2])
+        {
+            case 0x00:
+                data[3] = 2;
+                data[5] = 0x80;
+                EmuScsiDataIn(buffer, buf_len, data, 6, allocation);
+                return;
+            case 0x80:
+                data[1] = 0x80;
+                data[3] = 16;
+                sprintf((char*)data + 4, "%08X%08X", (uint32_t)(serial >> 32), (uint32_t)serial);
+                EmuScsiDataIn(buffer, buf_len, data, 20, allocation);
+                return;
+            default: EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0); return;
+        }
+    }
+
+    if(cdb[2] != 0)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return;
+    }
+
+    // SPC-4
+    data[1] = removable ? 0x80 : 0;
+    data[2] = 0x06;
+    data[3] = 0x02;
+    data[4] = sizeof(data) - 5;
+    memcpy(data + 8, "AARU    ", 8);
+    memcpy(data + 16, product, 16);
+    memcpy(data + 32, "1.0 ", 4);
+
+    EmuScsiDataIn(buffer, buf_len, data, sizeof(data), allocation);
+}
+
+void EmuScsiCheck(EmuDevice* dev, uint8_t sense_key, uint8_t asc, uint8_t ascq)
+{
+    dev->check_condition = 1;
+    dev->sense_key       = sense_key;
+    dev->asc             = asc;
+    dev->ascq            = ascq;
+}
+
+// Copies as much as the initiator allocated and its buffer holds
+void EmuScsiDataIn(char* buffer, uint32_t buf_len, const uint8_t* data, uint32_t len, uint32_t allocation)
+{
+    if(!buffer) return;
+
+    if(len > allocation) len = allocation;
+
+    if(len > buf_len) len = buf_len;
+
+    memcpy(buffer, data, len);
+}
+
+// Fixed format sense for the last check condition, which is forgotten afterwards
+uint32_t EmuScsiRequestSense(EmuDevice* dev, uint8_t* sense_data)
+{
+    memset(sense_data, 0, EMU_FIXED_SENSE_SIZE);
+    sense_data[0]  = 0x70;
+    sense_data[2]  = dev->sense_key;
+    sense_data[7]  = EMU_FIXED_SENSE_SIZE - 8;
+    sense_data[12] = dev->asc;
+    sense_data[13] = dev->ascq;
+
+    dev->sense_key = EMU_SENSE_KEY_NO_SENSE;
+    dev->asc       = 0;
+    dev->ascq      = 0;
+
+    return EMU_FIXED_SENSE_SIZE;
+}
+
+// Status goes back as the platforms report it, sense data is only there on check condition
+int32_t EmuScsiComplete(EmuDevice* dev, char** sense_buffer, uint32_t* sense, uint32_t* sense_len)
+{
+    uint8_t sense_data[EMU_FIXED_SENSE_SIZE];
+    uint8_t sense_key = dev->sense_key;
+    uint8_t asc       = dev->asc;
+    uint8_t ascq      = dev->ascq;
+
+    *sense     = 0;
+    *sense_len = 0;
+
+    if(!dev->check_condition) return 0;
+
+    dev->check_condition = 0;
+    *sense               = 1;
+
+    EmuScsiRequestSense(dev, sense_data);
+
+    // Kept for a REQUEST SENSE that comes after
+    dev->sense_key = sense_key;
+    dev->asc       = asc;
+    dev->ascq      = ascq;
+
+    *sense_buffer = malloc(EMU_FIXED_SENSE_SIZE);
+
+    if(!*sense_buffer) return 0;
+
+    memcpy(*sense_buffer, sense_data, EMU_FIXED_SENSE_SIZE);
+    *sense_len = EMU_FIXED_SENSE_SIZE;
+
+    return 0;
+}
+
+int32_t EmuNoScsiCommand(void*     device_ctx,
+                         char*     cdb,
+                         char*     buffer,
+                         char**    sense_buffer,
+                         uint32_t  timeout,
+                         int32_t   direction,
+                         uint32_t* duration,
+                         uint32_t* sense,
+                         uint32_t  cdb_len,
+                         uint32_t* buf_len,
+                         uint32_t* sense_len)
+{
+    *sense_buffer = NULL;
+    *duration     = 0;
+    *sense        = 0;
+    *sense_len    = 0;
+
+    return -1;
+}
+
+char* EmuNoScsiDataInBuffer(void* device_ctx, uint32_t length) { return NULL; }
+
+int32_t EmuNoSdhciRegisters(void*     device_ctx,
+                            char**    csd,
+                            char**    cid,
+                            char**    ocr,
+                            char**    scr,
+                            uint32_t* csd_len,
+                            uint32_t* cid_len,
+                            uint32_t* ocr_len,
+                            uint32_t* scr_len)
+{
+    *csd_len = 0;
+    *cid_len = 0;
+    *ocr_len = 0;
+    *scr_len = 0;
+
+    return 0;
+}
+
+uint8_t EmuNoUsbData(void*     device_ctx,
+                     uint16_t* desc_len,
+                     char*     descriptors,
+                     uint16_t* id_vendor,
+                     uint16_t* id_product,
+                     char*     manufacturer,
+                     char*     product,
+                     char*     serial)
+{
+    return 0;
+}
+
+uint8_t EmuNoFireWireData(void*     device_ctx,
+                          uint32_t* id_model,
+                          uint32_t* id_vendor,
+                          uint64_t* guid,
+                          char*     vendor,
+                          char*     model)
+{
+    return 0;
+}
+
+uint8_t EmuNoPcmciaData(void* device_ctx, uint16_t* cis_len, char* cis) { return 0; }
+
+int32_t EmuNoAtaChsCommand(void*                 device_ctx,
+                           AtaRegistersChs       registers,
+                           AtaErrorRegistersChs* error_registers,
+                           uint8_t               protocol,
+                           uint8_t               transfer_register,
+                           char*                 buffer,
+                           uint32_t              timeout,
+                           uint8_t               transfer_blocks,
+                           uint32_t*             duration,
+                           uint32_t*             sense,
+                           uint32_t*             buf_len)
+{
+    *duration = 0;
+    *sense    = 0;
+
+    return -1;
+}
+
+int32_t EmuNoAtaLba28Command(void*                   device_ctx,
+                             AtaRegistersLba28       registers,
+                             AtaErrorRegistersLba28* error_registers,
+                             uint8_t                 protocol,
+                             uint8_t                 transfer_register,
+                             char*                   buffer,
+                             uint32_t                timeout,
+                             uint8_t                 transfer_blocks,
+                             uint32_t*               duration,
+                             uint32_t*               sense,
+                             uint32_t*               buf_len)
+{
+    *duration = 0;
+    *sense    = 0;
+
+    return -1;
+}
+
+int32_t EmuNoAtaLba48Command(void*                   device_ctx,
+                             AtaRegistersLba48       registers,
+                             AtaErrorRegistersLba48* error_registers,
+                             uint8_t                 protocol,
+                             uint8_t                 transfer_register,
+                             char*                   buffer,
+                             uint32_t                timeout,
+                             uint8_t                 transfer_blocks,
+                             uint32_t*               duration,
+                             uint32_t*               sense,
+                             uint32_t*               buf_len)
+{
+    *duration = 0;
+    *sense    = 0;
+
+    return -1;
+}
+
+int32_t EmuNoSdhciCommand(void*     device_ctx,
+                          uint8_t   command,
+                          uint8_t   write,
+                          uint8_t   application,
+                          uint32_t  flags,
+                          uint32_t  argument,
+                          uint32_t  block_size,
+                          uint32_t  blocks,
+                          char*     buffer,
+                          uint32_t  buf_len,
+                          uint32_t  timeout,
+                          uint32_t* response,
+                          uint32_t* duration,
+                          uint32_t* sense)
+{
+    *duration = 0;
+    *sense    = 0;
+
+    return -1;
+}
+
+int32_t EmuNoMultiSdhciCommand(void*            device_ctx,
+                               uint64_t         count,
+                               MmcSingleCommand commands[],
+                               uint32_t*        duration,
+                               uint32_t*        sense)
+{
+    *duration = 0;
+    *sense    = 0;
+
+    return -1;
+}
@@ -0,0 +1,240 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AARUREMOTE_EMU_EMU_H_
+#define AARUREMOTE_EMU_EMU_H_
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+#include "../aaruremote.h"
+
+// Emulated devices are opened as emu:<model>[,option[=value]...]:<image>, bad=first[-last] makes blocks unreadable
+#define EMU_PREFIX "emu:"
+
+// Offset given for commands that do not touch the medium, they never seek
+#define EMU_NO_MEDIA ((uint64_t)-1)
+
+#define EMU_SENSE_KEY_NO_SENSE 0x00
+#define EMU_SENSE_KEY_NOT_READY 0x02
+#define EMU_SENSE_KEY_MEDIUM_ERROR 0x03
+#define EMU_SENSE_KEY_ILLEGAL_REQUEST 0x05
+#define EMU_SENSE_KEY_DATA_PROTECT 0x07
+
+#define EMU_ASC_WRITE_ERROR 0x0C
+#define EMU_ASC_UNRECOVERED_READ_ERROR 0x11
+#define EMU_ASC_INVALID_COMMAND_OPERATION_CODE 0x20
+#define EMU_ASC_LBA_OUT_OF_RANGE 0x21
+#define EMU_ASC_INVALID_FIELD_IN_CDB 0x24
+#define EMU_ASC_WRITE_PROTECTED 0x27
+#define EMU_ASC_ILLEGAL_MODE_FOR_THIS_TRACK 0x64
+
+#define EMU_FIXED_SENSE_SIZE 18
+
+#ifdef _WIN32
+#define EmuSeek(file, offset, whence) _fseeki64(file, (__int64)(offset), whence)
+#define EmuTell(file) ((uint64_t)_ftelli64(file))
+#else
+#define EmuSeek(file, offset, whence) fseeko(file, (off_t)(offset), whence)
+#define EmuTell(file) ((uint64_t)ftello(file))
+#endif
+
+// How long before a deadline commands stop sleeping and spin, Windows sleeps in whole scheduler ticks
+#ifdef _WIN32
+#define EMU_SPIN_MICROSECONDS 16000
+#else
+#define EMU_SPIN_MICROSECONDS 1000
+#endif
+
+// Every command takes latency plus up to jitter more, seek more when it does not start where the previous one ended,
+// spends access more on every block it touches and moves its data at rate KiB per second. Times in microseconds,
+// anything not given is zero. Models with a spinning medium use speed, as a multiple of its base speed, and scale seek
+// by distance instead.
+typedef struct
+{
+    uint32_t latency;
+    uint32_t jitter;
+    uint32_t seek;
+    uint32_t access;
+    uint32_t rate;
+    uint32_t speed;
+    uint64_t seed;
+} EmuLatencyModel;
+
+#define EMU_MAX_BAD_RANGES 16
+
+typedef struct
+{
+    uint64_t first;
+    uint64_t last;
+} EmuRange;
+
+typedef struct
+{
+    FILE*           image;
+    char            image_path[1024];
+    uint64_t        size;
+    uint32_t        block_size;
+    uint8_t         read_only;
+    int32_t         device_type;
+    EmuLatencyModel model;
+    uint64_t        random;
+    uint64_t        next_offset;
+    uint64_t        started;
+    uint64_t        delay;
+    uint8_t         check_condition;
+    uint8_t         sense_key;
+    uint8_t         asc;
+    uint8_t         ascq;
+    EmuRange        bad[EMU_MAX_BAD_RANGES];
+    uint32_t        bad_count;
+    void*           model_data;
+} EmuDevice;
+
+extern const DeviceBackend emu_sbc_backend;
+extern const DeviceBackend emu_mmc_backend;
+extern const DeviceBackend emu_acs_backend;
+extern const DeviceBackend emu_sd_backend;
+
+EmuDevice* EmuOpen(const char* device_path, int32_t device_type, uint32_t block_size, uint8_t read_only);
+void       EmuClose(void* device_ctx);
+int32_t    EmuGetDeviceType(void* device_ctx);
+int32_t    EmuReOpen(void* device_ctx, uint32_t* closeFailed);
+int32_t EmuOsRead(void*     device_ctx,
+                  char*     buffer,
+                  uint64_t  offset,
+                  uint32_t  length,
+                  uint32_t* read_length,
+                  uint32_t* duration);
+int32_t    EmuOsSeekData(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole);
+uint8_t    EmuBadBlock(EmuDevice* dev, uint64_t lba, uint64_t count, uint64_t* bad_lba);
+void       EmuStart(EmuDevice* dev);
+uint32_t   EmuFinish(EmuDevice* dev, uint64_t offset, uint32_t length);
+int32_t    EmuReadImage(EmuDevice* dev, char* buffer, uint64_t offset, uint32_t length, uint32_t* read_length);
+int32_t    EmuWriteImage(EmuDevice* dev, const char* buffer, uint64_t offset, uint32_t length);
+int32_t    EmuFlushImage(EmuDevice* dev);
+uint16_t   EmuGetBe16(const uint8_t* bytes);
+uint32_t   EmuGetBe32(const uint8_t* bytes);
+uint64_t   EmuGetBe64(const uint8_t* bytes);
+void       EmuPutBe16(uint8_t* bytes, uint16_t value);
+void       EmuPutBe32(uint8_t* bytes, uint32_t value);
+void       EmuPutBe64(uint8_t* bytes, uint64_t value);
+uint32_t   EmuScsiCdbLength(uint8_t opcode);
+void EmuScsiInquiry(EmuDevice*     dev,
+                    const uint8_t* cdb,
+                    char*          buffer,
+                    uint32_t       buf_len,
+                    uint8_t        peripheral_type,
+                    uint8_t        removable,
+                    const char*    product);
+void       EmuScsiCheck(EmuDevice* dev, uint8_t sense_key, uint8_t asc, uint8_t ascq);
+void       EmuScsiDataIn(char* buffer, uint32_t buf_len, const uint8_t* data, uint32_t len, uint32_t allocation);
+uint32_t   EmuScsiRequestSense(EmuDevice* dev, uint8_t* sense_data);
+int32_t    EmuScsiComplete(EmuDevice* dev, char** sense_buffer, uint32_t* sense, uint32_t* sense_len);
+int32_t EmuNoScsiCommand(void*     device_ctx,
+                         char*     cdb,
+                         char*     buffer,
+                         char**    sense_buffer,
+                         uint32_t  timeout,
+                         int32_t   direction,
+                         uint32_t* duration,
+                         uint32_t* sense,
+                         uint32_t  cdb_len,
+                         uint32_t* buf_len,
+                         uint32_t* sense_len);
+char*      EmuNoScsiDataInBuffer(void* device_ctx, uint32_t length);
+int32_t EmuNoSdhciRegisters(void*     device_ctx,
+                            char**    csd,
+                            char**    cid,
+                            char**    ocr,
+                            char**    scr,
+                            uint32_t* csd_len,
+                            uint32_t* cid_len,
+                            uint32_t* ocr_len,
+                            uint32_t* scr_len);
+uint8_t EmuNoUsbData(void*     device_ctx,
+                     uint16_t* desc_len,
+                     char*     descriptors,
+                     uint16_t* id_vendor,
+                     uint16_t* id_product,
+                     char*     manufacturer,
+                     char*     product,
+                     char*     serial);
+uint8_t EmuNoFireWireData(void*     device_ctx,
+                          uint32_t* id_model,
+                          uint32_t* id_vendor,
+                          uint64_t* guid,
+                          char*     vendor,
+                          char*     model);
+uint8_t    EmuNoPcmciaData(void* device_ctx, uint16_t* cis_len, char* cis);
+int32_t EmuNoAtaChsCommand(void*                 device_ctx,
+                           AtaRegistersChs       registers,
+                           AtaErrorRegistersChs* error_registers,
+                           uint8_t               protocol,
+                           uint8_t               transfer_register,
+                           char*                 buffer,
+                           uint32_t              timeout,
+                           uint8_t               transfer_blocks,
+                           uint32_t*             duration,
+                           uint32_t*             sense,
+                           uint32_t*             buf_len);
+int32_t EmuNoAtaLba28Command(void*                   device_ctx,
+                             AtaRegistersLba28       registers,
+                             AtaErrorRegistersLba28* error_registers,
+                             uint8_t                 protocol,
+                             uint8_t                 transfer_register,
+                             char*                   buffer,
+                             uint32_t                timeout,
+                             uint8_t                 transfer_blocks,
+                             uint32_t*               duration,
+                             uint32_t*               sense,
+                             uint32_t*               buf_len);
+int32_t EmuNoAtaLba48Command(void*                   device_ctx,
+                             AtaRegistersLba48       registers,
+                             AtaErrorRegistersLba48* error_registers,
+                             uint8_t                 protocol,
+                             uint8_t                 transfer_register,
+                             char*                   buffer,
+                             uint32_t                timeout,
+                             uint8_t                 transfer_blocks,
+                             uint32_t*               duration,
+                             uint32_t*               sense,
+                             uint32_t*               buf_len);
+int32_t EmuNoSdhciCommand(void*     device_ctx,
+                          uint8_t   command,
+                          uint8_t   write,
+                          uint8_t   application,
+                          uint32_t  flags,
+                          uint32_t  argument,
+                          uint32_t  block_size,
+                          uint32_t  blocks,
+                          char*     buffer,
+                          uint32_t  buf_len,
+                          uint32_t  timeout,
+                          uint32_t* response,
+                          uint32_t* duration,
+                          uint32_t* sense);
+int32_t EmuNoMultiSdhciCommand(void*            device_ctx,
+                               uint64_t         count,
+                               MmcSingleCommand commands[],
+                               uint32_t*        duration,
+                               uint32_t*        sense);
+
+#endif  // AARUREMOTE_EMU_EMU_H_
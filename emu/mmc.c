@@ -0,0 +1,1319 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "emu.h"
+
+#define MMC_TEST_UNIT_READY 0x00
+#define MMC_REQUEST_SENSE 0x03
+#define MMC_INQUIRY 0x12
+#define MMC_MODE_SENSE_6 0x1A
+#define MMC_START_STOP_UNIT 0x1B
+#define MMC_PREVENT_ALLOW_MEDIUM_REMOVAL 0x1E
+#define MMC_READ_CAPACITY 0x25
+#define MMC_READ_10 0x28
+#define MMC_READ_TOC_PMA_ATIP 0x43
+#define MMC_GET_CONFIGURATION 0x46
+#define MMC_READ_DISC_INFORMATION 0x51
+#define MMC_MODE_SENSE_10 0x5A
+#define MMC_READ_12 0xA8
+#define MMC_READ_CD_MSF 0xB9
+#define MMC_SET_CD_SPEED 0xBB
+#define MMC_READ_CD 0xBE
+
+#define MMC_PAGE_ERROR_RECOVERY 0x01
+#define MMC_PAGE_CAPABILITIES 0x2A
+#define MMC_PAGE_ALL 0x3F
+
+#define MMC_MAX_TRACKS 99
+#define MMC_RAW_SECTOR 2352
+#define MMC_USER_SECTOR 2048
+#define MMC_SUBCHANNEL_SIZE 96
+#define MMC_LEADOUT 0xAA
+
+// Sectors before LBA 0, addresses in MSF count them
+#define MMC_MSF_OFFSET 150
+
+#define MMC_MODE_AUDIO 0
+#define MMC_MODE_1 1
+#define MMC_MODE_2 2
+
+#define MMC_CONTROL_DATA 0x04
+
+// Single speed CLV moves 75 sectors a second at 1.3 m/s over a 1.6 um track pitch from 25 mm outwards
+#define MMC_SECTORS_PER_SECOND 75
+#define MMC_INNER_RADIUS 25000
+#define MMC_RADIUS_SPAN 33000
+#define MMC_AREA_PER_SECTOR 8828
+
+typedef struct
+{
+    uint8_t  number;
+    uint8_t  control;
+    uint8_t  mode;
+    uint32_t sector_size;
+    uint32_t file;
+    uint64_t file_offset;
+    uint32_t first_frame;
+    uint32_t index1_frame;
+    uint32_t pregap;
+    uint32_t pregap_start;
+    uint32_t data_start;
+    uint32_t start;
+    uint32_t end;
+} MmcTrack;
+
+// Disc layout in LBAs, pregap_start <= data_start <= start < end, sectors before data_start are not in any file
+typedef struct
+{
+    MmcTrack tracks[MMC_MAX_TRACKS];
+    uint32_t track_count;
+    FILE*    files[MMC_MAX_TRACKS];
+    uint32_t file_count;
+    uint32_t leadout;
+    uint8_t  disc_type;
+    uint32_t speed;
+    uint32_t next_lba;
+} MmcDisc;
+
+typedef struct
+{
+    uint16_t code;
+    uint8_t  flags;
+    uint8_t  length;
+    uint8_t  data[8];
+} MmcFeature;
+
+// CD-ROM profile, SCSI core, tray loading, 2048 byte blocks, multi-read, CD read with C2 and power management
+static const MmcFeature mmc_features[] = {{0x0000, 0x03, 4, {0x00, 0x08, 0x01, 0x00}},
+                                          {0x0001, 0x0B, 8, {0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00}},
+                                          {0x0003, 0x03, 4, {0x29, 0x00, 0x00, 0x00}},
+                                          {0x0010, 0x01, 8, {0x00, 0x00, 0x08, 0x00, 0x00, 0x01, 0x00, 0x00}},
+                                          {0x001D, 0x01, 0, {0}},
+                                          {0x001E, 0x09, 4, {0x02, 0x00, 0x00, 0x00}},
+                                          {0x0100, 0x03, 0, {0}}};
+
+static uint8_t  mmc_ecc_f[256];
+static uint8_t  mmc_ecc_b[256];
+static uint32_t mmc_edc[256];
+
+static void MmcClose(void* device_ctx);
+
+static void MmcInitTables()
+{
+    uint32_t i;
+    uint32_t j;
+    uint32_t edc;
+
+    for(i = 0; i < 256; i++)
+    {
+        j                         = (i << 1) ^ (i & 0x80 ? 0x11D : 0);
+        mmc_ecc_f[i]              = (uint8_t)j;
+        mmc_ecc_b[(i ^ j) & 0xFF] = (uint8_t)i;
+        edc                       = i;
+
+        for(j = 0; j < 8; j++) edc = (edc >> 1) ^ (edc & 1 ? 0xD8018001 : 0);
+
+        mmc_edc[i] = edc;
+    }
+}
+
+static uint32_t MmcEdc(const uint8_t* data, uint32_t len)
+{
+    uint32_t edc = 0;
+
+    while(len--) edc = (edc >> 8) ^ mmc_edc[(edc ^ *data++) & 0xFF];
+
+    return edc;
+}
+
+// Reed-Solomon product code, P parity over 86 columns of 24 bytes then Q parity over 52 diagonals of 43
+static void MmcEccBlock(const uint8_t* src,
+                        uint32_t       major_count,
+                        uint32_t       minor_count,
+                        uint32_t       major_mult,
+                        uint32_t       minor_inc,
+                        uint8_t*       dest)
+{
+    uint32_t size = major_count * minor_count;
+    uint32_t major;
+    uint32_t minor;
+    uint32_t index;
+    uint8_t  ecc_a;
+    uint8_t  ecc_b;
+
+    for(major = 0; major < major_count; major++)
+    {
+        index = (major >> 1) * major_mult + (major & 1);
+        ecc_a = 0;
+        ecc_b = 0;
+
+        for(minor = 0; minor < minor_count; minor++)
+        {
+            ecc_a ^= src[index];
+            ecc_b ^= src[index];
+            ecc_a = mmc_ecc_f[ecc_a];
+            index += minor_inc;
+
+            if(index >= size) index -= size;
+        }
+
+        ecc_a                     = mmc_ecc_b[mmc_ecc_f[ecc_a] ^ ecc_b];
+        dest[major]               = ecc_a;
+        dest[major + major_count] = ecc_a ^ ecc_b;
+    }
+}
+
+static uint8_t MmcBcd(uint32_t value) { return (uint8_t)((value / 10) << 4 | value % 10); }
+
+static void MmcMsf(uint32_t frames, uint8_t* msf)
+{
+    msf[0] = (uint8_t)(frames / (60 * MMC_SECTORS_PER_SECOND));
+    msf[1] = (uint8_t)(frames / MMC_SECTORS_PER_SECOND % 60);
+    msf[2] = (uint8_t)(frames % MMC_SECTORS_PER_SECOND);
+}
+
+// TOC addresses are an LBA or a binary MSF after a reserved byte
+static void MmcAddress(uint8_t* data, uint32_t lba, uint8_t msf)
+{
+    if(!msf)
+    {
+        EmuPutBe32(data, lba);
+        return;
+    }
+
+    data[0] = 0;
+    MmcMsf(lba + MMC_MSF_OFFSET, data + 1);
+}
+
+// Sync, header, EDC and ECC around user data already in place, mode 2 sectors get form 1
+static void MmcEncode(uint8_t* raw, uint32_t lba, uint8_t mode)
+{
+    uint8_t  header[4];
+    uint32_t edc;
+
+    raw[0] = 0;
+    memset(raw + 1, 0xFF, 10);
+    raw[11] = 0;
+    MmcMsf(lba + MMC_MSF_OFFSET, raw + 12);
+    raw[12] = MmcBcd(raw[12]);
+    raw[13] = MmcBcd(raw[13]);
+    raw[14] = MmcBcd(raw[14]);
+    raw[15] = mode;
+
+    if(mode == MMC_MODE_1)
+    {
+        edc = MmcEdc(raw, 2064);
+        memset(raw + 2068, 0, 8);
+    }
+    else
+        edc = MmcEdc(raw + 16, 2056);
+
+    raw[mode == MMC_MODE_1 ? 2064 : 2072] = (uint8_t)edc;
+    raw[mode == MMC_MODE_1 ? 2065 : 2073] = (uint8_t)(edc >> 8);
+    raw[mode == MMC_MODE_1 ? 2066 : 2074] = (uint8_t)(edc >> 16);
+    raw[mode == MMC_MODE_1 ? 2067 : 2075] = (uint8_t)(edc >> 24);
+
+    // Mode 2 parity is computed as if the header were zero
+    memcpy(header, raw + 12, 4);
+
+    if(mode != MMC_MODE_1) memset(raw + 12, 0, 4);
+
+    MmcEccBlock(raw + 12, 86, 24, 2, 86, raw + 2076);
+    MmcEccBlock(raw + 12, 52, 43, 86, 88, raw + 2248);
+    memcpy(raw + 12, header, 4);
+}
+
+static uint16_t MmcCrc16(const uint8_t* data, uint32_t len)
+{
+    uint16_t crc = 0;
+    uint32_t bit;
+
+    while(len--)
+    {
+        crc ^= (uint16_t)(*data++ << 8);
+
+        for(bit = 0; bit < 8; bit++) crc = (uint16_t)(crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1);
+    }
+
+    return (uint16_t)~crc;
+}
+
+// Mode 1 Q, counting down to index 1 through the pregap
+static void MmcSubchannelQ(const MmcTrack* track, uint32_t lba, uint8_t* q)
+{
+    uint8_t msf[3];
+
+    q[0] = (uint8_t)(track->control << 4 | 1);
+    q[1] = MmcBcd(track->number);
+    q[2] = lba < track->start ? 0 : 1;
+    MmcMsf(lba < track->start ? track->start - lba : lba - track->start, msf);
+    q[3] = MmcBcd(msf[0]);
+    q[4] = MmcBcd(msf[1]);
+    q[5] = MmcBcd(msf[2]);
+    q[6] = 0;
+    MmcMsf(lba + MMC_MSF_OFFSET, msf);
+    q[7] = MmcBcd(msf[0]);
+    q[8] = MmcBcd(msf[1]);
+    q[9] = MmcBcd(msf[2]);
+    EmuPutBe16(q + 10, MmcCrc16(q, 10));
+}
+
+static FILE* MmcFile(EmuDevice* dev, MmcDisc* disc, uint32_t file)
+{
+    return disc->file_count ? disc->files[file] : dev->image;
+}
+
+static const MmcTrack* MmcFindTrack(MmcDisc* disc, uint32_t lba)
+{
+    uint32_t i;
+
+    for(i = 0; i < disc->track_count; i++)
+        if(lba < disc->tracks[i].end) return &disc->tracks[i];
+
+    return NULL;
+}
+
+// Raw sector for an LBA inside the disc, cooked images and pregaps not in any file are encoded here, NULL if unreadable
+static const MmcTrack* MmcReadSector(EmuDevice* dev, MmcDisc* disc, uint32_t lba, uint8_t* raw)
+{
+    const MmcTrack* track = MmcFindTrack(disc, lba);
+    FILE*           file;
+    uint32_t        length;
+    uint64_t        bad_lba;
+
+    if(!track || EmuBadBlock(dev, lba, 1, &bad_lba)) return NULL;
+
+    memset(raw, 0, MMC_RAW_SECTOR);
+
+    if(lba < track->data_start)
+    {
+        if(track->mode != MMC_MODE_AUDIO) MmcEncode(raw, lba, track->mode);
+
+        return track;
+    }
+
+    file   = MmcFile(dev, disc, track->file);
+    length = track->sector_size;
+
+    if(!file || EmuSeek(file, track->file_offset + (uint64_t)(lba - track->data_start) * length, SEEK_SET) != 0)
+        return NULL;
+
+    if(fread(length == MMC_RAW_SECTOR ? raw : raw + 16, 1, length, file) != length) return NULL;
+
+    if(length != MMC_RAW_SECTOR) MmcEncode(raw, lba, MMC_MODE_1);
+
+    return track;
+}
+
+// Form 2 when the submode in the mode 2 subheader says so
+static uint8_t MmcForm2(const MmcTrack* track, const uint8_t* raw)
+{
+    return track->mode == MMC_MODE_2 && (raw[18] & 0x20);
+}
+
+static uint32_t MmcUserStart(const MmcTrack* track) { return track->mode == MMC_MODE_1 ? 16 : 24; }
+
+static uint64_t MmcSqrt(uint64_t value)
+{
+    uint64_t root = value;
+    uint64_t next;
+
+    if(value < 2) return value;
+
+    next = (root + value / root) / 2;
+
+    while(next < root)
+    {
+        root = next;
+        next = (root + value / root) / 2;
+    }
+
+    return root;
+}
+
+// Micrometres from the centre to where an LBA lies on the spiral
+static uint64_t MmcRadius(uint32_t lba)
+{
+    return MmcSqrt((uint64_t)MMC_INNER_RADIUS * MMC_INNER_RADIUS + (uint64_t)lba * MMC_AREA_PER_SECTOR);
+}
+
+// CLV drive, seeks scale with the radial distance and then wait half a turn, which is longer towards the outside
+static void MmcModelRead(EmuDevice* dev, MmcDisc* disc, uint32_t lba, uint32_t blocks)
+{
+    uint64_t from;
+    uint64_t to;
+
+    if(lba != disc->next_lba)
+    {
+        from = MmcRadius(disc->next_lba);
+        to   = MmcRadius(lba);
+
+        dev->delay += (uint64_t)dev->model.seek * (from > to ? from - to : to - from) / MMC_RADIUS_SPAN;
+
+        // Half of 2 pi r at 1.3 um per microsecond
+        if(disc->speed) dev->delay += to * 2417 / 1000 / disc->speed;
+    }
+
+    if(disc->speed) dev->delay += (uint64_t)blocks * 1000000 / (MMC_SECTORS_PER_SECOND * disc->speed);
+
+    disc->next_lba = lba + blocks;
+}
+
+static uint8_t MmcRangeCheck(EmuDevice* dev, MmcDisc* disc, uint32_t lba, uint32_t blocks)
+{
+    if(lba <= disc->leadout && blocks <= disc->leadout - lba) return 1;
+
+    EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_LBA_OUT_OF_RANGE, 0);
+    return 0;
+}
+
+// READ(10) and READ(12) give the user data of data tracks
+static void MmcRead(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t         raw[MMC_RAW_SECTOR];
+    uint32_t        lba    = EmuGetBe32(cdb + 2);
+    uint32_t        blocks = cdb[0] == MMC_READ_10 ? EmuGetBe16(cdb + 7) : EmuGetBe32(cdb + 6);
+    uint32_t        i;
+    const MmcTrack* track;
+
+    if(!MmcRangeCheck(dev, disc, lba, blocks)) return;
+
+    if((uint64_t)blocks * MMC_USER_SECTOR > buf_len || (blocks > 0 && !buffer))
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return;
+    }
+
+    MmcModelRead(dev, disc, lba, blocks);
+
+    for(i = 0; i < blocks; i++)
+    {
+        track = MmcReadSector(dev, disc, lba + i, raw);
+
+        if(!track)
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_UNRECOVERED_READ_ERROR, 0);
+            return;
+        }
+
+        if(track->mode == MMC_MODE_AUDIO || MmcForm2(track, raw))
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_ILLEGAL_MODE_FOR_THIS_TRACK, 0);
+            return;
+        }
+
+        memcpy(buffer + (size_t)i * MMC_USER_SECTOR, raw + MmcUserStart(track), MMC_USER_SECTOR);
+    }
+}
+
+static uint8_t MmcExpectedType(const MmcTrack* track, const uint8_t* raw, uint8_t expected)
+{
+    switch(expected)
+    {
+        case 0: return 1;
+        case 1: return track->mode == MMC_MODE_AUDIO;
+        case 2: return track->mode == MMC_MODE_1;
+        case 3: return track->mode == MMC_MODE_2;
+        case 4: return track->mode == MMC_MODE_2 && !MmcForm2(track, raw);
+        case 5: return MmcForm2(track, raw);
+        default: return 0;
+    }
+}
+
+// The parts of a raw sector selected by byte 9 of READ CD, followed by C2 pointers and the subchannel
+static uint32_t MmcCdFields(const MmcTrack* track,
+                            uint32_t        lba,
+                            const uint8_t*  raw,
+                            uint8_t         flags,
+                            uint8_t         subchannel,
+                            uint8_t*        out)
+{
+    uint32_t len  = 0;
+    uint32_t user = MmcUserStart(track);
+    uint32_t end  = track->mode == MMC_MODE_1 ? 2064 : MmcForm2(track, raw) ? 2348 : 2072;
+    uint8_t  q[12];
+    uint32_t i;
+
+    if(track->mode == MMC_MODE_AUDIO)
+    {
+        if(flags & 0x10)
+        {
+            memcpy(out, raw, MMC_RAW_SECTOR);
+            len = MMC_RAW_SECTOR;
+        }
+    }
+    else
+    {
+        if(flags & 0x80)
+        {
+            memcpy(out + len, raw, 12);
+            len += 12;
+        }
+
+        if(flags & 0x20)
+        {
+            memcpy(out + len, raw + 12, 4);
+            len += 4;
+        }
+
+        if((flags & 0x40) && track->mode == MMC_MODE_2)
+        {
+            memcpy(out + len, raw + 16, 8);
+            len += 8;
+        }
+
+        if(flags & 0x10)
+        {
+            memcpy(out + len, raw + user, end - user);
+            len += end - user;
+        }
+
+        if(flags & 0x08)
+        {
+            memcpy(out + len, raw + end, MMC_RAW_SECTOR - end);
+            len += MMC_RAW_SECTOR - end;
+        }
+    }
+
+    // Images carry no C2 errors, so pointers, and the block error bits, are all clear
+    if((flags & 0x06) == 0x02 || (flags & 0x06) == 0x04)
+    {
+        memset(out + len, 0, (flags & 0x06) == 0x02 ? 294 : 296);
+        len += (flags & 0x06) == 0x02 ? 294 : 296;
+    }
+
+    if(subchannel == 0) return len;
+
+    MmcSubchannelQ(track, lba, q);
+
+    // Formatted Q
+    if(subchannel == 2)
+    {
+        memcpy(out + len, q, sizeof(q));
+        memset(out + len + sizeof(q), 0, 4);
+        return len + 16;
+    }
+
+    memset(out + len, 0, MMC_SUBCHANNEL_SIZE);
+
+    // Raw P-W interleaves one bit of every channel per byte, P flags pauses and R-W are empty
+    if(subchannel == 1)
+        for(i = 0; i < MMC_SUBCHANNEL_SIZE; i++)
+            out[len + i] = (uint8_t)((lba < track->start ? 0x80 : 0) | ((q[i / 8] >> (7 - i % 8)) & 1) << 6);
+
+    return len + MMC_SUBCHANNEL_SIZE;
+}
+
+static void MmcReadCd(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t         raw[MMC_RAW_SECTOR];
+    uint8_t         out[MMC_RAW_SECTOR + 296 + MMC_SUBCHANNEL_SIZE];
+    uint8_t         expected   = (uint8_t)((cdb[1] >> 2) & 0x07);
+    uint8_t         subchannel = cdb[10] & 0x07;
+    uint32_t        lba;
+    uint32_t        blocks;
+    uint32_t        end;
+    uint32_t        len = 0;
+    uint32_t        sector_len;
+    uint32_t        i;
+    const MmcTrack* track;
+
+    if(cdb[0] == MMC_READ_CD)
+    {
+        lba    = EmuGetBe32(cdb + 2);
+        blocks = (uint32_t)cdb[6] << 16 | EmuGetBe16(cdb + 7);
+    }
+    else
+    {
+        lba = ((uint32_t)cdb[3] * 60 + cdb[4]) * MMC_SECTORS_PER_SECOND + cdb[5];
+        end = ((uint32_t)cdb[6] * 60 + cdb[7]) * MMC_SECTORS_PER_SECOND + cdb[8];
+
+        if(lba < MMC_MSF_OFFSET || end < lba)
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+            return;
+        }
+
+        blocks = end - lba;
+        lba -= MMC_MSF_OFFSET;
+    }
+
+    if(subchannel == 3 || subchannel > 4 || expected > 5 || (cdb[9] & 0x06) == 0x06)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return;
+    }
+
+    if(!MmcRangeCheck(dev, disc, lba, blocks)) return;
+
+    MmcModelRead(dev, disc, lba, blocks);
+
+    for(i = 0; i < blocks; i++)
+    {
+        track = MmcReadSector(dev, disc, lba + i, raw);
+
+        if(!track)
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_UNRECOVERED_READ_ERROR, 0);
+            return;
+        }
+
+        if(!MmcExpectedType(track, raw, expected))
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_ILLEGAL_MODE_FOR_THIS_TRACK, 0);
+            return;
+        }
+
+        sector_len = MmcCdFields(track, lba + i, raw, cdb[9], subchannel, out);
+
+        if(sector_len > buf_len - len || (sector_len > 0 && !buffer))
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+            return;
+        }
+
+        memcpy(buffer + len, out, sector_len);
+        len += sector_len;
+    }
+}
+
+static void MmcReadToc(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t         data[4 + (MMC_MAX_TRACKS + 3) * 11];
+    uint8_t         format = cdb[2] & 0x0F;
+    uint8_t         msf    = cdb[1] & 0x02;
+    uint32_t        len    = 4;
+    uint32_t        i;
+    const MmcTrack* last = &disc->tracks[disc->track_count - 1];
+
+    // Older initiators put the format in the control byte
+    if(format == 0) format = cdb[9] >> 6;
+
+    memset(data, 0, sizeof(data));
+    data[2] = disc->tracks[0].number;
+    data[3] = last->number;
+
+    switch(format)
+    {
+        case 0:
+            if(cdb[6] > last->number && cdb[6] != MMC_LEADOUT)
+            {
+                EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+                return;
+            }
+
+            for(i = 0; i < disc->track_count; i++)
+            {
+                if(disc->tracks[i].number < cdb[6]) continue;
+
+                data[len + 1] = (uint8_t)(0x10 | disc->tracks[i].control);
+                data[len + 2] = disc->tracks[i].number;
+                MmcAddress(data + len + 4, disc->tracks[i].start, msf);
+                len += 8;
+            }
+
+            data[len + 1] = (uint8_t)(0x10 | last->control);
+            data[len + 2] = MMC_LEADOUT;
+            MmcAddress(data + len + 4, disc->leadout, msf);
+            len += 8;
+            break;
+        // Session information, there is only one
+        case 1:
+            data[2] = 1;
+            data[3] = 1;
+            data[5] = (uint8_t)(0x10 | disc->tracks[0].control);
+            data[6] = disc->tracks[0].number;
+            MmcAddress(data + 8, disc->tracks[0].start, msf);
+            len += 8;
+            break;
+        // Full TOC as in the lead-in, first, last and lead-out points then the tracks, always MSF
+        case 2:
+            data[2] = 1;
+            data[3] = 1;
+
+            for(i = 0; i < disc->track_count + 3; i++)
+            {
+                data[len]     = 1;
+                data[len + 1] = (uint8_t)(0x10 | (i < 3 ? disc->tracks[0].control : disc->tracks[i - 3].control));
+
+                switch(i)
+                {
+                    case 0:
+                        data[len + 3] = 0xA0;
+                        data[len + 8] = disc->tracks[0].number;
+                        data[len + 9] = disc->disc_type;
+                        break;
+                    case 1:
+                        data[len + 3] = 0xA1;
+                        data[len + 8] = last->number;
+                        break;
+                    case 2:
+                        data[len + 1] = (uint8_t)(0x10 | last->control);
+                        data[len + 3] = 0xA2;
+                        MmcMsf(disc->leadout + MMC_MSF_OFFSET, data + len + 8);
+                        break;
+                    default:
+                        data[len + 3] = disc->tracks[i - 3].number;
+                        MmcMsf(disc->tracks[i - 3].start + MMC_MSF_OFFSET, data + len + 8);
+                        break;
+                }
+
+                len += 11;
+            }
+            break;
+        // No PMA, ATIP or CD-TEXT on a pressed disc
+        case 3:
+        case 4:
+        case 5: break;
+        default: EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0); return;
+    }
+
+    EmuPutBe16(data, (uint16_t)(len - 2));
+    EmuScsiDataIn(buffer, buf_len, data, len, EmuGetBe16(cdb + 7));
+}
+
+static void MmcGetConfiguration(EmuDevice* dev, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t  data[128];
+    uint8_t  rt    = cdb[1] & 0x03;
+    uint16_t start = EmuGetBe16(cdb + 2);
+    uint32_t len   = 8;
+    size_t   i;
+
+    if(rt == 3)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return;
+    }
+
+    memset(data, 0, sizeof(data));
+    EmuPutBe16(data + 6, 0x0008);
+
+    // All features from start, only the current ones, or just the one asked for
+    for(i = 0; i < sizeof(mmc_features) / sizeof(MmcFeature); i++)
+    {
+        if(rt == 2 ? mmc_features[i].code != start : mmc_features[i].code < start) continue;
+
+        if(rt == 1 && !(mmc_features[i].flags & 0x01)) continue;
+
+        EmuPutBe16(data + len, mmc_features[i].code);
+        data[len + 2] = mmc_features[i].flags;
+        data[len + 3] = mmc_features[i].length;
+        memcpy(data + len + 4, mmc_features[i].data, mmc_features[i].length);
+        len += 4 + mmc_features[i].length;
+    }
+
+    EmuPutBe32(data, len - 4);
+    EmuScsiDataIn(buffer, buf_len, data, len, EmuGetBe16(cdb + 7));
+}
+
+// A finalized single session disc
+static void MmcReadDiscInformation(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t data[34];
+
+    if(cdb[1] & 0x07)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return;
+    }
+
+    memset(data, 0, sizeof(data));
+    EmuPutBe16(data, sizeof(data) - 2);
+    data[2] = 0x0E;
+    data[3] = disc->tracks[0].number;
+    data[4] = 1;
+    data[5] = disc->tracks[0].number;
+    data[6] = disc->tracks[disc->track_count - 1].number;
+    data[7] = 0x20;
+    data[8] = disc->disc_type;
+    memset(data + 16, 0xFF, 8);
+
+    EmuScsiDataIn(buffer, buf_len, data, sizeof(data), EmuGetBe16(cdb + 7));
+}
+
+static uint32_t MmcModePage(EmuDevice* dev, MmcDisc* disc, uint8_t page, uint8_t* data)
+{
+    uint32_t speed = dev->model.speed ? dev->model.speed : 1;
+
+    switch(page)
+    {
+        case MMC_PAGE_ERROR_RECOVERY:
+            memset(data, 0, 12);
+            data[0] = MMC_PAGE_ERROR_RECOVERY;
+            data[1] = 10;
+            return 12;
+        // Reads CD-DA accurately with C2 pointers and both subchannel formats, tray that locks and ejects
+        case MMC_PAGE_CAPABILITIES:
+            memset(data, 0, 22);
+            data[0] = MMC_PAGE_CAPABILITIES;
+            data[1] = 20;
+            data[4] = 0x01;
+            data[5] = 0x1F;
+            data[6] = 0x29;
+            EmuPutBe16(data + 8, (uint16_t)(speed * 176));
+            EmuPutBe16(data + 14, (uint16_t)((disc->speed ? disc->speed : 1) * 176));
+            return 22;
+        default: return 0;
+    }
+}
+
+// No block descriptors, MMC drives do not have them
+static void MmcModeSense(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t  data[64];
+    uint8_t  page = cdb[2] & 0x3F;
+    uint8_t  ten  = cdb[0] == MMC_MODE_SENSE_10;
+    uint32_t len  = ten ? 8 : 4;
+    uint32_t page_len;
+
+    memset(data, 0, sizeof(data));
+
+    if(page == MMC_PAGE_ALL)
+    {
+        len += MmcModePage(dev, disc, MMC_PAGE_ERROR_RECOVERY, data + len);
+        len += MmcModePage(dev, disc, MMC_PAGE_CAPABILITIES, data + len);
+    }
+    else
+    {
+        page_len = MmcModePage(dev, disc, page, data + len);
+
+        if(!page_len)
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+            return;
+        }
+
+        len += page_len;
+    }
+
+    if(ten)
+    {
+        EmuPutBe16(data, (uint16_t)(len - 2));
+        EmuScsiDataIn(buffer, buf_len, data, len, EmuGetBe16(cdb + 7));
+        return;
+    }
+
+    data[0] = (uint8_t)(len - 1);
+    EmuScsiDataIn(buffer, buf_len, data, len, cdb[4]);
+}
+
+// Speeds come in KB/s, 176 of them make single speed, and never go over what the drive was given
+static void MmcSetCdSpeed(EmuDevice* dev, MmcDisc* disc, const uint8_t* cdb)
+{
+    uint16_t speed = EmuGetBe16(cdb + 2);
+
+    if(!dev->model.speed) return;
+
+    if(speed == 0xFFFF || speed / 176 >= dev->model.speed)
+        disc->speed = dev->model.speed;
+    else
+        disc->speed = speed < 176 ? 1 : speed / 176;
+}
+
+static int32_t MmcSendScsiCommand(void*     device_ctx,
+                                  char*     cdb,
+                                  char*     buffer,
+                                  char**    sense_buffer,
+                                  uint32_t  timeout,
+                                  int32_t   direction,
+                                  uint32_t* duration,
+                                  uint32_t* sense,
+                                  uint32_t  cdb_len,
+                                  uint32_t* buf_len,
+                                  uint32_t* sense_len)
+{
+    EmuDevice*     dev = device_ctx;
+    MmcDisc*       disc;
+    const uint8_t* c = (const uint8_t*)cdb;
+    uint8_t        data[EMU_FIXED_SENSE_SIZE];
+
+    *sense_buffer = NULL;
+    *duration     = 0;
+    *sense        = 0;
+    *sense_len    = 0;
+
+    if(!dev || !cdb || cdb_len == 0 || cdb_len < EmuScsiCdbLength(c[0])) return -1;
+
+    disc = dev->model_data;
+    EmuStart(dev);
+
+    switch(c[0])
+    {
+        case MMC_TEST_UNIT_READY:
+        case MMC_START_STOP_UNIT:
+        case MMC_PREVENT_ALLOW_MEDIUM_REMOVAL: break;
+        case MMC_REQUEST_SENSE:
+            EmuScsiRequestSense(dev, data);
+            EmuScsiDataIn(buffer, *buf_len, data, EMU_FIXED_SENSE_SIZE, c[4]);
+            break;
+        case MMC_INQUIRY: EmuScsiInquiry(dev, c, buffer, *buf_len, 0x05, 1, "EMULATED CD-ROM "); break;
+        case MMC_READ_CAPACITY:
+            EmuPutBe32(data, disc->leadout - 1);
+            EmuPutBe32(data + 4, MMC_USER_SECTOR);
+            EmuScsiDataIn(buffer, *buf_len, data, 8, 8);
+            break;
+        case MMC_READ_10:
+        case MMC_READ_12: MmcRead(dev, disc, c, buffer, *buf_len); break;
+        case MMC_READ_CD:
+        case MMC_READ_CD_MSF: MmcReadCd(dev, disc, c, buffer, *buf_len); break;
+        case MMC_READ_TOC_PMA_ATIP: MmcReadToc(dev, disc, c, buffer, *buf_len); break;
+        case MMC_GET_CONFIGURATION: MmcGetConfiguration(dev, c, buffer, *buf_len); break;
+        case MMC_READ_DISC_INFORMATION: MmcReadDiscInformation(dev, disc, c, buffer, *buf_len); break;
+        case MMC_MODE_SENSE_6:
+        case MMC_MODE_SENSE_10: MmcModeSense(dev, disc, c, buffer, *buf_len); break;
+        case MMC_SET_CD_SPEED: MmcSetCdSpeed(dev, disc, c); break;
+        default: EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_COMMAND_OPERATION_CODE, 0); break;
+    }
+
+    // Medium timing was added by the reads themselves
+    *duration = EmuFinish(dev, EMU_NO_MEDIA, 0);
+
+    return EmuScsiComplete(dev, sense_buffer, sense, sense_len);
+}
+
+// The operating system sees the user data of every sector, like a block device for the drive would
+static int32_t MmcOsRead(void*     device_ctx,
+                         char*     buffer,
+                         uint64_t  offset,
+                         uint32_t  length,
+                         uint32_t* read_length,
+                         uint32_t* duration)
+{
+    EmuDevice*      dev = device_ctx;
+    MmcDisc*        disc;
+    uint8_t         raw[MMC_RAW_SECTOR];
+    uint64_t        lba;
+    uint32_t        skip;
+    uint32_t        chunk;
+    const MmcTrack* track;
+    int32_t         ret = 0;
+    *duration           = 0;
+    *read_length        = 0;
+
+    if(!dev) return -1;
+
+    disc = dev->model_data;
+    EmuStart(dev);
+
+    if(offset < (uint64_t)disc->leadout * MMC_USER_SECTOR)
+    {
+        if(length > (uint64_t)disc->leadout * MMC_USER_SECTOR - offset)
+            length = (uint32_t)((uint64_t)disc->leadout * MMC_USER_SECTOR - offset);
+
+        lba = offset / MMC_USER_SECTOR;
+        MmcModelRead(dev,
+                     disc,
+                     (uint32_t)lba,
+                     (uint32_t)((offset + length + MMC_USER_SECTOR - 1) / MMC_USER_SECTOR - lba));
+
+        while(*read_length < length)
+        {
+            track = MmcReadSector(dev, disc, (uint32_t)lba, raw);
+
+            if(!track || track->mode == MMC_MODE_AUDIO || MmcForm2(track, raw))
+            {
+                ret = EIO;
+                break;
+            }
+
+            skip  = (uint32_t)((offset + *read_length) % MMC_USER_SECTOR);
+            chunk = MMC_USER_SECTOR - skip < length - *read_length ? MMC_USER_SECTOR - skip : length - *read_length;
+            memcpy(buffer + *read_length, raw + MmcUserStart(track) + skip, chunk);
+            *read_length += chunk;
+            lba++;
+        }
+    }
+
+    *duration = EmuFinish(dev, EMU_NO_MEDIA, 0);
+
+    return ret;
+}
+
+static uint32_t MmcParseMsf(const char* text)
+{
+    unsigned int minutes;
+    unsigned int seconds;
+    unsigned int frames;
+
+    if(!text || sscanf(text, "%u:%u:%u", &minutes, &seconds, &frames) != 3 || seconds >= 60 ||
+       frames >= MMC_SECTORS_PER_SECOND)
+        return (uint32_t)-1;
+
+    return ((uint32_t)minutes * 60 + seconds) * MMC_SECTORS_PER_SECOND + frames;
+}
+
+// Splits on blanks, a quoted token runs to its closing quote
+static char* MmcCueToken(char** line)
+{
+    char* token;
+
+    while(**line == ' ' || **line == '\t') (*line)++;
+
+    if(**line == 0) return NULL;
+
+    if(**line == '"')
+    {
+        token = ++*line;
+
+        while(**line && **line != '"') (*line)++;
+    }
+    else
+    {
+        token = *line;
+
+        while(**line && **line != ' ' && **line != '\t') (*line)++;
+    }
+
+    if(**line) *(*line)++ = 0;
+
+    return token;
+}
+
+// Files in the cue sheet are relative to it
+static FILE* MmcOpenCueFile(EmuDevice* dev, const char* name)
+{
+    char        path[sizeof(dev->image_path)];
+    const char* slash     = strrchr(dev->image_path, '/');
+    const char* backslash = strrchr(dev->image_path, '\\');
+    size_t      dir_len;
+    FILE*       file;
+
+    if(backslash > slash) slash = backslash;
+
+    dir_len = slash && name[0] != '/' && name[0] != '\\' ? (size_t)(slash - dev->image_path) + 1 : 0;
+
+    if(dir_len + strlen(name) >= sizeof(path)) return NULL;
+
+    memcpy(path, dev->image_path, dir_len);
+    strcpy(path + dir_len, name);
+    file = fopen(path, "rb");
+
+    if(file) setvbuf(file, NULL, _IONBF, 0);
+
+    return file;
+}
+
+static int MmcCueTrackType(const char* type, MmcTrack* track)
+{
+    if(strcmp(type, "AUDIO") == 0)
+    {
+        track->mode        = MMC_MODE_AUDIO;
+        track->sector_size = MMC_RAW_SECTOR;
+    }
+    else if(strcmp(type, "MODE1/2048") == 0)
+    {
+        track->mode        = MMC_MODE_1;
+        track->sector_size = MMC_USER_SECTOR;
+    }
+    else if(strcmp(type, "MODE1/2352") == 0 || strcmp(type, "MODE2/2352") == 0)
+    {
+        track->mode        = type[4] == '1' ? MMC_MODE_1 : MMC_MODE_2;
+        track->sector_size = MMC_RAW_SECTOR;
+    }
+    else
+        return -1;
+
+    track->control = track->mode == MMC_MODE_AUDIO ? 0 : MMC_CONTROL_DATA;
+
+    return 0;
+}
+
+// Places the tracks on the disc, pregaps in the files take their frames and PREGAP ones push everything after them
+static int MmcLayTracks(MmcDisc* disc)
+{
+    uint32_t  i;
+    uint64_t  file_size;
+    MmcTrack* track;
+    MmcTrack* previous;
+
+    for(i = 0; i < disc->track_count; i++)
+    {
+        track    = &disc->tracks[i];
+        previous = i > 0 ? &disc->tracks[i - 1] : NULL;
+
+        if(track->index1_frame == (uint32_t)-1 || track->first_frame > track->index1_frame) return -1;
+
+        // The pregap of the first track is before LBA 0 and cannot be read
+        if(!previous)
+        {
+            track->first_frame = track->index1_frame;
+            track->pregap      = 0;
+        }
+
+        if(previous && previous->file == track->file)
+        {
+            if(track->first_frame < previous->first_frame) return -1;
+
+            previous->end      = previous->data_start + (track->first_frame - previous->first_frame);
+            track->file_offset = previous->file_offset +
+                                 (uint64_t)(track->first_frame - previous->first_frame) * previous->sector_size;
+        }
+        else
+            track->file_offset = (uint64_t)track->first_frame * track->sector_size;
+
+        track->pregap_start = previous ? previous->end : 0;
+        track->data_start   = track->pregap_start + track->pregap;
+        track->start        = track->data_start + (track->index1_frame - track->first_frame);
+
+        // The last track in a file runs to its end
+        if(i + 1 == disc->track_count || disc->tracks[i + 1].file != track->file)
+        {
+            if(EmuSeek(disc->files[track->file], 0, SEEK_END) != 0) return -1;
+
+            file_size = EmuTell(disc->files[track->file]);
+
+            if(file_size < track->file_offset) return -1;
+
+            track->end = track->data_start + (uint32_t)((file_size - track->file_offset) / track->sector_size);
+        }
+
+        if(previous && previous->end < previous->start + 1) return -1;
+    }
+
+    track = &disc->tracks[disc->track_count - 1];
+
+    if(track->end <= track->start) return -1;
+
+    disc->leadout = track->end;
+
+    return 0;
+}
+
+static int MmcParseCue(EmuDevice* dev, MmcDisc* disc)
+{
+    char      line[1024 + 64];
+    char*     cursor;
+    char*     keyword;
+    char*     argument;
+    char*     type;
+    uint32_t  line_number = 0;
+    uint32_t  frame;
+    MmcTrack* track = NULL;
+
+    if(EmuSeek(dev->image, 0, SEEK_SET) != 0) return errno;
+
+    while(fgets(line, sizeof(line), dev->image))
+    {
+        line_number++;
+        line[strcspn(line, "\r\n")] = 0;
+        cursor                      = line;
+        keyword                     = MmcCueToken(&cursor);
+
+        if(!keyword) continue;
+
+        argument = MmcCueToken(&cursor);
+        type     = MmcCueToken(&cursor);
+
+        if(strcmp(keyword, "FILE") == 0)
+        {
+            if(!argument || !type || strcmp(type, "BINARY") != 0 || disc->file_count == MMC_MAX_TRACKS) break;
+
+            disc->files[disc->file_count] = MmcOpenCueFile(dev, argument);
+
+            if(!disc->files[disc->file_count])
+            {
+                printf("Cannot open %s from cue sheet %s.\n", argument, dev->image_path);
+                return ENOENT;
+            }
+
+            disc->file_count++;
+            track = NULL;
+        }
+        else if(strcmp(keyword, "TRACK") == 0)
+        {
+            if(!argument || !type || disc->file_count == 0 || disc->track_count == MMC_MAX_TRACKS) break;
+
+            track = &disc->tracks[disc->track_count];
+            memset(track, 0, sizeof(MmcTrack));
+            track->number       = (uint8_t)atoi(argument);
+            track->file         = disc->file_count - 1;
+            track->first_frame  = (uint32_t)-1;
+            track->index1_frame = (uint32_t)-1;
+
+            if(track->number < 1 || track->number > MMC_MAX_TRACKS || MmcCueTrackType(type, track) ||
+               (disc->track_count > 0 && track->number != disc->tracks[disc->track_count - 1].number + 1))
+                break;
+
+            disc->track_count++;
+        }
+        else if(strcmp(keyword, "INDEX") == 0)
+        {
+            frame = MmcParseMsf(type);
+
+            if(!track || !argument || frame == (uint32_t)-1) break;
+
+            // Only where the pregap and the track proper start matter, later indexes are kept in the data
+            if(atoi(argument) == 0)
+                track->first_frame = frame;
+            else if(atoi(argument) == 1)
+            {
+                track->index1_frame = frame;
+
+                if(track->first_frame == (uint32_t)-1) track->first_frame = frame;
+            }
+        }
+        else if(strcmp(keyword, "PREGAP") == 0)
+        {
+            frame = MmcParseMsf(argument);
+
+            if(!track || frame == (uint32_t)-1) break;
+
+            track->pregap = frame;
+        }
+        else if(strcmp(keyword, "FLAGS") == 0)
+        {
+            if(!track) break;
+
+            // Any number of flags can follow
+            while(argument)
+            {
+                if(strcmp(argument, "DCP") == 0)
+                    track->control |= 0x02;
+                else if(strcmp(argument, "4CH") == 0)
+                    track->control |= 0x08;
+                else if(strcmp(argument, "PRE") == 0)
+                    track->control |= 0x01;
+
+                argument = type;
+                type     = MmcCueToken(&cursor);
+            }
+        }
+        // REM, CATALOG, TITLE, PERFORMER, ISRC and the like describe the disc, they do not change its layout
+    }
+
+    if(!feof(dev->image) || disc->track_count == 0 || MmcLayTracks(disc))
+    {
+        printf("Invalid or unsupported cue sheet %s at line %u.\n", dev->image_path, line_number);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+// Anything not a cue sheet is a single mode 1 track of cooked sectors
+static int MmcLayIso(EmuDevice* dev, MmcDisc* disc)
+{
+    MmcTrack* track = &disc->tracks[0];
+
+    if(dev->size < MMC_USER_SECTOR)
+    {
+        printf("Image %s is smaller than a sector.\n", dev->image_path);
+        return EINVAL;
+    }
+
+    disc->track_count  = 1;
+    disc->leadout      = (uint32_t)(dev->size / MMC_USER_SECTOR);
+    track->number      = 1;
+    track->control     = MMC_CONTROL_DATA;
+    track->mode        = MMC_MODE_1;
+    track->sector_size = MMC_USER_SECTOR;
+    track->end         = disc->leadout;
+
+    return 0;
+}
+
+static uint8_t MmcIsCue(const char* path)
+{
+    size_t len = strlen(path);
+
+    return len > 4 && path[len - 4] == '.' && (path[len - 3] | 0x20) == 'c' && (path[len - 2] | 0x20) == 'u' &&
+           (path[len - 1] | 0x20) == 'e';
+}
+
+static void* MmcOpen(const char* device_path)
+{
+    EmuDevice* dev = EmuOpen(device_path, AARUREMOTE_DEVICE_TYPE_SCSI, MMC_USER_SECTOR, 1);
+    MmcDisc*   disc;
+    uint32_t   i;
+    int        ret;
+
+    if(!dev) return NULL;
+
+    disc = malloc(sizeof(MmcDisc));
+
+    if(!disc)
+    {
+        EmuClose(dev);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset(disc, 0, sizeof(MmcDisc));
+    dev->model_data = disc;
+    disc->speed     = dev->model.speed;
+
+    MmcInitTables();
+
+    ret = MmcIsCue(dev->image_path) ? MmcParseCue(dev, disc) : MmcLayIso(dev, disc);
+
+    if(ret)
+    {
+        MmcClose(dev);
+        errno = ret;
+        return NULL;
+    }
+
+    // CD-ROM XA as soon as there is a mode 2 track
+    for(i = 0; i < disc->track_count; i++)
+        if(disc->tracks[i].mode == MMC_MODE_2) disc->disc_type = 0x20;
+
+    return dev;
+}
+
+static void MmcClose(void* device_ctx)
+{
+    EmuDevice* dev = device_ctx;
+    MmcDisc*   disc;
+    uint32_t   i;
+
+    if(!dev) return;
+
+    disc = dev->model_data;
+
+    for(i = 0; disc && i < disc->file_count; i++)
+        if(disc->files[i]) fclose(disc->files[i]);
+
+    EmuClose(dev);
+}
+
+const DeviceBackend emu_mmc_backend = {MmcOpen,
+                                       MmcClose,
+                                       EmuGetDeviceType,
+                                       MmcSendScsiCommand,
+                                       EmuNoScsiDataInBuffer,
+                                       EmuNoSdhciRegisters,
+                                       EmuNoUsbData,
+                                       EmuNoFireWireData,
+                                       EmuNoPcmciaData,
+                                       EmuNoAtaChsCommand,
+                                       EmuNoAtaLba28Command,
+                                       EmuNoAtaLba48Command,
+                                       EmuNoSdhciCommand,
+                                       EmuNoMultiSdhciCommand,
+                                       EmuReOpen,
+                                       MmcOsRead,
+                                       EmuOsSeekData};
@@ -0,0 +1,323 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "emu.h"
+
+#define SBC_TEST_UNIT_READY 0x00
+#define SBC_REQUEST_SENSE 0x03
+#define SBC_READ_6 0x08
+#define SBC_WRITE_6 0x0A
+#define SBC_INQUIRY 0x12
+#define SBC_MODE_SENSE_6 0x1A
+#define SBC_START_STOP_UNIT 0x1B
+#define SBC_PREVENT_ALLOW_MEDIUM_REMOVAL 0x1E
+#define SBC_READ_CAPACITY_10 0x25
+#define SBC_READ_10 0x28
+#define SBC_WRITE_10 0x2A
+#define SBC_SYNCHRONIZE_CACHE_10 0x35
+#define SBC_MODE_SENSE_10 0x5A
+#define SBC_READ_16 0x88
+#define SBC_WRITE_16 0x8A
+#define SBC_SERVICE_ACTION_IN_16 0x9E
+#define SBC_READ_12 0xA8
+#define SBC_WRITE_12 0xAA
+
+#define SBC_READ_CAPACITY_16 0x10
+
+#define SBC_PAGE_CACHING 0x08
+#define SBC_PAGE_CONTROL 0x0A
+#define SBC_PAGE_ALL 0x3F
+
+// Big enough for both headers, a block descriptor and every page
+#define SBC_MODE_DATA_SIZE 64
+
+static void* SbcOpen(const char* device_path)
+{
+    return EmuOpen(device_path, AARUREMOTE_DEVICE_TYPE_SCSI, 512, 0);
+}
+
+static void SbcReadCapacity(EmuDevice* dev, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t  data[32];
+    uint64_t last_lba = dev->size / dev->block_size;
+
+    last_lba = last_lba > 0 ? last_lba - 1 : 0;
+    memset(data, 0, sizeof(data));
+
+    if(cdb[0] == SBC_READ_CAPACITY_10)
+    {
+        EmuPutBe32(data, last_lba > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)last_lba);
+        EmuPutBe32(data + 4, dev->block_size);
+        EmuScsiDataIn(buffer, buf_len, data, 8, 8);
+        return;
+    }
+
+    EmuPutBe64(data, last_lba);
+    EmuPutBe32(data + 8, dev->block_size);
+    EmuScsiDataIn(buffer, buf_len, data, sizeof(data), EmuGetBe32(cdb + 10));
+}
+
+static uint32_t SbcModePage(uint8_t page, uint8_t* data)
+{
+    switch(page)
+    {
+        case SBC_PAGE_CACHING:
+            memset(data, 0, 20);
+            data[0] = SBC_PAGE_CACHING;
+            data[1] = 18;
+            return 20;
+        case SBC_PAGE_CONTROL:
+            memset(data, 0, 12);
+            data[0] = SBC_PAGE_CONTROL;
+            data[1] = 10;
+            return 12;
+        default: return 0;
+    }
+}
+
+static void SbcModeSense(EmuDevice* dev, const uint8_t* cdb, char* buffer, uint32_t buf_len)
+{
+    uint8_t  data[SBC_MODE_DATA_SIZE];
+    uint8_t  page       = cdb[2] & 0x3F;
+    uint8_t  ten        = cdb[0] == SBC_MODE_SENSE_10;
+    uint32_t header_len = ten ? 8 : 4;
+    uint32_t len        = header_len;
+    uint32_t page_len;
+    uint64_t blocks     = dev->size / dev->block_size;
+
+    memset(data, 0, sizeof(data));
+
+    // Short block descriptor unless disabled
+    if(!(cdb[1] & 0x08))
+    {
+        data[len + 1] = (uint8_t)((blocks > 0xFFFFFF ? 0xFFFFFF : blocks) >> 16);
+        data[len + 2] = (uint8_t)((blocks > 0xFFFFFF ? 0xFFFFFF : blocks) >> 8);
+        data[len + 3] = (uint8_t)(blocks > 0xFFFFFF ? 0xFFFFFF : blocks);
+        data[len + 5] = (uint8_t)(dev->block_size >> 16);
+        data[len + 6] = (uint8_t)(dev->block_size >> 8);
+        data[len + 7] = (uint8_t)dev->block_size;
+        len += 8;
+    }
+
+    if(page == SBC_PAGE_ALL)
+    {
+        len += SbcModePage(SBC_PAGE_CACHING, data + len);
+        len += SbcModePage(SBC_PAGE_CONTROL, data + len);
+    }
+    else if(page != 0)
+    {
+        page_len = SbcModePage(page, data + len);
+
+        if(!page_len)
+        {
+            EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+            return;
+        }
+
+        len += page_len;
+    }
+
+    // Nothing can be changed, so every page control gives the same
+    if(ten)
+    {
+        EmuPutBe16(data, (uint16_t)(len - 2));
+        data[3] = dev->read_only ? 0x80 : 0;
+        data[7] = cdb[1] & 0x08 ? 0 : 8;
+        EmuScsiDataIn(buffer, buf_len, data, len, EmuGetBe16(cdb + 7));
+        return;
+    }
+
+    data[0] = (uint8_t)(len - 1);
+    data[2] = dev->read_only ? 0x80 : 0;
+    data[3] = cdb[1] & 0x08 ? 0 : 8;
+    EmuScsiDataIn(buffer, buf_len, data, len, cdb[4]);
+}
+
+// Gets where a READ or WRITE goes from its CDB
+static void SbcTransfer(const uint8_t* cdb, uint64_t* lba, uint32_t* blocks)
+{
+    switch(cdb[0])
+    {
+        case SBC_READ_6:
+        case SBC_WRITE_6:
+            *lba    = (uint32_t)(cdb[1] & 0x1F) << 16 | EmuGetBe16(cdb + 2);
+            *blocks = cdb[4] ? cdb[4] : 256;
+            break;
+        case SBC_READ_10:
+        case SBC_WRITE_10:
+            *lba    = EmuGetBe32(cdb + 2);
+            *blocks = EmuGetBe16(cdb + 7);
+            break;
+        case SBC_READ_12:
+        case SBC_WRITE_12:
+            *lba    = EmuGetBe32(cdb + 2);
+            *blocks = EmuGetBe32(cdb + 6);
+            break;
+        default:
+            *lba    = EmuGetBe64(cdb + 2);
+            *blocks = EmuGetBe32(cdb + 10);
+            break;
+    }
+}
+
+// Returns how much of the medium was touched, so the latency model can account for it
+static uint32_t SbcReadWrite(EmuDevice* dev, const uint8_t* cdb, char* buffer, uint32_t buf_len, uint64_t* offset)
+{
+    uint64_t lba;
+    uint64_t length;
+    uint64_t bad_lba;
+    uint32_t blocks;
+    uint32_t read_length;
+    uint8_t  write = cdb[0] == SBC_WRITE_6 || cdb[0] == SBC_WRITE_10 || cdb[0] == SBC_WRITE_12 ||
+                    cdb[0] == SBC_WRITE_16;
+
+    SbcTransfer(cdb, &lba, &blocks);
+
+    length = (uint64_t)blocks * dev->block_size;
+
+    if(lba > dev->size / dev->block_size || blocks > dev->size / dev->block_size - lba)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_LBA_OUT_OF_RANGE, 0);
+        return 0;
+    }
+
+    if(length > buf_len || (length > 0 && !buffer))
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+        return 0;
+    }
+
+    if(write && dev->read_only)
+    {
+        EmuScsiCheck(dev, EMU_SENSE_KEY_DATA_PROTECT, EMU_ASC_WRITE_PROTECTED, 0);
+        return 0;
+    }
+
+    *offset = lba * dev->block_size;
+
+    if(length == 0) return 0;
+
+    if(write)
+    {
+        if(EmuWriteImage(dev, buffer, *offset, (uint32_t)length))
+            EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_WRITE_ERROR, 0);
+
+        return (uint32_t)length;
+    }
+
+    // Blocks before a bad one are still transferred
+    if(EmuBadBlock(dev, lba, blocks, &bad_lba))
+    {
+        length = (bad_lba - lba) * dev->block_size;
+        EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_UNRECOVERED_READ_ERROR, 0);
+    }
+
+    if(EmuReadImage(dev, buffer, *offset, (uint32_t)length, &read_length))
+        EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_UNRECOVERED_READ_ERROR, 0);
+
+    return (uint32_t)length;
+}
+
+static int32_t SbcSendScsiCommand(void*     device_ctx,
+                                  char*     cdb,
+                                  char*     buffer,
+                                  char**    sense_buffer,
+                                  uint32_t  timeout,
+                                  int32_t   direction,
+                                  uint32_t* duration,
+                                  uint32_t* sense,
+                                  uint32_t  cdb_len,
+                                  uint32_t* buf_len,
+                                  uint32_t* sense_len)
+{
+    EmuDevice*     dev    = device_ctx;
+    const uint8_t* c      = (const uint8_t*)cdb;
+    uint64_t       offset = EMU_NO_MEDIA;
+    uint32_t       length = 0;
+    uint8_t        sense_data[EMU_FIXED_SENSE_SIZE];
+
+    *sense_buffer = NULL;
+    *duration     = 0;
+    *sense        = 0;
+    *sense_len    = 0;
+
+    if(!dev || !cdb || cdb_len == 0 || cdb_len < EmuScsiCdbLength(c[0])) return -1;
+
+    EmuStart(dev);
+
+    switch(c[0])
+    {
+        case SBC_TEST_UNIT_READY:
+        case SBC_START_STOP_UNIT:
+        case SBC_PREVENT_ALLOW_MEDIUM_REMOVAL: break;
+        case SBC_REQUEST_SENSE:
+            EmuScsiRequestSense(dev, sense_data);
+            EmuScsiDataIn(buffer, *buf_len, sense_data, sizeof(sense_data), c[4]);
+            break;
+        case SBC_INQUIRY: EmuScsiInquiry(dev, c, buffer, *buf_len, 0x00, 0, "EMULATED DISK   "); break;
+        case SBC_READ_CAPACITY_10: SbcReadCapacity(dev, c, buffer, *buf_len); break;
+        case SBC_SERVICE_ACTION_IN_16:
+            if((c[1] & 0x1F) == SBC_READ_CAPACITY_16)
+                SbcReadCapacity(dev, c, buffer, *buf_len);
+            else
+                EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_FIELD_IN_CDB, 0);
+            break;
+        case SBC_MODE_SENSE_6:
+        case SBC_MODE_SENSE_10: SbcModeSense(dev, c, buffer, *buf_len); break;
+        case SBC_READ_6:
+        case SBC_READ_10:
+        case SBC_READ_12:
+        case SBC_READ_16:
+        case SBC_WRITE_6:
+        case SBC_WRITE_10:
+        case SBC_WRITE_12:
+        case SBC_WRITE_16: length = SbcReadWrite(dev, c, buffer, *buf_len, &offset); break;
+        case SBC_SYNCHRONIZE_CACHE_10:
+            if(EmuFlushImage(dev)) EmuScsiCheck(dev, EMU_SENSE_KEY_MEDIUM_ERROR, EMU_ASC_WRITE_ERROR, 0);
+            break;
+        default: EmuScsiCheck(dev, EMU_SENSE_KEY_ILLEGAL_REQUEST, EMU_ASC_INVALID_COMMAND_OPERATION_CODE, 0); break;
+    }
+
+    *duration = EmuFinish(dev, offset, length);
+
+    return EmuScsiComplete(dev, sense_buffer, sense, sense_len);
+}
+
+const DeviceBackend emu_sbc_backend = {SbcOpen,
+                                       EmuClose,
+                                       EmuGetDeviceType,
+                                       SbcSendScsiCommand,
+                                       EmuNoScsiDataInBuffer,
+                                       EmuNoSdhciRegisters,
+                                       EmuNoUsbData,
+                                       EmuNoFireWireData,
+                                       EmuNoPcmciaData,
+                                       EmuNoAtaChsCommand,
+                                       EmuNoAtaLba28Command,
+                                       EmuNoAtaLba48Command,
+                                       EmuNoSdhciCommand,
+                                       EmuNoMultiSdhciCommand,
+                                       EmuReOpen,
+                                       EmuOsRead,
+                                       EmuOsSeekData};
@@ -0,0 +1,516 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "emu.h"
+
+#define SD_GO_IDLE_STATE 0
+#define SD_ALL_SEND_CID 2
+#define SD_SEND_RELATIVE_ADDR 3
+#define SD_SELECT_CARD 7
+#define SD_SEND_IF_COND 8
+#define SD_SEND_CSD 9
+#define SD_SEND_CID 10
+#define SD_STOP_TRANSMISSION 12
+#define SD_SEND_STATUS 13
+#define SD_SET_BLOCKLEN 16
+#define SD_READ_SINGLE_BLOCK 17
+#define SD_READ_MULTIPLE_BLOCK 18
+#define SD_APP_CMD 55
+
+#define SD_APP_SEND_OP_COND 41
+#define SD_APP_SEND_SCR 51
+
+#define SD_STATE_IDLE 0
+#define SD_STATE_READY 1
+#define SD_STATE_IDENT 2
+#define SD_STATE_STBY 3
+#define SD_STATE_TRAN 4
+
+#define SD_STATUS_APP_CMD 0x00000020
+#define SD_STATUS_READY_FOR_DATA 0x00000100
+#define SD_STATUS_ERROR 0x00080000
+#define SD_STATUS_CARD_ECC_FAILED 0x00200000
+#define SD_STATUS_ILLEGAL_COMMAND 0x00400000
+#define SD_STATUS_BLOCK_LEN_ERROR 0x20000000
+#define SD_STATUS_OUT_OF_RANGE 0x80000000
+
+#define SD_BLOCK 512
+
+// Powered up, high capacity, 2.7 to 3.6 V
+#define SD_OCR 0xC0FF8000
+
+// High capacity cards count their size in units of 512 KiB
+#define SD_SIZE_UNIT (512 * 1024)
+
+typedef struct
+{
+    uint8_t  state;
+    uint16_t rca;
+    uint8_t  application;
+    uint32_t errors;
+    uint8_t  csd[16];
+    uint8_t  cid[16];
+    uint8_t  scr[8];
+} SdCard;
+
+static uint8_t SdCrc7(const uint8_t* data, uint32_t len)
+{
+    uint8_t  crc = 0;
+    uint32_t bit;
+
+    while(len--)
+    {
+        crc ^= *data++;
+
+        for(bit = 0; bit < 8; bit++) crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x12 : crc << 1);
+    }
+
+    return crc | 0x01;
+}
+
+// CSD version 2.0 of a high capacity card with 512 byte blocks, write protected for read-only images
+static void SdBuildRegisters(EmuDevice* dev, SdCard* card)
+{
+    uint32_t c_size = (uint32_t)(dev->size / SD_SIZE_UNIT) - 1;
+    uint64_t serial = TraceHash(dev->image_path, (uint32_t)strlen(dev->image_path));
+
+    memset(card->csd, 0, sizeof(card->csd));
+    card->csd[0]  = 0x40;
+    card->csd[1]  = 0x0E;
+    card->csd[3]  = 0x32;
+    card->csd[4]  = 0x5B;
+    card->csd[5]  = 0x59;
+    card->csd[7]  = (uint8_t)((c_size >> 16) & 0x3F);
+    card->csd[8]  = (uint8_t)(c_size >> 8);
+    card->csd[9]  = (uint8_t)c_size;
+    card->csd[10] = 0x7F;
+    card->csd[11] = 0x80;
+    card->csd[12] = 0x0A;
+    card->csd[13] = 0x40;
+    card->csd[14] = dev->read_only ? 0x10 : 0x00;
+    card->csd[15] = SdCrc7(card->csd, 15);
+
+    // Manufactured January 2025, the serial number is the same for the same image
+    memset(card->cid, 0, sizeof(card->cid));
+    memcpy(card->cid + 1, "AREMUSD", 7);
+    card->cid[8] = 0x10;
+    EmuPutBe32(card->cid + 9, (uint32_t)(serial ^ serial >> 32));
+    card->cid[13] = 0x01;
+    card->cid[14] = 0x91;
+    card->cid[15] = SdCrc7(card->cid, 15);
+
+    // SD 3.0 physical layer, SDHC security, 1 and 4 bit bus
+    memset(card->scr, 0, sizeof(card->scr));
+    card->scr[0] = 0x02;
+    card->scr[1] = 0x35;
+    card->scr[2] = 0x80;
+}
+
+static void* SdOpen(const char* device_path)
+{
+    EmuDevice* dev = EmuOpen(device_path, AARUREMOTE_DEVICE_TYPE_SECURE_DIGITAL, SD_BLOCK, 0);
+    SdCard*    card;
+
+    if(!dev) return NULL;
+
+    if(dev->size < SD_SIZE_UNIT)
+    {
+        printf("Image %s is smaller than the smallest card.\n", dev->image_path);
+        EmuClose(dev);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    card = malloc(sizeof(SdCard));
+
+    if(!card)
+    {
+        EmuClose(dev);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Selected and ready for data, as the host leaves a card once it has set it up
+    memset(card, 0, sizeof(SdCard));
+    card->state     = SD_STATE_TRAN;
+    card->rca       = (uint16_t)(TraceHash(dev->image_path, (uint32_t)strlen(dev->image_path)) | 1);
+    dev->model_data = card;
+
+    SdBuildRegisters(dev, card);
+
+    return dev;
+}
+
+static int32_t SdGetSdhciRegisters(void*     device_ctx,
+                                   char**    csd,
+                                   char**    cid,
+                                   char**    ocr,
+                                   char**    scr,
+                                   uint32_t* csd_len,
+                                   uint32_t* cid_len,
+                                   uint32_t* ocr_len,
+                                   uint32_t* scr_len)
+{
+    EmuDevice* dev = device_ctx;
+    SdCard*    card;
+    *csd           = NULL;
+    *cid           = NULL;
+    *ocr           = NULL;
+    *scr           = NULL;
+    *csd_len       = 0;
+    *cid_len       = 0;
+    *ocr_len       = 0;
+    *scr_len       = 0;
+
+    if(!dev) return -1;
+
+    card = dev->model_data;
+    *csd = malloc(sizeof(card->csd));
+    *cid = malloc(sizeof(card->cid));
+    *ocr = malloc(4);
+    *scr = malloc(sizeof(card->scr));
+
+    if(*csd)
+    {
+        memcpy(*csd, card->csd, sizeof(card->csd));
+        *csd_len = sizeof(card->csd);
+    }
+
+    if(*cid)
+    {
+        memcpy(*cid, card->cid, sizeof(card->cid));
+        *cid_len = sizeof(card->cid);
+    }
+
+    if(*ocr)
+    {
+        EmuPutBe32((uint8_t*)*ocr, SD_OCR);
+        *ocr_len = 4;
+    }
+
+    if(*scr)
+    {
+        memcpy(*scr, card->scr, sizeof(card->scr));
+        *scr_len = sizeof(card->scr);
+    }
+
+    return 1;
+}
+
+// Card status for R1, errors are cleared once reported
+static uint32_t SdStatus(SdCard* card)
+{
+    uint32_t status = card->errors | (uint32_t)card->state << 9;
+
+    if(card->state == SD_STATE_TRAN) status |= SD_STATUS_READY_FOR_DATA;
+
+    if(card->application) status |= SD_STATUS_APP_CMD;
+
+    card->errors = 0;
+
+    return status;
+}
+
+// 136 bit responses come most significant word first, as the Linux host returns them
+static void SdLongResponse(const uint8_t* reg, uint32_t* response)
+{
+    response[0] = EmuGetBe32(reg);
+    response[1] = EmuGetBe32(reg + 4);
+    response[2] = EmuGetBe32(reg + 8);
+    response[3] = EmuGetBe32(reg + 12);
+}
+
+// Blocks are addressed by number, a bad one ends the transfer with a data error
+static int32_t SdRead(EmuDevice* dev,
+                      SdCard*    card,
+                      uint32_t   argument,
+                      uint32_t   blocks,
+                      char*      buffer,
+                      uint32_t   buf_len,
+                      uint64_t*  offset,
+                      uint32_t*  length)
+{
+    uint64_t bad_lba;
+    uint32_t read_length;
+
+    if(argument >= dev->size / SD_BLOCK || blocks > dev->size / SD_BLOCK - argument)
+    {
+        card->errors |= SD_STATUS_OUT_OF_RANGE;
+        return EIO;
+    }
+
+    if(blocks == 0 || (uint64_t)blocks * SD_BLOCK > buf_len || !buffer)
+    {
+        card->errors |= SD_STATUS_BLOCK_LEN_ERROR;
+        return EINVAL;
+    }
+
+    *offset = (uint64_t)argument * SD_BLOCK;
+    *length = blocks * SD_BLOCK;
+
+    if(EmuBadBlock(dev, argument, blocks, &bad_lba)) *length = (uint32_t)(bad_lba - argument) * SD_BLOCK;
+
+    if(*length > 0 && EmuReadImage(dev, buffer, *offset, *length, &read_length) != 0) *length = read_length;
+
+    if(*length == blocks * SD_BLOCK) return 0;
+
+    card->errors |= SD_STATUS_CARD_ECC_FAILED | SD_STATUS_ERROR;
+    return EIO;
+}
+
+// A command the card does not take in its state gets no response, it is flagged in the next status
+static int32_t SdIllegal(SdCard* card)
+{
+    card->errors |= SD_STATUS_ILLEGAL_COMMAND;
+    card->application = 0;
+
+    return ETIMEDOUT;
+}
+
+static int32_t SdCommand(EmuDevice* dev,
+                         uint8_t    command,
+                         uint8_t    application,
+                         uint32_t   argument,
+                         uint32_t   blocks,
+                         char*      buffer,
+                         uint32_t   buf_len,
+                         uint32_t*  response,
+                         uint32_t*  duration,
+                         uint32_t*  sense)
+{
+    SdCard*  card    = dev->model_data;
+    uint16_t rca     = (uint16_t)(argument >> 16);
+    uint64_t offset  = EMU_NO_MEDIA;
+    uint32_t length  = 0;
+    int32_t  ret     = 0;
+    uint8_t  app_cmd = application || card->application;
+
+    memset(response, 0, sizeof(uint32_t) * 4);
+    EmuStart(dev);
+
+    card->application = 0;
+
+    if(app_cmd && command == SD_APP_SEND_OP_COND)
+    {
+        if(card->state != SD_STATE_IDLE)
+            ret = SdIllegal(card);
+        else
+        {
+            // Powers up at once, an empty voltage window only asks
+            if(argument & 0x00FF8000) card->state = SD_STATE_READY;
+
+            response[0] = SD_OCR;
+        }
+    }
+    else if(app_cmd && command == SD_APP_SEND_SCR)
+    {
+        if(card->state != SD_STATE_TRAN || buf_len < sizeof(card->scr) || !buffer)
+            ret = SdIllegal(card);
+        else
+        {
+            response[0] = SdStatus(card) | SD_STATUS_APP_CMD;
+            memcpy(buffer, card->scr, sizeof(card->scr));
+        }
+    }
+    else
+        switch(command)
+        {
+            case SD_GO_IDLE_STATE:
+                card->state  = SD_STATE_IDLE;
+                card->rca    = 0;
+                card->errors = 0;
+                break;
+            // Only 2.7 to 3.6 V, the check pattern comes back
+            case SD_SEND_IF_COND:
+                if(card->state != SD_STATE_IDLE || (argument & 0xF00) != 0x100)
+                    ret = SdIllegal(card);
+                else
+                    response[0] = argument & 0xFFF;
+                break;
+            case SD_ALL_SEND_CID:
+                if(card->state != SD_STATE_READY)
+                    ret = SdIllegal(card);
+                else
+                {
+                    card->state = SD_STATE_IDENT;
+                    SdLongResponse(card->cid, response);
+                }
+                break;
+            // R6 packs the error bits of the status next to the new address
+            case SD_SEND_RELATIVE_ADDR:
+                if(card->state != SD_STATE_IDENT && card->state != SD_STATE_STBY)
+                    ret = SdIllegal(card);
+                else
+                {
+                    card->rca   = (uint16_t)((card->rca * 31 + 0x4D3) | 1);
+                    response[0] = SdStatus(card);
+                    response[0] = (uint32_t)card->rca << 16 | (response[0] >> 8 & 0xC000) |
+                                  (response[0] >> 6 & 0x2000) | (response[0] & 0x1FFF);
+                    card->state = SD_STATE_STBY;
+                }
+                break;
+            case SD_SELECT_CARD:
+                if(card->state != SD_STATE_STBY && card->state != SD_STATE_TRAN)
+                    ret = SdIllegal(card);
+                else if(rca != card->rca)
+                    card->state = SD_STATE_STBY;
+                else
+                {
+                    response[0] = SdStatus(card);
+                    card->state = SD_STATE_TRAN;
+                }
+                break;
+            // Cards the host set up answer these selected too
+            case SD_SEND_CSD:
+            case SD_SEND_CID:
+                if(card->state != SD_STATE_STBY && card->state != SD_STATE_TRAN)
+                    ret = SdIllegal(card);
+                else
+                    SdLongResponse(command == SD_SEND_CSD ? card->csd : card->cid, response);
+                break;
+            // Transfers end by themselves, as with hosts that stop them automatically
+            case SD_STOP_TRANSMISSION:
+            case SD_SEND_STATUS:
+            case SD_APP_CMD:
+                if(card->state < SD_STATE_STBY && command != SD_APP_CMD)
+                    ret = SdIllegal(card);
+                else
+                {
+                    card->application = command == SD_APP_CMD;
+                    response[0]       = SdStatus(card);
+                }
+                break;
+            case SD_SET_BLOCKLEN:
+                if(card->state != SD_STATE_TRAN)
+                    ret = SdIllegal(card);
+                else
+                {
+                    if(argument != SD_BLOCK) card->errors |= SD_STATUS_BLOCK_LEN_ERROR;
+
+                    response[0] = SdStatus(card);
+                }
+                break;
+            case SD_READ_SINGLE_BLOCK:
+            case SD_READ_MULTIPLE_BLOCK:
+                if(card->state != SD_STATE_TRAN)
+                    ret = SdIllegal(card);
+                else
+                {
+                    response[0] = SdStatus(card);
+                    ret         = SdRead(dev,
+                                 card,
+                                 argument,
+                                 command == SD_READ_SINGLE_BLOCK ? 1 : blocks,
+                                 buffer,
+                                 buf_len,
+                                 &offset,
+                                 &length);
+                }
+                break;
+            default: ret = SdIllegal(card); break;
+        }
+
+    *duration = EmuFinish(dev, offset, length);
+    *sense    = ret != 0;
+
+    return ret;
+}
+
+static int32_t SdSendSdhciCommand(void*     device_ctx,
+                                  uint8_t   command,
+                                  uint8_t   write,
+                                  uint8_t   application,
+                                  uint32_t  flags,
+                                  uint32_t  argument,
+                                  uint32_t  block_size,
+                                  uint32_t  blocks,
+                                  char*     buffer,
+                                  uint32_t  buf_len,
+                                  uint32_t  timeout,
+                                  uint32_t* response,
+                                  uint32_t* duration,
+                                  uint32_t* sense)
+{
+    EmuDevice* dev = device_ctx;
+    *duration      = 0;
+    *sense         = 0;
+
+    if(!dev) return -1;
+
+    return SdCommand(dev, command, application, argument, blocks, buffer, buf_len, response, duration, sense);
+}
+
+// Runs the commands in order and stops at the first that fails, like the host does
+static int32_t SdSendMultiSdhciCommand(void*            device_ctx,
+                                       uint64_t         count,
+                                       MmcSingleCommand commands[],
+                                       uint32_t*        duration,
+                                       uint32_t*        sense)
+{
+    EmuDevice* dev = device_ctx;
+    uint64_t   i;
+    uint32_t   command_duration;
+    int32_t    ret = 0;
+    *duration      = 0;
+    *sense         = 0;
+
+    if(!dev) return -1;
+
+    for(i = 0; i < count && ret == 0; i++)
+    {
+        ret = SdCommand(dev,
+                        commands[i].command,
+                        commands[i].application,
+                        commands[i].argument,
+                        commands[i].blocks,
+                        commands[i].buffer,
+                        commands[i].buf_len,
+                        commands[i].response,
+                        &command_duration,
+                        sense);
+        *duration += command_duration;
+    }
+
+    return ret;
+}
+
+const DeviceBackend emu_sd_backend = {SdOpen,
+                                      EmuClose,
+                                      EmuGetDeviceType,
+                                      EmuNoScsiCommand,
+                                      EmuNoScsiDataInBuffer,
+                                      SdGetSdhciRegisters,
+                                      EmuNoUsbData,
+                                      EmuNoFireWireData,
+                                      EmuNoPcmciaData,
+                                      EmuNoAtaChsCommand,
+                                      EmuNoAtaLba28Command,
+                                      EmuNoAtaLba48Command,
+                                      SdSendSdhciCommand,
+                                      SdSendMultiSdhciCommand,
+                                      EmuReOpen,
+                                      EmuOsRead,
+                                      EmuOsSeekData};
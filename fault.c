@@ -0,0 +1,929 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+
+#define FAULT_ERROR 0
+#define FAULT_DELAY 1
+
+#define FAULT_MAX_LINE 256
+#define FAULT_SECTOR 512
+#define FAULT_SENSE_SIZE 18
+
+typedef struct
+{
+    uint8_t  kind;
+    uint64_t first;
+    uint64_t last;
+    uint32_t value;
+} FaultRule;
+
+typedef struct
+{
+    const DeviceBackend* backend;
+    void*                ctx;
+    uint64_t             commands;
+    uint64_t             random;
+} FaultDevice;
+
+static FaultRule*           fault_rules;
+static uint32_t             fault_rule_count;
+static uint64_t             fault_disappear;
+static uint64_t             fault_seed = 1;
+static uint8_t              fault_enabled;
+static const DeviceBackend* fault_target;
+
+static int FaultParseNumber(const char* text, uint64_t* number)
+{
+    char* end;
+
+    if(*text < '0' || *text > '9') return -1;
+
+    errno   = 0;
+    *number = strtoull(text, &end, 10);
+
+    return errno != 0 || *end != 0 ? -1 : 0;
+}
+
+// LBA or first-last, all for every command whether it addresses the medium or not
+static int FaultParseRange(char* text, FaultRule* rule)
+{
+    char* dash;
+
+    if(strcmp(text, "all") == 0)
+    {
+        rule->first = 0;
+        rule->last  = UINT64_MAX;
+        return 0;
+    }
+
+    dash = strchr(text, '-');
+
+    if(dash) *dash = 0;
+
+    if(FaultParseNumber(text, &rule->first)) return -1;
+
+    if(!dash)
+    {
+        rule->last = rule->first;
+        return 0;
+    }
+
+    return FaultParseNumber(dash + 1, &rule->last) || rule->last < rule->first ? -1 : 0;
+}
+
+// One rule per line, # starts a comment:
+//   error RANGE [PERCENT%]   fail commands touching RANGE with a medium error, every time unless a chance is given
+//   delay RANGE MS           hold commands touching RANGE for MS milliseconds more
+//   disappear N              answer the first N commands, then behave as if the device was unplugged
+//   seed N                   start the random sequence deciding which errors happen at N
+static int FaultParseLine(char* line, FaultRule* rule, uint8_t* has_rule)
+{
+    char*    words[4];
+    int      count = 0;
+    char*    word;
+    uint64_t number;
+    size_t   len;
+
+    *has_rule = 0;
+
+    if(strchr(line, '#')) *strchr(line, '#') = 0;
+
+    for(word = strtok(line, " \t\r\n"); word; word = strtok(NULL, " \t\r\n"))
+    {
+        if(count == 4) return -1;
+
+        words[count++] = word;
+    }
+
+    if(count == 0) return 0;
+
+    if(strcmp(words[0], "error") == 0 && (count == 2 || count == 3))
+    {
+        rule->kind  = FAULT_ERROR;
+        rule->value = 100;
+
+        if(FaultParseRange(words[1], rule)) return -1;
+
+        if(count == 3)
+        {
+            len = strlen(words[2]);
+
+            if(len < 2 || words[2][len - 1] != '%') return -1;
+
+            words[2][len - 1] = 0;
+
+            if(FaultParseNumber(words[2], &number) || number > 100) return -1;
+
+            rule->value = (uint32_t)number;
+        }
+
+        *has_rule = 1;
+        return 0;
+    }
+
+    if(strcmp(words[0], "delay") == 0 && count == 3)
+    {
+        rule->kind = FAULT_DELAY;
+
+        if(FaultParseRange(words[1], rule) || FaultParseNumber(words[2], &number) || number > UINT32_MAX) return -1;
+
+        rule->value = (uint32_t)number;
+        *has_rule   = 1;
+        return 0;
+    }
+
+    if(strcmp(words[0], "disappear") == 0 && count == 2)
+        return FaultParseNumber(words[1], &fault_disappear) || fault_disappear == 0 ? -1 : 0;
+
+    if(strcmp(words[0], "seed") == 0 && count == 2)
+        return FaultParseNumber(words[1], &fault_seed) || fault_seed == 0 ? -1 : 0;
+
+    return -1;
+}
+
+int FaultInit()
+{
+    FILE*      file;
+    char       line[FAULT_MAX_LINE];
+    FaultRule  rule;
+    FaultRule* rules;
+    uint8_t    has_rule;
+    uint32_t   line_number = 0;
+
+    if(!server_options.fault_path) return 0;
+
+    file = fopen(server_options.fault_path, "r");
+
+    if(!file)
+    {
+        printf("Error %d opening fault rules %s.\n", errno, server_options.fault_path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), file))
+    {
+        line_number++;
+
+        if(FaultParseLine(line, &rule, &has_rule))
+        {
+            printf("Invalid fault rule in line %u of %s.\n", line_number, server_options.fault_path);
+            fclose(file);
+            return -1;
+        }
+
+        if(!has_rule) continue;
+
+        rules = realloc(fault_rules, sizeof(FaultRule) * (fault_rule_count + 1));
+
+        if(!rules)
+        {
+            printf("Error %d allocating memory for fault rules.\n", errno);
+            fclose(file);
+            return -1;
+        }
+
+        fault_rules                     = rules;
+        fault_rules[fault_rule_count++] = rule;
+    }
+
+    fclose(file);
+
+    printf("Injecting faults from %s, %u rules.\n", server_options.fault_path, fault_rule_count);
+
+    fault_enabled = 1;
+
+    return 0;
+}
+
+static void* FaultOpen(const char* device_path)
+{
+    FaultDevice* dev = malloc(sizeof(FaultDevice));
+
+    if(!dev) return NULL;
+
+    dev->backend  = fault_target;
+    dev->commands = 0;
+    dev->random   = fault_seed;
+    dev->ctx      = dev->backend->open(device_path);
+
+    if(!dev->ctx)
+    {
+        free(dev);
+        return NULL;
+    }
+
+    return dev;
+}
+
+static void FaultClose(void* device_ctx)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev) return;
+
+    dev->backend->close(dev->ctx);
+    free(dev);
+}
+
+// Every command counts towards the device disappearing, queries about it do not
+static uint8_t FaultGone(FaultDevice* dev, uint8_t command)
+{
+    if(command) dev->commands++;
+
+    return fault_disappear && dev->commands > fault_disappear;
+}
+
+static uint8_t FaultChance(FaultDevice* dev, uint32_t percent)
+{
+    dev->random ^= dev->random << 13;
+    dev->random ^= dev->random >> 7;
+    dev->random ^= dev->random << 17;
+
+    return dev->random % 100 < percent;
+}
+
+// Sleeps for the delays matching the command and returns them in milliseconds, bad_lba says where it fails if it does
+static uint32_t FaultApply(FaultDevice* dev,
+                           uint8_t      addressed,
+                           uint64_t     lba,
+                           uint64_t     count,
+                           uint64_t*    bad_lba,
+                           uint8_t*     fail)
+{
+    uint32_t   i;
+    uint32_t   delay = 0;
+    uint64_t   last  = count ? lba + count - 1 : lba;
+    FaultRule* rule;
+
+    *fail = 0;
+
+    for(i = 0; i < fault_rule_count; i++)
+    {
+        rule = &fault_rules[i];
+
+        if(rule->first != 0 || rule->last != UINT64_MAX)
+            if(!addressed || count == 0 || rule->first > last || rule->last < lba) continue;
+
+        if(rule->kind == FAULT_DELAY)
+            delay += rule->value;
+        else if(!*fail && FaultChance(dev, rule->value))
+        {
+            *fail    = 1;
+            *bad_lba = rule->first > lba ? rule->first : lba;
+        }
+    }
+
+    if(delay) SleepMicroseconds((uint64_t)delay * 1000);
+
+    return delay;
+}
+
+static int32_t FaultGetDeviceType(void* device_ctx)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev || FaultGone(dev, 0)) return AARUREMOTE_DEVICE_TYPE_UNKNOWN;
+
+    return dev->backend->get_device_type(dev->ctx);
+}
+
+static uint64_t FaultBe(const uint8_t* data, uint32_t len)
+{
+    uint64_t value = 0;
+
+    while(len--) value = value << 8 | *data++;
+
+    return value;
+}
+
+// Where a command reading, writing or verifying the medium starts and how many blocks it covers
+static uint64_t FaultScsiRange(const uint8_t* cdb, uint32_t cdb_len, uint64_t* lba)
+{
+    if(!cdb || cdb_len < 6) return 0;
+
+    switch(cdb[0])
+    {
+        case 0x08:
+        case 0x0A:
+            *lba = FaultBe(cdb + 1, 3) & 0x1FFFFF;
+            return cdb[4] ? cdb[4] : 256;
+        case 0x28:
+        case 0x2A:
+        case 0x2E:
+        case 0x2F:
+            if(cdb_len < 10) return 0;
+
+            *lba = FaultBe(cdb + 2, 4);
+            return FaultBe(cdb + 7, 2);
+        case 0xA8:
+        case 0xAA:
+        case 0xAF:
+        case 0xBE:
+            if(cdb_len < 12) return 0;
+
+            *lba = FaultBe(cdb + 2, 4);
+            return cdb[0] == 0xBE ? FaultBe(cdb + 6, 3) : FaultBe(cdb + 6, 4);
+        case 0x88:
+        case 0x8A:
+        case 0x8E:
+        case 0x8F:
+            if(cdb_len < 16) return 0;
+
+            *lba = FaultBe(cdb + 2, 8);
+            return FaultBe(cdb + 10, 4);
+        default: return 0;
+    }
+}
+
+static char* FaultGetScsiDataInBuffer(void* device_ctx, uint32_t length)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev || FaultGone(dev, 0)) return NULL;
+
+    return dev->backend->get_scsi_data_in_buffer(dev->ctx, length);
+}
+
+// Unrecovered read error in fixed format sense, with the failing block as information when it fits
+static int32_t FaultScsiCommand(void*     device_ctx,
+                                char*     cdb,
+                                char*     buffer,
+                                char**    sense_buffer,
+                                uint32_t  timeout,
+                                int32_t   direction,
+                                uint32_t* duration,
+                                uint32_t* sense,
+                                uint32_t  cdb_len,
+                                uint32_t* buf_len,
+                                uint32_t* sense_len)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     lba = 0;
+    uint64_t     count;
+    uint64_t     bad_lba;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    uint8_t*     data;
+    *sense_buffer    = NULL;
+    *sense_len       = 0;
+    *duration        = 0;
+    *sense           = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    count = FaultScsiRange((uint8_t*)cdb, cdb_len, &lba);
+    delay = FaultApply(dev, count != 0, lba, count, &bad_lba, &fail);
+
+    if(!fail)
+    {
+        ret = dev->backend->send_scsi_command(
+            dev->ctx, cdb, buffer, sense_buffer, timeout, direction, duration, sense, cdb_len, buf_len, sense_len);
+        *duration += delay;
+        return ret;
+    }
+
+    data = calloc(1, FAULT_SENSE_SIZE);
+
+    if(!data) return ENOMEM;
+
+    data[0]  = bad_lba <= UINT32_MAX ? 0xF0 : 0x70;
+    data[2]  = 0x03;
+    data[7]  = FAULT_SENSE_SIZE - 8;
+    data[12] = 0x11;
+
+    if(bad_lba <= UINT32_MAX)
+    {
+        data[3] = (uint8_t)(bad_lba >> 24);
+        data[4] = (uint8_t)(bad_lba >> 16);
+        data[5] = (uint8_t)(bad_lba >> 8);
+        data[6] = (uint8_t)bad_lba;
+    }
+
+    *sense_buffer = (char*)data;
+    *sense_len    = FAULT_SENSE_SIZE;
+    *duration     = delay;
+    *sense        = 1;
+
+    return 0;
+}
+
+static int32_t FaultGetSdhciRegisters(void*     device_ctx,
+                                      char**    csd,
+                                      char**    cid,
+                                      char**    ocr,
+                                      char**    scr,
+                                      uint32_t* csd_len,
+                                      uint32_t* cid_len,
+                                      uint32_t* ocr_len,
+                                      uint32_t* scr_len)
+{
+    FaultDevice* dev = device_ctx;
+    *csd             = NULL;
+    *cid             = NULL;
+    *ocr             = NULL;
+    *scr             = NULL;
+    *csd_len         = 0;
+    *cid_len         = 0;
+    *ocr_len         = 0;
+    *scr_len         = 0;
+
+    if(!dev || FaultGone(dev, 0)) return 0;
+
+    return dev->backend->get_sdhci_registers(dev->ctx, csd, cid, ocr, scr, csd_len, cid_len, ocr_len, scr_len);
+}
+
+static uint8_t FaultGetUsbData(void*     device_ctx,
+                               uint16_t* desc_len,
+                               char*     descriptors,
+                               uint16_t* id_vendor,
+                               uint16_t* id_product,
+                               char*     manufacturer,
+                               char*     product,
+                               char*     serial)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev || FaultGone(dev, 0)) return 0;
+
+    return dev->backend->get_usb_data(
+        dev->ctx, desc_len, descriptors, id_vendor, id_product, manufacturer, product, serial);
+}
+
+static uint8_t FaultGetFireWireData(void*     device_ctx,
+                                    uint32_t* id_model,
+                                    uint32_t* id_vendor,
+                                    uint64_t* guid,
+                                    char*     vendor,
+                                    char*     model)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev || FaultGone(dev, 0)) return 0;
+
+    return dev->backend->get_firewire_data(dev->ctx, id_model, id_vendor, guid, vendor, model);
+}
+
+static uint8_t FaultGetPcmciaData(void* device_ctx, uint16_t* cis_len, char* cis)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev || FaultGone(dev, 0)) return 0;
+
+    return dev->backend->get_pcmcia_data(dev->ctx, cis_len, cis);
+}
+
+// Commands moving sectors, the rest have no address to match
+static uint8_t FaultAtaMedia(uint8_t command)
+{
+    switch(command)
+    {
+        case 0x20:
+        case 0x21:
+        case 0x24:
+        case 0x25:
+        case 0x29:
+        case 0x30:
+        case 0x31:
+        case 0x34:
+        case 0x35:
+        case 0x39:
+        case 0x40:
+        case 0x41:
+        case 0x42:
+        case 0xC4:
+        case 0xC5:
+        case 0xC8:
+        case 0xC9:
+        case 0xCA:
+        case 0xCB: return 1;
+        default: return 0;
+    }
+}
+
+// Only CHS commands with the LBA bit set have an address, geometry is up to the device otherwise
+static int32_t FaultAtaChsCommand(void*                 device_ctx,
+                                  AtaRegistersChs       registers,
+                                  AtaErrorRegistersChs* error_registers,
+                                  uint8_t               protocol,
+                                  uint8_t               transfer_register,
+                                  char*                 buffer,
+                                  uint32_t              timeout,
+                                  uint8_t               transfer_blocks,
+                                  uint32_t*             duration,
+                                  uint32_t*             sense,
+                                  uint32_t*             buf_len)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     lba;
+    uint64_t     bad_lba;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    *duration        = 0;
+    *sense           = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    lba = (uint64_t)(registers.device_head & 0x0F) << 24 | (uint32_t)registers.cylinder_high << 16 |
+          (uint32_t)registers.cylinder_low << 8 | registers.sector;
+    delay = FaultApply(dev,
+                       (registers.device_head & 0x40) && FaultAtaMedia(registers.command),
+                       lba,
+                       registers.sector_count ? registers.sector_count : 256,
+                       &bad_lba,
+                       &fail);
+
+    if(!fail)
+    {
+        ret = dev->backend->send_ata_chs_command(dev->ctx,
+                                                 registers,
+                                                 error_registers,
+                                                 protocol,
+                                                 transfer_register,
+                                                 buffer,
+                                                 timeout,
+                                                 transfer_blocks,
+                                                 duration,
+                                                 sense,
+                                                 buf_len);
+        *duration += delay;
+        return ret;
+    }
+
+    memset(error_registers, 0, sizeof(AtaErrorRegistersChs));
+    error_registers->status        = 0x51;
+    error_registers->error         = 0x40;
+    error_registers->sector        = (uint8_t)bad_lba;
+    error_registers->cylinder_low  = (uint8_t)(bad_lba >> 8);
+    error_registers->cylinder_high = (uint8_t)(bad_lba >> 16);
+    error_registers->device_head   = (uint8_t)((registers.device_head & 0xF0) | (bad_lba >> 24 & 0x0F));
+    *duration                      = delay;
+    *sense                         = 1;
+
+    return 0;
+}
+
+static int32_t FaultAtaLba28Command(void*                   device_ctx,
+                                    AtaRegistersLba28       registers,
+                                    AtaErrorRegistersLba28* error_registers,
+                                    uint8_t                 protocol,
+                                    uint8_t                 transfer_register,
+                                    char*                   buffer,
+                                    uint32_t                timeout,
+                                    uint8_t                 transfer_blocks,
+                                    uint32_t*               duration,
+                                    uint32_t*               sense,
+                                    uint32_t*               buf_len)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     lba;
+    uint64_t     bad_lba;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    *duration        = 0;
+    *sense           = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    lba = (uint64_t)(registers.device_head & 0x0F) << 24 | (uint32_t)registers.lba_high << 16 |
+          (uint32_t)registers.lba_mid << 8 | registers.lba_low;
+    delay = FaultApply(dev,
+                       FaultAtaMedia(registers.command),
+                       lba,
+                       registers.sector_count ? registers.sector_count : 256,
+                       &bad_lba,
+                       &fail);
+
+    if(!fail)
+    {
+        ret = dev->backend->send_ata_lba28_command(dev->ctx,
+                                                   registers,
+                                                   error_registers,
+                                                   protocol,
+                                                   transfer_register,
+                                                   buffer,
+                                                   timeout,
+                                                   transfer_blocks,
+                                                   duration,
+                                                   sense,
+                                                   buf_len);
+        *duration += delay;
+        return ret;
+    }
+
+    memset(error_registers, 0, sizeof(AtaErrorRegistersLba28));
+    error_registers->status      = 0x51;
+    error_registers->error       = 0x40;
+    error_registers->lba_low     = (uint8_t)bad_lba;
+    error_registers->lba_mid     = (uint8_t)(bad_lba >> 8);
+    error_registers->lba_high    = (uint8_t)(bad_lba >> 16);
+    error_registers->device_head = (uint8_t)((registers.device_head & 0xF0) | (bad_lba >> 24 & 0x0F));
+    *duration                    = delay;
+    *sense                       = 1;
+
+    return 0;
+}
+
+static int32_t FaultAtaLba48Command(void*                   device_ctx,
+                                    AtaRegistersLba48       registers,
+                                    AtaErrorRegistersLba48* error_registers,
+                                    uint8_t                 protocol,
+                                    uint8_t                 transfer_register,
+                                    char*                   buffer,
+                                    uint32_t                timeout,
+                                    uint8_t                 transfer_blocks,
+                                    uint32_t*               duration,
+                                    uint32_t*               sense,
+                                    uint32_t*               buf_len)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     lba;
+    uint64_t     bad_lba;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    *duration        = 0;
+    *sense           = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    lba = (uint64_t)registers.lba_high_prev << 40 | (uint64_t)registers.lba_mid_prev << 32 |
+          (uint64_t)registers.lba_low_prev << 24 | (uint32_t)registers.lba_high_cur << 16 |
+          (uint32_t)registers.lba_mid_cur << 8 | registers.lba_low_cur;
+    delay = FaultApply(dev,
+                       FaultAtaMedia(registers.command),
+                       lba,
+                       registers.sector_count ? registers.sector_count : 65536,
+                       &bad_lba,
+                       &fail);
+
+    if(!fail)
+    {
+        ret = dev->backend->send_ata_lba48_command(dev->ctx,
+                                                   registers,
+                                                   error_registers,
+                                                   protocol,
+                                                   transfer_register,
+                                                   buffer,
+                                                   timeout,
+                                                   transfer_blocks,
+                                                   duration,
+                                                   sense,
+                                                   buf_len);
+        *duration += delay;
+        return ret;
+    }
+
+    memset(error_registers, 0, sizeof(AtaErrorRegistersLba48));
+    error_registers->status        = 0x51;
+    error_registers->error         = 0x40;
+    error_registers->lba_low_cur   = (uint8_t)bad_lba;
+    error_registers->lba_mid_cur   = (uint8_t)(bad_lba >> 8);
+    error_registers->lba_high_cur  = (uint8_t)(bad_lba >> 16);
+    error_registers->lba_low_prev  = (uint8_t)(bad_lba >> 24);
+    error_registers->lba_mid_prev  = (uint8_t)(bad_lba >> 32);
+    error_registers->lba_high_prev = (uint8_t)(bad_lba >> 40);
+    error_registers->device_head   = registers.device_head;
+    *duration                      = delay;
+    *sense                         = 1;
+
+    return 0;
+}
+
+// Block reads and writes, with the argument taken as a block number as high capacity cards use it
+static uint8_t FaultSdhciMedia(uint8_t command, uint32_t blocks, uint64_t* count)
+{
+    switch(command)
+    {
+        case 17:
+        case 24: *count = 1; return 1;
+        case 18:
+        case 25: *count = blocks; return 1;
+        default: *count = 0; return 0;
+    }
+}
+
+static int32_t FaultSdhciCommand(void*     device_ctx,
+                                 uint8_t   command,
+                                 uint8_t   write,
+                                 uint8_t   application,
+                                 uint32_t  flags,
+                                 uint32_t  argument,
+                                 uint32_t  block_size,
+                                 uint32_t  blocks,
+                                 char*     buffer,
+                                 uint32_t  buf_len,
+                                 uint32_t  timeout,
+                                 uint32_t* response,
+                                 uint32_t* duration,
+                                 uint32_t* sense)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     count;
+    uint64_t     bad_lba;
+    uint8_t      media;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    *duration        = 0;
+    *sense           = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    // Application commands share numbers with the media ones, they never address blocks
+    media = FaultSdhciMedia(command, blocks, &count);
+    delay = FaultApply(dev, !application && media, argument, count, &bad_lba, &fail);
+
+    if(!fail)
+    {
+        ret = dev->backend->send_sdhci_command(dev->ctx,
+                                               command,
+                                               write,
+                                               application,
+                                               flags,
+                                               argument,
+                                               block_size,
+                                               blocks,
+                                               buffer,
+                                               buf_len,
+                                               timeout,
+                                               response,
+                                               duration,
+                                               sense);
+        *duration += delay;
+        return ret;
+    }
+
+    *duration = delay;
+    *sense    = 1;
+
+    return EIO;
+}
+
+// The whole sequence fails if any of its commands would
+static int32_t FaultMultiSdhciCommand(void*            device_ctx,
+                                      uint64_t         count,
+                                      MmcSingleCommand commands[],
+                                      uint32_t*        duration,
+                                      uint32_t*        sense)
+{
+    FaultDevice* dev   = device_ctx;
+    uint32_t     delay = 0;
+    uint64_t     blocks;
+    uint64_t     bad_lba;
+    uint8_t      media;
+    uint8_t      fail = 0;
+    uint64_t     i;
+    int32_t      ret;
+    *duration         = 0;
+    *sense            = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    for(i = 0; i < count && !fail; i++)
+    {
+        media = FaultSdhciMedia(commands[i].command, commands[i].blocks, &blocks);
+        delay += FaultApply(dev, !commands[i].application && media, commands[i].argument, blocks, &bad_lba, &fail);
+    }
+
+    if(!fail)
+    {
+        ret = dev->backend->send_multi_sdhci_command(dev->ctx, count, commands, duration, sense);
+        *duration += delay;
+        return ret;
+    }
+
+    *duration = delay;
+    *sense    = 1;
+
+    return EIO;
+}
+
+static int32_t FaultReOpen(void* device_ctx, uint32_t* closeFailed)
+{
+    FaultDevice* dev = device_ctx;
+    *closeFailed     = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    return dev->backend->reopen(dev->ctx, closeFailed);
+}
+
+// Offsets are matched as 512 byte sectors
+static int32_t FaultOsRead(void*     device_ctx,
+                           char*     buffer,
+                           uint64_t  offset,
+                           uint32_t  length,
+                           uint32_t* read_length,
+                           uint32_t* duration)
+{
+    FaultDevice* dev = device_ctx;
+    uint64_t     first = offset / FAULT_SECTOR;
+    uint64_t     bad_lba;
+    uint8_t      fail;
+    uint32_t     delay;
+    int32_t      ret;
+    *read_length     = 0;
+    *duration        = 0;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 1)) return ENODEV;
+
+    delay = FaultApply(dev,
+                       length != 0,
+                       first,
+                       (offset + length + FAULT_SECTOR - 1) / FAULT_SECTOR - first,
+                       &bad_lba,
+                       &fail);
+
+    if(fail)
+    {
+        *duration = delay;
+        return EIO;
+    }
+
+    ret = dev->backend->os_read(dev->ctx, buffer, offset, length, read_length, duration);
+    *duration += delay;
+
+    return ret;
+}
+
+static int32_t FaultOsSeekData(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole)
+{
+    FaultDevice* dev = device_ctx;
+
+    if(!dev) return -1;
+
+    if(FaultGone(dev, 0)) return ENODEV;
+
+    return dev->backend->os_seek_data(dev->ctx, offset, data, hole);
+}
+
+const DeviceBackend fault_backend = {FaultOpen,
+                                     FaultClose,
+                                     FaultGetDeviceType,
+                                     FaultScsiCommand,
+                                     FaultGetScsiDataInBuffer,
+                                     FaultGetSdhciRegisters,
+                                     FaultGetUsbData,
+                                     FaultGetFireWireData,
+                                     FaultGetPcmciaData,
+                                     FaultAtaChsCommand,
+                                     FaultAtaLba28Command,
+                                     FaultAtaLba48Command,
+                                     FaultSdhciCommand,
+                                     FaultMultiSdhciCommand,
+                                     FaultReOpen,
+                                     FaultOsRead,
+                                     FaultOsSeekData};
+
+// Only one device is open at a time, the wrapper takes over whatever backend the path asked for
+const DeviceBackend* FaultWrap(const DeviceBackend* backend)
+{
+    if(!fault_enabled) return backend;
+
+    fault_target = backend;
+
+    return &fault_backend;
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../aaruremote.h"
@@ -126,22 +127,48 @@ int32_t ReOpen(void *device_ctx, uint32_t *closeFailed)
     return ctx->device == 0 ? errno : 0;
 }
 
-int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *duration)
+int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length,
+               uint32_t *duration)
 {
-    DeviceContext *ctx = device_ctx;
-    ssize_t        ret;
-    *duration = 0;
-    off_t pos;
+    DeviceContext  *ctx = device_ctx;
+    ssize_t         ret;
+    int32_t         error = 0;
+    struct timespec start_tp;
+    struct timespec end_tp;
+    int             clock_error;
+    *duration    = 0;
+    *read_length = 0;
 
     if(!ctx) return -1;
 
-    // TODO: Timing
-    pos = lseek(ctx->device.fd, (off_t)offset, SEEK_SET);
+    clock_error = clock_gettime(CLOCK_MONOTONIC, &start_tp);
+
+    // Loop until the whole length is in or the end of the device is reached
+    while(*read_length < length)
+    {
+        ret = pread(
+            ctx->device->fd, buffer + *read_length, length - *read_length, (off_t)(offset + *read_length));
+
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+
+            error = errno;
+            break;
+        }
 
-    if(pos < 0) return errno;
+        if(ret == 0) break;
 
-    // TODO: Timing
-    ret = read(ctx->device.fd, (void *)buffer, (size_t)length);
+        *read_length += (uint32_t)ret;
+    }
+
+    if(!clock_error) clock_error = clock_gettime(CLOCK_MONOTONIC, &end_tp);
+
+    if(!clock_error)
+        *duration = (uint32_t)((end_tp.tv_sec - start_tp.tv_sec) * 1000 + (end_tp.tv_nsec - start_tp.tv_nsec) / 1000000);
+
+    return error;
+}
 
-    return ret < 0 ? errno : 0;
-}
\ No newline at end of file
+// CAM pass through devices cannot tell holes apart, they are read instead
+int32_t OsSeekData(void *device_ctx, uint64_t offset, uint64_t *data, uint64_t *hole) { return EINVAL; }
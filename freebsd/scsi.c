@@ -137,4 +137,6 @@ int32_t SendScsiCommand(void *device_ctx, char *cdb, char *buffer, char **sense_
     *buf_len = camccb->csio.dxfer_len;
 
     return error;
-}
\ No newline at end of file
+}
+
+char *GetScsiDataInBuffer(void *device_ctx, uint32_t length) { return NULL; }
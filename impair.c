@@ -0,0 +1,284 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+
+// Writes smaller than a TCP segment are the ones a sender holds back to coalesce
+#define IMPAIR_SEGMENT 1448
+// Bytes in flight are bounded like a TCP window, at least this much and at most what the link carries in a round trip
+#define IMPAIR_MIN_QUEUE (64 * 1024)
+#define IMPAIR_MAX_QUEUE (16 * 1024 * 1024)
+
+struct ImpairChunk
+{
+    struct ImpairChunk* next;
+    uint64_t            due;
+    uint32_t            len;
+    uint8_t             open;
+    char                data[1];
+};
+
+typedef struct ImpairChunk ImpairChunk;
+
+uint8_t ImpairEnabled()
+{
+    return server_options.net_delay || server_options.net_jitter || server_options.net_rate ||
+           server_options.net_coalesce;
+}
+
+Impairment* ImpairNew()
+{
+    Impairment* impair;
+
+    if(!ImpairEnabled()) return NULL;
+
+    impair = malloc(sizeof(Impairment));
+
+    if(!impair) return NULL;
+
+    memset(impair, 0, sizeof(Impairment));
+    impair->random = 1;
+
+    return impair;
+}
+
+void ImpairFree(Impairment* impair)
+{
+    ImpairChunk* chunk;
+
+    if(!impair) return;
+
+    while(impair->head)
+    {
+        chunk        = impair->head;
+        impair->head = chunk->next;
+        free(chunk);
+    }
+
+    free(impair);
+}
+
+static uint64_t ImpairTransmitTime(uint64_t len)
+{
+    return server_options.net_rate ? len * 1000000 / ((uint64_t)server_options.net_rate * 1024) : 0;
+}
+
+// Puts the chunk on the wire after whatever went before it, then lets it cross the link. The delay each way is paid
+// here, the client cannot tell a late request from a late reply, and replies never overtake each other
+static void ImpairSchedule(Impairment* impair, ImpairChunk* chunk, uint64_t now)
+{
+    uint64_t jitter = 0;
+
+    if(impair->out_free < now) impair->out_free = now;
+
+    impair->out_free += ImpairTransmitTime(chunk->len);
+
+    if(server_options.net_jitter)
+    {
+        impair->random ^= impair->random << 13;
+        impair->random ^= impair->random >> 7;
+        impair->random ^= impair->random << 17;
+        jitter = impair->random % ((uint64_t)server_options.net_jitter * 1000 + 1);
+    }
+
+    chunk->due  = impair->out_free + (uint64_t)server_options.net_delay * 2000 + jitter;
+    chunk->open = 0;
+
+    if(chunk->due < impair->last_due) chunk->due = impair->last_due;
+
+    impair->last_due = chunk->due;
+}
+
+static ImpairChunk* ImpairAppend(Impairment* impair, uint32_t size)
+{
+    ImpairChunk* chunk = malloc(sizeof(ImpairChunk) + size);
+
+    if(!chunk) return NULL;
+
+    chunk->next = NULL;
+    chunk->len  = 0;
+    chunk->open = 0;
+
+    if(impair->tail)
+        impair->tail->next = chunk;
+    else
+        impair->head = chunk;
+
+    impair->tail = chunk;
+
+    return chunk;
+}
+
+// Bandwidth delay product of the link, a sender blocks once that much is on its way
+static uint64_t ImpairLimit()
+{
+    uint64_t limit = IMPAIR_MAX_QUEUE;
+
+    if(server_options.net_rate)
+        limit = (uint64_t)server_options.net_rate * 1024 *
+                ((uint64_t)server_options.net_delay * 2 + server_options.net_jitter) / 1000;
+
+    if(limit < IMPAIR_MIN_QUEUE) limit = IMPAIR_MIN_QUEUE;
+
+    return limit > IMPAIR_MAX_QUEUE ? IMPAIR_MAX_QUEUE : limit;
+}
+
+// How much more can be written before the sender has to wait for the link
+uint64_t ImpairRoom(Impairment* impair)
+{
+    uint64_t limit = ImpairLimit();
+
+    return impair->queued < limit ? limit - impair->queued : 0;
+}
+
+// Copies what is written from offset on, as much as there is room for. Small writes go together until they fill a
+// segment or have waited net_coalesce. Returns how much was taken, the caller waits for room to write the rest.
+int32_t ImpairQueue(Impairment* impair, const NetBuffer* buffers, int32_t count, uint32_t offset)
+{
+    uint64_t     now  = GetMonotonicMicroseconds();
+    uint64_t     room = ImpairRoom(impair);
+    uint32_t     size = 0;
+    uint32_t     skip = offset;
+    uint32_t     take;
+    uint32_t     piece;
+    int32_t      i;
+    ImpairChunk* chunk = impair->tail;
+
+    for(i = 0; i < count; i++) size += buffers[i].len;
+
+    size -= offset;
+
+    if(size > room) size = (uint32_t)room;
+
+    if(size == 0) return 0;
+
+    if(chunk && chunk->open && (size >= IMPAIR_SEGMENT || chunk->len + size > IMPAIR_SEGMENT))
+        ImpairSchedule(impair, chunk, now);
+
+    if(!chunk || !chunk->open)
+    {
+        chunk = ImpairAppend(impair, size < IMPAIR_SEGMENT && server_options.net_coalesce ? IMPAIR_SEGMENT : size);
+
+        if(!chunk) return -1;
+
+        if(size < IMPAIR_SEGMENT && server_options.net_coalesce)
+        {
+            chunk->open = 1;
+            chunk->due  = now + (uint64_t)server_options.net_coalesce * 1000;
+        }
+    }
+
+    impair->queued += size;
+    take = size;
+
+    for(i = 0; i < count && take > 0; i++)
+    {
+        if(skip >= buffers[i].len)
+        {
+            skip -= buffers[i].len;
+            continue;
+        }
+
+        piece = buffers[i].len - skip < take ? buffers[i].len - skip : take;
+        memcpy(chunk->data + chunk->len, (const char*)buffers[i].data + skip, piece);
+        chunk->len += piece;
+        take -= piece;
+        skip = 0;
+    }
+
+    if(!chunk->open || chunk->len == IMPAIR_SEGMENT) ImpairSchedule(impair, chunk, now);
+
+    return (int32_t)size;
+}
+
+// What has arrived at the client by now, wait says in how many microseconds the next chunk will, if any is left
+int32_t ImpairDue(Impairment* impair, NetBuffer* buffers, int32_t max, uint64_t* wait)
+{
+    uint64_t     now   = GetMonotonicMicroseconds();
+    ImpairChunk* chunk = impair->head;
+    int32_t      count = 0;
+
+    *wait = IMPAIR_IDLE;
+
+    // Coalescing ends when the hold does, the chunk then goes out like any other
+    if(impair->tail && impair->tail->open && impair->tail->due <= now)
+        ImpairSchedule(impair, impair->tail, impair->tail->due);
+
+    while(chunk && count < max)
+    {
+        if(chunk->due > now)
+        {
+            *wait = chunk->due - now;
+            break;
+        }
+
+        buffers[count].data = chunk->data;
+        buffers[count].len  = chunk->len;
+        count++;
+        chunk = chunk->next;
+    }
+
+    return count;
+}
+
+// Drops chunks once written, the first one may have gone only in part
+void ImpairSent(Impairment* impair, uint32_t len)
+{
+    ImpairChunk* chunk;
+
+    impair->queued -= len;
+
+    while(impair->head && len >= impair->head->len)
+    {
+        chunk        = impair->head;
+        impair->head = chunk->next;
+        len -= chunk->len;
+        free(chunk);
+    }
+
+    if(!impair->head)
+    {
+        impair->tail = NULL;
+        return;
+    }
+
+    if(len == 0) return;
+
+    memmove(impair->head->data, impair->head->data + len, impair->head->len - len);
+    impair->head->len -= len;
+}
+
+// How long to hold data just read so it does not come in faster than the link carries it
+uint64_t ImpairReceived(Impairment* impair, int32_t len)
+{
+    uint64_t now = GetMonotonicMicroseconds();
+
+    if(len <= 0 || !server_options.net_rate) return 0;
+
+    if(impair->in_free < now) impair->in_free = now;
+
+    impair->in_free += ImpairTransmitTime((uint64_t)len);
+
+    return impair->in_free - now;
+}
@@ -20,6 +20,11 @@
 #include "../aaruremote.h"
 #include "linux.h"
 
+// Addressing modes of the cached ATA PASS-THROUGH(16) CDB
+#define ATA_CDB_CHS 0
+#define ATA_CDB_LBA28 1
+#define ATA_CDB_LBA48 2
+
 int32_t AtaProtocolToScsiDirection(uint8_t protocol)
 {
     switch(protocol)
@@ -42,23 +47,22 @@ int32_t AtaProtocolToScsiDirection(uint8_t protocol)
     }
 }
 
-int32_t SendAtaChsCommand(void *device_ctx, AtaRegistersChs registers, AtaErrorRegistersChs *error_registers,
-                          uint8_t protocol, uint8_t transfer_register, char *buffer, uint32_t timeout,
-                          uint8_t transfer_blocks, uint32_t *duration, uint32_t *sense, uint32_t *buf_len)
+// Returns the session CDB with opcode, protocol and transfer bytes in place, registers are patched in by the caller
+static unsigned char *AtaCdb(DeviceContext *ctx, uint8_t mode, uint8_t protocol, uint8_t transfer_register,
+                             uint8_t transfer_blocks)
 {
-    *duration = 0;
-    *sense    = 0;
-    unsigned char  cdb[16];
-    char          *sense_buf;
-    uint32_t       sense_len;
-    DeviceContext *ctx = device_ctx;
+    AtaCdbTemplate *tmpl = &ctx->ata_cdb;
+    unsigned char  *cdb  = tmpl->cdb;
 
-    if(!ctx) return -1;
+    if(tmpl->valid && tmpl->extend == mode && tmpl->protocol == protocol &&
+       tmpl->transfer_register == transfer_register && tmpl->transfer_blocks == transfer_blocks)
+        return cdb;
 
-    memset(&cdb, 0, 16);
+    memset(cdb, 0, 16);
 
     cdb[0] = 0x85;
     cdb[1] = (protocol << 1) & 0x1E;
+    if(mode == ATA_CDB_LBA48) cdb[1] |= 0x01;
     if(transfer_register != AARUREMOTE_ATA_TRANSFER_REGISTER_NONE && protocol != AARUREMOTE_ATA_PROTOCOL_NO_DATA)
     {
         switch(protocol)
@@ -77,6 +81,33 @@ int32_t SendAtaChsCommand(void *device_ctx, AtaRegistersChs registers, AtaErrorR
         cdb[2] |= (transfer_register & 0x03);
     }
 
+    if(mode != ATA_CDB_CHS) cdb[2] |= 0x20;
+
+    tmpl->valid             = 1;
+    tmpl->extend            = mode;
+    tmpl->protocol          = protocol;
+    tmpl->transfer_register = transfer_register;
+    tmpl->transfer_blocks   = transfer_blocks;
+
+    return cdb;
+}
+
+int32_t SendAtaChsCommand(void *device_ctx, AtaRegistersChs registers, AtaErrorRegistersChs *error_registers,
+                          uint8_t protocol, uint8_t transfer_register, char *buffer, uint32_t timeout,
+                          uint8_t transfer_blocks, uint32_t *duration, uint32_t *sense, uint32_t *buf_len)
+{
+    *duration = 0;
+    *sense    = 0;
+    unsigned char *cdb;
+    unsigned char *sense_buf;
+    uint32_t       sense_len = ATA_SENSE_SIZE;
+    int32_t        error;
+    DeviceContext *ctx = device_ctx;
+
+    if(!ctx) return -1;
+
+    cdb = AtaCdb(ctx, ATA_CDB_CHS, protocol, transfer_register, transfer_blocks);
+
     cdb[4]  = registers.feature;
     cdb[6]  = registers.sector_count;
     cdb[8]  = registers.sector;
@@ -85,8 +116,10 @@ int32_t SendAtaChsCommand(void *device_ctx, AtaRegistersChs registers, AtaErrorR
     cdb[13] = registers.device_head;
     cdb[14] = registers.command;
 
-    int error = SendScsiCommand(ctx, (char *)cdb, buffer, &sense_buf, timeout, AtaProtocolToScsiDirection(protocol),
-                                duration, sense, 16, buf_len, &sense_len);
+    // Sense goes to the buffer in the device context, ATA commands never allocate
+    sense_buf = ctx->ata_sense;
+    error     = ScsiExecute(ctx, (char *)cdb, 16, buffer, buf_len, AtaProtocolToScsiDirection(protocol), timeout,
+                            sense_buf, &sense_len, duration, sense);
 
     if(sense_len < 22 || (sense_buf[8] != 0x09 && sense_buf[9] != 0x0C)) return error;
 
@@ -110,36 +143,15 @@ int32_t SendAtaLba28Command(void *device_ctx, AtaRegistersLba28 registers, AtaEr
 {
     *duration = 0;
     *sense    = 0;
-    unsigned char  cdb[16];
-    char          *sense_buf;
-    uint32_t       sense_len;
+    unsigned char *cdb;
+    unsigned char *sense_buf;
+    uint32_t       sense_len = ATA_SENSE_SIZE;
+    int32_t        error;
     DeviceContext *ctx = device_ctx;
 
     if(!ctx) return -1;
 
-    memset(&cdb, 0, 16);
-
-    cdb[0] = 0x85;
-    cdb[1] = (protocol << 1) & 0x1E;
-    if(transfer_register != AARUREMOTE_ATA_TRANSFER_REGISTER_NONE && protocol != AARUREMOTE_ATA_PROTOCOL_NO_DATA)
-    {
-        switch(protocol)
-        {
-            case AARUREMOTE_ATA_PROTOCOL_PIO_IN:
-            case AARUREMOTE_ATA_PROTOCOL_UDMA_IN:
-                cdb[2] = 0x08;
-                break;
-            default:
-                cdb[2] = 0x00;
-                break;
-        }
-
-        if(transfer_blocks) cdb[2] |= 0x04;
-
-        cdb[2] |= (transfer_register & 0x03);
-    }
-
-    cdb[2] |= 0x20;
+    cdb = AtaCdb(ctx, ATA_CDB_LBA28, protocol, transfer_register, transfer_blocks);
 
     cdb[4]  = registers.feature;
     cdb[6]  = registers.sector_count;
@@ -149,8 +161,10 @@ int32_t SendAtaLba28Command(void *device_ctx, AtaRegistersLba28 registers, AtaEr
     cdb[13] = registers.device_head;
     cdb[14] = registers.command;
 
-    int error = SendScsiCommand(ctx, (char *)cdb, buffer, &sense_buf, timeout, AtaProtocolToScsiDirection(protocol),
-                                duration, sense, 16, buf_len, &sense_len);
+    // Sense goes to the buffer in the device context, ATA commands never allocate
+    sense_buf = ctx->ata_sense;
+    error     = ScsiExecute(ctx, (char *)cdb, 16, buffer, buf_len, AtaProtocolToScsiDirection(protocol), timeout,
+                            sense_buf, &sense_len, duration, sense);
 
     if(sense_len < 22 || (sense_buf[8] != 0x09 && sense_buf[9] != 0x0C)) return error;
 
@@ -174,37 +188,15 @@ int32_t SendAtaLba48Command(void *device_ctx, AtaRegistersLba48 registers, AtaEr
 {
     *duration = 0;
     *sense    = 0;
-    unsigned char  cdb[16];
-    char          *sense_buf;
-    uint32_t       sense_len;
+    unsigned char *cdb;
+    unsigned char *sense_buf;
+    uint32_t       sense_len = ATA_SENSE_SIZE;
+    int32_t        error;
     DeviceContext *ctx = device_ctx;
 
     if(!ctx) return -1;
 
-    memset(&cdb, 0, 16);
-
-    cdb[0] = 0x85;
-    cdb[1] = (protocol << 1) & 0x1E;
-    cdb[1] |= 0x01;
-    if(transfer_register != AARUREMOTE_ATA_TRANSFER_REGISTER_NONE && protocol != AARUREMOTE_ATA_PROTOCOL_NO_DATA)
-    {
-        switch(protocol)
-        {
-            case AARUREMOTE_ATA_PROTOCOL_PIO_IN:
-            case AARUREMOTE_ATA_PROTOCOL_UDMA_IN:
-                cdb[2] = 0x08;
-                break;
-            default:
-                cdb[2] = 0x00;
-                break;
-        }
-
-        if(transfer_blocks) cdb[2] |= 0x04;
-
-        cdb[2] |= (transfer_register & 0x03);
-    }
-
-    cdb[2] |= 0x20;
+    cdb = AtaCdb(ctx, ATA_CDB_LBA48, protocol, transfer_register, transfer_blocks);
 
     cdb[3]  = ((registers.feature & 0xFF00) >> 8);
     cdb[4]  = (registers.feature & 0xFF);
@@ -219,8 +211,10 @@ int32_t SendAtaLba48Command(void *device_ctx, AtaRegistersLba48 registers, AtaEr
     cdb[13] = registers.device_head;
     cdb[14] = registers.command;
 
-    int error = SendScsiCommand(ctx, (char *)cdb, buffer, &sense_buf, timeout, AtaProtocolToScsiDirection(protocol),
-                                duration, sense, 16, buf_len, &sense_len);
+    // Sense goes to the buffer in the device context, ATA commands never allocate
+    sense_buf = ctx->ata_sense;
+    error     = ScsiExecute(ctx, (char *)cdb, 16, buffer, buf_len, AtaProtocolToScsiDirection(protocol), timeout,
+                            sense_buf, &sense_len, duration, sense);
 
     if(sense_len < 22 || (sense_buf[8] != 0x09 && sense_buf[9] != 0x0C)) return error;
 
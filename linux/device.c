@@ -15,6 +15,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -65,6 +69,9 @@ void *DeviceOpen(const char *device_path)
 
     free(real_device_path);
 
+    SgOpen(ctx);
+    DirectOpen(ctx);
+
     return ctx;
 }
 
@@ -74,6 +81,9 @@ void DeviceClose(void *device_ctx)
 
     if(!ctx) return;
 
+    UringClose(ctx);
+    DirectClose(ctx);
+    SgClose(ctx);
     close(ctx->fd);
 
     free(ctx);
@@ -360,6 +370,10 @@ int32_t ReOpen(void *device_ctx, uint32_t *closeFailed)
 
     if(!ctx) return -1;
 
+    // Registered file goes stale with the descriptor, the ring is set up again on next read
+    UringClose(ctx);
+    DirectClose(ctx);
+
     ret = close(ctx->fd);
 
     if(ret < 0)
@@ -372,25 +386,103 @@ int32_t ReOpen(void *device_ctx, uint32_t *closeFailed)
 
     if((ctx->fd < 0) && (errno == EACCES || errno == EROFS)) ctx->fd = open(ctx->device_path, O_RDONLY | O_NONBLOCK);
 
-    return ctx->fd <= 0 ? errno : 0;
+    if(ctx->fd <= 0) return errno;
+
+    DirectOpen(ctx);
+
+    return 0;
 }
 
-int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *duration)
+// Reads until the whole length is in or the end of the device is reached
+static int32_t PlainRead(int fd, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length)
+{
+    ssize_t ret;
+
+    *read_length = 0;
+
+    while(*read_length < length)
+    {
+        ret = pread(fd, buffer + *read_length, length - *read_length, (off_t)(offset + *read_length));
+
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+
+            return errno;
+        }
+
+        if(ret == 0) break;
+
+        *read_length += (uint32_t)ret;
+    }
+
+    return 0;
+}
+
+int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length,
+               uint32_t *duration)
 {
     DeviceContext *ctx = device_ctx;
-    ssize_t        ret;
-    *duration = 0;
-    off_t pos;
+    int32_t        ret = -1;
+    uint64_t       start;
+    *duration    = 0;
+    *read_length = 0;
 
     if(!ctx) return -1;
 
-    // TODO: Timing
-    pos = lseek(ctx->fd, (off_t)offset, SEEK_SET);
+    start = GetMonotonicMicroseconds();
+
+    if(UringOpen(ctx) == 0) ret = UringRead(ctx, buffer, offset, length, read_length);
+
+    // Ring gets dropped if the kernel refused it, then the other paths are used
+    if(!ctx->uring)
+    {
+        if(ctx->direct_fd >= 0)
+            ret = DirectRead(ctx, buffer, offset, length, read_length);
+        else
+            ret = PlainRead(ctx->fd, buffer, offset, length, read_length);
+    }
+
+    *duration = (uint32_t)((GetMonotonicMicroseconds() - start) / 1000);
+
+    return ret;
+}
+
+// Sparse files tell where their holes are, block devices are all data up to their end
+int32_t OsSeekData(void *device_ctx, uint64_t offset, uint64_t *data, uint64_t *hole)
+{
+#ifdef SEEK_DATA
+    DeviceContext *ctx = device_ctx;
+    off_t          pos;
+
+    if(!ctx) return -1;
+
+    pos = lseek(ctx->fd, (off_t)offset, SEEK_DATA);
+
+    // Only a hole is left, or not even that, the device ends at both
+    if(pos < 0 && errno == ENXIO)
+    {
+        pos = lseek(ctx->fd, 0, SEEK_END);
+
+        if(pos < 0) return errno;
+
+        *data = (uint64_t)pos;
+        *hole = (uint64_t)pos;
+
+        return 0;
+    }
 
     if(pos < 0) return errno;
 
-    // TODO: Timing
-    ret = read(ctx->fd, (void *)buffer, (size_t)length);
+    *data = (uint64_t)pos;
+    pos   = lseek(ctx->fd, pos, SEEK_HOLE);
 
-    return ret < 0 ? errno : 0;
-}
\ No newline at end of file
+    if(pos < 0) return errno;
+
+    *hole = (uint64_t)pos;
+
+    return 0;
+#else
+    return EINVAL;
+#endif
+}
@@ -0,0 +1,208 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "../aaruremote.h"
+#include "linux.h"
+
+// Aligned buffers are shared by every device and kept around once allocated
+static char    *direct_pool[DIRECT_POOL_BUFFERS];
+static uint8_t  direct_pool_used[DIRECT_POOL_BUFFERS];
+
+char *DirectBufferGet()
+{
+    int i;
+
+    for(i = 0; i < DIRECT_POOL_BUFFERS; i++)
+    {
+        if(direct_pool_used[i]) continue;
+
+        if(!direct_pool[i] && posix_memalign((void **)&direct_pool[i], DIRECT_MAX_ALIGNMENT, DIRECT_CHUNK_SIZE) != 0)
+        {
+            direct_pool[i] = NULL;
+            return NULL;
+        }
+
+        direct_pool_used[i] = 1;
+        return direct_pool[i];
+    }
+
+    return NULL;
+}
+
+void DirectBufferPut(char *buffer)
+{
+    int i;
+
+    for(i = 0; i < DIRECT_POOL_BUFFERS; i++)
+    {
+        if(direct_pool[i] != buffer) continue;
+
+        direct_pool_used[i] = 0;
+        return;
+    }
+}
+
+int DirectOpen(DeviceContext *ctx)
+{
+    int logical_size  = 0;
+    int physical_size = 0;
+
+    ctx->direct_fd        = -1;
+    ctx->direct_alignment = 0;
+
+    if(!server_options.direct_io) return -1;
+
+    ctx->direct_fd = open(ctx->device_path, O_RDONLY | O_DIRECT);
+
+    if(ctx->direct_fd < 0) return -1;
+
+    // Logical size is what the kernel enforces, physical size avoids read-modify cycles on 512e drives
+    if(ioctl(ctx->direct_fd, BLKSSZGET, &logical_size) < 0) logical_size = 0;
+    if(ioctl(ctx->direct_fd, BLKPBSZGET, &physical_size) < 0) physical_size = 0;
+
+    if(physical_size > logical_size) logical_size = physical_size;
+
+    // Regular files do not answer the block ioctls, a page is safe for every filesystem
+    if(logical_size <= 0) logical_size = DIRECT_MAX_ALIGNMENT;
+
+    if(logical_size > DIRECT_MAX_ALIGNMENT || (logical_size & (logical_size - 1)) != 0)
+    {
+        close(ctx->direct_fd);
+        ctx->direct_fd = -1;
+        return -1;
+    }
+
+    ctx->direct_alignment = (uint32_t)logical_size;
+
+    return 0;
+}
+
+void DirectClose(DeviceContext *ctx)
+{
+    if(ctx->direct_fd < 0) return;
+
+    close(ctx->direct_fd);
+    ctx->direct_fd        = -1;
+    ctx->direct_alignment = 0;
+}
+
+// Reads an aligned range, stopping early only at the end of the device
+static ssize_t DirectReadFull(int fd, char *buffer, uint64_t offset, uint32_t length, uint64_t mask)
+{
+    ssize_t  ret;
+    uint32_t done = 0;
+
+    while(done < length)
+    {
+        ret = pread(fd, buffer + done, length - done, (off_t)(offset + done));
+
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+
+            return -1;
+        }
+
+        if(ret == 0) break;
+
+        done += (uint32_t)ret;
+
+        // Short direct read means end of file, the next offset would not be aligned anyway
+        if((done & mask) != 0) break;
+    }
+
+    return (ssize_t)done;
+}
+
+int32_t DirectRead(DeviceContext *ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length)
+{
+    uint64_t mask  = ctx->direct_alignment - 1;
+    uint64_t start = offset & ~mask;
+    uint64_t stop  = (offset + length + mask) & ~mask;
+    uint64_t end   = offset + length;
+    uint64_t pos;
+    uint64_t copy_start;
+    uint64_t copy_end;
+    uint32_t chunk;
+    char    *bounce = NULL;
+    ssize_t  ret    = 0;
+
+    *read_length = 0;
+
+    if(ctx->direct_fd < 0) return -1;
+
+    for(pos = start; pos < stop; pos += chunk)
+    {
+        chunk = (stop - pos) > DIRECT_CHUNK_SIZE ? DIRECT_CHUNK_SIZE : (uint32_t)(stop - pos);
+
+        // Whole aligned chunks that land on an aligned spot of the caller's buffer need no copy
+        if(pos >= offset && pos + chunk <= end && ((uintptr_t)(buffer + (pos - offset)) & mask) == 0)
+        {
+            ret = DirectReadFull(ctx->direct_fd, buffer + (pos - offset), pos, chunk, mask);
+
+            if(ret < 0) break;
+
+            *read_length = (uint32_t)(pos + ret - offset);
+
+            if((uint32_t)ret < chunk) break;
+
+            continue;
+        }
+
+        // Unaligned head, tail or destination go through a bounce buffer from the pool
+        if(!bounce) bounce = DirectBufferGet();
+
+        if(!bounce)
+        {
+            errno = ENOMEM;
+            ret   = -1;
+            break;
+        }
+
+        ret = DirectReadFull(ctx->direct_fd, bounce, pos, chunk, mask);
+
+        if(ret < 0) break;
+
+        copy_start = pos < offset ? offset : pos;
+        copy_end   = pos + ret > end ? end : pos + ret;
+
+        if(copy_end > copy_start)
+        {
+            memcpy(buffer + (copy_start - offset), bounce + (copy_start - pos), (size_t)(copy_end - copy_start));
+            *read_length = (uint32_t)(copy_end - offset);
+        }
+
+        if((uint32_t)ret < chunk) break;
+    }
+
+    if(bounce) DirectBufferPut(bounce);
+
+    return ret < 0 ? errno : 0;
+}
@@ -18,12 +18,86 @@
 #ifndef AARUREMOTE_LINUX_LINUX_H_
 #define AARUREMOTE_LINUX_LINUX_H_
 
+#include <scsi/sg.h>
+
+// Older C library headers predate the mmap'd reserved buffer flag of the kernel driver
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO 4
+#endif
+
 #define PATH_SYS_DEVBLOCK "/sys/block"
+#define PATH_SYS_CLASSBLOCK "/sys/class/block"
+#define PATH_SYS_CLASSTAPE "/sys/class/scsi_tape"
+
+// Commands that can be outstanding at the same time in the sg driver for a single file descriptor
+#define SG_QUEUE_DEPTH SG_MAX_QUEUE
+// Reserved buffer requested from the sg driver and mapped into our memory for zero-copy data-in
+#define SG_RESERVED_SIZE (1024 * 1024)
+// Reads kept in flight by the io_uring engine, each one into its own registered buffer
+#define URING_QUEUE_DEPTH 8
+#define URING_CHUNK_SIZE (128 * 1024)
+// Aligned buffers for O_DIRECT reads that cannot land straight in the caller's buffer
+#define DIRECT_POOL_BUFFERS 4
+#define DIRECT_CHUNK_SIZE (1024 * 1024)
+#define DIRECT_MAX_ALIGNMENT 4096
+
+// Fixed format sense with the ATA status return descriptor fits in 32 bytes
+#define ATA_SENSE_SIZE 32
+
+typedef struct UringContext UringContext;
+
+typedef struct
+{
+    int32_t     pack_id;
+    uint8_t     in_use;
+    uint8_t     done;
+    uint8_t     orphaned;
+    sg_io_hdr_t hdr;
+} SgRequest;
+
+// ATA PASS-THROUGH(16) CDB, rebuilt only when the protocol or transfer settings change
+typedef struct
+{
+    uint8_t       valid;
+    uint8_t       extend;
+    uint8_t       protocol;
+    uint8_t       transfer_register;
+    uint8_t       transfer_blocks;
+    unsigned char cdb[16];
+} AtaCdbTemplate;
 
 typedef struct
 {
-    int  fd;
-    char device_path[4096];
+    int            fd;
+    char           device_path[4096];
+    int            sg_fd;
+    int32_t        sg_next_pack_id;
+    uint32_t       sg_outstanding;
+    SgRequest      sg_queue[SG_QUEUE_DEPTH];
+    char          *sg_mmap;
+    uint32_t       sg_mmap_size;
+    UringContext  *uring;
+    uint8_t        uring_unavailable;
+    int            direct_fd;
+    uint32_t       direct_alignment;
+    AtaCdbTemplate ata_cdb;
+    unsigned char  ata_sense[ATA_SENSE_SIZE];
 } DeviceContext;
 
+int32_t ScsiExecute(DeviceContext *ctx, char *cdb, uint32_t cdb_len, char *buffer, uint32_t *buf_len, int32_t direction,
+                    uint32_t timeout, unsigned char *sense_buffer, uint32_t *sense_len, uint32_t *duration,
+                    uint32_t *sense);
+int     SgOpen(DeviceContext *ctx);
+void    SgClose(DeviceContext *ctx);
+int32_t SgSubmit(DeviceContext *ctx, sg_io_hdr_t *hdr);
+int32_t SgComplete(DeviceContext *ctx, int32_t pack_id, sg_io_hdr_t *hdr);
+int     UringOpen(DeviceContext *ctx);
+void    UringClose(DeviceContext *ctx);
+int32_t UringRead(DeviceContext *ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length);
+int     DirectOpen(DeviceContext *ctx);
+void    DirectClose(DeviceContext *ctx);
+int32_t DirectRead(DeviceContext *ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length);
+char   *DirectBufferGet();
+void    DirectBufferPut(char *buffer);
+
 #endif  // AARUREMOTE_LINUX_LINUX_H_
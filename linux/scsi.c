@@ -24,21 +24,15 @@
 #include "../aaruremote.h"
 #include "linux.h"
 
-int32_t SendScsiCommand(void *device_ctx, char *cdb, char *buffer, char **sense_buffer, uint32_t timeout,
-                        int32_t direction, uint32_t *duration, uint32_t *sense, uint32_t cdb_len, uint32_t *buf_len,
-                        uint32_t *sense_len)
+int32_t ScsiExecute(DeviceContext *ctx, char *cdb, uint32_t cdb_len, char *buffer, uint32_t *buf_len, int32_t direction,
+                    uint32_t timeout, unsigned char *sense_buffer, uint32_t *sense_len, uint32_t *duration,
+                    uint32_t *sense)
 {
-    DeviceContext *ctx = device_ctx;
-    sg_io_hdr_t    hdr;
-    int            dir, ret;
-    *sense_len = 32;
-
-    if(!ctx) return -1;
+    sg_io_hdr_t hdr;
+    int         dir, ret;
+    uint64_t    start;
 
     memset(&hdr, 0, sizeof(sg_io_hdr_t));
-    *sense_buffer = malloc(*sense_len);
-
-    if(!*sense_buffer) return -1;
 
     switch(direction)
     {
@@ -60,21 +54,64 @@ int32_t SendScsiCommand(void *device_ctx, char *cdb, char *buffer, char **sense_
 
     hdr.interface_id    = 'S';
     hdr.cmd_len         = (char)cdb_len;
-    hdr.mx_sb_len       = 32;
+    hdr.mx_sb_len       = (unsigned char)*sense_len;
     hdr.dxfer_direction = dir;
     hdr.dxfer_len       = *buf_len;
     hdr.dxferp          = buffer;
     hdr.cmdp            = (unsigned char *)cdb;
-    hdr.sbp             = (unsigned char *)*sense_buffer;
+    hdr.sbp             = sense_buffer;
     hdr.timeout         = timeout;
     hdr.flags           = SG_FLAG_DIRECT_IO;
 
-    ret = ioctl(ctx->fd, SG_IO, &hdr);
+    // Data-in straight into the mapped reserved buffer, the driver ignores dxferp then
+    if(buffer && buffer == ctx->sg_mmap && ctx->sg_fd >= 0 && *buf_len <= ctx->sg_mmap_size)
+    {
+        hdr.dxferp = NULL;
+        hdr.flags  = SG_FLAG_MMAP_IO;
+    }
+
+    start = GetMonotonicMicroseconds();
+
+    // Go through the sg node when we have one, so the same queue can carry pipelined commands
+    if(ctx->sg_fd >= 0)
+    {
+        ret = SgSubmit(ctx, &hdr);
+
+        if(ret >= 0) ret = SgComplete(ctx, ret, &hdr);
+    }
+    else
+        ret = ioctl(ctx->fd, SG_IO, &hdr);
 
+    // Driver only counts whole milliseconds from its own jiffies, our clock also covers the submission
+    *duration  = (uint32_t)((GetMonotonicMicroseconds() - start) / 1000);
     *sense     = (hdr.info & SG_INFO_OK_MASK) != SG_INFO_OK;
-    // TODO: Manual timing if duration is 0
-    *duration  = hdr.duration;
     *sense_len = hdr.sb_len_wr;
 
     return ret;  // TODO: Implement
-}
\ No newline at end of file
+}
+
+int32_t SendScsiCommand(void *device_ctx, char *cdb, char *buffer, char **sense_buffer, uint32_t timeout,
+                        int32_t direction, uint32_t *duration, uint32_t *sense, uint32_t cdb_len, uint32_t *buf_len,
+                        uint32_t *sense_len)
+{
+    DeviceContext *ctx = device_ctx;
+    *sense_len         = 32;
+
+    if(!ctx) return -1;
+
+    *sense_buffer = malloc(*sense_len);
+
+    if(!*sense_buffer) return -1;
+
+    return ScsiExecute(ctx, cdb, cdb_len, buffer, buf_len, direction, timeout, (unsigned char *)*sense_buffer,
+                       sense_len, duration, sense);
+}
+
+char *GetScsiDataInBuffer(void *device_ctx, uint32_t length)
+{
+    DeviceContext *ctx = device_ctx;
+
+    if(!ctx || ctx->sg_fd < 0 || !ctx->sg_mmap || length == 0 || length > ctx->sg_mmap_size) return NULL;
+
+    return ctx->sg_mmap;
+}
@@ -34,6 +34,7 @@ int32_t SendSdhciCommand(void *device_ctx, uint8_t command, uint8_t write, uint8
     DeviceContext     *ctx = device_ctx;
     struct mmc_ioc_cmd mmc_ioc_cmd;
     int32_t            error;
+    uint64_t           start;
     *duration = 0;
     *sense    = 0;
 
@@ -56,8 +57,9 @@ int32_t SendSdhciCommand(void *device_ctx, uint8_t command, uint8_t write, uint8
     }
     mmc_ioc_cmd.data_ptr = (uint64_t)buffer;
 
-    // TODO: Timing
-    error = ioctl(ctx->fd, MMC_IOC_CMD, &mmc_ioc_cmd);
+    start     = GetMonotonicMicroseconds();
+    error     = ioctl(ctx->fd, MMC_IOC_CMD, &mmc_ioc_cmd);
+    *duration = (uint32_t)((GetMonotonicMicroseconds() - start) / 1000);
 
     if(error < 0) error = errno;
 
@@ -227,6 +229,7 @@ int32_t SendMultiSdhciCommand(void *device_ctx, uint64_t count, MmcSingleCommand
     *sense             = 0;
     struct mmc_ioc_multi_cmd *mmc_ioc_multi_cmd;
     uint64_t                  i;
+    uint64_t                  start;
     int32_t                   error;
     if(!ctx) return -1;
 
@@ -261,7 +264,9 @@ int32_t SendMultiSdhciCommand(void *device_ctx, uint64_t count, MmcSingleCommand
         mmc_ioc_multi_cmd->cmds[i].data_ptr   = (uint64_t)commands[i].buffer;
     }
 
-    error = ioctl(ctx->fd, MMC_IOC_MULTI_CMD, mmc_ioc_multi_cmd);
+    start     = GetMonotonicMicroseconds();
+    error     = ioctl(ctx->fd, MMC_IOC_MULTI_CMD, mmc_ioc_multi_cmd);
+    *duration = (uint32_t)((GetMonotonicMicroseconds() - start) / 1000);
 
     if(error < 0) error = errno;
 
@@ -0,0 +1,291 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "../aaruremote.h"
+#include "linux.h"
+
+#ifndef SCSI_GENERIC_MAJOR
+#define SCSI_GENERIC_MAJOR 21
+#endif
+
+// Finds the sgN node behind a block or tape device using its sysfs scsi_generic link
+static int SgFindNode(const char *device_path, char *sg_path, size_t sg_path_len)
+{
+    char           sysfs_path[4096];
+    const char    *dev_name;
+    DIR           *dir;
+    struct dirent *dirent;
+    struct stat    sb;
+
+    if(stat(device_path, &sb) == 0 && S_ISCHR(sb.st_mode) && major(sb.st_rdev) == SCSI_GENERIC_MAJOR)
+    {
+        snprintf(sg_path, sg_path_len, "%s", device_path);
+        return 0;
+    }
+
+    dev_name = strrchr(device_path, '/');
+
+    if(!dev_name) return -1;
+
+    dev_name++;
+
+    if(*dev_name == 0) return -1;
+
+    snprintf(sysfs_path, sizeof(sysfs_path), "%s/%s/device/scsi_generic", PATH_SYS_CLASSBLOCK, dev_name);
+    dir = opendir(sysfs_path);
+
+    if(!dir)
+    {
+        snprintf(sysfs_path, sizeof(sysfs_path), "%s/%s/device/scsi_generic", PATH_SYS_CLASSTAPE, dev_name);
+        dir = opendir(sysfs_path);
+    }
+
+    if(!dir) return -1;
+
+    while((dirent = readdir(dir)) != NULL)
+    {
+        if(strncmp(dirent->d_name, "sg", 2) != 0) continue;
+
+        snprintf(sg_path, sg_path_len, "/dev/%s", dirent->d_name);
+        closedir(dir);
+        return 0;
+    }
+
+    closedir(dir);
+    return -1;
+}
+
+int SgOpen(DeviceContext *ctx)
+{
+    char  sg_path[4096];
+    int   version;
+    int   reserved;
+    void *map;
+
+    ctx->sg_fd           = -1;
+    ctx->sg_outstanding  = 0;
+    ctx->sg_next_pack_id = 1;
+    ctx->sg_mmap         = NULL;
+    ctx->sg_mmap_size    = 0;
+    memset(ctx->sg_queue, 0, sizeof(ctx->sg_queue));
+
+    if(SgFindNode(ctx->device_path, sg_path, sizeof(sg_path)) < 0) return -1;
+
+    ctx->sg_fd = open(sg_path, O_RDWR | O_NONBLOCK);
+
+    if(ctx->sg_fd < 0) return -1;
+
+    // Asynchronous write()/read() of sg_io_hdr_t needs the version 3 driver
+    if(ioctl(ctx->sg_fd, SG_GET_VERSION_NUM, &version) < 0 || version < 30000)
+    {
+        close(ctx->sg_fd);
+        ctx->sg_fd = -1;
+        return -1;
+    }
+
+    // Driver may cap the reserved buffer to what the host adapter allows, map whatever it gave us
+    reserved = SG_RESERVED_SIZE;
+    ioctl(ctx->sg_fd, SG_SET_RESERVED_SIZE, &reserved);
+
+    if(ioctl(ctx->sg_fd, SG_GET_RESERVED_SIZE, &reserved) < 0 || reserved <= 0) return 0;
+
+    map = mmap(NULL, (size_t)reserved, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->sg_fd, 0);
+
+    if(map == MAP_FAILED) return 0;
+
+    ctx->sg_mmap      = map;
+    ctx->sg_mmap_size = (uint32_t)reserved;
+
+    return 0;
+}
+
+void SgClose(DeviceContext *ctx)
+{
+    sg_io_hdr_t hdr;
+    int         i;
+
+    if(ctx->sg_fd < 0) return;
+
+    // Drain whatever is still in flight so the driver does not write into freed buffers
+    for(i = 0; i < SG_QUEUE_DEPTH; i++)
+        if(ctx->sg_queue[i].in_use && !ctx->sg_queue[i].done) SgComplete(ctx, ctx->sg_queue[i].pack_id, &hdr);
+
+    if(ctx->sg_mmap) munmap(ctx->sg_mmap, ctx->sg_mmap_size);
+
+    ctx->sg_mmap      = NULL;
+    ctx->sg_mmap_size = 0;
+
+    close(ctx->sg_fd);
+    ctx->sg_fd          = -1;
+    ctx->sg_outstanding = 0;
+}
+
+int32_t SgSubmit(DeviceContext *ctx, sg_io_hdr_t *hdr)
+{
+    SgRequest *req = NULL;
+    ssize_t    ret;
+    int        i;
+
+    if(ctx->sg_fd < 0) return -1;
+
+    for(i = 0; i < SG_QUEUE_DEPTH; i++)
+    {
+        if(ctx->sg_queue[i].in_use) continue;
+
+        req = &ctx->sg_queue[i];
+        break;
+    }
+
+    if(!req)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    hdr->pack_id = ctx->sg_next_pack_id++;
+
+    // Negative identifiers mean "any" to the driver, never hand them out
+    if(ctx->sg_next_pack_id <= 0) ctx->sg_next_pack_id = 1;
+
+    do
+        ret = write(ctx->sg_fd, hdr, sizeof(sg_io_hdr_t));
+    while(ret < 0 && errno == EINTR);
+
+    if(ret < 0) return -1;
+
+    req->pack_id  = hdr->pack_id;
+    req->in_use   = 1;
+    req->done     = 0;
+    req->orphaned = 0;
+    ctx->sg_outstanding++;
+
+    return hdr->pack_id;
+}
+
+// Reads one finished command from the driver, whichever it is, and parks it in its queue slot
+static int SgReapOne(DeviceContext *ctx)
+{
+    sg_io_hdr_t   hdr;
+    struct pollfd pfd;
+    ssize_t       ret;
+    int           i;
+
+    for(;;)
+    {
+        memset(&hdr, 0, sizeof(sg_io_hdr_t));
+        hdr.interface_id = 'S';
+        hdr.pack_id      = -1;
+
+        ret = read(ctx->sg_fd, &hdr, sizeof(sg_io_hdr_t));
+
+        if(ret >= 0) break;
+
+        if(errno == EINTR) continue;
+
+        if(errno != EAGAIN) return -1;
+
+        pfd.fd      = ctx->sg_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR) return -1;
+    }
+
+    for(i = 0; i < SG_QUEUE_DEPTH; i++)
+    {
+        if(!ctx->sg_queue[i].in_use || ctx->sg_queue[i].pack_id != hdr.pack_id) continue;
+
+        // Nobody waits for it anymore, the buffers it used are safe to reuse now
+        if(ctx->sg_queue[i].orphaned)
+        {
+            ctx->sg_queue[i].in_use   = 0;
+            ctx->sg_queue[i].orphaned = 0;
+            ctx->sg_outstanding--;
+            return 0;
+        }
+
+        ctx->sg_queue[i].hdr  = hdr;
+        ctx->sg_queue[i].done = 1;
+        return 0;
+    }
+
+    // Completion for something we never submitted, nothing to correlate it with
+    return 0;
+}
+
+int32_t SgComplete(DeviceContext *ctx, int32_t pack_id, sg_io_hdr_t *hdr)
+{
+    SgRequest *req = NULL;
+    int        i;
+
+    if(ctx->sg_fd < 0) return -1;
+
+    for(i = 0; i < SG_QUEUE_DEPTH; i++)
+    {
+        if(!ctx->sg_queue[i].in_use || ctx->sg_queue[i].pack_id != pack_id) continue;
+
+        req = &ctx->sg_queue[i];
+        break;
+    }
+
+    if(!req)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    req->orphaned = 0;
+
+    while(!req->done)
+    {
+        if(SgReapOne(ctx) >= 0) continue;
+
+        // Command may still be writing into the caller's buffers, the slot stays taken until the driver gives it back
+        req->orphaned = 1;
+        return -1;
+    }
+
+    // Completion carries status only, keep the caller's buffer pointers
+    hdr->status        = req->hdr.status;
+    hdr->masked_status = req->hdr.masked_status;
+    hdr->msg_status    = req->hdr.msg_status;
+    hdr->sb_len_wr     = req->hdr.sb_len_wr;
+    hdr->host_status   = req->hdr.host_status;
+    hdr->driver_status = req->hdr.driver_status;
+    hdr->resid         = req->hdr.resid;
+    hdr->duration      = req->hdr.duration;
+    hdr->info          = req->hdr.info;
+
+    req->in_use = 0;
+    req->done   = 0;
+    ctx->sg_outstanding--;
+
+    return 0;
+}
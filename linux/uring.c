@@ -0,0 +1,345 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../aaruremote.h"
+#include "linux.h"
+
+#ifdef HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+struct UringContext
+{
+    int                  ring_fd;
+    void                *sq_ptr;
+    size_t               sq_len;
+    void                *cq_ptr;
+    size_t               cq_len;
+    struct io_uring_sqe *sqes;
+    size_t               sqes_len;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+    char                *buffers;
+    uint64_t             slot_offset[URING_QUEUE_DEPTH];
+    uint32_t             slot_length[URING_QUEUE_DEPTH];
+    uint32_t             slot_done[URING_QUEUE_DEPTH];
+};
+
+static int UringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int UringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int UringRegister(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static void UringFree(UringContext *ring)
+{
+    if(ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_len);
+    if(ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if(ring->sq_ptr && ring->sq_ptr != MAP_FAILED) munmap(ring->sq_ptr, ring->sq_len);
+    if(ring->ring_fd >= 0) close(ring->ring_fd);
+    free(ring->buffers);
+    free(ring);
+}
+
+int UringOpen(DeviceContext *ctx)
+{
+    UringContext          *ring;
+    struct io_uring_params params;
+    struct iovec           iov[URING_QUEUE_DEPTH];
+    int                    i;
+    int                    fd = ctx->direct_fd >= 0 ? ctx->direct_fd : ctx->fd;
+
+    if(ctx->uring) return 0;
+
+    if(ctx->uring_unavailable) return -1;
+
+    ring = malloc(sizeof(UringContext));
+
+    if(!ring) return -1;
+
+    memset(ring, 0, sizeof(UringContext));
+    memset(&params, 0, sizeof(params));
+
+    ring->ring_fd = UringSetup(URING_QUEUE_DEPTH, &params);
+
+    if(ring->ring_fd < 0)
+    {
+        // Kernel without io_uring or with it disabled by policy, do not try again on this device
+        ctx->uring_unavailable = 1;
+        free(ring);
+        return -1;
+    }
+
+    ring->sq_len   = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr =
+        mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+
+    if(ring->sq_ptr == MAP_FAILED)
+    {
+        ctx->uring_unavailable = 1;
+        UringFree(ring);
+        return -1;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else
+        ring->cq_ptr = mmap(
+            NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+
+    ring->sqes = mmap(
+        NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+
+    if(ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        ctx->uring_unavailable = 1;
+        UringFree(ring);
+        return -1;
+    }
+
+    ring->sq_head  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+    ring->cq_head  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+    if(posix_memalign((void **)&ring->buffers, 4096, URING_QUEUE_DEPTH * URING_CHUNK_SIZE) != 0)
+    {
+        ring->buffers = NULL;
+        UringFree(ring);
+        return -1;
+    }
+
+    for(i = 0; i < URING_QUEUE_DEPTH; i++)
+    {
+        iov[i].iov_base = ring->buffers + i * URING_CHUNK_SIZE;
+        iov[i].iov_len  = URING_CHUNK_SIZE;
+    }
+
+    // Registered buffers are page aligned, so they double as the aligned pool when reading with O_DIRECT.
+    // Fixed buffers and file save the kernel from pinning pages and taking file references on every read
+    if(UringRegister(ring->ring_fd, IORING_REGISTER_BUFFERS, iov, URING_QUEUE_DEPTH) < 0 ||
+       UringRegister(ring->ring_fd, IORING_REGISTER_FILES, &fd, 1) < 0)
+    {
+        ctx->uring_unavailable = 1;
+        UringFree(ring);
+        return -1;
+    }
+
+    ctx->uring = ring;
+
+    return 0;
+}
+
+void UringClose(DeviceContext *ctx)
+{
+    if(!ctx->uring) return;
+
+    UringFree(ctx->uring);
+    ctx->uring = NULL;
+}
+
+static void UringQueueRead(UringContext *ring, unsigned slot, uint64_t offset, uint32_t length)
+{
+    struct io_uring_sqe *sqe;
+    unsigned             tail  = *ring->sq_tail;
+    unsigned             index = tail & *ring->sq_mask;
+
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    sqe->opcode    = IORING_OP_READ_FIXED;
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = 0;
+    sqe->off       = offset;
+    sqe->addr      = (uint64_t)(uintptr_t)(ring->buffers + slot * URING_CHUNK_SIZE + ring->slot_done[slot]);
+    sqe->len       = length;
+    sqe->buf_index = slot;
+    sqe->user_data = slot;
+
+    ring->sq_array[index] = index;
+
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int32_t UringRead(DeviceContext *ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length)
+{
+    UringContext        *ring = ctx->uring;
+    struct io_uring_cqe *cqe;
+    unsigned             head;
+    unsigned             to_submit = 0;
+    unsigned             in_flight = 0;
+    unsigned             free_slots[URING_QUEUE_DEPTH];
+    unsigned             free_count = 0;
+    unsigned             slot;
+    uint64_t             mask        = ctx->direct_fd >= 0 ? ctx->direct_alignment - 1 : 0;
+    uint64_t             end         = offset + length;
+    uint64_t             next_offset = offset & ~mask;
+    uint64_t             eof         = (end + mask) & ~mask;
+    uint64_t             slot_end;
+    uint64_t             copy_start;
+    uint64_t             copy_end;
+    int32_t              error = 0;
+    int32_t              res;
+    int                  ret;
+    int                  i;
+
+    *read_length = 0;
+
+    if(!ring) return -1;
+
+    for(i = URING_QUEUE_DEPTH - 1; i >= 0; i--) free_slots[free_count++] = i;
+
+    while(next_offset < eof || in_flight > 0)
+    {
+        // Keep every slot busy with the next chunk so the device sees the full queue depth
+        while(next_offset < eof && free_count > 0 && !error)
+        {
+            slot                    = free_slots[--free_count];
+            ring->slot_offset[slot] = next_offset;
+            ring->slot_length[slot] =
+                (eof - next_offset) > URING_CHUNK_SIZE ? URING_CHUNK_SIZE : (uint32_t)(eof - next_offset);
+            ring->slot_done[slot] = 0;
+
+            UringQueueRead(ring, slot, next_offset, ring->slot_length[slot]);
+            next_offset += ring->slot_length[slot];
+            to_submit++;
+            in_flight++;
+        }
+
+        if(in_flight == 0) break;
+
+        ret = UringEnter(ring->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+
+            // Ring is unusable, requests may still be outstanding so drop it entirely
+            error = errno;
+            UringClose(ctx);
+            ctx->uring_unavailable = 1;
+            return error;
+        }
+
+        to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+        head = *ring->cq_head;
+
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            cqe  = &ring->cqes[head & *ring->cq_mask];
+            slot = (unsigned)cqe->user_data;
+            res  = cqe->res;
+            head++;
+
+            if(res < 0 && !error) error = -res;
+
+            if(res > 0) ring->slot_done[slot] += res;
+
+            slot_end = ring->slot_offset[slot] + ring->slot_done[slot];
+
+            if(res > 0 && ring->slot_done[slot] < ring->slot_length[slot] && !error && slot_end < eof &&
+               (slot_end & mask) == 0)
+            {
+                // Short read in the middle of the range, ask for the rest into the same slot
+                UringQueueRead(ring, slot, slot_end, ring->slot_length[slot] - ring->slot_done[slot]);
+                to_submit++;
+                continue;
+            }
+
+            // End of device or file, nothing past here can be read
+            if(res >= 0 && ring->slot_done[slot] < ring->slot_length[slot] && slot_end < eof) eof = slot_end;
+
+            // Aligned reads may start before or end after the range asked for
+            copy_start = ring->slot_offset[slot] < offset ? offset : ring->slot_offset[slot];
+            copy_end   = slot_end > end ? end : slot_end;
+
+            if(copy_end > copy_start)
+                memcpy(buffer + (copy_start - offset),
+                       ring->buffers + slot * URING_CHUNK_SIZE + (copy_start - ring->slot_offset[slot]),
+                       (size_t)(copy_end - copy_start));
+
+            free_slots[free_count++] = slot;
+            in_flight--;
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if(error) return error;
+
+    if(eof > end) eof = end;
+
+    *read_length = eof > offset ? (uint32_t)(eof - offset) : 0;
+
+    return 0;
+}
+
+#else
+
+int UringOpen(DeviceContext *ctx)
+{
+    ctx->uring_unavailable = 1;
+
+    return -1;
+}
+
+void UringClose(DeviceContext *ctx) {}
+
+int32_t UringRead(DeviceContext *ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length)
+{
+    *read_length = 0;
+
+    return -1;
+}
+
+#endif
@@ -17,6 +17,8 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -28,11 +30,156 @@
 
 #include "aaruremote.h"
 
-int main()
+AaruRemoteOptions server_options;
+
+static void PrintUsage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  --direct-io       Bypass the operating system cache on OS reads where supported\n");
+    printf("  --huge-pages      Back large transfer buffers with huge pages where supported\n");
+    printf("  --pool-cap N      Limit memory kept for large transfer buffers to N MiB (default %d)\n",
+           POOL_DEFAULT_CAP / (1024 * 1024));
+    printf("  --port N          Listen for clients on port N (default %d)\n", AARUREMOTE_PORT);
+    printf("  --metrics-port N  Serve Prometheus metrics over HTTP on port N\n");
+    printf("  --trace FILE      Record every command served to FILE\n");
+    printf("  --trace-ring N    Keep the last N commands in memory, dumped on request\n");
+    printf("  --trace-hash      Add a hash of the data moved by each command to the trace\n");
+    printf("  --faults FILE     Inject the errors and delays described in FILE into every device\n");
+    printf("  --net-delay MS    Delay traffic to and from clients by MS milliseconds each way\n");
+    printf("  --net-jitter MS   Delay each reply by up to MS milliseconds more\n");
+    printf("  --net-rate N      Limit client traffic to N KiB per second each way\n");
+    printf("  --net-coalesce MS Hold small writes up to MS milliseconds to send them together\n");
+    printf("  --help            Show this help\n");
+}
+
+static int ParseArguments(int argc, char* argv[])
+{
+    int   i;
+    long  cap;
+    long  port;
+    long  records;
+    long  value;
+    char* end;
+
+    memset(&server_options, 0, sizeof(AaruRemoteOptions));
+    server_options.pool_cap = POOL_DEFAULT_CAP;
+    server_options.port     = AARUREMOTE_PORT;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--direct-io") == 0)
+            server_options.direct_io = 1;
+        else if(strcmp(argv[i], "--huge-pages") == 0)
+            server_options.huge_pages = 1;
+        else if(strcmp(argv[i], "--pool-cap") == 0 && i + 1 < argc)
+        {
+            cap = strtol(argv[++i], &end, 10);
+
+            if(*end != 0 || cap <= 0 || (unsigned long)cap > ((size_t)-1) / (1024 * 1024))
+            {
+                printf("Invalid pool cap %s\n", argv[i]);
+                return -1;
+            }
+
+            server_options.pool_cap = (size_t)cap * 1024 * 1024;
+        }
+        else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            port = strtol(argv[++i], &end, 10);
+
+            if(*end != 0 || port <= 0 || port > 65535)
+            {
+                printf("Invalid port %s\n", argv[i]);
+                return -1;
+            }
+
+            server_options.port = (uint16_t)port;
+        }
+        else if(strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc)
+        {
+            port = strtol(argv[++i], &end, 10);
+
+            if(*end != 0 || port <= 0 || port > 65535)
+            {
+                printf("Invalid metrics port %s\n", argv[i]);
+                return -1;
+            }
+
+            server_options.metrics_port = (uint16_t)port;
+        }
+        else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            server_options.trace_path = argv[++i];
+        else if(strcmp(argv[i], "--trace-ring") == 0 && i + 1 < argc)
+        {
+            records = strtol(argv[++i], &end, 10);
+
+            if(*end != 0 || records <= 0 || (unsigned long)records > UINT32_MAX ||
+               (unsigned long)records > ((size_t)-1) / sizeof(AaruTraceRecord))
+            {
+                printf("Invalid trace ring size %s\n", argv[i]);
+                return -1;
+            }
+
+            server_options.trace_ring = (uint32_t)records;
+        }
+        else if(strcmp(argv[i], "--trace-hash") == 0)
+            server_options.trace_hash = 1;
+        else if(strcmp(argv[i], "--faults") == 0 && i + 1 < argc)
+            server_options.fault_path = argv[++i];
+        else if((strcmp(argv[i], "--net-delay") == 0 || strcmp(argv[i], "--net-jitter") == 0 ||
+                 strcmp(argv[i], "--net-rate") == 0 || strcmp(argv[i], "--net-coalesce") == 0) &&
+                i + 1 < argc)
+        {
+            value = strtol(argv[i + 1], &end, 10);
+
+            if(*end != 0 || value < 0 || (unsigned long)value > UINT32_MAX)
+            {
+                printf("Invalid value %s for %s\n", argv[i + 1], argv[i]);
+                return -1;
+            }
+
+            if(strcmp(argv[i], "--net-delay") == 0)
+                server_options.net_delay = (uint32_t)value;
+            else if(strcmp(argv[i], "--net-jitter") == 0)
+                server_options.net_jitter = (uint32_t)value;
+            else if(strcmp(argv[i], "--net-rate") == 0)
+                server_options.net_rate = (uint32_t)value;
+            else
+                server_options.net_coalesce = (uint32_t)value;
+
+            i++;
+        }
+        else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            PrintUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(server_options.metrics_port == server_options.port)
+    {
+        printf("Metrics cannot be served on the same port as clients\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
 {
     AaruPacketHello* pkt_server_hello;
     int              ret;
 
+    ret = ParseArguments(argc, argv);
+
+    if(ret) return ret < 0 ? 1 : 0;
+
     Initialize();
 
     printf("Aaru Remote Server %s\n", AARUREMOTE_VERSION);
@@ -57,5 +204,12 @@ int main()
         return 1;
     }
 
+    // Before any thread can read the statistics
+    StatsInit();
+
+    if(TraceInit()) return 1;
+
+    if(FaultInit()) return 1;
+
     PlatformLoop(pkt_server_hello);
 }
\ No newline at end of file
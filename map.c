@@ -0,0 +1,188 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+#include "endian.h"
+
+// Bytes read at once looking for zeros, rounded down to whole blocks
+#define MAP_SCAN_SIZE (1024 * 1024)
+
+typedef struct
+{
+    const DeviceBackend* backend;
+    void*                device_ctx;
+    AaruOsReadMapExtent* extents;
+    uint32_t             count;
+    uint32_t             max_extents;
+    uint32_t             block_size;
+    uint64_t             pos;
+    uint8_t              ended;
+    uint8_t              full;
+    int32_t              error_no;
+} MapContext;
+
+// Extends the last extent when it is of the same type. Returns 0 and stops the map once there is no room for another.
+static uint8_t MapAdd(MapContext* map, uint32_t type, uint64_t length)
+{
+    AaruOsReadMapExtent* last = map->count ? &map->extents[map->count - 1] : NULL;
+
+    if(last && last->type == type)
+        last->length += length;
+    else
+    {
+        if(map->count == map->max_extents)
+        {
+            map->full = 1;
+            return 0;
+        }
+
+        last         = &map->extents[map->count++];
+        last->offset = map->pos;
+        last->length = length;
+        last->type   = type;
+        last->spare  = 0;
+    }
+
+    map->pos += length;
+
+    return 1;
+}
+
+// Reads up to end telling data and zero blocks apart, stops early when the device ends or fails
+static void MapScan(MapContext* map, uint64_t end)
+{
+    char*    buffer;
+    size_t   granted;
+    uint32_t chunk = MAP_SCAN_SIZE - MAP_SCAN_SIZE % map->block_size;
+    uint32_t read_length;
+    uint32_t duration;
+    uint32_t block;
+    uint32_t off;
+
+    buffer = PoolGet(chunk, &granted);
+
+    if(!buffer)
+    {
+        map->error_no = ENOMEM;
+        return;
+    }
+
+    while(map->pos < end)
+    {
+        if(end - map->pos < chunk) chunk = (uint32_t)(end - map->pos);
+
+        map->error_no = map->backend->os_read(map->device_ctx, buffer, map->pos, chunk, &read_length, &duration);
+
+        for(off = 0; off < read_length; off += block)
+        {
+            block = read_length - off < map->block_size ? read_length - off : map->block_size;
+
+            if(!MapAdd(map,
+                       CompressIsZero((uint8_t*)buffer + off, block) ? AARUREMOTE_OSREAD_MAP_ZERO
+                                                                     : AARUREMOTE_OSREAD_MAP_DATA,
+                       block))
+                break;
+        }
+
+        if(map->error_no || off < read_length) break;
+
+        if(read_length < chunk)
+        {
+            map->ended = 1;
+            break;
+        }
+    }
+
+    PoolPut(buffer);
+}
+
+// Holes come from the device when it can tell them apart, otherwise every block is read to find the zeros
+void OsReadMap(const DeviceBackend*          backend,
+               void*                         device_ctx,
+               const AaruPacketCmdOsReadMap* pkt_cmd_map,
+               AaruPacketResOsReadMap*       pkt_res_map)
+{
+    MapContext map;
+    uint64_t   end = pkt_cmd_map->offset + pkt_cmd_map->length;
+    uint64_t   data;
+    uint64_t   hole;
+    uint8_t    seek = 1;
+    uint32_t   i;
+
+    // Up to the end of the device when it would wrap
+    if(end < pkt_cmd_map->offset) end = UINT64_MAX;
+
+    memset(&map, 0, sizeof(MapContext));
+    map.backend     = backend;
+    map.device_ctx  = device_ctx;
+    map.extents     = pkt_res_map->extents;
+    map.max_extents = pkt_cmd_map->max_extents;
+    map.block_size  = pkt_cmd_map->block_size;
+    map.pos         = pkt_cmd_map->offset;
+
+    while(map.pos < end && !map.ended && !map.full && !map.error_no)
+    {
+        if(seek && backend->os_seek_data(device_ctx, map.pos, &data, &hole) != 0) seek = 0;
+
+        if(!seek)
+        {
+            MapScan(&map, end);
+            break;
+        }
+
+        // Nothing left, the device ends at both of them
+        if(data == hole || hole <= map.pos)
+        {
+            if(data > end) data = end;
+
+            if(data > map.pos) MapAdd(&map, AARUREMOTE_OSREAD_MAP_HOLE, data - map.pos);
+
+            break;
+        }
+
+        if(data > map.pos)
+        {
+            MapAdd(&map, AARUREMOTE_OSREAD_MAP_HOLE, (data < end ? data : end) - map.pos);
+            continue;
+        }
+
+        if(hole > end) hole = end;
+
+        if(pkt_cmd_map->flags & AARUREMOTE_OSREAD_MAP_SCAN_ZEROS)
+            MapScan(&map, hole);
+        else
+            MapAdd(&map, AARUREMOTE_OSREAD_MAP_DATA, hole - map.pos);
+    }
+
+    for(i = 0; i < map.count; i++)
+    {
+        map.extents[i].offset = htole64(map.extents[i].offset);
+        map.extents[i].length = htole64(map.extents[i].length);
+        map.extents[i].type   = htole32(map.extents[i].type);
+    }
+
+    pkt_res_map->error_no     = htole32(map.error_no);
+    pkt_res_map->extent_count = htole32(map.count);
+    pkt_res_map->end          = htole64(map.pos);
+}
@@ -0,0 +1,546 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+
+#include "win32/win32.h"
+#else
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+
+// Only the request line matters, headers past this are ignored
+#define METRICS_REQUEST_SIZE 1024
+#define METRICS_INITIAL_SIZE (64 * 1024)
+// Escaping can double a device path, plus the packet type and opcode
+#define METRICS_LABELS_SIZE 2304
+#define METRICS_LINE_SIZE 2560
+
+typedef struct
+{
+    char*   data;
+    size_t  len;
+    size_t  size;
+    uint8_t failed;
+} MetricsBuffer;
+
+static void MetricsAppend(MetricsBuffer* buffer, const char* text)
+{
+    size_t len = strlen(text);
+    size_t size;
+    char*  data;
+
+    if(buffer->failed) return;
+
+    if(buffer->len + len > buffer->size)
+    {
+        size = buffer->size ? buffer->size : METRICS_INITIAL_SIZE;
+
+        while(size < buffer->len + len) size *= 2;
+
+        data = realloc(buffer->data, size);
+
+        if(!data)
+        {
+            buffer->failed = 1;
+            return;
+        }
+
+        buffer->data = data;
+        buffer->size = size;
+    }
+
+    memcpy(buffer->data + buffer->len, text, len);
+    buffer->len += len;
+}
+
+// 64-bit printf formats differ between every C library we build with
+static char* MetricsUnsigned(char* out, uint64_t value)
+{
+    char digits[21];
+    int  i = 0;
+    int  j = 0;
+
+    do
+    {
+        digits[i++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value);
+
+    while(i > 0) out[j++] = digits[--i];
+
+    out[j] = 0;
+
+    return out;
+}
+
+static char* MetricsSeconds(char* out, uint64_t microseconds)
+{
+    sprintf(out, "%.6f", (double)microseconds / 1000000);
+    return out;
+}
+
+static void MetricsFamily(MetricsBuffer* buffer, const char* name, const char* type, const char* help)
+{
+    char line[METRICS_LINE_SIZE];
+
+    sprintf(line, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    MetricsAppend(buffer, line);
+}
+
+static void MetricsSample(MetricsBuffer* buffer, const char* name, const char* labels, const char* value)
+{
+    char line[METRICS_LINE_SIZE];
+
+    if(labels && *labels)
+        sprintf(line, "%s{%s} %s\n", name, labels, value);
+    else
+        sprintf(line, "%s %s\n", name, value);
+
+    MetricsAppend(buffer, line);
+}
+
+static const char* MetricsPacketName(int8_t packet_type)
+{
+    switch(packet_type)
+    {
+        case AARUREMOTE_PACKET_TYPE_COMMAND_LIST_DEVICES: return "list_devices";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE: return "open_device";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SCSI: return "scsi";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_CHS: return "ata_chs";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_28: return "ata_lba28";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_48: return "ata_lba48";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SDHCI: return "sdhci";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_DEVTYPE: return "get_devtype";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_SDHCI_REGISTERS: return "get_sdhci_registers";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_USB_DATA: return "get_usb_data";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_FIREWIRE_DATA: return "get_firewire_data";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_PCMCIA_DATA: return "get_pcmcia_data";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_CLOSE_DEVICE: return "close_device";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_AM_I_ROOT: return "am_i_root";
+        case AARUREMOTE_PACKET_TYPE_MULTI_COMMAND_SDHCI: return "multi_sdhci";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_REOPEN: return "reopen";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD: return "osread";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_VECTOR: return "osread_vector";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_MAP: return "osread_map";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_STATS: return "get_stats";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ECHO: return "echo";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SINK: return "sink";
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SOURCE: return "source";
+        default: return NULL;
+    }
+}
+
+// Label values escape backslash, double quote and line feed
+static void MetricsEscape(char* out, const char* value)
+{
+    for(; *value; value++)
+    {
+        if(*value == '\\' || *value == '"')
+            *out++ = '\\';
+        else if(*value == '\n')
+        {
+            *out++ = '\\';
+            *out++ = 'n';
+            continue;
+        }
+
+        *out++ = *value;
+    }
+
+    *out = 0;
+}
+
+static void MetricsDeviceLabel(char* out, const AaruStatsDevice* devices, uint32_t device)
+{
+    char path[sizeof(devices->device_path)];
+
+    memcpy(path, devices[device].device_path, sizeof(path));
+    path[sizeof(path) - 1] = 0;
+
+    strcpy(out, "device=\"");
+    MetricsEscape(out + strlen(out), path);
+    strcat(out, "\"");
+}
+
+static void MetricsEntryLabels(char*                  out,
+                               const AaruStatsEntry*  entry,
+                               const AaruStatsDevice* devices,
+                               uint32_t               device_count)
+{
+    const char* name = MetricsPacketName(entry->packet_type);
+
+    if(name)
+        sprintf(out, "packet=\"%s\"", name);
+    else
+        sprintf(out, "packet=\"%d\"", entry->packet_type);
+
+    if(entry->opcode != AARUREMOTE_STATS_NO_OPCODE) sprintf(out + strlen(out), ",opcode=\"0x%02X\"", entry->opcode);
+
+    if(entry->device < 0 || (uint32_t)entry->device >= device_count) return;
+
+    strcat(out, ",");
+    MetricsDeviceLabel(out + strlen(out), devices, (uint32_t)entry->device);
+}
+
+// Upper end of the histogram bucket the quantile falls in, never past the slowest request seen
+static uint64_t MetricsQuantile(const AaruStatsEntry* entry, uint32_t permille)
+{
+    uint64_t target = (entry->count * permille + 999) / 1000;
+    uint64_t seen   = 0;
+    uint64_t upper;
+    uint32_t b;
+
+    if(target == 0) target = 1;
+
+    for(b = 0; b < AARUREMOTE_STATS_BUCKETS; b++)
+    {
+        seen += entry->buckets[b];
+
+        if(seen < target) continue;
+
+        upper = b < 8 ? b : ((uint64_t)(9 + b % 8) << (b / 8 - 1)) - 1;
+
+        return upper < entry->max_time ? upper : entry->max_time;
+    }
+
+    return entry->max_time;
+}
+
+static void MetricsRender(MetricsBuffer*         buffer,
+                          const StatsSummary*    summary,
+                          const AaruStatsDevice* devices,
+                          const AaruStatsEntry*  entries)
+{
+    static const uint32_t quantiles[]      = {500, 900, 990};
+    static const char*    quantile_names[] = {"0.5", "0.9", "0.99"};
+    char                  labels[METRICS_LABELS_SIZE];
+    char                  quantile_labels[METRICS_LABELS_SIZE + 32];
+    char                  value[32];
+    uint64_t              device_in[STATS_MAX_DEVICES];
+    uint64_t              device_out[STATS_MAX_DEVICES];
+    uint64_t              device_errors[STATS_MAX_DEVICES];
+    PoolStats             pool_stats;
+    const AaruStatsEntry* entry;
+    uint32_t              i, q;
+
+    MetricsFamily(buffer, "aaruremote_uptime_seconds", "gauge", "Time since the server started.");
+    MetricsSample(buffer, "aaruremote_uptime_seconds", NULL, MetricsSeconds(value, summary->uptime));
+
+    MetricsFamily(buffer, "aaruremote_sessions_active", "gauge", "Clients currently connected.");
+    MetricsSample(buffer, "aaruremote_sessions_active", NULL, MetricsUnsigned(value, summary->sessions_active));
+
+    MetricsFamily(buffer, "aaruremote_sessions_total", "counter", "Client sessions served.");
+    MetricsSample(buffer, "aaruremote_sessions_total", NULL, MetricsUnsigned(value, summary->sessions));
+
+    MetricsFamily(buffer,
+                  "aaruremote_stats_dropped_total",
+                  "counter",
+                  "Requests not accounted because the statistics table was full.");
+    MetricsSample(buffer, "aaruremote_stats_dropped_total", NULL, MetricsUnsigned(value, summary->dropped));
+
+    MetricsFamily(buffer, "aaruremote_requests_total", "counter", "Requests served.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+        MetricsSample(buffer, "aaruremote_requests_total", labels, MetricsUnsigned(value, entry->count));
+    }
+
+    MetricsFamily(buffer, "aaruremote_request_errors_total", "counter", "Requests that failed.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+        MetricsSample(buffer, "aaruremote_request_errors_total", labels, MetricsUnsigned(value, entry->errors));
+    }
+
+    MetricsFamily(buffer, "aaruremote_request_received_bytes_total", "counter", "Bytes received in requests.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+        MetricsSample(buffer,
+                      "aaruremote_request_received_bytes_total",
+                      labels,
+                      MetricsUnsigned(value, entry->bytes_in));
+    }
+
+    MetricsFamily(buffer, "aaruremote_request_sent_bytes_total", "counter", "Bytes sent in responses.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+        MetricsSample(buffer, "aaruremote_request_sent_bytes_total", labels, MetricsUnsigned(value, entry->bytes_out));
+    }
+
+    MetricsFamily(buffer, "aaruremote_request_duration_seconds", "summary", "Time the device took to serve requests.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+
+        for(q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+        {
+            sprintf(quantile_labels, "%s,quantile=\"%s\"", labels, quantile_names[q]);
+            MetricsSample(buffer,
+                          "aaruremote_request_duration_seconds",
+                          quantile_labels,
+                          MetricsSeconds(value, MetricsQuantile(entry, quantiles[q])));
+        }
+
+        MetricsSample(buffer,
+                      "aaruremote_request_duration_seconds_sum",
+                      labels,
+                      MetricsSeconds(value, entry->total_time));
+        MetricsSample(buffer,
+                      "aaruremote_request_duration_seconds_count",
+                      labels,
+                      MetricsUnsigned(value, entry->count));
+    }
+
+    MetricsFamily(buffer, "aaruremote_request_duration_max_seconds", "gauge", "Slowest request served.");
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        MetricsEntryLabels(labels, entry, devices, summary->device_count);
+        MetricsSample(buffer,
+                      "aaruremote_request_duration_max_seconds",
+                      labels,
+                      MetricsSeconds(value, entry->max_time));
+    }
+
+    // Per device totals, what a dashboard needs to spot a slow or failing drive without summing opcodes
+    memset(device_in, 0, sizeof(device_in));
+    memset(device_out, 0, sizeof(device_out));
+    memset(device_errors, 0, sizeof(device_errors));
+
+    for(i = 0, entry = entries; i < summary->entry_count; i++, entry++)
+    {
+        if(entry->device < 0 || (uint32_t)entry->device >= summary->device_count) continue;
+
+        device_in[entry->device] += entry->bytes_in;
+        device_out[entry->device] += entry->bytes_out;
+        device_errors[entry->device] += entry->errors;
+    }
+
+    MetricsFamily(buffer, "aaruremote_device_received_bytes_total", "counter", "Bytes received for a device.");
+
+    for(i = 0; i < summary->device_count; i++)
+    {
+        MetricsDeviceLabel(labels, devices, i);
+        MetricsSample(buffer, "aaruremote_device_received_bytes_total", labels, MetricsUnsigned(value, device_in[i]));
+    }
+
+    MetricsFamily(buffer, "aaruremote_device_sent_bytes_total", "counter", "Bytes sent from a device.");
+
+    for(i = 0; i < summary->device_count; i++)
+    {
+        MetricsDeviceLabel(labels, devices, i);
+        MetricsSample(buffer, "aaruremote_device_sent_bytes_total", labels, MetricsUnsigned(value, device_out[i]));
+    }
+
+    MetricsFamily(buffer, "aaruremote_device_errors_total", "counter", "Requests that failed on a device.");
+
+    for(i = 0; i < summary->device_count; i++)
+    {
+        MetricsDeviceLabel(labels, devices, i);
+        MetricsSample(buffer, "aaruremote_device_errors_total", labels, MetricsUnsigned(value, device_errors[i]));
+    }
+
+    PoolGetStats(&pool_stats);
+
+    MetricsFamily(buffer, "aaruremote_pool_bytes", "gauge", "Memory held for large transfer buffers.");
+    MetricsSample(buffer, "aaruremote_pool_bytes", "state=\"in_use\"", MetricsUnsigned(value, pool_stats.in_use));
+    MetricsSample(buffer, "aaruremote_pool_bytes", "state=\"cached\"", MetricsUnsigned(value, pool_stats.cached));
+
+    MetricsFamily(buffer, "aaruremote_pool_peak_bytes", "gauge", "Most memory ever held for large transfer buffers.");
+    MetricsSample(buffer, "aaruremote_pool_peak_bytes", NULL, MetricsUnsigned(value, pool_stats.peak));
+
+    MetricsFamily(buffer, "aaruremote_pool_limit_bytes", "gauge", "Memory allowed for large transfer buffers.");
+    MetricsSample(buffer, "aaruremote_pool_limit_bytes", NULL, MetricsUnsigned(value, server_options.pool_cap));
+
+    MetricsFamily(buffer, "aaruremote_pool_requests_total", "counter", "Large transfer buffers asked for.");
+    MetricsSample(buffer, "aaruremote_pool_requests_total", "result=\"hit\"", MetricsUnsigned(value, pool_stats.hits));
+    MetricsSample(
+        buffer, "aaruremote_pool_requests_total", "result=\"miss\"", MetricsUnsigned(value, pool_stats.misses));
+    MetricsSample(
+        buffer, "aaruremote_pool_requests_total", "result=\"failure\"", MetricsUnsigned(value, pool_stats.failures));
+
+    MetricsFamily(buffer, "aaruremote_pool_evictions_total", "counter", "Idle buffers freed to make room.");
+    MetricsSample(buffer, "aaruremote_pool_evictions_total", NULL, MetricsUnsigned(value, pool_stats.evictions));
+}
+
+static int32_t MetricsWrite(void* cli_ctx, const char* data, size_t len)
+{
+    int32_t ret;
+
+    while(len > 0)
+    {
+        ret = NetWrite(cli_ctx, data, len > 0x40000000 ? 0x40000000 : (int32_t)len);
+
+        if(ret <= 0) return -1;
+
+        data += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+static void MetricsRespond(void* cli_ctx, const char* status, const char* body, size_t len)
+{
+    char header[256];
+
+    sprintf(header,
+            "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %lu\r\n"
+            "Connection: close\r\n\r\n",
+            status,
+            (unsigned long)len);
+
+    if(MetricsWrite(cli_ctx, header, strlen(header)) == 0) MetricsWrite(cli_ctx, body, len);
+}
+
+static void MetricsServe(void*            cli_ctx,
+                         MetricsBuffer*   body,
+                         StatsSummary*    summary,
+                         AaruStatsDevice* devices,
+                         AaruStatsEntry*  entries)
+{
+    char    request[METRICS_REQUEST_SIZE];
+    int32_t len = 0;
+    int32_t ret;
+
+    // NetRecv waits for everything asked for, so go a byte at a time until the blank line ending the headers
+    while(len < METRICS_REQUEST_SIZE - 1)
+    {
+        ret = NetRecv(cli_ctx, request + len, 1, 0);
+
+        if(ret <= 0) break;
+
+        len++;
+
+        if(len >= 2 && request[len - 1] == '\n' &&
+           (request[len - 2] == '\n' || (len >= 4 && strncmp(request + len - 4, "\r\n\r\n", 4) == 0)))
+            break;
+    }
+
+    request[len] = 0;
+
+    if(strncmp(request, "GET /metrics", 12) != 0 || (request[12] != ' ' && request[12] != '?'))
+    {
+        MetricsRespond(cli_ctx, "404 Not Found", "Not found\n", 10);
+        return;
+    }
+
+    StatsCopy(summary, devices, entries);
+
+    body->len    = 0;
+    body->failed = 0;
+    MetricsRender(body, summary, devices, entries);
+
+    if(body->failed)
+    {
+        MetricsRespond(cli_ctx, "500 Internal Server Error", "Out of memory\n", 14);
+        return;
+    }
+
+    MetricsRespond(cli_ctx, "200 OK", body->data, body->len);
+}
+
+// Serves the statistics to monitoring scrapers, on its own thread so a slow scrape never stalls a dump
+void* MetricsLoop(void* arguments)
+{
+    struct sockaddr_in serv_addr;
+    struct sockaddr_in cli_addr;
+    socklen_t          cli_len;
+    void*              net_ctx;
+    void*              cli_ctx;
+    StatsSummary       summary;
+    AaruStatsDevice*   devices;
+    AaruStatsEntry*    entries;
+    MetricsBuffer      body;
+
+    memset(&body, 0, sizeof(MetricsBuffer));
+
+    devices = malloc(sizeof(AaruStatsDevice) * STATS_MAX_DEVICES);
+    entries = malloc(sizeof(AaruStatsEntry) * STATS_MAX_ENTRIES);
+
+    if(!devices || !entries)
+    {
+        printf("Error %d allocating memory for metrics.\n", errno);
+        free(devices);
+        free(entries);
+        return NULL;
+    }
+
+    net_ctx = NetSocket(AF_INET, SOCK_STREAM, 0);
+
+    if(!net_ctx)
+    {
+        printf("Error %d opening metrics socket.\n", errno);
+        free(devices);
+        free(entries);
+        return NULL;
+    }
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family      = AF_INET;
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.sin_port        = htons(server_options.metrics_port);
+
+    if(NetBind(net_ctx, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0 || NetListen(net_ctx, 4) != 0)
+    {
+        printf("Error %d listening for metrics on port %d.\n", errno, server_options.metrics_port);
+        NetClose(net_ctx);
+        free(devices);
+        free(entries);
+        return NULL;
+    }
+
+    printf("Serving metrics on port %d.\n", server_options.metrics_port);
+
+    for(;;)
+    {
+        cli_len = sizeof(cli_addr);
+        cli_ctx = NetAccept(net_ctx, (struct sockaddr*)&cli_addr, &cli_len);
+
+        if(!cli_ctx)
+        {
+            printf("Error %d accepting metrics connection.\n", errno);
+            break;
+        }
+
+        MetricsServe(cli_ctx, &body, &summary, devices, entries);
+        NetClose(cli_ctx);
+    }
+
+    NetClose(net_ctx);
+    free(body.data);
+    free(devices);
+    free(entries);
+
+    return NULL;
+}
@@ -0,0 +1,139 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "aaruremote.h"
+
+typedef struct
+{
+    char*   data;
+    size_t  size;
+    uint8_t in_use;
+} PoolBuffer;
+
+static PoolBuffer pool_buffers[POOL_MAX_BUFFERS];
+static PoolStats  pool_stats;
+
+// Sizes go up in powers of two so buffers from different requests can be reused for each other
+static size_t PoolRound(size_t size)
+{
+    size_t rounded = POOL_MIN_SIZE;
+
+    while(rounded < size)
+    {
+        if(rounded > ((size_t)-1) / 2) return 0;
+
+        rounded <<= 1;
+    }
+
+    return rounded;
+}
+
+static void PoolRelease(PoolBuffer* buffer)
+{
+    FreeLargeBuffer(buffer->data, buffer->size);
+    pool_stats.cached -= buffer->size;
+    pool_stats.evictions++;
+
+    buffer->data = NULL;
+    buffer->size = 0;
+}
+
+void* PoolGet(size_t size, size_t* granted)
+{
+    PoolBuffer* slot = NULL;
+    int         i;
+
+    size = PoolRound(size);
+
+    if(size == 0) return NULL;
+
+    for(i = 0; i < POOL_MAX_BUFFERS; i++)
+    {
+        if(pool_buffers[i].in_use || pool_buffers[i].size != size) continue;
+
+        pool_buffers[i].in_use = 1;
+        pool_stats.hits++;
+        pool_stats.cached -= size;
+        pool_stats.in_use += size;
+        *granted = size;
+
+        return pool_buffers[i].data;
+    }
+
+    pool_stats.misses++;
+
+    // Idle buffers of other sizes go first when the new one would not fit under the cap
+    for(i = 0; i < POOL_MAX_BUFFERS && pool_stats.in_use + pool_stats.cached + size > server_options.pool_cap; i++)
+        if(pool_buffers[i].data && !pool_buffers[i].in_use) PoolRelease(&pool_buffers[i]);
+
+    if(pool_stats.in_use + pool_stats.cached + size > server_options.pool_cap)
+    {
+        pool_stats.failures++;
+        return NULL;
+    }
+
+    for(i = 0; i < POOL_MAX_BUFFERS && !slot; i++)
+        if(!pool_buffers[i].data) slot = &pool_buffers[i];
+
+    for(i = 0; i < POOL_MAX_BUFFERS && !slot; i++)
+    {
+        if(pool_buffers[i].in_use) continue;
+
+        PoolRelease(&pool_buffers[i]);
+        slot = &pool_buffers[i];
+    }
+
+    if(slot) slot->data = AllocateLargeBuffer(size, server_options.huge_pages);
+
+    if(!slot || !slot->data)
+    {
+        pool_stats.failures++;
+        return NULL;
+    }
+
+    slot->size   = size;
+    slot->in_use = 1;
+    pool_stats.in_use += size;
+
+    if(pool_stats.in_use + pool_stats.cached > pool_stats.peak) pool_stats.peak = pool_stats.in_use + pool_stats.cached;
+
+    *granted = size;
+
+    return slot->data;
+}
+
+void PoolPut(void* buffer)
+{
+    int i;
+
+    if(!buffer) return;
+
+    for(i = 0; i < POOL_MAX_BUFFERS; i++)
+    {
+        if(pool_buffers[i].data != buffer || !pool_buffers[i].in_use) continue;
+
+        pool_buffers[i].in_use = 0;
+        pool_stats.in_use -= pool_buffers[i].size;
+        pool_stats.cached += pool_buffers[i].size;
+
+        return;
+    }
+}
+
+void PoolGetStats(PoolStats* stats) { memcpy(stats, &pool_stats, sizeof(PoolStats)); }
@@ -0,0 +1,285 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+#include "endian.h"
+
+// Only the worker thread writes these, so it never waits. Other threads read through StatsCopy, which copies again
+// whatever the worker changed meanwhile: each entry has its own sequence, the rest share stats_sequence.
+static AaruStatsEntry    stats_entries[STATS_MAX_ENTRIES];
+static volatile uint32_t stats_entry_sequences[STATS_MAX_ENTRIES];
+static volatile uint8_t  stats_used[STATS_MAX_ENTRIES];
+static uint32_t          stats_entry_count;
+static AaruStatsDevice   stats_devices[STATS_MAX_DEVICES];
+static uint32_t          stats_device_count;
+static int32_t           stats_device = AARUREMOTE_STATS_NO_DEVICE;
+static uint64_t          stats_dropped;
+static uint64_t          stats_started;
+static uint32_t          stats_sessions_active;
+static uint64_t          stats_sessions;
+static volatile uint32_t stats_sequence;
+
+// Sequence is odd while the worker writes
+static void StatsWriteBegin(volatile uint32_t* sequence)
+{
+    (*sequence)++;
+    MemoryFence();
+}
+
+static void StatsWriteEnd(volatile uint32_t* sequence)
+{
+    MemoryFence();
+    (*sequence)++;
+}
+
+static uint32_t StatsReadBegin(const volatile uint32_t* sequence)
+{
+    uint32_t start;
+
+    while((start = *sequence) & 1)
+        ;
+
+    MemoryFence();
+
+    return start;
+}
+
+// What was read is only good if the sequence did not move meanwhile
+static uint8_t StatsReadAgain(const volatile uint32_t* sequence, uint32_t start)
+{
+    MemoryFence();
+
+    return *sequence != start;
+}
+
+void StatsInit() { stats_started = GetMonotonicMicroseconds(); }
+
+void StatsSessionStarted()
+{
+    StatsWriteBegin(&stats_sequence);
+    stats_sessions_active++;
+    stats_sessions++;
+    StatsWriteEnd(&stats_sequence);
+}
+
+void StatsSessionEnded()
+{
+    StatsWriteBegin(&stats_sequence);
+    stats_sessions_active--;
+    StatsWriteEnd(&stats_sequence);
+}
+
+void StatsSetDevice(const char* device_path)
+{
+    uint32_t i;
+
+    stats_device = AARUREMOTE_STATS_NO_DEVICE;
+
+    if(!device_path) return;
+
+    for(i = 0; i < stats_device_count; i++)
+    {
+        if(strncmp(stats_devices[i].device_path, device_path, sizeof(stats_devices[i].device_path) - 1) != 0)
+            continue;
+
+        stats_device = (int32_t)i;
+        return;
+    }
+
+    // Once full, new devices are accounted together with no device
+    if(stats_device_count >= STATS_MAX_DEVICES) return;
+
+    StatsWriteBegin(&stats_sequence);
+    strncpy(stats_devices[stats_device_count].device_path,
+            device_path,
+            sizeof(stats_devices[stats_device_count].device_path) - 1);
+    stats_device = (int32_t)stats_device_count++;
+    StatsWriteEnd(&stats_sequence);
+}
+
+static uint32_t StatsBucket(uint32_t time)
+{
+    uint32_t exponent = 0;
+
+    if(time < 8) return time;
+
+    while((time >> exponent) > 1) exponent++;
+
+    return (exponent - 2) * 8 + ((time >> (exponent - 3)) & 7);
+}
+
+// Open addressing on the key, the table never shrinks so lookups stop at the first free slot
+static AaruStatsEntry* StatsFind(int8_t packet_type, int16_t opcode, int32_t device)
+{
+    uint32_t hash = ((uint32_t)(uint8_t)packet_type * 257 + (uint32_t)(opcode + 1)) * 31 + (uint32_t)(device + 1);
+    uint32_t i;
+    uint32_t slot;
+
+    for(i = 0; i < STATS_MAX_ENTRIES; i++)
+    {
+        slot = (hash + i) % STATS_MAX_ENTRIES;
+
+        if(!stats_used[slot])
+        {
+            stats_entries[slot].packet_type = packet_type;
+            stats_entries[slot].opcode      = opcode;
+            stats_entries[slot].device      = device;
+            stats_entry_count++;
+
+            // Readers only look at the entry once its key is there
+            MemoryFence();
+            stats_used[slot] = 1;
+
+            return &stats_entries[slot];
+        }
+
+        if(stats_entries[slot].packet_type == packet_type && stats_entries[slot].opcode == opcode &&
+           stats_entries[slot].device == device)
+            return &stats_entries[slot];
+    }
+
+    return NULL;
+}
+
+void StatsRecord(int8_t   packet_type,
+                 int16_t  opcode,
+                 uint32_t bytes_in,
+                 uint32_t bytes_out,
+                 uint64_t time,
+                 uint8_t  error)
+{
+    AaruStatsEntry*    entry;
+    volatile uint32_t* sequence;
+
+    entry = StatsFind(packet_type, opcode, stats_device);
+
+    if(!entry)
+    {
+        StatsWriteBegin(&stats_sequence);
+        stats_dropped++;
+        StatsWriteEnd(&stats_sequence);
+        return;
+    }
+
+    if(time > UINT32_MAX) time = UINT32_MAX;
+
+    sequence = &stats_entry_sequences[entry - stats_entries];
+    StatsWriteBegin(sequence);
+
+    entry->count++;
+    entry->bytes_in += bytes_in;
+    entry->bytes_out += bytes_out;
+    entry->total_time += time;
+    entry->buckets[StatsBucket((uint32_t)time)]++;
+
+    if(error) entry->errors++;
+
+    if(time > entry->max_time) entry->max_time = (uint32_t)time;
+
+    StatsWriteEnd(sequence);
+}
+
+uint32_t StatsSize()
+{
+    return sizeof(AaruPacketResStats) + sizeof(AaruStatsDevice) * stats_device_count +
+           sizeof(AaruStatsEntry) * stats_entry_count;
+}
+
+// Fills a response of StatsSize() bytes, little endian as everything on the wire
+void StatsSnapshot(AaruPacketResStats* pkt_res_stats)
+{
+    AaruStatsDevice* devices = (AaruStatsDevice*)((char*)pkt_res_stats + sizeof(AaruPacketResStats));
+    AaruStatsEntry*  entries = (AaruStatsEntry*)((char*)devices + sizeof(AaruStatsDevice) * stats_device_count);
+    AaruStatsEntry*  entry;
+    uint32_t         i, j;
+
+    memset(pkt_res_stats, 0, sizeof(AaruPacketResStats));
+    pkt_res_stats->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+    pkt_res_stats->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+    pkt_res_stats->hdr.version     = AARUREMOTE_PACKET_VERSION;
+    pkt_res_stats->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_STATS;
+    pkt_res_stats->hdr.len         = htole32(StatsSize());
+    pkt_res_stats->uptime          = htole64(GetMonotonicMicroseconds() - stats_started);
+    pkt_res_stats->dropped         = htole64(stats_dropped);
+    pkt_res_stats->device_count    = htole32(stats_device_count);
+    pkt_res_stats->entry_count     = htole32(stats_entry_count);
+
+    memcpy(devices, stats_devices, sizeof(AaruStatsDevice) * stats_device_count);
+
+    entry = entries;
+
+    for(i = 0; i < STATS_MAX_ENTRIES; i++)
+    {
+        if(!stats_used[i]) continue;
+
+        entry->packet_type = stats_entries[i].packet_type;
+        entry->spare       = 0;
+        entry->opcode      = (int16_t)htole16((uint16_t)stats_entries[i].opcode);
+        entry->device      = (int32_t)htole32((uint32_t)stats_entries[i].device);
+        entry->count       = htole64(stats_entries[i].count);
+        entry->errors      = htole64(stats_entries[i].errors);
+        entry->bytes_in    = htole64(stats_entries[i].bytes_in);
+        entry->bytes_out   = htole64(stats_entries[i].bytes_out);
+        entry->total_time  = htole64(stats_entries[i].total_time);
+        entry->max_time    = htole32(stats_entries[i].max_time);
+
+        for(j = 0; j < AARUREMOTE_STATS_BUCKETS; j++) entry->buckets[j] = htole32(stats_entries[i].buckets[j]);
+
+        entry++;
+    }
+}
+
+// Host order copy for readers on other threads, arrays must hold STATS_MAX_DEVICES and STATS_MAX_ENTRIES.
+// Every entry is consistent on its own, a request recorded while this runs may be in some entries and not others.
+void StatsCopy(StatsSummary* summary, AaruStatsDevice* devices, AaruStatsEntry* entries)
+{
+    uint32_t start;
+    uint32_t i;
+
+    summary->uptime      = GetMonotonicMicroseconds() - stats_started;
+    summary->entry_count = 0;
+
+    do
+    {
+        start                    = StatsReadBegin(&stats_sequence);
+        summary->dropped         = stats_dropped;
+        summary->sessions        = stats_sessions;
+        summary->sessions_active = stats_sessions_active;
+        summary->device_count    = stats_device_count;
+
+        memcpy(devices, stats_devices, sizeof(AaruStatsDevice) * summary->device_count);
+    } while(StatsReadAgain(&stats_sequence, start));
+
+    for(i = 0; i < STATS_MAX_ENTRIES; i++)
+    {
+        if(!stats_used[i]) continue;
+
+        do
+        {
+            start = StatsReadBegin(&stats_entry_sequences[i]);
+            memcpy(&entries[summary->entry_count], &stats_entries[i], sizeof(AaruStatsEntry));
+        } while(StatsReadAgain(&stats_entry_sequences[i], start));
+
+        summary->entry_count++;
+    }
+}
@@ -0,0 +1,877 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../endian.h"
+#include "client.h"
+
+#ifndef AARUREMOTE_BENCH_SERVER
+#define AARUREMOTE_BENCH_SERVER "aaruremote"
+#endif
+
+#define BENCH_MAX_DEVICES 64
+#define BENCH_MAX_CLIENTS 256
+#define BENCH_MAX_SERVER_OPTIONS 16
+#define BENCH_BASE_PORT 16666
+#define BENCH_CONNECT_TIMEOUT 10000000
+#define BENCH_SECTOR 512
+
+#define BENCH_WORKLOAD_SMALL 0
+#define BENCH_WORKLOAD_SEQUENTIAL 1
+#define BENCH_WORKLOAD_MIXED 2
+#define BENCH_WORKLOAD_ECHO 3
+#define BENCH_WORKLOAD_SINK 4
+#define BENCH_WORKLOAD_SOURCE 5
+
+#define BENCH_COMMAND_OSREAD 0
+#define BENCH_COMMAND_SCSI 1
+#define BENCH_COMMAND_ATA 2
+
+typedef struct
+{
+    const char* name;
+    uint32_t    block_size;
+    const char* description;
+} BenchWorkload;
+
+static const BenchWorkload bench_workloads[] = {
+    {"small", BENCH_SECTOR, "one sector OS reads at random offsets, as many as the server can take"},
+    {"sequential", 1024 * 1024, "large OS reads one after the other through the whole device"},
+    {"mixed", 4096, "SCSI READ(10), ATA READ SECTORS and OS reads in turn, those the device takes, at random offsets"},
+    {"echo", BENCH_SECTOR, "payloads the server sends back, the link round trip without any device"},
+    {"sink", 1024 * 1024, "payloads the server throws away, the link bandwidth towards the server"},
+    {"source", 1024 * 1024, "data the server makes up, the link bandwidth towards the client"}};
+
+typedef struct
+{
+    const char* server;
+    const char* server_options[BENCH_MAX_SERVER_OPTIONS];
+    uint32_t    server_option_count;
+    uint16_t    base_port;
+    uint32_t    workload;
+    uint32_t    clients;
+    uint32_t    duration;
+    uint32_t    block_size;
+    const char* devices[BENCH_MAX_DEVICES];
+    uint64_t    device_sizes[BENCH_MAX_DEVICES];
+    uint32_t    device_count;
+    uint32_t    images;
+    uint32_t    image_size;
+} BenchOptions;
+
+typedef struct
+{
+    BenchOptions*   options;
+    uint32_t        index;
+    pthread_t       thread;
+    pid_t           server;
+    uint64_t        random;
+    uint64_t        offset;
+    uint32_t        commands[3];
+    uint32_t        command_count;
+    uint64_t        operations;
+    uint64_t        errors;
+    uint64_t        bytes;
+    uint64_t        elapsed;
+    ClientLatencies latencies;
+    ClientBuffer    packet;
+    ClientBuffer    response;
+    int             failed;
+} BenchClient;
+
+static pthread_barrier_t bench_barrier;
+static int               bench_abort;
+
+static void PrintUsage(const char* name)
+{
+    size_t i;
+
+    printf("Usage: %s [options]\n", name);
+    printf("  --workload NAME       Workload to run (default small)\n");
+    printf("  --clients N           Clients sending commands at the same time, each to its own server (default 1)\n");
+    printf("  --device PATH         Device or image to read, repeat for more, clients take them in turn\n");
+    printf("  --images N            Without --device, number of images to create (default 1)\n");
+    printf("  --image-size N        Size of the images created in MiB (default 64)\n");
+    printf("  --duration N          Seconds to run (default 5)\n");
+    printf("  --block-size N        Bytes each command reads (default depends on the workload)\n");
+    printf("  --server PATH         Server to start (default %s)\n", AARUREMOTE_BENCH_SERVER);
+    printf("  --server-option OPT   Pass OPT to the server, repeat for more\n");
+    printf("  --base-port N         First port servers listen on, one more for every client (default %d)\n",
+           BENCH_BASE_PORT);
+    printf("  --help                Show this help\n");
+    printf("\nWorkloads:\n");
+
+    for(i = 0; i < sizeof(bench_workloads) / sizeof(BenchWorkload); i++)
+        printf("  %-20s  %s\n", bench_workloads[i].name, bench_workloads[i].description);
+}
+
+static int ParseNumber(const char* text, const char* what, long min, long max, long* value)
+{
+    char* end;
+
+    *value = strtol(text, &end, 10);
+
+    if(*end == 0 && *value >= min && *value <= max) return 0;
+
+    fprintf(stderr, "Invalid %s %s\n", what, text);
+    return -1;
+}
+
+static int ParseArguments(int argc, char* argv[], BenchOptions* options)
+{
+    int    i;
+    long   value;
+    size_t w;
+
+    memset(options, 0, sizeof(BenchOptions));
+    options->server     = AARUREMOTE_BENCH_SERVER;
+    options->base_port  = BENCH_BASE_PORT;
+    options->clients    = 1;
+    options->duration   = 5;
+    options->images     = 1;
+    options->image_size = 64;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--workload") == 0 && i + 1 < argc)
+        {
+            i++;
+
+            for(w = 0; w < sizeof(bench_workloads) / sizeof(BenchWorkload); w++)
+                if(strcmp(argv[i], bench_workloads[w].name) == 0) break;
+
+            if(w == sizeof(bench_workloads) / sizeof(BenchWorkload))
+            {
+                fprintf(stderr, "Unknown workload %s\n", argv[i]);
+                return -1;
+            }
+
+            options->workload = (uint32_t)w;
+        }
+        else if(strcmp(argv[i], "--clients") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "client count", 1, BENCH_MAX_CLIENTS, &value)) return -1;
+
+            options->clients = (uint32_t)value;
+        }
+        else if(strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            if(options->device_count == BENCH_MAX_DEVICES)
+            {
+                fprintf(stderr, "Too many devices, at most %d\n", BENCH_MAX_DEVICES);
+                return -1;
+            }
+
+            options->devices[options->device_count++] = argv[++i];
+        }
+        else if(strcmp(argv[i], "--images") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "image count", 1, BENCH_MAX_DEVICES, &value)) return -1;
+
+            options->images = (uint32_t)value;
+        }
+        else if(strcmp(argv[i], "--image-size") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "image size", 1, 1024 * 1024, &value)) return -1;
+
+            options->image_size = (uint32_t)value;
+        }
+        else if(strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "duration", 1, 86400, &value)) return -1;
+
+            options->duration = (uint32_t)value;
+        }
+        else if(strcmp(argv[i], "--block-size") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "block size", BENCH_SECTOR, 64 * 1024 * 1024, &value)) return -1;
+
+            options->block_size = (uint32_t)value;
+        }
+        else if(strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+            options->server = argv[++i];
+        else if(strcmp(argv[i], "--server-option") == 0 && i + 1 < argc)
+        {
+            if(options->server_option_count == BENCH_MAX_SERVER_OPTIONS)
+            {
+                fprintf(stderr, "Too many server options, at most %d\n", BENCH_MAX_SERVER_OPTIONS);
+                return -1;
+            }
+
+            options->server_options[options->server_option_count++] = argv[++i];
+        }
+        else if(strcmp(argv[i], "--base-port") == 0 && i + 1 < argc)
+        {
+            if(ParseNumber(argv[++i], "base port", 1, 65535, &value)) return -1;
+
+            options->base_port = (uint16_t)value;
+        }
+        else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            PrintUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(options->base_port + options->clients - 1 > 65535)
+    {
+        fprintf(stderr, "Not enough ports above %u for %u clients\n", options->base_port, options->clients);
+        return -1;
+    }
+
+    if(!options->block_size) options->block_size = bench_workloads[options->workload].block_size;
+
+    // Commands address whole sectors
+    options->block_size -= options->block_size % BENCH_SECTOR;
+
+    // Every command gets a single response
+    if((options->workload == BENCH_WORKLOAD_ECHO || options->workload == BENCH_WORKLOAD_SOURCE) &&
+       options->block_size > AARUREMOTE_DIAGNOSTICS_MAX_CHUNK)
+    {
+        fprintf(stderr,
+                "Block size of the %s workload is at most %d\n",
+                bench_workloads[options->workload].name,
+                AARUREMOTE_DIAGNOSTICS_MAX_CHUNK);
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint64_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+// Images are filled with noise so nothing on the way can cheat by finding them empty
+static int CreateImages(BenchOptions* options)
+{
+    static char paths[BENCH_MAX_DEVICES][32];
+    uint64_t*   chunk;
+    uint64_t    state = 0x9E3779B97F4A7C15ULL;
+    uint32_t    i;
+    uint32_t    mib;
+    size_t      word;
+    int         fd;
+
+    chunk = malloc(1024 * 1024);
+
+    if(!chunk)
+    {
+        fprintf(stderr, "Error %d allocating memory for the images.\n", errno);
+        return -1;
+    }
+
+    for(i = 0; i < options->images; i++)
+    {
+        strcpy(paths[i], "/tmp/aaruremote-bench-XXXXXX");
+        fd = mkstemp(paths[i]);
+
+        if(fd < 0)
+        {
+            fprintf(stderr, "Error %d creating image.\n", errno);
+            free(chunk);
+            return -1;
+        }
+
+        options->devices[options->device_count]        = paths[i];
+        options->device_sizes[options->device_count++] = (uint64_t)options->image_size * 1024 * 1024;
+
+        for(mib = 0; mib < options->image_size; mib++)
+        {
+            for(word = 0; word < 1024 * 1024 / sizeof(uint64_t); word++) chunk[word] = NextRandom(&state);
+
+            if(ClientSend(fd, chunk, 1024 * 1024))
+            {
+                fprintf(stderr, "Error %d writing image %s.\n", errno, paths[i]);
+                close(fd);
+                free(chunk);
+                return -1;
+            }
+        }
+
+        close(fd);
+    }
+
+    free(chunk);
+
+    return 0;
+}
+
+static void RemoveImages(BenchOptions* options)
+{
+    uint32_t i;
+
+    for(i = 0; i < options->device_count; i++) unlink(options->devices[i]);
+}
+
+// Devices are local as the servers run here, so their size can be found directly, emulated ones from their image
+static int FindDeviceSizes(BenchOptions* options)
+{
+    uint32_t    i;
+    off_t       size;
+    int         fd;
+    const char* path;
+
+    for(i = 0; i < options->device_count; i++)
+    {
+        path = options->devices[i];
+
+        if(strncmp(path, "emu:", 4) == 0 && strchr(path + 4, ':')) path = strchr(path + 4, ':') + 1;
+
+        fd = open(path, O_RDONLY);
+
+        if(fd < 0)
+        {
+            fprintf(stderr, "Error %d opening %s.\n", errno, options->devices[i]);
+            return -1;
+        }
+
+        size = lseek(fd, 0, SEEK_END);
+        close(fd);
+
+        if(size < (off_t)options->block_size)
+        {
+            fprintf(stderr, "Cannot find the size of %s or it is smaller than a block.\n", options->devices[i]);
+            return -1;
+        }
+
+        options->device_sizes[i] = (uint64_t)size;
+    }
+
+    return 0;
+}
+
+static pid_t StartServer(BenchOptions* options, uint16_t port)
+{
+    const char* args[BENCH_MAX_SERVER_OPTIONS + 4];
+    char        port_text[8];
+    uint32_t    i;
+    pid_t       pid;
+    int         null_fd;
+
+    sprintf(port_text, "%u", port);
+    args[0] = options->server;
+    args[1] = "--port";
+    args[2] = port_text;
+
+    for(i = 0; i < options->server_option_count; i++) args[3 + i] = options->server_options[i];
+
+    args[3 + i] = NULL;
+
+    pid = fork();
+
+    if(pid != 0) return pid;
+
+    // Server chatter would mix with the results
+    null_fd = open("/dev/null", O_WRONLY);
+
+    if(null_fd >= 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+
+    execv(options->server, (char* const*)args);
+    _exit(127);
+}
+
+// Servers take a moment to start listening, keep trying until they do
+static int ConnectServer(uint16_t port)
+{
+    uint64_t deadline = ClientMicroseconds() + BENCH_CONNECT_TIMEOUT;
+    int      fd;
+
+    for(;;)
+    {
+        fd = ClientConnect("127.0.0.1", port, "aaruremote-bench");
+
+        if(fd >= 0 || errno != ECONNREFUSED || ClientMicroseconds() >= deadline) return fd;
+
+        ClientSleepUntil(ClientMicroseconds() + 50000);
+    }
+}
+
+// Offset of the next command, in whole blocks inside the device
+static uint64_t NextOffset(BenchClient* client, uint64_t device_size)
+{
+    uint64_t blocks = device_size / client->options->block_size;
+    uint64_t offset;
+
+    if(client->options->workload != BENCH_WORKLOAD_SEQUENTIAL)
+        return NextRandom(&client->random) % blocks * client->options->block_size;
+
+    offset         = client->offset;
+    client->offset = (client->offset + client->options->block_size) % (blocks * client->options->block_size);
+
+    return offset;
+}
+
+static uint32_t BuildOsRead(BenchClient* client, uint64_t offset)
+{
+    AaruPacketCmdOsRead* pkt_cmd_osread;
+
+    pkt_cmd_osread = ClientReserve(&client->packet, sizeof(AaruPacketCmdOsRead));
+
+    if(!pkt_cmd_osread) return 0;
+
+    ClientFillHeader(&pkt_cmd_osread->hdr, AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD, sizeof(AaruPacketCmdOsRead));
+    pkt_cmd_osread->offset = htole64(offset);
+    pkt_cmd_osread->length = htole32(client->options->block_size);
+
+    return sizeof(AaruPacketCmdOsRead);
+}
+
+static uint32_t BuildScsiRead(BenchClient* client, uint64_t offset)
+{
+    AaruPacketCmdScsi* pkt_cmd_scsi;
+    uint8_t*           cdb;
+    uint32_t           lba    = (uint32_t)(offset / BENCH_SECTOR);
+    uint32_t           blocks = client->options->block_size / BENCH_SECTOR;
+    uint32_t           len    = sizeof(AaruPacketCmdScsi) + 10 + client->options->block_size;
+
+    pkt_cmd_scsi = ClientReserve(&client->packet, len);
+
+    if(!pkt_cmd_scsi) return 0;
+
+    memset(pkt_cmd_scsi, 0, len);
+    ClientFillHeader(&pkt_cmd_scsi->hdr, AARUREMOTE_PACKET_TYPE_COMMAND_SCSI, len);
+    pkt_cmd_scsi->cdb_len   = htole32(10);
+    pkt_cmd_scsi->buf_len   = htole32(client->options->block_size);
+    pkt_cmd_scsi->direction = (int32_t)htole32(AARUREMOTE_SCSI_DIRECTION_IN);
+    pkt_cmd_scsi->timeout   = htole32(10);
+
+    cdb    = (uint8_t*)pkt_cmd_scsi + sizeof(AaruPacketCmdScsi);
+    cdb[0] = 0x28;
+    cdb[2] = (uint8_t)(lba >> 24);
+    cdb[3] = (uint8_t)(lba >> 16);
+    cdb[4] = (uint8_t)(lba >> 8);
+    cdb[5] = (uint8_t)lba;
+    cdb[7] = (uint8_t)(blocks >> 8);
+    cdb[8] = (uint8_t)blocks;
+
+    return len;
+}
+
+static uint32_t BuildAtaRead(BenchClient* client, uint64_t offset)
+{
+    AaruPacketCmdAtaLba28* pkt_cmd_ata;
+    uint32_t               lba    = (uint32_t)(offset / BENCH_SECTOR) & 0x0FFFFFFF;
+    uint32_t               blocks = client->options->block_size / BENCH_SECTOR;
+    uint32_t               len;
+
+    // READ SECTORS counts up to 256 sectors
+    if(blocks > 256) blocks = 256;
+
+    len         = sizeof(AaruPacketCmdAtaLba28) + blocks * BENCH_SECTOR;
+    pkt_cmd_ata = ClientReserve(&client->packet, len);
+
+    if(!pkt_cmd_ata) return 0;
+
+    memset(pkt_cmd_ata, 0, len);
+    ClientFillHeader(&pkt_cmd_ata->hdr, AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_28, len);
+    pkt_cmd_ata->buf_len                = htole32(blocks * BENCH_SECTOR);
+    pkt_cmd_ata->registers.sector_count = (uint8_t)blocks;
+    pkt_cmd_ata->registers.lba_low      = (uint8_t)lba;
+    pkt_cmd_ata->registers.lba_mid      = (uint8_t)(lba >> 8);
+    pkt_cmd_ata->registers.lba_high     = (uint8_t)(lba >> 16);
+    pkt_cmd_ata->registers.device_head  = (uint8_t)(0x40 | (lba >> 24));
+    pkt_cmd_ata->registers.command      = 0x20;
+    pkt_cmd_ata->protocol               = AARUREMOTE_ATA_PROTOCOL_PIO_IN;
+    pkt_cmd_ata->transfer_register      = 2;
+    pkt_cmd_ata->transfer_blocks        = 1;
+    pkt_cmd_ata->timeout                = htole32(10);
+
+    return len;
+}
+
+// Payload is left as it was, only its size matters
+static uint32_t BuildPayload(BenchClient* client, int8_t packet_type)
+{
+    AaruPacketHeader* hdr;
+    uint32_t          len = sizeof(AaruPacketHeader) + client->options->block_size;
+
+    hdr = ClientReserve(&client->packet, len);
+
+    if(!hdr) return 0;
+
+    ClientFillHeader(hdr, packet_type, len);
+
+    return len;
+}
+
+static uint32_t BuildSource(BenchClient* client)
+{
+    AaruPacketCmdSource* pkt_cmd_source;
+
+    pkt_cmd_source = ClientReserve(&client->packet, sizeof(AaruPacketCmdSource));
+
+    if(!pkt_cmd_source) return 0;
+
+    ClientFillHeader(&pkt_cmd_source->hdr, AARUREMOTE_PACKET_TYPE_COMMAND_SOURCE, sizeof(AaruPacketCmdSource));
+    pkt_cmd_source->length     = htole64(client->options->block_size);
+    pkt_cmd_source->chunk_size = htole32(client->options->block_size);
+    pkt_cmd_source->spare      = 0;
+
+    return sizeof(AaruPacketCmdSource);
+}
+
+// Data read and whether the command failed, from the response
+static uint32_t CheckResponse(const char* packet, uint32_t len, int* error)
+{
+    const AaruPacketHeader*      hdr = (const AaruPacketHeader*)packet;
+    const AaruPacketResOsRead*   pkt_res_osread;
+    const AaruPacketResScsi*     pkt_res_scsi;
+    const AaruPacketResAtaLba28* pkt_res_ata;
+    const AaruPacketResSink*     pkt_res_sink;
+
+    *error = 1;
+
+    switch(hdr->packet_type)
+    {
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD:
+            pkt_res_osread = (const AaruPacketResOsRead*)packet;
+            *error         = pkt_res_osread->error_no != 0;
+            return len - (uint32_t)sizeof(AaruPacketResOsRead);
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_SCSI:
+            pkt_res_scsi = (const AaruPacketResScsi*)packet;
+            *error       = pkt_res_scsi->error_no != 0 || pkt_res_scsi->sense != 0;
+            return le32toh(pkt_res_scsi->buf_len);
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_LBA_28:
+            pkt_res_ata = (const AaruPacketResAtaLba28*)packet;
+            *error      = pkt_res_ata->error_no != 0 || pkt_res_ata->sense != 0;
+            return le32toh(pkt_res_ata->buf_len);
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_ECHO:
+            *error = 0;
+            return len - (uint32_t)sizeof(AaruPacketHeader);
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_SINK:
+            pkt_res_sink = (const AaruPacketResSink*)packet;
+            *error       = 0;
+            return (uint32_t)le64toh(pkt_res_sink->bytes);
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_SOURCE:
+            *error = 0;
+            return len - (uint32_t)sizeof(AaruPacketResSource);
+        default: return 0;
+    }
+}
+
+// Sends a single command, returns 1 if the device did it, 0 if it refused and -1 if the server could not be reached
+static int ProbeCommand(BenchClient* client, int fd, uint32_t len)
+{
+    int32_t received;
+    int     error;
+
+    if(len == 0 || ClientSend(fd, client->packet.data, len) || (received = ClientReceive(fd, &client->response)) < 0)
+        return -1;
+
+    CheckResponse(client->response.data, (uint32_t)received, &error);
+
+    return !error;
+}
+
+// Mixed only sends what the device takes, plain images and emulated devices only answer some of the commands
+static int ChooseCommands(BenchClient* client, int fd)
+{
+    BenchOptions* options = client->options;
+    uint32_t      device  = client->index % options->device_count;
+    int           ret;
+
+    client->commands[0]   = BENCH_COMMAND_OSREAD;
+    client->command_count = 1;
+
+    if(options->workload != BENCH_WORKLOAD_MIXED) return 0;
+
+    ret = ProbeCommand(client, fd, BuildScsiRead(client, 0));
+
+    if(ret < 0) return -1;
+
+    if(ret)
+        client->commands[client->command_count++] = BENCH_COMMAND_SCSI;
+    else
+        fprintf(stderr, "%s does not take SCSI READ(10), leaving it out of the mix.\n", options->devices[device]);
+
+    ret = ProbeCommand(client, fd, BuildAtaRead(client, 0));
+
+    if(ret < 0) return -1;
+
+    if(ret)
+        client->commands[client->command_count++] = BENCH_COMMAND_ATA;
+    else
+        fprintf(stderr, "%s does not take ATA READ SECTORS, leaving it out of the mix.\n", options->devices[device]);
+
+    if(client->command_count > 1) return 0;
+
+    fprintf(stderr,
+            "%s takes neither SCSI nor ATA commands, use the small workload or a device that does.\n",
+            options->devices[device]);
+
+    return 1;
+}
+
+static void* ClientLoop(void* arg)
+{
+    BenchClient*  client  = arg;
+    BenchOptions* options = client->options;
+    uint32_t      device  = client->index % options->device_count;
+    uint16_t      port    = (uint16_t)(options->base_port + client->index);
+    uint64_t      start;
+    uint64_t      stop;
+    uint64_t      sent;
+    uint64_t      offset;
+    uint32_t      len;
+    uint32_t      data;
+    uint32_t      command;
+    int32_t       received;
+    int           error = 0;
+    int           fd;
+
+    client->random = 0x2545F4914F6CDD1DULL * (client->index + 1);
+    fd             = ConnectServer(port);
+
+    if(fd < 0)
+        fprintf(stderr, "Error %d connecting to the server on port %u.\n", errno, port);
+    else if((error = ClientOpen(fd, options->devices[device], &client->response)) != 0)
+        fprintf(stderr, "Error %d opening %s on port %u.\n", error, options->devices[device], port);
+    else if((error = ChooseCommands(client, fd)) < 0)
+        fprintf(stderr, "Error %d talking to the server on port %u.\n", errno, port);
+
+    client->failed = fd < 0 || error;
+
+    // Everybody starts at once, or gives up at once
+    pthread_barrier_wait(&bench_barrier);
+    pthread_barrier_wait(&bench_barrier);
+
+    if(bench_abort)
+    {
+        if(fd >= 0) close(fd);
+        return NULL;
+    }
+
+    start = ClientMicroseconds();
+    stop  = start + (uint64_t)options->duration * 1000000;
+
+    while(!client->failed && (sent = ClientMicroseconds()) < stop)
+    {
+        offset = NextOffset(client, options->device_sizes[device]);
+
+        command = client->commands[client->operations % client->command_count];
+
+        if(command == BENCH_COMMAND_SCSI)
+            len = BuildScsiRead(client, offset);
+        else if(command == BENCH_COMMAND_ATA)
+            len = BuildAtaRead(client, offset);
+        else if(options->workload == BENCH_WORKLOAD_ECHO)
+            len = BuildPayload(client, AARUREMOTE_PACKET_TYPE_COMMAND_ECHO);
+        else if(options->workload == BENCH_WORKLOAD_SINK)
+            len = BuildPayload(client, AARUREMOTE_PACKET_TYPE_COMMAND_SINK);
+        else if(options->workload == BENCH_WORKLOAD_SOURCE)
+            len = BuildSource(client);
+        else
+            len = BuildOsRead(client, offset);
+
+        if(len == 0 || ClientSend(fd, client->packet.data, len) ||
+           (received = ClientReceive(fd, &client->response)) < 0)
+        {
+            fprintf(stderr, "Error %d talking to the server on port %u.\n", errno, port);
+            client->failed = 1;
+            break;
+        }
+
+        ClientLatencyAdd(&client->latencies, (uint32_t)(ClientMicroseconds() - sent));
+
+        data = CheckResponse(client->response.data, (uint32_t)received, &error);
+        client->operations++;
+
+        if(error)
+            client->errors++;
+        else
+            client->bytes += data;
+    }
+
+    client->elapsed = ClientMicroseconds() - start;
+    close(fd);
+
+    return NULL;
+}
+
+// Returns how many operations failed, a run with errors is not a clean measurement
+static uint64_t PrintResults(BenchOptions* options, BenchClient* clients)
+{
+    ClientLatencies latencies;
+    uint64_t        operations = 0;
+    uint64_t        errors     = 0;
+    uint64_t        bytes      = 0;
+    uint64_t        elapsed    = 1;
+    double          seconds;
+    uint32_t        i;
+    size_t          j;
+
+    memset(&latencies, 0, sizeof(ClientLatencies));
+
+    for(i = 0; i < options->clients; i++)
+    {
+        operations += clients[i].operations;
+        errors += clients[i].errors;
+        bytes += clients[i].bytes;
+
+        if(clients[i].elapsed > elapsed) elapsed = clients[i].elapsed;
+
+        for(j = 0; j < clients[i].latencies.count; j++) ClientLatencyAdd(&latencies, clients[i].latencies.values[j]);
+    }
+
+    seconds = (double)elapsed / 1000000;
+
+    printf("{\n");
+    printf("  \"workload\": \"%s\",\n", bench_workloads[options->workload].name);
+    printf("  \"clients\": %u,\n", options->clients);
+    printf("  \"devices\": %u,\n", options->device_count);
+    printf("  \"block_size\": %u,\n", options->block_size);
+    printf("  \"duration_seconds\": %.3f,\n", seconds);
+    printf("  \"operations\": %lu,\n", (unsigned long)operations);
+    printf("  \"errors\": %lu,\n", (unsigned long)errors);
+    printf("  \"clean\": %s,\n", errors ? "false" : "true");
+    printf("  \"bytes\": %lu,\n", (unsigned long)bytes);
+    printf("  \"ops_per_second\": %.1f,\n", (double)(operations - errors) / seconds);
+    printf("  \"mb_per_second\": %.2f,\n", (double)bytes / 1000000 / seconds);
+    printf("  \"latency_us\": {\"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}\n",
+           ClientLatencyPercentile(&latencies, 0.5),
+           ClientLatencyPercentile(&latencies, 0.99),
+           ClientLatencyPercentile(&latencies, 0.999),
+           ClientLatencyPercentile(&latencies, 1.0));
+    printf("}\n");
+
+    ClientLatencyFree(&latencies);
+
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    static BenchOptions options;
+    BenchClient*        clients;
+    uint32_t            i;
+    uint8_t             created = 0;
+    int                 failed  = 0;
+    int                 ret;
+
+    ret = ParseArguments(argc, argv, &options);
+
+    if(ret) return ret < 0 ? 1 : 0;
+
+    if(options.device_count == 0)
+    {
+        created = 1;
+
+        if(CreateImages(&options))
+        {
+            RemoveImages(&options);
+            return 1;
+        }
+    }
+    else if(FindDeviceSizes(&options))
+        return 1;
+
+    clients = calloc(options.clients, sizeof(BenchClient));
+
+    if(!clients)
+    {
+        fprintf(stderr, "Error %d allocating memory for the clients.\n", errno);
+        if(created) RemoveImages(&options);
+        return 1;
+    }
+
+    fprintf(stderr,
+            "Running %s with %u clients against %u devices for %u seconds...\n",
+            bench_workloads[options.workload].name,
+            options.clients,
+            options.device_count,
+            options.duration);
+
+    pthread_barrier_init(&bench_barrier, NULL, options.clients + 1);
+
+    for(i = 0; i < options.clients; i++)
+    {
+        clients[i].options = &options;
+        clients[i].index   = i;
+        clients[i].server  = StartServer(&options, (uint16_t)(options.base_port + i));
+
+        if(clients[i].server < 0 || pthread_create(&clients[i].thread, NULL, ClientLoop, &clients[i]) != 0)
+        {
+            fprintf(stderr, "Error %d starting client %u.\n", errno, i);
+
+            // Threads already started wait for the rest forever, nothing to do but leave
+            while(i-- > 0) kill(clients[i].server, SIGTERM);
+
+            if(created) RemoveImages(&options);
+            return 1;
+        }
+    }
+
+    pthread_barrier_wait(&bench_barrier);
+
+    for(i = 0; i < options.clients; i++) bench_abort |= clients[i].failed;
+
+    pthread_barrier_wait(&bench_barrier);
+
+    for(i = 0; i < options.clients; i++)
+    {
+        pthread_join(clients[i].thread, NULL);
+        kill(clients[i].server, SIGTERM);
+        waitpid(clients[i].server, NULL, 0);
+        failed |= clients[i].failed;
+    }
+
+    pthread_barrier_destroy(&bench_barrier);
+
+    if(!failed && PrintResults(&options, clients) > 0)
+    {
+        fprintf(stderr, "Some operations failed, the results are not clean.\n");
+        failed = 1;
+    }
+
+    for(i = 0; i < options.clients; i++)
+    {
+        ClientLatencyFree(&clients[i].latencies);
+        free(clients[i].packet.data);
+        free(clients[i].response.data);
+    }
+
+    free(clients);
+
+    if(created) RemoveImages(&options);
+
+    return failed;
+}
@@ -0,0 +1,291 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../endian.h"
+#include "client.h"
+
+uint64_t ClientMicroseconds()
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+
+    return (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+}
+
+void ClientSleepUntil(uint64_t microseconds)
+{
+    struct timespec delay;
+    uint64_t        now = ClientMicroseconds();
+
+    if(now >= microseconds) return;
+
+    delay.tv_sec  = (time_t)((microseconds - now) / 1000000);
+    delay.tv_nsec = (long)((microseconds - now) % 1000000) * 1000;
+
+    while(nanosleep(&delay, &delay) != 0 && errno == EINTR)
+        ;
+}
+
+int ClientSend(int fd, const void* buf, size_t len)
+{
+    const char* data = buf;
+    ssize_t     ret;
+
+    while(len > 0)
+    {
+        ret = write(fd, data, len);
+
+        if(ret < 0 && errno == EINTR) continue;
+
+        if(ret <= 0) return -1;
+
+        data += ret;
+        len -= (size_t)ret;
+    }
+
+    return 0;
+}
+
+static int ClientReceiveFull(int fd, char* buf, size_t len)
+{
+    ssize_t ret;
+
+    while(len > 0)
+    {
+        ret = read(fd, buf, len);
+
+        if(ret < 0 && errno == EINTR) continue;
+
+        if(ret <= 0) return -1;
+
+        buf += ret;
+        len -= (size_t)ret;
+    }
+
+    return 0;
+}
+
+void* ClientReserve(ClientBuffer* buffer, size_t size)
+{
+    char* data;
+
+    if(size <= buffer->size) return buffer->data;
+
+    data = realloc(buffer->data, size);
+
+    if(!data) return NULL;
+
+    buffer->data = data;
+    buffer->size = size;
+
+    return data;
+}
+
+// Whole packet, header included, returns its length
+int32_t ClientReceive(int fd, ClientBuffer* buffer)
+{
+    AaruPacketHeader hdr;
+    uint32_t         len;
+
+    if(ClientReceiveFull(fd, (char*)&hdr, sizeof(AaruPacketHeader))) return -1;
+
+    len = le32toh(hdr.len);
+
+    if(hdr.remote_id != htole32(AARUREMOTE_REMOTE_ID) || hdr.packet_id != htole32(AARUREMOTE_PACKET_ID) ||
+       len < sizeof(AaruPacketHeader) || len > INT32_MAX)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    if(!ClientReserve(buffer, len)) return -1;
+
+    memcpy(buffer->data, &hdr, sizeof(AaruPacketHeader));
+
+    if(ClientReceiveFull(fd, buffer->data + sizeof(AaruPacketHeader), len - sizeof(AaruPacketHeader))) return -1;
+
+    return (int32_t)len;
+}
+
+void ClientFillHeader(AaruPacketHeader* hdr, int8_t packet_type, uint32_t len)
+{
+    memset(hdr, 0, sizeof(AaruPacketHeader));
+    hdr->remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+    hdr->packet_id   = htole32(AARUREMOTE_PACKET_ID);
+    hdr->len         = htole32(len);
+    hdr->version     = AARUREMOTE_PACKET_VERSION;
+    hdr->packet_type = packet_type;
+}
+
+// Connects and goes through the hello exchange, with no optional capabilities so responses are the legacy ones
+int ClientConnect(const char* host, uint16_t port, const char* application)
+{
+    struct addrinfo  hints;
+    struct addrinfo* addresses;
+    struct utsname   name;
+    AaruPacketHello  hello;
+    ClientBuffer     buffer;
+    char             service[8];
+    int              fd;
+    int              flag = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%u", port);
+
+    if(getaddrinfo(host, service, &hints, &addresses) != 0)
+    {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+
+    if(fd < 0 || connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0)
+    {
+        if(fd >= 0) close(fd);
+        freeaddrinfo(addresses);
+        return -1;
+    }
+
+    freeaddrinfo(addresses);
+
+    // Commands are small and answered one by one, waiting to coalesce them only adds latency
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    memset(&buffer, 0, sizeof(ClientBuffer));
+
+    if(ClientReceive(fd, &buffer) < 0 || ((AaruPacketHeader*)buffer.data)->packet_type != AARUREMOTE_PACKET_TYPE_HELLO)
+    {
+        free(buffer.data);
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+
+    free(buffer.data);
+
+    memset(&hello, 0, sizeof(AaruPacketHello));
+    ClientFillHeader(&hello.hdr, AARUREMOTE_PACKET_TYPE_HELLO, sizeof(AaruPacketHello));
+    strncpy(hello.application, application, sizeof(hello.application) - 1);
+    strncpy(hello.version, AARUREMOTE_VERSION, sizeof(hello.version) - 1);
+    hello.max_protocol = AARUREMOTE_PROTOCOL_MAX;
+
+    if(uname(&name) == 0)
+    {
+        strncpy(hello.sysname, name.sysname, sizeof(hello.sysname) - 1);
+        strncpy(hello.release, name.release, sizeof(hello.release) - 1);
+        strncpy(hello.machine, name.machine, sizeof(hello.machine) - 1);
+    }
+
+    if(ClientSend(fd, &hello, sizeof(AaruPacketHello)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Returns the error the server gave opening the device, or -1 if the exchange itself failed
+int ClientOpen(int fd, const char* device_path, ClientBuffer* buffer)
+{
+    AaruPacketCmdOpen pkt_cmd_open;
+    AaruPacketNop*    pkt_nop;
+
+    memset(&pkt_cmd_open, 0, sizeof(AaruPacketCmdOpen));
+    ClientFillHeader(&pkt_cmd_open.hdr, AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE, sizeof(AaruPacketCmdOpen));
+    strncpy(pkt_cmd_open.device_path, device_path, sizeof(pkt_cmd_open.device_path) - 1);
+
+    if(ClientSend(fd, &pkt_cmd_open, sizeof(AaruPacketCmdOpen)) || ClientReceive(fd, buffer) < 0) return -1;
+
+    pkt_nop = (AaruPacketNop*)buffer->data;
+
+    if(pkt_nop->hdr.packet_type != AARUREMOTE_PACKET_TYPE_NOP) return -1;
+
+    if(pkt_nop->reason_code == AARUREMOTE_PACKET_NOP_REASON_OPEN_OK) return 0;
+
+    return pkt_nop->error_no ? (int)le32toh(pkt_nop->error_no) : -1;
+}
+
+void ClientLatencyAdd(ClientLatencies* latencies, uint32_t value)
+{
+    uint32_t* values;
+    size_t    size;
+
+    if(latencies->count == latencies->size)
+    {
+        size   = latencies->size ? latencies->size * 2 : 1024;
+        values = realloc(latencies->values, size * sizeof(uint32_t));
+
+        if(!values) return;
+
+        latencies->values = values;
+        latencies->size   = size;
+    }
+
+    latencies->values[latencies->count++] = value;
+    latencies->sorted                     = 0;
+}
+
+static int ClientCompareLatency(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank, so the result is always a latency that was really measured
+uint32_t ClientLatencyPercentile(ClientLatencies* latencies, double quantile)
+{
+    size_t rank;
+
+    if(latencies->count == 0) return 0;
+
+    if(!latencies->sorted)
+    {
+        qsort(latencies->values, latencies->count, sizeof(uint32_t), ClientCompareLatency);
+        latencies->sorted = 1;
+    }
+
+    rank = (size_t)(quantile * (double)latencies->count + 0.999999);
+
+    if(rank < 1) rank = 1;
+
+    if(rank > latencies->count) rank = latencies->count;
+
+    return latencies->values[rank - 1];
+}
+
+void ClientLatencyFree(ClientLatencies* latencies)
+{
+    free(latencies->values);
+    memset(latencies, 0, sizeof(ClientLatencies));
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AARUREMOTE_TOOLS_CLIENT_H_
+#define AARUREMOTE_TOOLS_CLIENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../aaruremote.h"
+
+// Packets received are kept here, grown to fit the biggest one seen
+typedef struct
+{
+    char*  data;
+    size_t size;
+} ClientBuffer;
+
+// Every sample is kept, so percentiles are exact
+typedef struct
+{
+    uint32_t* values;
+    size_t    count;
+    size_t    size;
+    uint8_t   sorted;
+} ClientLatencies;
+
+uint64_t ClientMicroseconds();
+void     ClientSleepUntil(uint64_t microseconds);
+int      ClientConnect(const char* host, uint16_t port, const char* application);
+int      ClientSend(int fd, const void* buf, size_t len);
+int32_t  ClientReceive(int fd, ClientBuffer* buffer);
+void*    ClientReserve(ClientBuffer* buffer, size_t size);
+void     ClientFillHeader(AaruPacketHeader* hdr, int8_t packet_type, uint32_t len);
+int      ClientOpen(int fd, const char* device_path, ClientBuffer* buffer);
+void     ClientLatencyAdd(ClientLatencies* latencies, uint32_t value);
+uint32_t ClientLatencyPercentile(ClientLatencies* latencies, double quantile);
+void     ClientLatencyFree(ClientLatencies* latencies);
+
+#endif  // AARUREMOTE_TOOLS_CLIENT_H_
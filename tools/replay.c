@@ -0,0 +1,674 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../endian.h"
+#include "client.h"
+
+// Divergent commands printed one by one, the rest are only counted
+#define REPLAY_MAX_REPORTED 10
+#define REPLAY_PACKET_TYPES 128
+
+typedef struct
+{
+    const char* host;
+    uint16_t    port;
+    const char* device_path;
+    const char* trace_path;
+    uint8_t     paced;
+    uint8_t     allow_writes;
+} ReplayOptions;
+
+typedef struct
+{
+    uint64_t        replayed;
+    uint64_t        skipped_writes;
+    uint64_t        skipped_incomplete;
+    uint64_t        skipped_unsupported;
+    uint64_t        bytes_sent;
+    uint64_t        bytes_received;
+    uint64_t        rejected;
+    uint64_t        error_divergences;
+    uint64_t        sense_divergences;
+    uint64_t        data_divergences;
+    uint64_t        hashed;
+    uint64_t        reported;
+    ClientLatencies latencies;
+    ClientLatencies types[REPLAY_PACKET_TYPES];
+    ClientLatencies original[REPLAY_PACKET_TYPES];
+} ReplayResults;
+
+// What came back, pointing into the received packet
+typedef struct
+{
+    int32_t        error_no;
+    const uint8_t* sense;
+    uint32_t       sense_len;
+    const char*    data;
+    uint32_t       data_len;
+} ReplayResponse;
+
+// ATA commands that write when sent with one of the DMA protocols, which do not tell the direction by themselves
+static const uint8_t replay_ata_dma_writes[] = {0x06, 0x35, 0x36, 0x3A, 0x3D, 0x61, 0xCA, 0xCB, 0xCC};
+
+static void PrintUsage(const char* name)
+{
+    printf("Usage: %s [options] TRACE\n", name);
+    printf("  --host HOST      Server to replay against (default 127.0.0.1)\n");
+    printf("  --port N         Server port (default %d)\n", AARUREMOTE_PORT);
+    printf("  --device PATH    Device to open wherever the trace opened one\n");
+    printf("  --paced          Keep the original time between commands instead of going as fast as possible\n");
+    printf("  --allow-writes   Also replay commands that send data to the device, with zeroed data\n");
+    printf("  --help           Show this help\n");
+}
+
+static int ParseArguments(int argc, char* argv[], ReplayOptions* options)
+{
+    int   i;
+    long  port;
+    char* end;
+
+    memset(options, 0, sizeof(ReplayOptions));
+    options->host = "127.0.0.1";
+    options->port = AARUREMOTE_PORT;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+            options->host = argv[++i];
+        else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            port = strtol(argv[++i], &end, 10);
+
+            if(*end != 0 || port <= 0 || port > 65535)
+            {
+                printf("Invalid port %s\n", argv[i]);
+                return -1;
+            }
+
+            options->port = (uint16_t)port;
+        }
+        else if(strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+            options->device_path = argv[++i];
+        else if(strcmp(argv[i], "--paced") == 0)
+            options->paced = 1;
+        else if(strcmp(argv[i], "--allow-writes") == 0)
+            options->allow_writes = 1;
+        else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else if(argv[i][0] != '-' && !options->trace_path)
+            options->trace_path = argv[i];
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            PrintUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(!options->trace_path)
+    {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Loads the whole trace in host order
+static AaruTraceRecord* LoadTrace(const char* path, size_t* count)
+{
+    AaruTraceHeader  header;
+    AaruTraceRecord* records = NULL;
+    AaruTraceRecord* grown;
+    AaruTraceRecord* record;
+    size_t           size = 0;
+    FILE*            file;
+
+    *count = 0;
+    file   = fopen(path, "rb");
+
+    if(!file)
+    {
+        printf("Error %d opening trace %s.\n", errno, path);
+        return NULL;
+    }
+
+    if(fread(&header, sizeof(AaruTraceHeader), 1, file) != 1 ||
+       memcmp(header.magic, AARUREMOTE_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+       le16toh(header.version) != AARUREMOTE_TRACE_VERSION || le16toh(header.record_size) != sizeof(AaruTraceRecord))
+    {
+        printf("%s is not a trace this version understands.\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    for(;;)
+    {
+        if(*count == size)
+        {
+            size  = size ? size * 2 : 4096;
+            grown = realloc(records, size * sizeof(AaruTraceRecord));
+
+            if(!grown)
+            {
+                printf("Error %d allocating memory for the trace.\n", errno);
+                free(records);
+                fclose(file);
+                return NULL;
+            }
+
+            records = grown;
+        }
+
+        record = &records[*count];
+
+        if(fread(record, sizeof(AaruTraceRecord), 1, file) != 1) break;
+
+        record->sequence  = le64toh(record->sequence);
+        record->started   = le64toh(record->started);
+        record->duration  = le32toh(record->duration);
+        record->elapsed   = le32toh(record->elapsed);
+        record->bytes_in  = le32toh(record->bytes_in);
+        record->bytes_out = le32toh(record->bytes_out);
+        record->data_len  = le32toh(record->data_len);
+        record->error_no  = (int32_t)le32toh((uint32_t)record->error_no);
+        record->data_hash = le64toh(record->data_hash);
+
+        if(record->command_len > AARUREMOTE_TRACE_COMMAND_SIZE) record->command_len = AARUREMOTE_TRACE_COMMAND_SIZE;
+
+        if(record->sense_len > AARUREMOTE_TRACE_SENSE_SIZE) record->sense_len = AARUREMOTE_TRACE_SENSE_SIZE;
+
+        (*count)++;
+    }
+
+    fclose(file);
+
+    return records;
+}
+
+static uint64_t ReplayHash(const void* data, uint32_t len)
+{
+    const unsigned char* bytes = data;
+    uint64_t             hash  = 0xCBF29CE484222325ULL;
+    uint32_t             i;
+
+    for(i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x00000100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static uint32_t ReadLe32(const uint8_t* bytes)
+{
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint8_t IsAtaWrite(uint8_t protocol, uint8_t command)
+{
+    size_t i;
+
+    if(protocol == AARUREMOTE_ATA_PROTOCOL_PIO_OUT || protocol == AARUREMOTE_ATA_PROTOCOL_UDMA_OUT) return 1;
+
+    if(protocol != AARUREMOTE_ATA_PROTOCOL_DMA && protocol != AARUREMOTE_ATA_PROTOCOL_DMA_QUEUED &&
+       protocol != AARUREMOTE_ATA_PROTOCOL_FPDMA)
+        return 0;
+
+    for(i = 0; i < sizeof(replay_ata_dma_writes); i++)
+        if(replay_ata_dma_writes[i] == command) return 1;
+
+    return 0;
+}
+
+// Builds the packet again from the recorded start of the command, returns its length or 0 with the counter to blame
+static uint32_t BuildPacket(const AaruTraceRecord* record,
+                            const ReplayOptions*   options,
+                            ClientBuffer*          packet,
+                            ReplayResults*         results)
+{
+    const uint8_t* body = record->command;
+    uint32_t       body_len;
+    uint32_t       buf_len = 0;
+    uint8_t        write   = 0;
+    char*          data;
+
+    switch(record->packet_type)
+    {
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE:
+            body_len = sizeof(AaruPacketCmdOpen) - sizeof(AaruPacketHeader);
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SCSI:
+            body_len = sizeof(AaruPacketCmdScsi) - sizeof(AaruPacketHeader);
+
+            if(record->command_len < body_len) break;
+
+            body_len += ReadLe32(body);
+            buf_len = ReadLe32(body + 4);
+            write   = (int32_t)ReadLe32(body + 8) == AARUREMOTE_SCSI_DIRECTION_OUT ||
+                    (int32_t)ReadLe32(body + 8) == AARUREMOTE_SCSI_DIRECTION_INOUT;
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_CHS:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_28:
+            // Registers end with the command, then come the protocol and the transfer settings
+            body_len = sizeof(AaruPacketCmdAtaChs) - sizeof(AaruPacketHeader);
+
+            if(record->command_len < body_len) break;
+
+            buf_len = ReadLe32(body);
+            write   = IsAtaWrite(body[4 + sizeof(AtaRegistersChs)], body[4 + sizeof(AtaRegistersChs) - 1]);
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_48:
+            body_len = sizeof(AaruPacketCmdAtaLba48) - sizeof(AaruPacketHeader);
+
+            if(record->command_len < body_len) break;
+
+            buf_len = ReadLe32(body);
+            write   = IsAtaWrite(body[4 + sizeof(AtaRegistersLba48)], body[4 + sizeof(AtaRegistersLba48) - 1]);
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_SDHCI:
+            body_len = sizeof(AaruCmdSdhci);
+
+            if(record->command_len < body_len) break;
+
+            buf_len = ReadLe32(body + 19);
+            write   = body[1];
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD:
+            body_len = sizeof(AaruPacketCmdOsRead) - sizeof(AaruPacketHeader);
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_VECTOR:
+            // Only vectors short enough to have been recorded whole
+            body_len = sizeof(uint64_t);
+
+            if(record->command_len < body_len || ReadLe32(body + 4) != 0) break;
+
+            body_len += ReadLe32(body) * (uint32_t)sizeof(AaruCmdOsReadExtent);
+            break;
+        case AARUREMOTE_PACKET_TYPE_COMMAND_LIST_DEVICES:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_DEVTYPE:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_SDHCI_REGISTERS:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_USB_DATA:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_FIREWIRE_DATA:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_PCMCIA_DATA:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_CLOSE_DEVICE:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_AM_I_ROOT:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_REOPEN:
+        case AARUREMOTE_PACKET_TYPE_COMMAND_GET_STATS: body_len = 0; break;
+        default: results->skipped_unsupported++; return 0;
+    }
+
+    if(record->packet_type != AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE && record->command_len < body_len)
+    {
+        results->skipped_incomplete++;
+        return 0;
+    }
+
+    if(write && !options->allow_writes)
+    {
+        results->skipped_writes++;
+        return 0;
+    }
+
+    data = ClientReserve(packet, sizeof(AaruPacketHeader) + body_len + buf_len);
+
+    if(!data) return 0;
+
+    ClientFillHeader((AaruPacketHeader*)data, record->packet_type, sizeof(AaruPacketHeader) + body_len + buf_len);
+
+    if(record->packet_type == AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE)
+    {
+        memset(data + sizeof(AaruPacketHeader), 0, body_len);
+        strncpy(data + sizeof(AaruPacketHeader), options->device_path, body_len - 1);
+    }
+    else
+        memcpy(data + sizeof(AaruPacketHeader), body, body_len);
+
+    // Data the trace does not have, only what comes back from the device matters
+    memset(data + sizeof(AaruPacketHeader) + body_len, 0, buf_len);
+
+    return (uint32_t)sizeof(AaruPacketHeader) + body_len + buf_len;
+}
+
+// Finds the error, sense and data in a response the same way the server recorded them
+static void ParseResponse(const char* packet, uint32_t len, const AaruTraceRecord* record, ReplayResponse* response)
+{
+    const AaruPacketHeader*          hdr = (const AaruPacketHeader*)packet;
+    const AaruPacketResScsi*         pkt_res_scsi;
+    const AaruPacketResAtaChs*       pkt_res_ata_chs;
+    const AaruPacketResAtaLba28*     pkt_res_ata_lba28;
+    const AaruPacketResAtaLba48*     pkt_res_ata_lba48;
+    const AaruPacketResSdhci*        pkt_res_sdhci;
+    const AaruPacketResOsRead*       pkt_res_osread;
+    const AaruPacketResOsReadVector* pkt_res_osread_vector;
+    uint64_t                         n;
+    uint32_t                         offset;
+
+    memset(response, 0, sizeof(ReplayResponse));
+
+    switch(hdr->packet_type)
+    {
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_SCSI:
+            pkt_res_scsi        = (const AaruPacketResScsi*)packet;
+            response->error_no  = (int32_t)le32toh(pkt_res_scsi->error_no);
+            response->sense_len = le32toh(pkt_res_scsi->sense_len);
+            response->sense     = (const uint8_t*)packet + sizeof(AaruPacketResScsi);
+            response->data      = packet + sizeof(AaruPacketResScsi) + response->sense_len;
+            response->data_len  = le32toh(pkt_res_scsi->buf_len);
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_CHS:
+            pkt_res_ata_chs     = (const AaruPacketResAtaChs*)packet;
+            response->error_no  = (int32_t)le32toh(pkt_res_ata_chs->error_no);
+            response->sense     = (const uint8_t*)&pkt_res_ata_chs->registers;
+            response->sense_len = sizeof(pkt_res_ata_chs->registers);
+            response->data      = packet + sizeof(AaruPacketResAtaChs);
+            response->data_len  = le32toh(pkt_res_ata_chs->buf_len);
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_LBA_28:
+            pkt_res_ata_lba28   = (const AaruPacketResAtaLba28*)packet;
+            response->error_no  = (int32_t)le32toh(pkt_res_ata_lba28->error_no);
+            response->sense     = (const uint8_t*)&pkt_res_ata_lba28->registers;
+            response->sense_len = sizeof(pkt_res_ata_lba28->registers);
+            response->data      = packet + sizeof(AaruPacketResAtaLba28);
+            response->data_len  = le32toh(pkt_res_ata_lba28->buf_len);
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_LBA_48:
+            pkt_res_ata_lba48   = (const AaruPacketResAtaLba48*)packet;
+            response->error_no  = (int32_t)le32toh(pkt_res_ata_lba48->error_no);
+            response->sense     = (const uint8_t*)&pkt_res_ata_lba48->registers;
+            response->sense_len = sizeof(pkt_res_ata_lba48->registers);
+            response->data      = packet + sizeof(AaruPacketResAtaLba48);
+            response->data_len  = le32toh(pkt_res_ata_lba48->buf_len);
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_SDHCI:
+            pkt_res_sdhci       = (const AaruPacketResSdhci*)packet;
+            response->error_no  = (int32_t)le32toh(pkt_res_sdhci->res.error_no);
+            response->sense     = (const uint8_t*)pkt_res_sdhci->res.response;
+            response->sense_len = sizeof(pkt_res_sdhci->res.response);
+            response->data      = packet + sizeof(AaruPacketResSdhci);
+            response->data_len  = le32toh(pkt_res_sdhci->res.buf_len);
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD:
+            // Zero filled past the end of the device, only what was really read went in the hash
+            pkt_res_osread     = (const AaruPacketResOsRead*)packet;
+            response->error_no = (int32_t)le32toh(pkt_res_osread->error_no);
+            response->data     = packet + sizeof(AaruPacketResOsRead);
+            response->data_len = len - (uint32_t)sizeof(AaruPacketResOsRead);
+
+            if(record->data_len < response->data_len) response->data_len = record->data_len;
+            break;
+        case AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD_VECTOR:
+            pkt_res_osread_vector = (const AaruPacketResOsReadVector*)packet;
+            offset                = (uint32_t)(sizeof(AaruPacketResOsReadVector) +
+                                sizeof(AaruResOsReadExtent) * le64toh(pkt_res_osread_vector->extent_count));
+
+            for(n = 0; n < le64toh(pkt_res_osread_vector->extent_count); n++)
+                if(pkt_res_osread_vector->results[n].error_no)
+                    response->error_no = (int32_t)le32toh(pkt_res_osread_vector->results[n].error_no);
+
+            response->data     = packet + offset;
+            response->data_len = len > offset ? len - offset : 0;
+            break;
+        default: break;
+    }
+
+    // Never past what was received
+    if((const char*)response->sense + response->sense_len > packet + len) response->sense_len = 0;
+
+    if(response->data && (response->data < packet || response->data + response->data_len > packet + len))
+        response->data_len = 0;
+}
+
+static void ReportDivergence(ReplayResults* results, const AaruTraceRecord* record, const char* what)
+{
+    if(results->reported++ >= REPLAY_MAX_REPORTED) return;
+
+    printf("Command %lu (packet type %d) diverged: %s\n", (unsigned long)record->sequence, record->packet_type, what);
+}
+
+static void CompareResponse(const char* packet, uint32_t len, const AaruTraceRecord* record, ReplayResults* results)
+{
+    const AaruPacketNop* pkt_nop = (const AaruPacketNop*)packet;
+    ReplayResponse       response;
+    char                 what[64];
+
+    if(pkt_nop->hdr.packet_type == AARUREMOTE_PACKET_TYPE_NOP)
+    {
+        if(pkt_nop->reason_code == AARUREMOTE_PACKET_NOP_REASON_OPEN_OK ||
+           pkt_nop->reason_code == AARUREMOTE_PACKET_NOP_REASON_REOPEN_OK)
+            return;
+
+        // Only a failed open is expected to be answered like this
+        if(record->packet_type == AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE &&
+           (record->flags & AARUREMOTE_TRACE_FLAG_ERROR))
+            return;
+
+        results->rejected++;
+        ReportDivergence(results, record, "rejected by the server");
+        return;
+    }
+
+    ParseResponse(packet, len, record, &response);
+
+    if(response.error_no != record->error_no)
+    {
+        results->error_divergences++;
+        sprintf(what, "error %d, recorded %d", response.error_no, record->error_no);
+        ReportDivergence(results, record, what);
+    }
+
+    if(record->sense_len > 0 &&
+       (response.sense_len < record->sense_len || memcmp(response.sense, record->sense, record->sense_len) != 0))
+    {
+        results->sense_divergences++;
+        ReportDivergence(results, record, "different sense");
+    }
+
+    if(!(record->flags & AARUREMOTE_TRACE_FLAG_HASH) || !response.data) return;
+
+    results->hashed++;
+
+    if(response.data_len != record->data_len || ReplayHash(response.data, response.data_len) != record->data_hash)
+    {
+        results->data_divergences++;
+        ReportDivergence(results, record, "different data");
+    }
+}
+
+static void PrintLatencies(const char* name, ClientLatencies* replayed, ClientLatencies* original)
+{
+    printf("%-20s %8lu %8u %8u %8u %8u %8u",
+           name,
+           (unsigned long)replayed->count,
+           ClientLatencyPercentile(replayed, 0.5),
+           ClientLatencyPercentile(replayed, 0.9),
+           ClientLatencyPercentile(replayed, 0.99),
+           ClientLatencyPercentile(replayed, 0.999),
+           ClientLatencyPercentile(replayed, 1.0));
+
+    if(original)
+        printf("   (recorded p50 %u, p99 %u)",
+               ClientLatencyPercentile(original, 0.5),
+               ClientLatencyPercentile(original, 0.99));
+
+    printf("\n");
+}
+
+static void PrintResults(ReplayResults* results, uint64_t elapsed)
+{
+    double seconds = (double)elapsed / 1000000;
+    char   name[32];
+    int    i;
+
+    if(seconds <= 0) seconds = 1e-6;
+
+    printf("Replayed %lu commands in %.3f s, %.1f commands/s.\n",
+           (unsigned long)results->replayed,
+           seconds,
+           (double)results->replayed / seconds);
+    printf("Sent %.2f MiB (%.2f MiB/s), received %.2f MiB (%.2f MiB/s).\n",
+           (double)results->bytes_sent / (1024 * 1024),
+           (double)results->bytes_sent / (1024 * 1024) / seconds,
+           (double)results->bytes_received / (1024 * 1024),
+           (double)results->bytes_received / (1024 * 1024) / seconds);
+    printf("Skipped %lu that write, %lu not recorded whole and %lu that cannot be replayed.\n",
+           (unsigned long)results->skipped_writes,
+           (unsigned long)results->skipped_incomplete,
+           (unsigned long)results->skipped_unsupported);
+
+    printf("\nLatency in microseconds, round trip as seen by this client:\n");
+    printf("%-20s %8s %8s %8s %8s %8s %8s\n", "", "count", "p50", "p90", "p99", "p99.9", "max");
+    PrintLatencies("all", &results->latencies, NULL);
+
+    for(i = 0; i < REPLAY_PACKET_TYPES; i++)
+    {
+        if(results->types[i].count == 0) continue;
+
+        sprintf(name, "packet type %d", i);
+        PrintLatencies(name, &results->types[i], &results->original[i]);
+    }
+
+    printf("\nDivergences: %lu rejected, %lu errors, %lu sense, %lu data out of %lu hashed.\n",
+           (unsigned long)results->rejected,
+           (unsigned long)results->error_divergences,
+           (unsigned long)results->sense_divergences,
+           (unsigned long)results->data_divergences,
+           (unsigned long)results->hashed);
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions    options;
+    ReplayResults    results;
+    AaruTraceRecord* records;
+    AaruTraceRecord* record;
+    ClientBuffer     packet;
+    ClientBuffer     response;
+    size_t           count;
+    size_t           i;
+    uint64_t         start;
+    uint64_t         sent;
+    uint32_t         len;
+    int32_t          received;
+    int              fd;
+    int              ret;
+
+    ret = ParseArguments(argc, argv, &options);
+
+    if(ret) return ret < 0 ? 1 : 0;
+
+    records = LoadTrace(options.trace_path, &count);
+
+    if(!records) return 1;
+
+    for(i = 0; i < count && !options.device_path; i++)
+    {
+        if(records[i].packet_type != AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE) continue;
+
+        printf("The trace opens a device, say which one with --device.\n");
+        free(records);
+        return 1;
+    }
+
+    fd = ClientConnect(options.host, options.port, "aaruremote-replay");
+
+    if(fd < 0)
+    {
+        printf("Error %d connecting to %s port %d.\n", errno, options.host, options.port);
+        free(records);
+        return 1;
+    }
+
+    memset(&results, 0, sizeof(ReplayResults));
+    memset(&packet, 0, sizeof(ClientBuffer));
+    memset(&response, 0, sizeof(ClientBuffer));
+
+    printf("Replaying %lu commands from %s against %s port %d...\n",
+           (unsigned long)count,
+           options.trace_path,
+           options.host,
+           options.port);
+
+    start = ClientMicroseconds();
+
+    for(i = 0; i < count; i++)
+    {
+        record = &records[i];
+        len    = BuildPacket(record, &options, &packet, &results);
+
+        if(len == 0) continue;
+
+        if(options.paced) ClientSleepUntil(start + (record->started - records[0].started));
+
+        sent = ClientMicroseconds();
+
+        if(ClientSend(fd, packet.data, len))
+        {
+            printf("Error %d sending command %lu.\n", errno, (unsigned long)record->sequence);
+            break;
+        }
+
+        results.replayed++;
+        results.bytes_sent += len;
+
+        // Closing is the only command the server does not answer
+        if(record->packet_type == AARUREMOTE_PACKET_TYPE_COMMAND_CLOSE_DEVICE) continue;
+
+        received = ClientReceive(fd, &response);
+
+        if(received < 0)
+        {
+            printf("Error %d receiving response to command %lu.\n", errno, (unsigned long)record->sequence);
+            break;
+        }
+
+        results.bytes_received += (uint32_t)received;
+
+        ClientLatencyAdd(&results.latencies, (uint32_t)(ClientMicroseconds() - sent));
+        ClientLatencyAdd(&results.types[(uint8_t)record->packet_type % REPLAY_PACKET_TYPES],
+                         (uint32_t)(ClientMicroseconds() - sent));
+        ClientLatencyAdd(&results.original[(uint8_t)record->packet_type % REPLAY_PACKET_TYPES], record->elapsed);
+
+        CompareResponse(response.data, (uint32_t)received, record, &results);
+    }
+
+    PrintResults(&results, ClientMicroseconds() - start);
+
+    close(fd);
+    free(packet.data);
+    free(response.data);
+    free(records);
+    ClientLatencyFree(&results.latencies);
+
+    for(i = 0; i < REPLAY_PACKET_TYPES; i++)
+    {
+        ClientLatencyFree(&results.types[i]);
+        ClientLatencyFree(&results.original[i]);
+    }
+
+    return results.rejected + results.error_divergences + results.sense_divergences + results.data_divergences ? 2 : 0;
+}
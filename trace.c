@@ -0,0 +1,209 @@
+/*
+ * This file is part of the Aaru Remote Server.
+ * Copyright (c) 2019-2025 Natalia Portillo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#endif
+
+#include "aaruremote.h"
+#include "endian.h"
+
+// Records are buffered by stdio so the worker only reaches the disk every few thousand commands
+#define TRACE_FILE_BUFFER (1024 * 1024)
+
+#define TRACE_FNV_OFFSET 0xCBF29CE484222325ULL
+#define TRACE_FNV_PRIME 0x00000100000001B3ULL
+
+// Only the worker thread records, dumps from other threads skip the slot being written at the time
+static FILE*            trace_file;
+static AaruTraceRecord* trace_ring;
+static uint64_t         trace_sequence;
+static uint64_t         trace_started;
+static uint64_t         trace_start_time;
+static uint32_t         trace_dumps;
+static uint8_t          trace_enabled;
+
+static void TraceFillHeader(AaruTraceHeader* header)
+{
+    memset(header, 0, sizeof(AaruTraceHeader));
+    memcpy(header->magic, AARUREMOTE_TRACE_MAGIC, sizeof(header->magic));
+    header->version     = htole16(AARUREMOTE_TRACE_VERSION);
+    header->record_size = htole16(sizeof(AaruTraceRecord));
+    header->start_time  = htole64(trace_start_time);
+}
+
+int TraceInit()
+{
+    AaruTraceHeader header;
+
+    if(!server_options.trace_path && !server_options.trace_ring) return 0;
+
+    trace_started    = GetMonotonicMicroseconds();
+    trace_start_time = (uint64_t)time(NULL);
+
+    if(server_options.trace_ring)
+    {
+        trace_ring = calloc(server_options.trace_ring, sizeof(AaruTraceRecord));
+
+        if(!trace_ring)
+        {
+            printf("Error %d allocating memory for %u trace records.\n", errno, server_options.trace_ring);
+            return -1;
+        }
+    }
+
+    if(server_options.trace_path)
+    {
+        trace_file = fopen(server_options.trace_path, "wb");
+
+        if(!trace_file)
+        {
+            printf("Error %d opening trace file %s.\n", errno, server_options.trace_path);
+            free(trace_ring);
+            trace_ring = NULL;
+            return -1;
+        }
+
+        setvbuf(trace_file, NULL, _IOFBF, TRACE_FILE_BUFFER);
+
+        TraceFillHeader(&header);
+        fwrite(&header, sizeof(AaruTraceHeader), 1, trace_file);
+    }
+
+    trace_enabled = 1;
+
+    return 0;
+}
+
+uint8_t TraceEnabled() { return trace_enabled; }
+
+uint64_t TraceHash(const void* data, uint32_t len)
+{
+    const unsigned char* bytes = data;
+    uint64_t             hash  = TRACE_FNV_OFFSET;
+    uint32_t             i;
+
+    for(i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= TRACE_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// Takes a record in host order with started in monotonic clock time, and leaves it as it was stored
+void TraceRecord(AaruTraceRecord* record)
+{
+    AaruTraceRecord* slot;
+
+    if(!trace_enabled) return;
+
+    trace_sequence++;
+
+    record->sequence  = htole64(trace_sequence);
+    record->started   = htole64(record->started - trace_started);
+    record->duration  = htole32(record->duration);
+    record->elapsed   = htole32(record->elapsed);
+    record->bytes_in  = htole32(record->bytes_in);
+    record->bytes_out = htole32(record->bytes_out);
+    record->data_len  = htole32(record->data_len);
+    record->error_no  = (int32_t)htole32((uint32_t)record->error_no);
+    record->spare     = 0;
+    record->data_hash = htole64(record->data_hash);
+
+    if(trace_file) fwrite(record, sizeof(AaruTraceRecord), 1, trace_file);
+
+    if(!trace_ring) return;
+
+    slot = &trace_ring[(trace_sequence - 1) % server_options.trace_ring];
+
+    // Sequence goes last, until then a dump sees the slot does not hold the record it expects
+    *(volatile uint64_t*)&slot->sequence = 0;
+    MemoryFence();
+    memcpy((char*)slot + sizeof(slot->sequence),
+           (char*)record + sizeof(record->sequence),
+           sizeof(AaruTraceRecord) - sizeof(record->sequence));
+    MemoryFence();
+    *(volatile uint64_t*)&slot->sequence = record->sequence;
+}
+
+void TraceFlush()
+{
+    if(trace_file) fflush(trace_file);
+}
+
+// Writes the flight recorder to a new file in the working directory, oldest command first
+void TraceDump()
+{
+    AaruTraceHeader header;
+    AaruTraceRecord  record;
+    AaruTraceRecord* slot;
+    FILE*            file;
+    char             path[64];
+    uint64_t         first;
+    uint64_t         last = trace_sequence;
+    uint64_t         sequence;
+    uint64_t         before;
+    uint32_t         count = 0;
+
+    if(!trace_ring)
+    {
+        printf("Flight recorder is not enabled, use --trace-ring.\n");
+        return;
+    }
+
+    first = last > server_options.trace_ring ? last - server_options.trace_ring + 1 : 1;
+
+    sprintf(path, "aaruremote-flight-%u.trace", ++trace_dumps);
+    file = fopen(path, "wb");
+
+    if(!file)
+    {
+        printf("Error %d opening flight recorder dump %s.\n", errno, path);
+        return;
+    }
+
+    TraceFillHeader(&header);
+    fwrite(&header, sizeof(AaruTraceHeader), 1, file);
+
+    for(sequence = first; sequence <= last; sequence++)
+    {
+        slot = &trace_ring[(sequence - 1) % server_options.trace_ring];
+
+        before = *(volatile uint64_t*)&slot->sequence;
+        MemoryFence();
+        memcpy(&record, slot, sizeof(AaruTraceRecord));
+        MemoryFence();
+
+        // Overwritten, or the worker started writing it while we were copying it
+        if(le64toh(before) != sequence || *(volatile uint64_t*)&slot->sequence != before) continue;
+
+        fwrite(&record, sizeof(AaruTraceRecord), 1, file);
+        count++;
+    }
+
+    fclose(file);
+
+    printf("Flight recorder dumped the last %u commands to %s.\n", count, path);
+}
@@ -20,11 +20,20 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "../aaruremote.h"
 #include "unix.h"
 
+#ifdef MSG_NOSIGNAL
+#define NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NET_SEND_FLAGS 0
+#endif
+
 int PrintNetworkAddresses()
 {
     int             ret;
@@ -44,7 +53,7 @@ int PrintNetworkAddresses()
         if(ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET)
         {
             inet_ntop(AF_INET, &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr, ipv4_address, INET_ADDRSTRLEN);
-            printf("%s port %d\n", ipv4_address, AARUREMOTE_PORT);
+            printf("%s port %d\n", ipv4_address, server_options.port);
         }
 
         ifa = ifa->ifa_next;
@@ -65,7 +74,8 @@ void *NetSocket(uint32_t domain, uint32_t type, uint32_t protocol)
 
     if(!ctx) return NULL;
 
-    ctx->fd = socket(domain, type, protocol);
+    ctx->fd     = socket(domain, type, protocol);
+    ctx->impair = NULL;
 
     if(ctx->fd < 0)
     {
@@ -105,7 +115,8 @@ void *NetAccept(void *net_ctx, struct sockaddr *addr, socklen_t *addrlen)
 
     if(!cli_ctx) return NULL;
 
-    cli_ctx->fd = accept(ctx->fd, addr, addrlen);
+    cli_ctx->fd     = accept(ctx->fd, addr, addrlen);
+    cli_ctx->impair = NULL;
 
     if(cli_ctx->fd < 0)
     {
@@ -116,6 +127,65 @@ void *NetAccept(void *net_ctx, struct sockaddr *addr, socklen_t *addrlen)
     return cli_ctx;
 }
 
+// Sends what the impairment lets through by now, then waits for more as asked
+static int32_t NetFlush(NetworkContext *ctx, uint8_t until)
+{
+    NetBuffer      due[NET_MAX_BUFFERS];
+    struct iovec   iov[NET_MAX_BUFFERS];
+    struct msghdr  msg;
+    struct timeval timeout;
+    fd_set         readable;
+    uint64_t       wait;
+    int32_t        count;
+    int32_t        i;
+    ssize_t        sent;
+
+    for(;;)
+    {
+        count = ImpairDue(ctx->impair, due, NET_MAX_BUFFERS, &wait);
+
+        if(count > 0)
+        {
+            for(i = 0; i < count; i++)
+            {
+                iov[i].iov_base = (void *)due[i].data;
+                iov[i].iov_len  = due[i].len;
+            }
+
+            // Queued replies may still be going out after the client left, that must not kill the server
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov    = iov;
+            msg.msg_iovlen = count;
+            sent           = sendmsg(ctx->fd, &msg, NET_SEND_FLAGS);
+
+            if(sent < 0) return -1;
+
+            ImpairSent(ctx->impair, (uint32_t)sent);
+            continue;
+        }
+
+        if(wait == IMPAIR_IDLE || until == IMPAIR_SEND_DUE) return 0;
+
+        if(until == IMPAIR_SEND_ROOM && ImpairRoom(ctx->impair) > 0) return 0;
+
+        FD_ZERO(&readable);
+        FD_SET(ctx->fd, &readable);
+        timeout.tv_sec  = (time_t)(wait / 1000000);
+        timeout.tv_usec = (suseconds_t)(wait % 1000000);
+
+        // The client sending something ends the wait, unless what is queued has to go first
+        if(select(ctx->fd + 1, until == IMPAIR_SEND_UNTIL_READABLE ? &readable : NULL, NULL, NULL, &timeout) > 0)
+            return 0;
+    }
+}
+
+void NetImpair(void *net_ctx)
+{
+    NetworkContext *ctx = net_ctx;
+
+    if(ctx) ctx->impair = ImpairNew();
+}
+
 int32_t NetRecv(void *net_ctx, void *buf, int32_t len, uint32_t flags)
 {
     NetworkContext *ctx = net_ctx;
@@ -125,6 +195,8 @@ int32_t NetRecv(void *net_ctx, void *buf, int32_t len, uint32_t flags)
     int32_t got_once;
     int32_t got_total = 0;
 
+    if(ctx->impair && NetFlush(ctx, IMPAIR_SEND_UNTIL_READABLE) < 0) return -1;
+
     while(len > 0)
     {
         got_once = recv(ctx->fd, buf, len, flags);
@@ -136,6 +208,8 @@ int32_t NetRecv(void *net_ctx, void *buf, int32_t len, uint32_t flags)
         len -= got_once;
     }
 
+    if(ctx->impair && !(flags & MSG_PEEK)) SleepMicroseconds(ImpairReceived(ctx->impair, got_total));
+
     return got_total;
 }
 
@@ -143,11 +217,59 @@ int32_t NetWrite(void *net_ctx, const void *buf, int32_t size)
 {
     NetworkContext *ctx = net_ctx;
 
+    NetBuffer       buffer;
+
     if(!ctx) return -1;
 
+    if(ctx->impair)
+    {
+        buffer.data = buf;
+        buffer.len  = (uint32_t)size;
+        return NetWriteV(net_ctx, &buffer, 1);
+    }
+
     return write(ctx->fd, buf, size);
 }
 
+int32_t NetWriteV(void *net_ctx, const NetBuffer *buffers, int32_t count)
+{
+    NetworkContext *ctx = net_ctx;
+    struct iovec    iov[NET_MAX_BUFFERS];
+    int32_t         i;
+    int32_t         ret;
+    uint32_t        size = 0;
+    uint32_t        done = 0;
+
+    if(!ctx || count < 0 || count > NET_MAX_BUFFERS) return -1;
+
+    if(ctx->impair)
+    {
+        for(i = 0; i < count; i++) size += buffers[i].len;
+
+        // Blocks like a real sender would once the link has all it can carry in flight
+        while(done < size)
+        {
+            ret = ImpairQueue(ctx->impair, buffers, count, done);
+
+            if(ret < 0) return -1;
+
+            done += (uint32_t)ret;
+
+            if(NetFlush(ctx, done < size ? IMPAIR_SEND_ROOM : IMPAIR_SEND_DUE) < 0) return -1;
+        }
+
+        return (int32_t)done;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        iov[i].iov_base = (void *)buffers[i].data;
+        iov[i].iov_len  = buffers[i].len;
+    }
+
+    return writev(ctx->fd, iov, count);
+}
+
 int32_t NetClose(void *net_ctx)
 {
     int             ret;
@@ -155,6 +277,13 @@ int32_t NetClose(void *net_ctx)
 
     if(!ctx) return -1;
 
+    // Whatever is still on its way gets there before the connection ends
+    if(ctx->impair)
+    {
+        NetFlush(ctx, IMPAIR_SEND_ALL);
+        ImpairFree(ctx->impair);
+    }
+
     ret = close(ctx->fd);
     free(ctx);
     return ret;
@@ -15,15 +15,120 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../aaruremote.h"
+#include "unix.h"
 
 void Initialize()
 {
     // Do nothing
 }
 
-void PlatformLoop(AaruPacketHello *pkt_server_hello) { WorkingLoop(pkt_server_hello); }
+static void *FlightRecorderLoop(void *arguments)
+{
+    sigset_t *signals = arguments;
+    int       signal_number;
+
+    for(;;)
+        if(sigwait(signals, &signal_number) == 0) TraceDump();
+
+    return NULL;
+}
+
+void PlatformLoop(AaruPacketHello *pkt_server_hello)
+{
+    static sigset_t signals;
+    pthread_t       flight_recorder;
+    pthread_t       metrics;
+
+    if(server_options.trace_ring)
+    {
+        // Blocked before any other thread exists, so SIGUSR1 only ever reaches the thread that dumps
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+        if(pthread_create(&flight_recorder, NULL, FlightRecorderLoop, &signals) == 0)
+        {
+            pthread_detach(flight_recorder);
+            printf("Send SIGUSR1 to process %d to dump the flight recorder.\n", (int)getpid());
+        }
+        else
+            printf("Error starting flight recorder thread.\n");
+    }
+
+    if(server_options.metrics_port)
+    {
+        if(pthread_create(&metrics, NULL, MetricsLoop, NULL) == 0)
+            pthread_detach(metrics);
+        else
+            printf("Error starting metrics thread.\n");
+    }
+
+    WorkingLoop(pkt_server_hello);
+}
+
+uint8_t AmIRoot() { return geteuid() == 0; }
+
+uint64_t GetMonotonicMicroseconds()
+{
+    struct timespec tp;
+
+#ifdef CLOCK_MONOTONIC_RAW
+    // Not slewed by NTP, so intervals are what the hardware really took
+    if(clock_gettime(CLOCK_MONOTONIC_RAW, &tp) == 0) return (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+#endif
+
+    if(clock_gettime(CLOCK_MONOTONIC, &tp) != 0) return 0;
+
+    return (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+}
+
+void SleepMicroseconds(uint64_t microseconds)
+{
+    struct timespec delay;
+
+    delay.tv_sec  = (time_t)(microseconds / 1000000);
+    delay.tv_nsec = (long)(microseconds % 1000000) * 1000;
+
+    // Interrupted sleeps carry on with what is left
+    while(nanosleep(&delay, &delay) != 0 && errno == EINTR)
+        ;
+}
+
+// Neither the processor nor the compiler move loads and stores across it
+void MemoryFence() { __sync_synchronize(); }
+
+void *AllocateLargeBuffer(size_t size, uint8_t huge_pages)
+{
+    void *buffer;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist if the administrator reserved them, fall back quietly otherwise
+    if(huge_pages && (size & (UNIX_HUGE_PAGE_SIZE - 1)) == 0)
+    {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if(buffer != MAP_FAILED) return buffer;
+    }
+#endif
+
+    buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(buffer == MAP_FAILED) return NULL;
+
+#ifdef MADV_HUGEPAGE
+    if(huge_pages) madvise(buffer, size, MADV_HUGEPAGE);
+#endif
+
+    return buffer;
+}
 
-uint8_t AmIRoot() { return geteuid() == 0; }
\ No newline at end of file
+void FreeLargeBuffer(void *buffer, size_t size) { munmap(buffer, size); }
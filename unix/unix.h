@@ -18,9 +18,13 @@
 #ifndef AARUREMOTE_UNIX_UNIX_H_
 #define AARUREMOTE_UNIX_UNIX_H_
 
+// Size of the huge pages that MAP_HUGETLB hands out by default
+#define UNIX_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 typedef struct
 {
-    int fd;
+    int                fd;
+    struct Impairment *impair;
 } NetworkContext;
 
 #endif  // AARUREMOTE_UNIX_UNIX_H_
@@ -34,7 +34,7 @@ int PrintNetworkAddresses()
     if(ret < 0) return -1;
 
     printf("Available addresses:\n");
-    printf("%s port %d\n", localip, AARUREMOTE_PORT);
+    printf("%s port %d\n", localip, server_options.port);
 
     return 0;
 }
@@ -100,6 +100,12 @@ void *NetAccept(void *net_ctx, struct sockaddr *addr, socklen_t *addrlen)
     return cli_ctx;
 }
 
+// No way to wait on a socket with a timeout here, the link is always as fast as it really is
+void NetImpair(void *net_ctx)
+{
+    if(ImpairEnabled()) printf("Network impairment is not supported on this platform.\n");
+}
+
 int32_t NetRecv(void *net_ctx, void *buf, int32_t len, uint32_t flags)
 {
     NetworkContext *ctx = net_ctx;
@@ -132,6 +138,28 @@ int32_t NetWrite(void *net_ctx, const void *buf, int32_t size)
     return net_write(ctx->fd, buf, size);
 }
 
+int32_t NetWriteV(void *net_ctx, const NetBuffer *buffers, int32_t count)
+{
+    NetworkContext *ctx = net_ctx;
+    int32_t         ret;
+    int32_t         i;
+    int32_t         total = 0;
+
+    if(!ctx || count < 0 || count > NET_MAX_BUFFERS) return -1;
+
+    // No scatter/gather in the Wii network stack, send the pieces one after the other
+    for(i = 0; i < count; i++)
+    {
+        ret = net_write(ctx->fd, buffers[i].data, buffers[i].len);
+
+        if(ret < 0) return ret;
+
+        total += ret;
+    }
+
+    return total;
+}
+
 int32_t NetClose(void *net_ctx)
 {
     int             ret;
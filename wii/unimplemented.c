@@ -51,4 +51,10 @@ int32_t ReOpen(void *device_ctx, uint32_t *closeFailed)
     return -1;
 }
 
-int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *duration) { return -1; }
\ No newline at end of file
+int32_t OsRead(void *device_ctx, char *buffer, uint64_t offset, uint32_t length, uint32_t *read_length,
+               uint32_t *duration)
+{
+    return -1;
+}
+
+int32_t OsSeekData(void *device_ctx, uint64_t offset, uint64_t *data, uint64_t *hole) { return -1; }
@@ -53,6 +53,8 @@ int32_t SendScsiCommand(void *device_ctx, char *cdb, char *buffer, char **sense_
     return -1;
 }
 
+char *GetScsiDataInBuffer(void *device_ctx, uint32_t length) { return NULL; }
+
 uint8_t GetUsbData(void *device_ctx, uint16_t *desc_len, char *descriptors, uint16_t *id_vendor, uint16_t *id_product,
                    char *manufacturer, char *product, char *serial)
 {
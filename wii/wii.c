@@ -18,6 +18,10 @@
 #include <debug.h>
 #include <errno.h>
 #include <gccore.h>
+#include <malloc.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <wiiuse/wpad.h>
 
 #include "../aaruremote.h"
@@ -44,8 +48,12 @@ void Initialize()
 
 void PlatformLoop(AaruPacketHello *pkt_server_hello)
 {
-    static lwp_t worker = (lwp_t)NULL;
+    static lwp_t worker  = (lwp_t)NULL;
+    static lwp_t metrics = (lwp_t)NULL;
     int          buttonsDown;
+
+    if(server_options.trace_ring) printf("Press 1 to dump the flight recorder.\n");
+
     LWP_CreateThread(&worker,          /* thread handle */
                      WorkingLoop,      /* code */
                      pkt_server_hello, /* arg pointer for thread */
@@ -53,6 +61,15 @@ void PlatformLoop(AaruPacketHello *pkt_server_hello)
                      16 * 1024,        /* stack size */
                      50 /* thread priority */);
 
+    // Below the worker, scrapes wait while a command is being served
+    if(server_options.metrics_port)
+        LWP_CreateThread(&metrics,    /* thread handle */
+                         MetricsLoop, /* code */
+                         NULL,        /* arg pointer for thread */
+                         NULL,        /* stack base */
+                         32 * 1024,   /* stack size */
+                         40 /* thread priority */);
+
     while(true)
     {
         VIDEO_WaitVSync();
@@ -61,7 +78,21 @@ void PlatformLoop(AaruPacketHello *pkt_server_hello)
         buttonsDown = WPAD_ButtonsDown(0);
 
         if(buttonsDown & WPAD_BUTTON_HOME) { return; }
+
+        // No signals here, the flight recorder is dumped from the controller
+        if(buttonsDown & WPAD_BUTTON_1) TraceDump();
     }
 }
 
-uint8_t AmIRoot() { return 1; }
\ No newline at end of file
+uint8_t AmIRoot() { return 1; }
+
+uint64_t GetMonotonicMicroseconds() { return ticks_to_microsecs(gettime()); }
+
+void SleepMicroseconds(uint64_t microseconds) { usleep((useconds_t)microseconds); }
+
+void MemoryFence() { __sync_synchronize(); }
+
+// No virtual memory to speak of, cache line aligned heap memory is as good as it gets
+void *AllocateLargeBuffer(size_t size, uint8_t huge_pages) { return memalign(32, size); }
+
+void FreeLargeBuffer(void *buffer, size_t size) { free(buffer); }
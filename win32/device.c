@@ -141,24 +141,105 @@ int32_t ReOpen(void* device_ctx, uint32_t* closeFailed)
     return ctx->handle == INVALID_HANDLE_VALUE ? GetLastError() : 0;
 }
 
-int32_t OsRead(void* device_ctx, char* buffer, uint64_t offset, uint32_t length, uint32_t* duration)
+int32_t OsRead(void*     device_ctx,
+               char*     buffer,
+               uint64_t  offset,
+               uint32_t  length,
+               uint32_t* read_length,
+               uint32_t* duration)
 {
     DeviceContext* ctx = device_ctx;
     BOOL           ret;
-    LARGE_INTEGER  liDistanceToMove;
+    OVERLAPPED     overlapped;
     DWORD          nNumberOfBytesRead;
-    *duration                 = 0;
-    liDistanceToMove.QuadPart = offset;
+    DWORD          error = 0;
+    LARGE_INTEGER  frequency;
+    LARGE_INTEGER  start;
+    LARGE_INTEGER  end;
+    DOUBLE         interval;
+    *duration    = 0;
+    *read_length = 0;
 
     if(!ctx) return -1;
 
-    // TODO: Timing
-    ret = SetFilePointerEx(ctx->handle, liDistanceToMove, NULL, FILE_BEGIN);
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
 
-    if(!ret) return GetLastError();
+    // Positioned reads, looping until the whole length is in or the end of the device is reached
+    while(*read_length < length)
+    {
+        memset(&overlapped, 0, sizeof(OVERLAPPED));
+        overlapped.Offset     = (DWORD)(offset + *read_length);
+        overlapped.OffsetHigh = (DWORD)((offset + *read_length) >> 32);
+
+        ret = ReadFile(ctx->handle, buffer + *read_length, length - *read_length, &nNumberOfBytesRead, &overlapped);
+
+        if(!ret)
+        {
+            error = GetLastError();
+
+            if(error == ERROR_HANDLE_EOF) error = 0;
+
+            break;
+        }
+
+        if(nNumberOfBytesRead == 0) break;
 
-    // TODO: Timing
-    ret = ReadFile(ctx->handle, buffer, length, &nNumberOfBytesRead, NULL);
+        *read_length += nNumberOfBytesRead;
+    }
+
+    QueryPerformanceCounter(&end);
+
+    interval  = (DOUBLE)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    *duration = (uint32_t)(interval * 1000.0);
 
-    return !ret ? GetLastError() : 0;
-}
\ No newline at end of file
+    return error;
+}
+
+// Sparse files tell which ranges hold data, devices have no size here and are read instead
+int32_t OsSeekData(void* device_ctx, uint64_t offset, uint64_t* data, uint64_t* hole)
+{
+#ifdef FSCTL_QUERY_ALLOCATED_RANGES
+    DeviceContext*              ctx = device_ctx;
+    FILE_ALLOCATED_RANGE_BUFFER query;
+    FILE_ALLOCATED_RANGE_BUFFER range;
+    LARGE_INTEGER               size;
+    DWORD                       returned = 0;
+    uint64_t                    end;
+
+    if(!ctx) return -1;
+
+    if(!GetFileSizeEx(ctx->handle, &size)) return GetLastError();
+
+    // Without any more data the device ends at both
+    *data = (uint64_t)size.QuadPart;
+    *hole = (uint64_t)size.QuadPart;
+
+    if(offset >= (uint64_t)size.QuadPart) return 0;
+
+    query.FileOffset.QuadPart = (LONGLONG)offset;
+    query.Length.QuadPart     = size.QuadPart - (LONGLONG)offset;
+
+    // Only the first range is needed, there being more is no error
+    if(!DeviceIoControl(ctx->handle,
+                        FSCTL_QUERY_ALLOCATED_RANGES,
+                        &query,
+                        sizeof(FILE_ALLOCATED_RANGE_BUFFER),
+                        &range,
+                        sizeof(FILE_ALLOCATED_RANGE_BUFFER),
+                        &returned,
+                        NULL) &&
+       GetLastError() != ERROR_MORE_DATA)
+        return GetLastError();
+
+    if(returned < sizeof(FILE_ALLOCATED_RANGE_BUFFER)) return 0;
+
+    end   = (uint64_t)(range.FileOffset.QuadPart + range.Length.QuadPart);
+    *data = (uint64_t)range.FileOffset.QuadPart < offset ? offset : (uint64_t)range.FileOffset.QuadPart;
+    *hole = end < (uint64_t)size.QuadPart ? end : (uint64_t)size.QuadPart;
+
+    return 0;
+#else
+    return EINVAL;
+#endif
+}
@@ -64,7 +64,7 @@ int PrintNetworkAddresses()
         {
             printf("%s port %d\n",
                    inet_ntoa(((struct sockaddr_in*)pUnicast->Address.lpSockaddr)->sin_addr),
-                   AARUREMOTE_PORT);
+                   server_options.port);
             pUnicast = pUnicast->Next;
         }
 
@@ -97,6 +97,7 @@ void* NetSocket(uint32_t domain, uint32_t type, uint32_t protocol)
     if(!ctx) return NULL;
 
     ctx->socket = socket(domain, type, protocol);
+    ctx->impair = NULL;
 
     if(ctx->socket == INVALID_SOCKET)
     {
@@ -138,6 +139,7 @@ void* NetAccept(void* net_ctx, struct sockaddr* addr, socklen_t* addrlen)
     if(!cli_ctx) return NULL;
 
     cli_ctx->socket = accept(ctx->socket, addr, addrlen);
+    cli_ctx->impair = NULL;
 
     if(cli_ctx->socket == INVALID_SOCKET)
     {
@@ -148,6 +150,60 @@ void* NetAccept(void* net_ctx, struct sockaddr* addr, socklen_t* addrlen)
     return cli_ctx;
 }
 
+// Sends what the impairment lets through by now, then waits for more as asked
+static int32_t NetFlush(NetworkContext* ctx, uint8_t until)
+{
+    NetBuffer      due[NET_MAX_BUFFERS];
+    WSABUF         wsa_buffers[NET_MAX_BUFFERS];
+    struct timeval timeout;
+    fd_set         readable;
+    uint64_t       wait;
+    int32_t        count;
+    int32_t        i;
+    DWORD          sent;
+
+    for(;;)
+    {
+        count = ImpairDue(ctx->impair, due, NET_MAX_BUFFERS, &wait);
+
+        if(count > 0)
+        {
+            for(i = 0; i < count; i++)
+            {
+                wsa_buffers[i].buf = (char*)due[i].data;
+                wsa_buffers[i].len = due[i].len;
+            }
+
+            if(WSASend(ctx->socket, wsa_buffers, count, &sent, 0, NULL, NULL) != 0) return -1;
+
+            ImpairSent(ctx->impair, (uint32_t)sent);
+            continue;
+        }
+
+        if(wait == IMPAIR_IDLE || until == IMPAIR_SEND_DUE) return 0;
+
+        if(until == IMPAIR_SEND_ROOM && ImpairRoom(ctx->impair) > 0) return 0;
+
+        FD_ZERO(&readable);
+        FD_SET(ctx->socket, &readable);
+        timeout.tv_sec  = (long)(wait / 1000000);
+        timeout.tv_usec = (long)(wait % 1000000);
+
+        // Windows wants at least one set, so what is queued going first just sleeps instead
+        if(until != IMPAIR_SEND_UNTIL_READABLE)
+            SleepMicroseconds(wait);
+        else if(select(0, &readable, NULL, NULL, &timeout) > 0)
+            return 0;
+    }
+}
+
+void NetImpair(void* net_ctx)
+{
+    NetworkContext* ctx = net_ctx;
+
+    if(ctx) ctx->impair = ImpairNew();
+}
+
 int32_t NetRecv(void* net_ctx, void* buf, int32_t len, uint32_t flags)
 {
     NetworkContext* ctx     = net_ctx;
@@ -157,6 +213,8 @@ int32_t NetRecv(void* net_ctx, void* buf, int32_t len, uint32_t flags)
 
     if(!ctx) return -1;
 
+    if(ctx->impair && NetFlush(ctx, IMPAIR_SEND_UNTIL_READABLE) < 0) return -1;
+
     while(len > 0)
     {
         got_once = recv(ctx->socket, charbuf, len, flags);
@@ -168,18 +226,70 @@ int32_t NetRecv(void* net_ctx, void* buf, int32_t len, uint32_t flags)
         len -= got_once;
     }
 
+    if(ctx->impair && !(flags & MSG_PEEK)) SleepMicroseconds(ImpairReceived(ctx->impair, got_total));
+
     return got_total;
 }
 
 int32_t NetWrite(void* net_ctx, const void* buf, int32_t size)
 {
     NetworkContext* ctx = net_ctx;
+    NetBuffer       buffer;
 
     if(!ctx) return -1;
 
+    if(ctx->impair)
+    {
+        buffer.data = buf;
+        buffer.len  = (uint32_t)size;
+        return NetWriteV(net_ctx, &buffer, 1);
+    }
+
     return send(ctx->socket, buf, size, 0);
 }
 
+int32_t NetWriteV(void* net_ctx, const NetBuffer* buffers, int32_t count)
+{
+    NetworkContext* ctx = net_ctx;
+    WSABUF          wsa_buffers[NET_MAX_BUFFERS];
+    DWORD           sent;
+    int32_t         i;
+    int32_t         ret;
+    uint32_t        size = 0;
+    uint32_t        done = 0;
+
+    if(!ctx || count < 0 || count > NET_MAX_BUFFERS) return -1;
+
+    if(ctx->impair)
+    {
+        for(i = 0; i < count; i++) size += buffers[i].len;
+
+        // Blocks like a real sender would once the link has all it can carry in flight
+        while(done < size)
+        {
+            ret = ImpairQueue(ctx->impair, buffers, count, done);
+
+            if(ret < 0) return -1;
+
+            done += (uint32_t)ret;
+
+            if(NetFlush(ctx, done < size ? IMPAIR_SEND_ROOM : IMPAIR_SEND_DUE) < 0) return -1;
+        }
+
+        return (int32_t)done;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        wsa_buffers[i].buf = (char*)buffers[i].data;
+        wsa_buffers[i].len = buffers[i].len;
+    }
+
+    if(WSASend(ctx->socket, wsa_buffers, count, &sent, 0, NULL, NULL) != 0) return -1;
+
+    return (int32_t)sent;
+}
+
 int32_t NetClose(void* net_ctx)
 {
     int             ret;
@@ -187,6 +297,13 @@ int32_t NetClose(void* net_ctx)
 
     if(!ctx) return -1;
 
+    // Whatever is still on its way gets there before the connection ends
+    if(ctx->impair)
+    {
+        NetFlush(ctx, IMPAIR_SEND_ALL);
+        ImpairFree(ctx->impair);
+    }
+
     ret = closesocket(ctx->socket);
     free(ctx);
     return ret;
@@ -115,4 +115,6 @@ int32_t SendScsiCommand(void*     device_ctx,
 
     free(sptd_and_sense);
     return error;
-}
\ No newline at end of file
+}
+
+char* GetScsiDataInBuffer(void* device_ctx, uint32_t length) { return NULL; }
@@ -15,6 +15,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <windows.h>
 
 #include "win32.h"
@@ -26,7 +27,40 @@ void Initialize()
     // Do nothing
 }
 
-void PlatformLoop(AaruPacketHello* pkt_server_hello) { WorkingLoop(pkt_server_hello); }
+static DWORD WINAPI MetricsThread(LPVOID arguments)
+{
+    MetricsLoop(arguments);
+    return 0;
+}
+
+// Windows has no SIGUSR1, Ctrl+Break in the server console dumps the flight recorder instead
+static BOOL WINAPI FlightRecorderHandler(DWORD control_type)
+{
+    if(control_type != CTRL_BREAK_EVENT) return FALSE;
+
+    TraceDump();
+    return TRUE;
+}
+
+void PlatformLoop(AaruPacketHello* pkt_server_hello)
+{
+    HANDLE metrics;
+
+    if(server_options.trace_ring && SetConsoleCtrlHandler(FlightRecorderHandler, TRUE))
+        printf("Press Ctrl+Break to dump the flight recorder.\n");
+
+    if(server_options.metrics_port)
+    {
+        metrics = CreateThread(NULL, 0, MetricsThread, NULL, 0, NULL);
+
+        if(metrics)
+            CloseHandle(metrics);
+        else
+            printf("Error %lu starting metrics thread.\n", (unsigned long)GetLastError());
+    }
+
+    WorkingLoop(pkt_server_hello);
+}
 
 uint8_t AmIRoot()
 {
@@ -44,4 +78,47 @@ uint8_t AmIRoot()
     }
 
     return b;
-}
\ No newline at end of file
+}
+
+uint64_t GetMonotonicMicroseconds()
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER        counter;
+
+    if(frequency.QuadPart == 0 && !QueryPerformanceFrequency(&frequency)) return 0;
+
+    if(!QueryPerformanceCounter(&counter)) return 0;
+
+    // Whole seconds first so high frequency counters do not overflow
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+// Millisecond resolution is all Sleep gives, rounded up so short waits are not skipped
+void SleepMicroseconds(uint64_t microseconds) { Sleep((DWORD)((microseconds + 999) / 1000)); }
+
+// Neither the processor nor the compiler move loads and stores across it
+void MemoryFence() { MemoryBarrier(); }
+
+void* AllocateLargeBuffer(size_t size, uint8_t huge_pages)
+{
+    void* buffer;
+
+#ifdef MEM_LARGE_PAGES
+    SIZE_T large_page = GetLargePageMinimum();
+
+    // Needs the lock pages in memory privilege, plain pages otherwise
+    if(huge_pages && large_page > 0 && (size % large_page) == 0)
+    {
+        buffer = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+        if(buffer) return buffer;
+    }
+#endif
+
+    buffer = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    return buffer;
+}
+
+void FreeLargeBuffer(void* buffer, size_t size) { VirtualFree(buffer, 0, MEM_RELEASE); }
@@ -47,7 +47,8 @@ typedef int socklen_t;
 
 typedef struct
 {
-    SOCKET socket;
+    SOCKET             socket;
+    struct Impairment* impair;
 } NetworkContext;
 
 typedef struct
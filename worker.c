@@ -33,6 +33,387 @@
 #include "aaruremote.h"
 #include "endian.h"
 
+#define WORKER_DISCARD_SIZE 4096
+// Responses shorter than this gain too little from leaving zeros out or compression to be worth it
+#define WORKER_REDUCE_MIN 512
+// Room kept in front of received packets so responses bigger than their commands can be built in place
+#define WORKER_HEADROOM 256
+// SPC limits sense data to 252 bytes, always fits in the headroom
+#define WORKER_MAX_SENSE 252
+
+// Request being served, accounted in the statistics and the trace once done. Device commands send their timestamps
+// back in the response trailer when the session negotiated it, zero runs are left out and responses compressed if
+// that was too.
+typedef struct
+{
+    uint8_t     timing;
+    uint8_t     compress;
+    uint8_t     zero_runs;
+    uint8_t     trace;
+    uint8_t     pending;
+    int8_t      packet_type;
+    uint8_t     error;
+    int16_t     opcode;
+    uint32_t    bytes_in;
+    uint32_t    bytes_out;
+    uint64_t    started;
+    uint64_t    received;
+    uint64_t    submitted;
+    uint64_t    completed;
+    uint64_t    sent;
+    int32_t     error_no;
+    const void* data;
+    uint32_t    data_len;
+    uint8_t     command_len;
+    uint8_t     sense_len;
+    uint8_t     command[AARUREMOTE_TRACE_COMMAND_SIZE];
+    uint8_t     sense[AARUREMOTE_TRACE_SENSE_SIZE];
+} WorkerRequest;
+
+// Reads and throws away a packet whose contents are of no use, without allocating room for it
+static void DiscardPacket(void* cli_ctx, uint32_t len)
+{
+    static char scratch[WORKER_DISCARD_SIZE];
+    int32_t     ret;
+
+    while(len > 0)
+    {
+        ret = NetRecv(cli_ctx, scratch, len > WORKER_DISCARD_SIZE ? WORKER_DISCARD_SIZE : (int32_t)len, 0);
+
+        if(ret <= 0) return;
+
+        len -= ret;
+    }
+}
+
+// Receives a packet with WORKER_HEADROOM free bytes before it
+static char* RecvPacket(void* cli_ctx, Arena* arena, uint32_t len)
+{
+    char* buf = ArenaAlloc(arena, WORKER_HEADROOM + (size_t)len);
+
+    if(!buf) return NULL;
+
+    NetRecv(cli_ctx, buf + WORKER_HEADROOM, len, 0);
+
+    return buf + WORKER_HEADROOM;
+}
+
+static void SendPacket(void* cli_ctx, WorkerRequest* request, const void* buf, uint32_t len)
+{
+    NetWrite(cli_ctx, buf, (int32_t)len);
+    request->bytes_out += len;
+}
+
+static void SendErrorPacket(void*          cli_ctx,
+                            WorkerRequest* request,
+                            AaruPacketNop* pkt_nop,
+                            uint8_t        reason_code,
+                            int32_t        error_no,
+                            const char*    reason)
+{
+    pkt_nop->reason_code = reason_code;
+    pkt_nop->error_no    = error_no;
+    memset(&pkt_nop->reason, 0, 256);
+    strncpy(pkt_nop->reason, reason, 256);
+    SendPacket(cli_ctx, request, pkt_nop, sizeof(AaruPacketNop));
+    request->error = 1;
+    printf("%s\n", reason);
+}
+
+static void SendInvalidPacket(void* cli_ctx, WorkerRequest* request, AaruPacketNop* pkt_nop, const char* reason)
+{
+    SendErrorPacket(cli_ctx, request, pkt_nop, AARUREMOTE_PACKET_NOP_REASON_INVALID_PACKET, EINVAL, reason);
+}
+
+// Packet is already read, only the response did not fit in memory, so the session can go on
+static void SendOutOfMemory(void* cli_ctx, WorkerRequest* request, AaruPacketNop* pkt_nop, const char* reason)
+{
+    SendErrorPacket(cli_ctx, request, pkt_nop, AARUREMOTE_PACKET_NOP_REASON_OUT_OF_MEMORY, ENOMEM, reason);
+}
+
+// Start of the command packet after its header as the client sent it, enough to issue the command again
+static void SetTraceCommand(WorkerRequest* request, const void* command, uint32_t len)
+{
+    if(!request->trace) return;
+
+    if(len > AARUREMOTE_TRACE_COMMAND_SIZE) len = AARUREMOTE_TRACE_COMMAND_SIZE;
+
+    memcpy(request->command, command, len);
+    request->command_len = (uint8_t)len;
+}
+
+// Outcome of the command for the trace, data must stay valid until the request is recorded
+static void SetTraceResult(WorkerRequest* request,
+                           int32_t        error_no,
+                           const void*    sense,
+                           uint32_t       sense_len,
+                           const void*    data,
+                           uint32_t       data_len)
+{
+    if(!request->trace) return;
+
+    if(!sense) sense_len = 0;
+
+    if(sense_len > AARUREMOTE_TRACE_SENSE_SIZE) sense_len = AARUREMOTE_TRACE_SENSE_SIZE;
+
+    if(sense_len > 0) memcpy(request->sense, sense, sense_len);
+
+    request->sense_len = (uint8_t)sense_len;
+    request->error_no  = error_no;
+    request->data      = data;
+    request->data_len  = data_len;
+}
+
+// Accounts the request that was just served, device commands by how long the device took
+static void RecordRequest(WorkerRequest* request)
+{
+    AaruTraceRecord record;
+    uint64_t        elapsed;
+    uint64_t        time;
+
+    if(!request->pending) return;
+
+    elapsed = GetMonotonicMicroseconds() - request->started;
+
+    if(request->submitted)
+        time = request->completed - request->submitted;
+    else
+        time = elapsed;
+
+    StatsRecord(request->packet_type, request->opcode, request->bytes_in, request->bytes_out, time, request->error);
+
+    if(request->trace)
+    {
+        memset(&record, 0, sizeof(AaruTraceRecord));
+        record.started     = request->started;
+        record.duration    = request->submitted ? (time > UINT32_MAX ? UINT32_MAX : (uint32_t)time) : 0;
+        record.elapsed     = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        record.bytes_in    = request->bytes_in;
+        record.bytes_out   = request->bytes_out;
+        record.data_len    = request->data_len;
+        record.error_no    = request->error_no;
+        record.packet_type = request->packet_type;
+        record.flags       = request->error ? AARUREMOTE_TRACE_FLAG_ERROR : 0;
+        record.command_len = request->command_len;
+        record.sense_len   = request->sense_len;
+        memcpy(record.command, request->command, request->command_len);
+        memcpy(record.sense, request->sense, request->sense_len);
+
+        // Hashing reads every byte again, so it is only done when asked for
+        if(server_options.trace_hash && request->data)
+        {
+            record.data_hash = TraceHash(request->data, request->data_len);
+            record.flags |= AARUREMOTE_TRACE_FLAG_HASH;
+        }
+
+        TraceRecord(&record);
+    }
+
+    request->pending = 0;
+}
+
+// Packet without the zero runs in the response, 0 if there are none. out must have room for the response and runs
+// for one run per AARUREMOTE_ZERO_RUN_WINDOW bytes.
+static uint32_t ElideZeroRuns(const char* packet, uint32_t len, char* out, AaruZeroRun* runs)
+{
+    AaruPacketZeroRuns* pkt_zero_runs = (AaruPacketZeroRuns*)out;
+    uint32_t            run_count;
+    uint32_t            zero_bytes;
+    uint32_t            elided;
+    uint32_t            from = 0;
+    uint32_t            i;
+
+    run_count = CompressZeroRuns((const uint8_t*)packet, len, runs, &zero_bytes);
+    elided    = (uint32_t)(sizeof(AaruPacketZeroRuns) + sizeof(AaruZeroRun) * run_count) + len - zero_bytes;
+
+    if(run_count == 0 || elided >= len) return 0;
+
+    pkt_zero_runs->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+    pkt_zero_runs->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+    pkt_zero_runs->hdr.len         = htole32(elided);
+    pkt_zero_runs->hdr.version     = AARUREMOTE_PACKET_VERSION;
+    pkt_zero_runs->hdr.packet_type = AARUREMOTE_PACKET_TYPE_ZERO_RUNS;
+    pkt_zero_runs->original_len    = htole32(len);
+    pkt_zero_runs->run_count       = htole32(run_count);
+    memset(pkt_zero_runs->hdr.spare, 0, sizeof(pkt_zero_runs->hdr.spare));
+    memcpy(pkt_zero_runs->runs, runs, sizeof(AaruZeroRun) * run_count);
+
+    out += sizeof(AaruPacketZeroRuns) + sizeof(AaruZeroRun) * run_count;
+
+    // Everything between the runs goes as it is
+    for(i = 0; i < run_count; i++)
+    {
+        memcpy(out, packet + from, le32toh(runs[i].offset) - from);
+        out += le32toh(runs[i].offset) - from;
+        from = le32toh(runs[i].offset) + le32toh(runs[i].length);
+    }
+
+    memcpy(out, packet + from, len - from);
+
+    return elided;
+}
+
+// Compressed packet holding the whole one given, 0 if it does not get smaller. out must have room for len bytes.
+static uint32_t CompressPacket(const char* packet, uint32_t len, char* out)
+{
+    AaruPacketCompressed* pkt_compressed = (AaruPacketCompressed*)out;
+    uint32_t              compressed;
+
+    if(!CompressWorthTrying((const uint8_t*)packet, len)) return 0;
+
+    compressed = CompressBlock((const uint8_t*)packet,
+                               len,
+                               (uint8_t*)out + sizeof(AaruPacketCompressed),
+                               len - (uint32_t)sizeof(AaruPacketCompressed) - 1);
+
+    if(compressed == 0) return 0;
+
+    compressed += sizeof(AaruPacketCompressed);
+
+    pkt_compressed->hdr.remote_id    = htole32(AARUREMOTE_REMOTE_ID);
+    pkt_compressed->hdr.packet_id    = htole32(AARUREMOTE_PACKET_ID);
+    pkt_compressed->hdr.len          = htole32(compressed);
+    pkt_compressed->hdr.version      = AARUREMOTE_PACKET_VERSION;
+    pkt_compressed->hdr.packet_type  = AARUREMOTE_PACKET_TYPE_COMPRESSED;
+    pkt_compressed->uncompressed_len = htole32(len);
+    pkt_compressed->algorithm        = AARUREMOTE_COMPRESSION_LZ4;
+    memset(pkt_compressed->hdr.spare, 0, sizeof(pkt_compressed->hdr.spare));
+    memset(pkt_compressed->spare, 0, sizeof(pkt_compressed->spare));
+
+    return compressed;
+}
+
+// Sends the response without its zero runs and then compressed, as negotiated and as long as each step makes it
+// smaller. Returns the bytes sent, or 0 if the response is still to be sent as it is.
+static uint32_t SendReduced(void*            cli_ctx,
+                            WorkerRequest*   request,
+                            const NetBuffer* buffers,
+                            int32_t          count,
+                            uint32_t         len)
+{
+    char*    staging;
+    char*    packet;
+    char*    out;
+    size_t   granted;
+    uint32_t packet_len = len;
+    uint32_t reduced;
+    uint32_t off = 0;
+    int32_t  i;
+
+    if(len < WORKER_REDUCE_MIN) return 0;
+
+    // Response, room for what replaces it and the zero runs found
+    staging = PoolGet((size_t)len * 2 + sizeof(AaruZeroRun) * (len / AARUREMOTE_ZERO_RUN_WINDOW + 1), &granted);
+
+    if(!staging) return 0;
+
+    for(i = 0; i < count; i++)
+    {
+        memcpy(staging + off, buffers[i].data, buffers[i].len);
+        off += buffers[i].len;
+    }
+
+    packet = staging;
+    out    = staging + len;
+
+    if(request->zero_runs)
+    {
+        reduced = ElideZeroRuns(packet, packet_len, out, (AaruZeroRun*)(staging + (size_t)len * 2));
+
+        // The response is not needed anymore, its room takes the compressed packet
+        if(reduced)
+        {
+            packet     = out;
+            packet_len = reduced;
+            out        = staging;
+        }
+    }
+
+    if(request->compress)
+    {
+        reduced = CompressPacket(packet, packet_len, out);
+
+        if(reduced)
+        {
+            packet     = out;
+            packet_len = reduced;
+        }
+    }
+
+    if(packet_len < len) NetWrite(cli_ctx, packet, (int32_t)packet_len);
+
+    PoolPut(staging);
+
+    return packet_len < len ? packet_len : 0;
+}
+
+// Sends a device command response, with data that is not right after it in memory and the timing trailer if negotiated
+static void SendResponse(void*             cli_ctx,
+                         WorkerRequest*    request,
+                         AaruPacketHeader* hdr,
+                         uint32_t          len,
+                         const void*       data,
+                         uint32_t          data_len)
+{
+    AaruResponseTiming trailer;
+    NetBuffer          buffers[3];
+    int32_t            count = 1;
+    uint32_t           sent  = 0;
+
+    buffers[0].data = hdr;
+    buffers[0].len  = len;
+
+    if(data_len > 0)
+    {
+        buffers[count].data = data;
+        buffers[count].len  = data_len;
+        count++;
+    }
+
+    if(request->timing)
+    {
+        trailer.received      = htole64(request->received);
+        trailer.submitted     = htole64(request->submitted);
+        trailer.completed     = htole64(request->completed);
+        trailer.previous_sent = htole64(request->sent);
+
+        hdr->len            = htole32(le32toh(hdr->len) + sizeof(AaruResponseTiming));
+        buffers[count].data = &trailer;
+        buffers[count].len  = sizeof(AaruResponseTiming);
+        count++;
+    }
+
+    if(request->compress || request->zero_runs) sent = SendReduced(cli_ctx, request, buffers, count, le32toh(hdr->len));
+
+    if(sent == 0)
+    {
+        if(count == 1)
+            NetWrite(cli_ctx, hdr, (int32_t)len);
+        else
+            NetWriteV(cli_ctx, buffers, count);
+
+        sent = le32toh(hdr->len);
+    }
+
+    request->bytes_out += sent;
+    request->sent = GetMonotonicMicroseconds();
+}
+
+// Data for the source packets, random so nothing on the way can make it smaller than it is
+static void FillGenerated(char* buf, uint32_t len)
+{
+    uint64_t random = 0x2545F4914F6CDD1DULL;
+    uint32_t i;
+
+    for(i = 0; i < len; i += sizeof(uint64_t))
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        memcpy(buf + i, &random, len - i < sizeof(uint64_t) ? len - i : sizeof(uint64_t));
+    }
+}
+
 void* WorkingLoop(void* arguments)
 {
     AtaErrorRegistersChs            ata_chs_error_regs;
@@ -41,6 +422,7 @@ void* WorkingLoop(void* arguments)
     char*                           buffer;
     char*                           cdb_buf;
     char*                           cid;
+    char*                           data_buf;
     char*                           csd;
     char*                           in_buf;
     char*                           ocr;
@@ -70,25 +452,44 @@ void* WorkingLoop(void* arguments)
     AaruPacketResListDevs*          pkt_res_devinfo;
     AaruPacketResScsi*              pkt_res_scsi;
     AaruPacketResSdhci*             pkt_res_sdhci;
+    AaruPacketResStats*             pkt_res_stats;
     AaruPacketMultiResSdhci*        pkt_res_multi_sdhci;
     AaruPacketCmdOsRead*            pkt_cmd_osread;
     AaruPacketResOsRead*            pkt_res_osread;
+    AaruPacketCmdOsReadVector*      pkt_cmd_osread_vector;
+    AaruPacketResOsReadVector*      pkt_res_osread_vector;
+    AaruPacketCmdOsReadMap*         pkt_cmd_osread_map;
+    AaruPacketResOsReadMap*         pkt_res_osread_map;
+    AaruPacketResSink*              pkt_res_sink;
+    AaruPacketCmdSource*            pkt_cmd_source;
+    AaruPacketResSource*            pkt_res_source;
     int                             skip_next_hdr;
     int                             ret;
     socklen_t                       cli_len;
     ssize_t                         recv_size;
     struct DeviceInfoList*          device_info_list;
     struct sockaddr_in              cli_addr, serv_addr;
+    uint32_t                        buf_len;
+    uint32_t                        cdb_len;
     uint32_t                        duration;
+    uint32_t                        read_length;
     uint32_t                        sdhci_response[4];
     uint32_t                        sense;
     uint32_t                        sense_len;
     uint32_t                        n;
     void*                           device_ctx = NULL;
+    const DeviceBackend*            backend    = &platform_backend;
     void*                           net_ctx    = NULL;
     void*                           cli_ctx    = NULL;
     long                            off;
+    long                            data_off;
+    PoolStats                       pool_stats;
+    WorkerRequest                   request;
+    uint64_t                        extents_len;
+    uint64_t                        source_offset;
+    uint64_t                        source_length;
     MmcSingleCommand*               multi_sdhci_commands;
+    Arena*                          arena = NULL;
 
     if(!arguments)
     {
@@ -96,7 +497,8 @@ void* WorkingLoop(void* arguments)
         return NULL;
     }
 
-    pkt_server_hello = (AaruPacketHello*)arguments;
+    pkt_server_hello               = (AaruPacketHello*)arguments;
+    pkt_server_hello->capabilities = AARUREMOTE_CAPABILITIES;
 
     printf("Opening socket.\n");
     net_ctx = NetSocket(AF_INET, SOCK_STREAM, 0);
@@ -108,7 +510,7 @@ void* WorkingLoop(void* arguments)
 
     serv_addr.sin_family      = AF_INET;
     serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port        = htons(AARUREMOTE_PORT);
+    serv_addr.sin_port        = htons(server_options.port);
 
     if(NetBind(net_ctx, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0)
     {
@@ -161,6 +563,9 @@ void* WorkingLoop(void* arguments)
 
         printf("Client %s connected successfully.\n", PrintIpv4Address(cli_addr.sin_addr));
 
+        // Only the session is slowed down, metrics keep flowing as usual
+        NetImpair(cli_ctx);
+
         NetWrite(cli_ctx, pkt_server_hello, sizeof(AaruPacketHello));
 
         pkt_hdr = malloc(sizeof(AaruPacketHeader));
@@ -245,26 +650,51 @@ void* WorkingLoop(void* arguments)
                pkt_client_hello->machine);
         printf("Client maximum protocol: %d\n", pkt_client_hello->max_protocol);
 
+        // Only what both sides understand is used, older clients send zeroes here
+        memset(&request, 0, sizeof(WorkerRequest));
+
+        if(le32toh(pkt_hdr->len) >= sizeof(AaruPacketHello))
+        {
+            request.timing    = (pkt_client_hello->capabilities & AARUREMOTE_CAPABILITY_TIMING) != 0;
+            request.compress  = (pkt_client_hello->capabilities & AARUREMOTE_CAPABILITY_COMPRESSION) != 0;
+            request.zero_runs = (pkt_client_hello->capabilities & AARUREMOTE_CAPABILITY_ZERO_RUNS) != 0;
+        }
+
+        if(request.timing) printf("Client requested timing information.\n");
+
+        if(request.compress) printf("Client requested compressed responses.\n");
+
+        if(request.zero_runs) printf("Client requested zero runs left out of responses.\n");
+
+        request.trace = TraceEnabled();
+
         free(pkt_client_hello);
 
+        arena = ArenaNew(ARENA_INITIAL_SIZE);
+
+        if(!arena)
+        {
+            printf("Fatal error %d allocating memory for session, closing connection...\n", errno);
+            free(pkt_hdr);
+            NetClose(cli_ctx);
+            continue;
+        }
+
         skip_next_hdr = 0;
 
+        StatsSessionStarted();
+
         for(;;)
         {
-            if(skip_next_hdr)
-            {
-                in_buf = malloc(le32toh(pkt_hdr->len));
+            // Every case leaves through a continue, so the previous packet is accounted here
+            RecordRequest(&request);
 
-                if(!in_buf)
-                {
-                    printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                    free(pkt_hdr);
-                    NetClose(cli_ctx);
-                    continue;
-                }
+            // Everything from the previous packet is gone by now
+            ArenaReset(arena);
 
-                NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                free(in_buf);
+            if(skip_next_hdr)
+            {
+                DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
                 skip_next_hdr = 0;
             }
 
@@ -295,6 +725,15 @@ void* WorkingLoop(void* arguments)
                 break;
             }
 
+            // Cannot be skipped, whatever follows would be read from the middle of the packet
+            if(le32toh(pkt_hdr->len) < sizeof(AaruPacketHeader))
+            {
+                printf("Received packet shorter than its header, closing connection...\n");
+                NetClose(cli_ctx);
+                free(pkt_hdr);
+                break;
+            }
+
             if(pkt_hdr->version != AARUREMOTE_PACKET_VERSION)
             {
                 printf("Unrecognized packet version, skipping...\n");
@@ -302,13 +741,29 @@ void* WorkingLoop(void* arguments)
                 continue;
             }
 
+            request.pending     = 1;
+            request.packet_type = pkt_hdr->packet_type;
+            request.error       = 0;
+            request.opcode      = AARUREMOTE_STATS_NO_OPCODE;
+            request.bytes_in    = le32toh(pkt_hdr->len);
+            request.bytes_out   = 0;
+            request.started     = GetMonotonicMicroseconds();
+            request.received    = 0;
+            request.submitted   = 0;
+            request.completed   = 0;
+            request.error_no    = 0;
+            request.data        = NULL;
+            request.data_len    = 0;
+            request.command_len = 0;
+            request.sense_len   = 0;
+
             switch(pkt_hdr->packet_type)
             {
                 case AARUREMOTE_PACKET_TYPE_HELLO:
                     pkt_nop->reason_code = AARUREMOTE_PACKET_NOP_REASON_OOO;
                     memset(&pkt_nop->reason, 0, 256);
                     strncpy(pkt_nop->reason, "Received hello packet out of order, skipping...", 256);
-                    NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                    SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
                     printf("%s...\n", pkt_nop->reason);
                     skip_next_hdr = 1;
                     continue;
@@ -316,37 +771,25 @@ void* WorkingLoop(void* arguments)
                     device_info_list = ListDevices();
 
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
-
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
                     if(!device_info_list)
                     {
                         pkt_nop->reason_code = AARUREMOTE_PACKET_NOP_REASON_ERROR_LIST_DEVICES;
                         memset(&pkt_nop->reason, 0, 256);
                         strncpy(pkt_nop->reason, "Could not get device list, continuing...", 256);
-                        NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                        SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
                         printf("%s...\n", pkt_nop->reason);
                         continue;
                     }
 
-                    pkt_res_devinfo          = malloc(sizeof(AaruPacketResListDevs));
+                    pkt_res_devinfo          = ArenaAlloc(arena, sizeof(AaruPacketResListDevs));
                     pkt_res_devinfo->devices = htole16(DeviceInfoListCount(device_info_list));
 
                     n      = sizeof(AaruPacketResListDevs) + le16toh(pkt_res_devinfo->devices) * sizeof(DeviceInfo);
-                    in_buf = malloc(n);
+                    in_buf = ArenaAlloc(arena, n);
                     ((AaruPacketResListDevs*)in_buf)->hdr.len = htole32(n);
                     ((AaruPacketResListDevs*)in_buf)->devices = pkt_res_devinfo->devices;
-                    free(pkt_res_devinfo);
                     pkt_res_devinfo = (AaruPacketResListDevs*)in_buf;
 
                     pkt_res_devinfo->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
@@ -368,8 +811,7 @@ void* WorkingLoop(void* arguments)
                     device_info_list = (struct DeviceInfoList*)in_buf;
                     FreeDeviceInfoList(device_info_list);
 
-                    NetWrite(cli_ctx, pkt_res_devinfo, le32toh(pkt_res_devinfo->hdr.len));
-                    free(pkt_res_devinfo);
+                    SendPacket(cli_ctx, &request, pkt_res_devinfo, le32toh(pkt_res_devinfo->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_RESPONSE_GET_SDHCI_REGISTERS:
                 case AARUREMOTE_PACKET_TYPE_RESPONSE_LIST_DEVICES:
@@ -385,56 +827,47 @@ void* WorkingLoop(void* arguments)
                     pkt_nop->reason_code = AARUREMOTE_PACKET_NOP_REASON_OOO;
                     memset(&pkt_nop->reason, 0, 256);
                     strncpy(pkt_nop->reason, "Received response packet?! You should certainly not do that...", 256);
-                    NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                    SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
                     printf("%s...\n", pkt_nop->reason);
                     skip_next_hdr = 1;
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_OPEN_DEVICE:
-                    pkt_dev_open = malloc(le32toh(pkt_hdr->len));
+                    pkt_dev_open = ArenaAlloc(arena, le32toh(pkt_hdr->len));
 
                     if(!pkt_dev_open)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     NetRecv(cli_ctx, pkt_dev_open, le32toh(pkt_hdr->len), 0);
 
-                    device_ctx = DeviceOpen(pkt_dev_open->device_path);
+                    backend    = GetDeviceBackend(pkt_dev_open->device_path);
+                    device_ctx = backend->open(pkt_dev_open->device_path);
+                    StatsSetDevice(device_ctx ? pkt_dev_open->device_path : NULL);
+                    request.error = device_ctx == NULL;
 
                     pkt_nop->reason_code = device_ctx == NULL ? AARUREMOTE_PACKET_NOP_REASON_OPEN_ERROR
                                                               : AARUREMOTE_PACKET_NOP_REASON_OPEN_OK;
                     pkt_nop->error_no    = errno;
                     memset(&pkt_nop->reason, 0, 256);
-                    NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                    SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
 
-                    free(pkt_dev_open);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_GET_DEVTYPE:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
-
-                    pkt_dev_type = malloc(sizeof(AaruPacketResGetDeviceType));
+                    pkt_dev_type = ArenaAlloc(arena, sizeof(AaruPacketResGetDeviceType));
 
                     if(!pkt_dev_type)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_dev_type, 0, sizeof(AaruPacketResGetDeviceType));
@@ -444,123 +877,114 @@ void* WorkingLoop(void* arguments)
                     pkt_dev_type->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_dev_type->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
                     pkt_dev_type->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
-                    pkt_dev_type->device_type     = htole32(GetDeviceType(device_ctx));
+                    pkt_dev_type->device_type     = htole32(backend->get_device_type(device_ctx));
 
-                    NetWrite(cli_ctx, pkt_dev_type, sizeof(AaruPacketResGetDeviceType));
-                    free(pkt_dev_type);
+                    SendPacket(cli_ctx, &request, pkt_dev_type, sizeof(AaruPacketResGetDeviceType));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_SCSI:
                     // Packet contains data after
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = RecvPacket(cli_ctx, arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-
-                    pkt_cmd_scsi = (AaruPacketCmdScsi*)in_buf;
+                    request.received = GetMonotonicMicroseconds();
+                    pkt_cmd_scsi     = (AaruPacketCmdScsi*)in_buf;
+                    cdb_len          = le32toh(pkt_cmd_scsi->cdb_len);
+                    buf_len          = le32toh(pkt_cmd_scsi->buf_len);
 
-                    // TODO: Check size of buffers + size of packet is not bigger than size in header
-
-                    if(le32toh(pkt_cmd_scsi->cdb_len) > 0)
+                    if((uint64_t)sizeof(AaruPacketCmdScsi) + cdb_len + buf_len > le32toh(pkt_hdr->len))
                     {
-                        cdb_buf = malloc(le32toh(pkt_cmd_scsi->cdb_len));
-                        memcpy(cdb_buf, in_buf + sizeof(AaruPacketCmdScsi), le32toh(pkt_cmd_scsi->cdb_len));
-                    }
-                    else
-                        cdb_buf = NULL;
-
-                    if(le32toh(pkt_cmd_scsi->buf_len) > 0)
-                    {
-                        buffer = malloc(le32toh(pkt_cmd_scsi->buf_len));
-                        memcpy(buffer,
-                               in_buf + le32toh(pkt_cmd_scsi->cdb_len) + sizeof(AaruPacketCmdScsi),
-                               le32toh(pkt_cmd_scsi->buf_len));
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "SCSI packet is shorter than its buffers, skipping...");
+                        continue;
                     }
-                    else
-                        buffer = NULL;
-
-                    // Swap buf_len
-                    pkt_cmd_scsi->buf_len = le32toh(pkt_cmd_scsi->buf_len);
 
-                    ret = SendScsiCommand(device_ctx,
-                                          cdb_buf,
-                                          buffer,
-                                          &sense_buf,
-                                          le32toh(pkt_cmd_scsi->timeout),
-                                          le32toh(pkt_cmd_scsi->direction),
-                                          &duration,
-                                          &sense,
-                                          le32toh(pkt_cmd_scsi->cdb_len),
-                                          &pkt_cmd_scsi->buf_len,
-                                          &sense_len);
+                    // CDB and data are used straight from the received packet, data-in lands in the same place
+                    cdb_buf  = cdb_len > 0 ? in_buf + sizeof(AaruPacketCmdScsi) : NULL;
+                    buffer   = in_buf + sizeof(AaruPacketCmdScsi) + cdb_len;
+                    data_buf = buf_len > 0 ? buffer : NULL;
 
-                    // Swap buf_len back
-                    pkt_cmd_scsi->buf_len = htole32(pkt_cmd_scsi->buf_len);
+                    if(cdb_buf) request.opcode = (uint8_t)cdb_buf[0];
 
-                    out_buf = malloc(sizeof(AaruPacketResScsi) + sense_len + le32toh(pkt_cmd_scsi->buf_len));
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdScsi) - sizeof(AaruPacketHeader) + cdb_len);
 
-                    if(!out_buf)
+                    // Backend may have memory the device reads into directly, data is then sent from there
+                    if(buf_len > 0 && le32toh(pkt_cmd_scsi->direction) == AARUREMOTE_SCSI_DIRECTION_IN)
                     {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
-                        continue;
+                        data_buf = backend->get_scsi_data_in_buffer(device_ctx, buf_len);
+
+                        if(!data_buf) data_buf = buffer;
                     }
 
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_scsi_command(device_ctx,
+                                                                   cdb_buf,
+                                                                   data_buf,
+                                                                   &sense_buf,
+                                                                   le32toh(pkt_cmd_scsi->timeout),
+                                                                   le32toh(pkt_cmd_scsi->direction),
+                                                                   &duration,
+                                                                   &sense,
+                                                                   cdb_len,
+                                                                   &buf_len,
+                                                                   &sense_len);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    if(!sense_buf) sense_len = 0;
+
+                    if(sense_len > WORKER_MAX_SENSE) sense_len = WORKER_MAX_SENSE;
+
+                    SetTraceResult(&request, ret, sense_buf, sense_len, data_buf, buf_len);
+
+                    // Response header and sense go right before the data, over the command that is not needed anymore
+                    out_buf      = buffer - sense_len - sizeof(AaruPacketResScsi);
                     pkt_res_scsi = (AaruPacketResScsi*)out_buf;
                     if(sense_buf) memcpy(out_buf + sizeof(AaruPacketResScsi), sense_buf, sense_len);
-                    if(buffer)
-                        memcpy(out_buf + sizeof(AaruPacketResScsi) + sense_len, buffer, le32toh(pkt_cmd_scsi->buf_len));
 
-                    pkt_res_scsi->hdr.len =
-                        htole32(sizeof(AaruPacketResScsi) + sense_len + le32toh(pkt_cmd_scsi->buf_len));
+                    pkt_res_scsi->hdr.len         = htole32(sizeof(AaruPacketResScsi) + sense_len + buf_len);
                     pkt_res_scsi->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_SCSI;
                     pkt_res_scsi->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_scsi->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
                     pkt_res_scsi->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
 
                     pkt_res_scsi->sense_len = htole32(sense_len);
-                    pkt_res_scsi->buf_len   = pkt_cmd_scsi->buf_len;
+                    pkt_res_scsi->buf_len   = htole32(buf_len);
                     pkt_res_scsi->duration  = htole32(duration);
                     pkt_res_scsi->sense     = htole32(sense);
                     pkt_res_scsi->error_no  = htole32(ret);
 
-                    NetWrite(cli_ctx, pkt_res_scsi, le32toh(pkt_res_scsi->hdr.len));
-                    free(pkt_cmd_scsi);
-                    free(pkt_res_scsi);
-                    if(cdb_buf) free(cdb_buf);
-                    if(buffer) free(buffer);
+                    if(data_buf && data_buf != buffer)
+                        SendResponse(cli_ctx,
+                                     &request,
+                                     &pkt_res_scsi->hdr,
+                                     sizeof(AaruPacketResScsi) + sense_len,
+                                     data_buf,
+                                     buf_len);
+                    else
+                        SendResponse(cli_ctx, &request, &pkt_res_scsi->hdr, le32toh(pkt_res_scsi->hdr.len), NULL, 0);
+
                     if(sense_buf) free(sense_buf);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_GET_SDHCI_REGISTERS:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
-
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    pkt_res_sdhci_registers = malloc(sizeof(AaruPacketResGetSdhciRegisters));
+                    pkt_res_sdhci_registers = ArenaAlloc(arena, sizeof(AaruPacketResGetSdhciRegisters));
                     if(!pkt_res_sdhci_registers)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_res_sdhci_registers, 0, sizeof(AaruPacketResGetSdhciRegisters));
@@ -569,15 +993,16 @@ void* WorkingLoop(void* arguments)
                     pkt_res_sdhci_registers->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_sdhci_registers->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_GET_SDHCI_REGISTERS;
                     pkt_res_sdhci_registers->hdr.len         = htole32(sizeof(AaruPacketResGetSdhciRegisters));
-                    pkt_res_sdhci_registers->is_sdhci        = GetSdhciRegisters(device_ctx,
-                                                                                 &csd,
-                                                                                 &cid,
-                                                                                 &ocr,
-                                                                                 &scr,
-                                                                                 &pkt_res_sdhci_registers->csd_len,
-                                                                                 &pkt_res_sdhci_registers->cid_len,
-                                                                                 &pkt_res_sdhci_registers->ocr_len,
-                                                                                 &pkt_res_sdhci_registers->scr_len);
+                    pkt_res_sdhci_registers->is_sdhci =
+                        backend->get_sdhci_registers(device_ctx,
+                                                     &csd,
+                                                     &cid,
+                                                     &ocr,
+                                                     &scr,
+                                                     &pkt_res_sdhci_registers->csd_len,
+                                                     &pkt_res_sdhci_registers->cid_len,
+                                                     &pkt_res_sdhci_registers->ocr_len,
+                                                     &pkt_res_sdhci_registers->scr_len);
 
                     if(pkt_res_sdhci_registers->csd_len > 0 && csd != NULL)
                     {
@@ -615,31 +1040,19 @@ void* WorkingLoop(void* arguments)
                     free(scr);
                     free(ocr);
 
-                    NetWrite(cli_ctx, pkt_res_sdhci_registers, le32toh(pkt_res_sdhci_registers->hdr.len));
-                    free(pkt_res_sdhci_registers);
+                    SendPacket(cli_ctx, &request, pkt_res_sdhci_registers, le32toh(pkt_res_sdhci_registers->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_GET_USB_DATA:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
-
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    pkt_res_usb = malloc(sizeof(AaruPacketResGetUsbData));
+                    pkt_res_usb = ArenaAlloc(arena, sizeof(AaruPacketResGetUsbData));
                     if(!pkt_res_usb)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_res_usb, 0, sizeof(AaruPacketResGetUsbData));
@@ -648,44 +1061,32 @@ void* WorkingLoop(void* arguments)
                     pkt_res_usb->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_usb->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_GET_USB_DATA;
                     pkt_res_usb->hdr.len         = htole32(sizeof(AaruPacketResGetUsbData));
-                    pkt_res_usb->is_usb          = GetUsbData(device_ctx,
-                                                              &pkt_res_usb->desc_len,
-                                                              pkt_res_usb->descriptors,
-                                                              &pkt_res_usb->id_vendor,
-                                                              &pkt_res_usb->id_product,
-                                                              pkt_res_usb->manufacturer,
-                                                              pkt_res_usb->product,
-                                                              pkt_res_usb->serial);
+                    pkt_res_usb->is_usb          = backend->get_usb_data(device_ctx,
+                                                                         &pkt_res_usb->desc_len,
+                                                                         pkt_res_usb->descriptors,
+                                                                         &pkt_res_usb->id_vendor,
+                                                                         &pkt_res_usb->id_product,
+                                                                         pkt_res_usb->manufacturer,
+                                                                         pkt_res_usb->product,
+                                                                         pkt_res_usb->serial);
 
                     // Swap parameters
                     pkt_res_usb->desc_len = htole32(pkt_res_usb->desc_len);
                     // TODO: Need to swap vendor, product?
 
-                    NetWrite(cli_ctx, pkt_res_usb, le32toh(pkt_res_usb->hdr.len));
-                    free(pkt_res_usb);
+                    SendPacket(cli_ctx, &request, pkt_res_usb, le32toh(pkt_res_usb->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_GET_FIREWIRE_DATA:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
-
-                    pkt_res_firewire = malloc(sizeof(AaruPacketResGetFireWireData));
+                    pkt_res_firewire = ArenaAlloc(arena, sizeof(AaruPacketResGetFireWireData));
                     if(!pkt_res_firewire)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_res_firewire, 0, sizeof(AaruPacketResGetFireWireData));
@@ -694,40 +1095,28 @@ void* WorkingLoop(void* arguments)
                     pkt_res_firewire->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_firewire->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_GET_FIREWIRE_DATA;
                     pkt_res_firewire->hdr.len         = htole32(sizeof(AaruPacketResGetFireWireData));
-                    pkt_res_firewire->is_firewire     = GetFireWireData(device_ctx,
-                                                                        &pkt_res_firewire->id_model,
-                                                                        &pkt_res_firewire->id_vendor,
-                                                                        &pkt_res_firewire->guid,
-                                                                        pkt_res_firewire->vendor,
-                                                                        pkt_res_firewire->model);
+                    pkt_res_firewire->is_firewire     = backend->get_firewire_data(device_ctx,
+                                                                                   &pkt_res_firewire->id_model,
+                                                                                   &pkt_res_firewire->id_vendor,
+                                                                                   &pkt_res_firewire->guid,
+                                                                                   pkt_res_firewire->vendor,
+                                                                                   pkt_res_firewire->model);
 
                     // TODO: Need to swap IDs?
 
-                    NetWrite(cli_ctx, pkt_res_firewire, le32toh(pkt_res_firewire->hdr.len));
-                    free(pkt_res_firewire);
+                    SendPacket(cli_ctx, &request, pkt_res_firewire, le32toh(pkt_res_firewire->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_GET_PCMCIA_DATA:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
-
-                    pkt_res_pcmcia = malloc(sizeof(AaruPacketResGetPcmciaData));
+                    pkt_res_pcmcia = ArenaAlloc(arena, sizeof(AaruPacketResGetPcmciaData));
                     if(!pkt_res_pcmcia)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_res_pcmcia, 0, sizeof(AaruPacketResGetPcmciaData));
@@ -737,218 +1126,214 @@ void* WorkingLoop(void* arguments)
                     pkt_res_pcmcia->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_GET_PCMCIA_DATA;
                     pkt_res_pcmcia->hdr.len         = htole32(sizeof(AaruPacketResGetPcmciaData));
                     pkt_res_pcmcia->is_pcmcia =
-                        GetPcmciaData(device_ctx, &pkt_res_pcmcia->cis_len, pkt_res_pcmcia->cis);
+                        backend->get_pcmcia_data(device_ctx, &pkt_res_pcmcia->cis_len, pkt_res_pcmcia->cis);
 
                     pkt_res_pcmcia->cis_len = htole32(pkt_res_pcmcia->cis_len);
 
-                    NetWrite(cli_ctx, pkt_res_pcmcia, le32toh(pkt_res_pcmcia->hdr.len));
-                    free(pkt_res_pcmcia);
+                    SendPacket(cli_ctx, &request, pkt_res_pcmcia, le32toh(pkt_res_pcmcia->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_CHS:
                     // Packet contains data after
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = RecvPacket(cli_ctx, arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+                    request.received = GetMonotonicMicroseconds();
+                    pkt_cmd_ata_chs  = (AaruPacketCmdAtaChs*)in_buf;
+                    buf_len          = le32toh(pkt_cmd_ata_chs->buf_len);
 
-                    pkt_cmd_ata_chs = (AaruPacketCmdAtaChs*)in_buf;
+                    if((uint64_t)sizeof(AaruPacketCmdAtaChs) + buf_len > le32toh(pkt_hdr->len))
+                    {
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "ATA CHS packet is shorter than its buffer, skipping...");
+                        continue;
+                    }
 
-                    // TODO: Check size of buffers + size of packet is not bigger than size in header
+                    // Data is used straight from the received packet, data-in lands in the same place
+                    buffer = in_buf + sizeof(AaruPacketCmdAtaChs);
 
-                    if(le32toh(pkt_cmd_ata_chs->buf_len) > 0) buffer = in_buf + sizeof(AaruPacketCmdAtaChs);
-                    else
-                        buffer = NULL;
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdAtaChs) - sizeof(AaruPacketHeader));
 
                     memset(&ata_chs_error_regs, 0, sizeof(AtaErrorRegistersChs));
 
-                    pkt_cmd_ata_chs->buf_len = le32toh(pkt_cmd_ata_chs->buf_len);
-
-                    duration = 0;
-                    sense    = 1;
-                    ret      = SendAtaChsCommand(device_ctx,
-                                                 pkt_cmd_ata_chs->registers,
-                                                 &ata_chs_error_regs,
-                                                 pkt_cmd_ata_chs->protocol,
-                                                 pkt_cmd_ata_chs->transfer_register,
-                                                 buffer,
-                                                 le32toh(pkt_cmd_ata_chs->timeout),
-                                                 pkt_cmd_ata_chs->transfer_blocks,
-                                                 &duration,
-                                                 &sense,
-                                                 &pkt_cmd_ata_chs->buf_len);
-
-                    out_buf = malloc(sizeof(AaruPacketResAtaChs) + pkt_cmd_ata_chs->buf_len);
-
-                    pkt_cmd_ata_chs->buf_len = htole32(pkt_cmd_ata_chs->buf_len);
-
-                    if(!out_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
+                    duration          = 0;
+                    sense             = 1;
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_ata_chs_command(device_ctx,
+                                                                      pkt_cmd_ata_chs->registers,
+                                                                      &ata_chs_error_regs,
+                                                                      pkt_cmd_ata_chs->protocol,
+                                                                      pkt_cmd_ata_chs->transfer_register,
+                                                                      buf_len > 0 ? buffer : NULL,
+                                                                      le32toh(pkt_cmd_ata_chs->timeout),
+                                                                      pkt_cmd_ata_chs->transfer_blocks,
+                                                                      &duration,
+                                                                      &sense,
+                                                                      &buf_len);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    SetTraceResult(&request, ret, &ata_chs_error_regs, sizeof(ata_chs_error_regs), buffer, buf_len);
+
+                    // Response header goes right before the data, over the command that is not needed anymore
+                    out_buf         = buffer - sizeof(AaruPacketResAtaChs);
                     pkt_res_ata_chs = (AaruPacketResAtaChs*)out_buf;
-                    if(buffer) memcpy(out_buf + sizeof(AaruPacketResAtaChs), buffer, htole32(pkt_cmd_ata_chs->buf_len));
 
-                    pkt_res_ata_chs->hdr.len = htole32(sizeof(AaruPacketResAtaChs) + htole32(pkt_cmd_ata_chs->buf_len));
+                    pkt_res_ata_chs->hdr.len         = htole32(sizeof(AaruPacketResAtaChs) + buf_len);
                     pkt_res_ata_chs->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_CHS;
                     pkt_res_ata_chs->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_ata_chs->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
                     pkt_res_ata_chs->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
 
                     pkt_res_ata_chs->registers = ata_chs_error_regs;
-                    pkt_res_ata_chs->buf_len   = pkt_cmd_ata_chs->buf_len;
+                    pkt_res_ata_chs->buf_len   = htole32(buf_len);
                     pkt_res_ata_chs->duration  = htole32(duration);
                     pkt_res_ata_chs->sense     = htole32(sense);
                     pkt_res_ata_chs->error_no  = htole32(ret);
 
-                    NetWrite(cli_ctx, pkt_res_ata_chs, le32toh(pkt_res_ata_chs->hdr.len));
-                    free(pkt_cmd_ata_chs);
-                    free(pkt_res_ata_chs);
+                    SendResponse(cli_ctx, &request, &pkt_res_ata_chs->hdr, le32toh(pkt_res_ata_chs->hdr.len), NULL, 0);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_28:
                     // Packet contains data after
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = RecvPacket(cli_ctx, arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-
+                    request.received  = GetMonotonicMicroseconds();
                     pkt_cmd_ata_lba28 = (AaruPacketCmdAtaLba28*)in_buf;
+                    buf_len           = le32toh(pkt_cmd_ata_lba28->buf_len);
 
-                    // TODO: Check size of buffers + size of packet is not bigger than size in header
-
-                    if(le32toh(pkt_cmd_ata_lba28->buf_len) > 0) buffer = in_buf + sizeof(AaruPacketCmdAtaLba28);
-                    else
-                        buffer = NULL;
-
-                    memset(&ata_lba28_error_regs, 0, sizeof(AtaErrorRegistersLba28));
-
-                    pkt_cmd_ata_lba28->buf_len = le32toh(pkt_cmd_ata_lba28->buf_len);
-
-                    duration = 0;
-                    sense    = 1;
-                    ret      = SendAtaLba28Command(device_ctx,
-                                                   pkt_cmd_ata_lba28->registers,
-                                                   &ata_lba28_error_regs,
-                                                   pkt_cmd_ata_lba28->protocol,
-                                                   pkt_cmd_ata_lba28->transfer_register,
-                                                   buffer,
-                                                   le32toh(pkt_cmd_ata_lba28->timeout),
-                                                   pkt_cmd_ata_lba28->transfer_blocks,
-                                                   &duration,
-                                                   &sense,
-                                                   &pkt_cmd_ata_lba28->buf_len);
-
-                    out_buf                    = malloc(sizeof(AaruPacketResAtaLba28) + pkt_cmd_ata_lba28->buf_len);
-                    pkt_cmd_ata_lba28->buf_len = htole32(pkt_cmd_ata_lba28->buf_len);
-
-                    if(!out_buf)
+                    if((uint64_t)sizeof(AaruPacketCmdAtaLba28) + buf_len > le32toh(pkt_hdr->len))
                     {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "ATA LBA28 packet is shorter than its buffer, skipping...");
                         continue;
                     }
 
+                    // Data is used straight from the received packet, data-in lands in the same place
+                    buffer = in_buf + sizeof(AaruPacketCmdAtaLba28);
+
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdAtaLba28) - sizeof(AaruPacketHeader));
+
+                    memset(&ata_lba28_error_regs, 0, sizeof(AtaErrorRegistersLba28));
+
+                    duration          = 0;
+                    sense             = 1;
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_ata_lba28_command(device_ctx,
+                                                                        pkt_cmd_ata_lba28->registers,
+                                                                        &ata_lba28_error_regs,
+                                                                        pkt_cmd_ata_lba28->protocol,
+                                                                        pkt_cmd_ata_lba28->transfer_register,
+                                                                        buf_len > 0 ? buffer : NULL,
+                                                                        le32toh(pkt_cmd_ata_lba28->timeout),
+                                                                        pkt_cmd_ata_lba28->transfer_blocks,
+                                                                        &duration,
+                                                                        &sense,
+                                                                        &buf_len);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    SetTraceResult(&request, ret, &ata_lba28_error_regs, sizeof(ata_lba28_error_regs), buffer, buf_len);
+
+                    // Response header goes right before the data, over the command that is not needed anymore
+                    out_buf           = buffer - sizeof(AaruPacketResAtaLba28);
                     pkt_res_ata_lba28 = (AaruPacketResAtaLba28*)out_buf;
-                    if(buffer)
-                        memcpy(out_buf + sizeof(AaruPacketResAtaLba28), buffer, le32toh(pkt_cmd_ata_lba28->buf_len));
 
-                    pkt_res_ata_lba28->hdr.len =
-                        htole32(sizeof(AaruPacketResAtaLba28) + le32toh(pkt_cmd_ata_lba28->buf_len));
+                    pkt_res_ata_lba28->hdr.len         = htole32(sizeof(AaruPacketResAtaLba28) + buf_len);
                     pkt_res_ata_lba28->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_LBA_28;
                     pkt_res_ata_lba28->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_ata_lba28->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
                     pkt_res_ata_lba28->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
 
                     pkt_res_ata_lba28->registers = ata_lba28_error_regs;
-                    pkt_res_ata_lba28->buf_len   = pkt_cmd_ata_lba28->buf_len;
-                    pkt_res_ata_lba28->duration  = le32toh(duration);
-                    pkt_res_ata_lba28->sense     = le32toh(sense);
-                    pkt_res_ata_lba28->error_no  = le32toh(ret);
-
-                    NetWrite(cli_ctx, pkt_res_ata_lba28, le32toh(pkt_res_ata_lba28->hdr.len));
-                    free(pkt_cmd_ata_lba28);
-                    free(pkt_res_ata_lba28);
+                    pkt_res_ata_lba28->buf_len   = htole32(buf_len);
+                    pkt_res_ata_lba28->duration  = htole32(duration);
+                    pkt_res_ata_lba28->sense     = htole32(sense);
+                    pkt_res_ata_lba28->error_no  = htole32(ret);
+
+                    SendResponse(cli_ctx,
+                                 &request,
+                                 &pkt_res_ata_lba28->hdr,
+                                 le32toh(pkt_res_ata_lba28->hdr.len),
+                                 NULL,
+                                 0);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_ATA_LBA_48:
                     // Packet contains data after
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = RecvPacket(cli_ctx, arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-
+                    request.received  = GetMonotonicMicroseconds();
                     pkt_cmd_ata_lba48 = (AaruPacketCmdAtaLba48*)in_buf;
+                    buf_len           = le32toh(pkt_cmd_ata_lba48->buf_len);
 
-                    // TODO: Check size of buffers + size of packet is not bigger than size in header
+                    if((uint64_t)sizeof(AaruPacketCmdAtaLba48) + buf_len > le32toh(pkt_hdr->len))
+                    {
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "ATA LBA48 packet is shorter than its buffer, skipping...");
+                        continue;
+                    }
 
-                    if(le32toh(pkt_cmd_ata_lba48->buf_len) > 0) buffer = in_buf + sizeof(AaruPacketCmdAtaLba48);
-                    else
-                        buffer = NULL;
+                    // Data is used straight from the received packet, data-in lands in the same place
+                    buffer = in_buf + sizeof(AaruPacketCmdAtaLba48);
+
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdAtaLba48) - sizeof(AaruPacketHeader));
 
                     memset(&ata_lba48_error_regs, 0, sizeof(AtaErrorRegistersLba48));
-                    pkt_cmd_ata_lba48->buf_len = le32toh(pkt_cmd_ata_lba48->buf_len);
 
                     // Swapping
                     pkt_cmd_ata_lba48->registers.sector_count = le16toh(pkt_cmd_ata_lba48->registers.sector_count);
 
-                    duration = 0;
-                    sense    = 1;
-                    ret      = SendAtaLba48Command(device_ctx,
-                                                   pkt_cmd_ata_lba48->registers,
-                                                   &ata_lba48_error_regs,
-                                                   pkt_cmd_ata_lba48->protocol,
-                                                   pkt_cmd_ata_lba48->transfer_register,
-                                                   buffer,
-                                                   le32toh(pkt_cmd_ata_lba48->timeout),
-                                                   pkt_cmd_ata_lba48->transfer_blocks,
-                                                   &duration,
-                                                   &sense,
-                                                   &pkt_cmd_ata_lba48->buf_len);
-
-                    out_buf                    = malloc(sizeof(AaruPacketResAtaLba48) + pkt_cmd_ata_lba48->buf_len);
-                    pkt_cmd_ata_lba48->buf_len = htole32(pkt_cmd_ata_lba48->buf_len);
-
-                    if(!out_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
+                    duration          = 0;
+                    sense             = 1;
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_ata_lba48_command(device_ctx,
+                                                                        pkt_cmd_ata_lba48->registers,
+                                                                        &ata_lba48_error_regs,
+                                                                        pkt_cmd_ata_lba48->protocol,
+                                                                        pkt_cmd_ata_lba48->transfer_register,
+                                                                        buf_len > 0 ? buffer : NULL,
+                                                                        le32toh(pkt_cmd_ata_lba48->timeout),
+                                                                        pkt_cmd_ata_lba48->transfer_blocks,
+                                                                        &duration,
+                                                                        &sense,
+                                                                        &buf_len);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    SetTraceResult(&request, ret, &ata_lba48_error_regs, sizeof(ata_lba48_error_regs), buffer, buf_len);
+
+                    // Response header goes right before the data, over the command that is not needed anymore
+                    out_buf           = buffer - sizeof(AaruPacketResAtaLba48);
                     pkt_res_ata_lba48 = (AaruPacketResAtaLba48*)out_buf;
-                    if(buffer)
-                        memcpy(out_buf + sizeof(AaruPacketResAtaLba48), buffer, le32toh(pkt_cmd_ata_lba48->buf_len));
 
-                    pkt_res_ata_lba48->hdr.len =
-                        htole32(sizeof(AaruPacketResAtaLba48) + le32toh(pkt_cmd_ata_lba48->buf_len));
+                    pkt_res_ata_lba48->hdr.len         = htole32(sizeof(AaruPacketResAtaLba48) + buf_len);
                     pkt_res_ata_lba48->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_ATA_LBA_48;
                     pkt_res_ata_lba48->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_ata_lba48->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
@@ -958,73 +1343,73 @@ void* WorkingLoop(void* arguments)
                     ata_lba48_error_regs.sector_count = htole16(ata_lba48_error_regs.sector_count);
 
                     pkt_res_ata_lba48->registers = ata_lba48_error_regs;
-                    pkt_res_ata_lba48->buf_len   = pkt_cmd_ata_lba48->buf_len;
-                    pkt_res_ata_lba48->duration  = le32toh(duration);
-                    pkt_res_ata_lba48->sense     = le32toh(sense);
-                    pkt_res_ata_lba48->error_no  = le32toh(ret);
-
-                    NetWrite(cli_ctx, pkt_res_ata_lba48, le32toh(pkt_res_ata_lba48->hdr.len));
-                    free(pkt_cmd_ata_lba48);
-                    free(pkt_res_ata_lba48);
+                    pkt_res_ata_lba48->buf_len   = htole32(buf_len);
+                    pkt_res_ata_lba48->duration  = htole32(duration);
+                    pkt_res_ata_lba48->sense     = htole32(sense);
+                    pkt_res_ata_lba48->error_no  = htole32(ret);
+
+                    SendResponse(cli_ctx,
+                                 &request,
+                                 &pkt_res_ata_lba48->hdr,
+                                 le32toh(pkt_res_ata_lba48->hdr.len),
+                                 NULL,
+                                 0);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_SDHCI:
                     // Packet contains data after
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = RecvPacket(cli_ctx, arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+                    request.received = GetMonotonicMicroseconds();
+                    pkt_cmd_sdhci    = (AaruPacketCmdSdhci*)in_buf;
+                    buf_len          = le32toh(pkt_cmd_sdhci->command.buf_len);
 
-                    pkt_cmd_sdhci = (AaruPacketCmdSdhci*)in_buf;
+                    if((uint64_t)sizeof(AaruPacketCmdSdhci) + buf_len > le32toh(pkt_hdr->len))
+                    {
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "SDHCI packet is shorter than its buffer, skipping...");
+                        continue;
+                    }
 
-                    // TODO: Check size of buffers + size of packet is not bigger than size in header
+                    // Data is used straight from the received packet, data-in lands in the same place
+                    buffer = in_buf + sizeof(AaruPacketCmdSdhci);
 
-                    if(le32toh(pkt_cmd_sdhci->command.buf_len) > 0) buffer = in_buf + sizeof(AaruPacketCmdSdhci);
-                    else
-                        buffer = NULL;
+                    SetTraceCommand(&request, &pkt_cmd_sdhci->command, sizeof(AaruCmdSdhci));
 
                     memset((char*)&sdhci_response, 0, sizeof(uint32_t) * 4);
 
-                    duration = 0;
-                    sense    = 1;
-                    ret      = SendSdhciCommand(device_ctx,
-                                                pkt_cmd_sdhci->command.command,
-                                                pkt_cmd_sdhci->command.write,
-                                                pkt_cmd_sdhci->command.application,
-                                                le32toh(pkt_cmd_sdhci->command.flags),
-                                                le32toh(pkt_cmd_sdhci->command.argument),
-                                                le32toh(pkt_cmd_sdhci->command.block_size),
-                                                le32toh(pkt_cmd_sdhci->command.blocks),
-                                                buffer,
-                                                le32toh(pkt_cmd_sdhci->command.buf_len),
-                                                le32toh(pkt_cmd_sdhci->command.timeout),
-                                                (uint32_t*)&sdhci_response,
-                                                &duration,
-                                                &sense);
-
-                    out_buf = malloc(sizeof(AaruPacketResSdhci) + le32toh(pkt_cmd_sdhci->command.buf_len));
-
-                    if(!out_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
+                    duration          = 0;
+                    sense             = 1;
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_sdhci_command(device_ctx,
+                                                                    pkt_cmd_sdhci->command.command,
+                                                                    pkt_cmd_sdhci->command.write,
+                                                                    pkt_cmd_sdhci->command.application,
+                                                                    le32toh(pkt_cmd_sdhci->command.flags),
+                                                                    le32toh(pkt_cmd_sdhci->command.argument),
+                                                                    le32toh(pkt_cmd_sdhci->command.block_size),
+                                                                    le32toh(pkt_cmd_sdhci->command.blocks),
+                                                                    buf_len > 0 ? buffer : NULL,
+                                                                    buf_len,
+                                                                    le32toh(pkt_cmd_sdhci->command.timeout),
+                                                                    (uint32_t*)&sdhci_response,
+                                                                    &duration,
+                                                                    &sense);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    // Response header goes right before the data, over the command that is not needed anymore
+                    out_buf       = buffer - sizeof(AaruPacketResSdhci);
                     pkt_res_sdhci = (AaruPacketResSdhci*)out_buf;
-                    if(buffer)
-                        memcpy(out_buf + sizeof(AaruPacketResSdhci), buffer, le32toh(pkt_cmd_sdhci->command.buf_len));
 
-                    pkt_res_sdhci->hdr.len =
-                        htole32(sizeof(AaruPacketResSdhci) + le32toh(pkt_cmd_sdhci->command.buf_len));
+                    pkt_res_sdhci->hdr.len         = htole32(sizeof(AaruPacketResSdhci) + buf_len);
                     pkt_res_sdhci->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_SDHCI;
                     pkt_res_sdhci->hdr.version     = AARUREMOTE_PACKET_VERSION;
                     pkt_res_sdhci->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
@@ -1036,42 +1421,31 @@ void* WorkingLoop(void* arguments)
                     sdhci_response[3] = htole32(sdhci_response[3]);
 
                     memcpy((char*)&pkt_res_sdhci->res.response, (char*)&sdhci_response, sizeof(uint32_t) * 4);
-                    pkt_res_sdhci->res.buf_len  = pkt_cmd_sdhci->command.buf_len;
+                    SetTraceResult(&request, ret, &sdhci_response, sizeof(uint32_t) * 4, buffer, buf_len);
+                    pkt_res_sdhci->res.buf_len  = htole32(buf_len);
                     pkt_res_sdhci->res.duration = htole32(duration);
                     pkt_res_sdhci->res.sense    = htole32(sense);
                     pkt_res_sdhci->res.error_no = htole32(ret);
 
-                    NetWrite(cli_ctx, pkt_res_sdhci, le32toh(pkt_res_sdhci->hdr.len));
-                    free(pkt_cmd_sdhci);
-                    free(pkt_res_sdhci);
+                    SendResponse(cli_ctx, &request, &pkt_res_sdhci->hdr, le32toh(pkt_res_sdhci->hdr.len), NULL, 0);
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_CLOSE_DEVICE:
-                    DeviceClose(device_ctx);
+                    backend->close(device_ctx);
+                    StatsSetDevice(NULL);
                     device_ctx    = NULL;
                     skip_next_hdr = 1;
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_AM_I_ROOT:
                     // Packet only contains header so, dummy
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
 
-                    if(!in_buf)
-                    {
-                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
-                        free(pkt_hdr);
-                        NetClose(cli_ctx);
-                        continue;
-                    }
-
-                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
-                    free(in_buf);
-
-                    pkt_res_am_i_root = malloc(sizeof(AaruPacketResAmIRoot));
+                    pkt_res_am_i_root = ArenaAlloc(arena, sizeof(AaruPacketResAmIRoot));
                     if(!pkt_res_am_i_root)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(pkt_res_am_i_root, 0, sizeof(AaruPacketResAmIRoot));
@@ -1082,36 +1456,41 @@ void* WorkingLoop(void* arguments)
                     pkt_res_am_i_root->hdr.len         = htole32(sizeof(AaruPacketResAmIRoot));
                     pkt_res_am_i_root->am_i_root       = AmIRoot();
 
-                    NetWrite(cli_ctx, pkt_res_am_i_root, le32toh(pkt_res_am_i_root->hdr.len));
-                    free(pkt_res_am_i_root);
+                    SendPacket(cli_ctx, &request, pkt_res_am_i_root, le32toh(pkt_res_am_i_root->hdr.len));
                     continue;
                 case AARUREMOTE_PACKET_TYPE_MULTI_COMMAND_SDHCI:
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
 
+                    request.received    = GetMonotonicMicroseconds();
                     pkt_cmd_multi_sdhci = (AaruPacketMultiCmdSdhci*)in_buf;
 
+                    // Command count and the first command
+                    if(le32toh(pkt_hdr->len) > sizeof(AaruPacketHeader))
+                        SetTraceCommand(&request,
+                                        in_buf + sizeof(AaruPacketHeader),
+                                        le32toh(pkt_hdr->len) - (uint32_t)sizeof(AaruPacketHeader));
+
                     pkt_cmd_multi_sdhci->cmd_count = le64toh(pkt_cmd_multi_sdhci->cmd_count);
 
                     // TODO: Check size of buffers + size of packet is not bigger than size in header
-                    multi_sdhci_commands = malloc(sizeof(MmcSingleCommand) * pkt_cmd_multi_sdhci->cmd_count);
+                    multi_sdhci_commands = ArenaAlloc(arena, sizeof(MmcSingleCommand) * pkt_cmd_multi_sdhci->cmd_count);
 
                     if(!multi_sdhci_commands)
                     {
                         printf("Fatal error %d allocating memory for commands, closing connection...\n", errno);
                         free(pkt_hdr);
-                        free(in_buf);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     memset(multi_sdhci_commands, 0, sizeof(MmcSingleCommand) * pkt_cmd_multi_sdhci->cmd_count);
@@ -1137,23 +1516,25 @@ void* WorkingLoop(void* arguments)
                         off += multi_sdhci_commands[n].buf_len;
                     }
 
-                    ret = SendMultiSdhciCommand(
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->send_multi_sdhci_command(
                         device_ctx, pkt_cmd_multi_sdhci->cmd_count, multi_sdhci_commands, &duration, &sense);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    SetTraceResult(&request, ret, NULL, 0, NULL, 0);
 
                     off =
                         (long)(sizeof(AaruPacketMultiResSdhci) + sizeof(AaruResSdhci) * pkt_cmd_multi_sdhci->cmd_count);
 
                     for(n = 0; n < pkt_cmd_multi_sdhci->cmd_count; n++) off += multi_sdhci_commands[n].buf_len;
 
-                    out_buf = malloc(off);
+                    out_buf = ArenaAlloc(arena, off);
 
                     if(!out_buf)
                     {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(multi_sdhci_commands);
-                        free(pkt_hdr);
-                        free(in_buf);
-                        NetClose(cli_ctx);
+                        SendOutOfMemory(
+                            cli_ctx, &request, pkt_nop, "Not enough memory for multiple SDHCI response, skipping...");
                         continue;
                     }
 
@@ -1187,26 +1568,28 @@ void* WorkingLoop(void* arguments)
                         off += multi_sdhci_commands->buf_len;
                     }
 
-                    NetWrite(cli_ctx, pkt_res_multi_sdhci, le32toh(pkt_res_multi_sdhci->hdr.len));
-                    free(multi_sdhci_commands);
-                    free(pkt_cmd_multi_sdhci);
-                    free(pkt_res_multi_sdhci);
+                    SendResponse(cli_ctx,
+                                 &request,
+                                 &pkt_res_multi_sdhci->hdr,
+                                 le32toh(pkt_res_multi_sdhci->hdr.len),
+                                 NULL,
+                                 0);
 
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_REOPEN:
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
 
-                    ret = ReOpen(device_ctx, &sense);
+                    ret = backend->reopen(device_ctx, &sense);
                     memset(&pkt_nop->reason, 0, 256);
 
                     if(ret)
@@ -1224,73 +1607,383 @@ void* WorkingLoop(void* arguments)
                         pkt_nop->reason_code = AARUREMOTE_PACKET_NOP_REASON_REOPEN_OK;
                     }
 
-                    NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                    SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
 
-                    free(in_buf);
 
                     continue;
                 case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD:
-                    in_buf = malloc(le32toh(pkt_hdr->len));
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
 
                     if(!in_buf)
                     {
                         printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
                         NetClose(cli_ctx);
-                        continue;
+                        break;
                     }
 
                     NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
 
-                    pkt_cmd_osread = (AaruPacketCmdOsRead*)in_buf;
+                    request.received = GetMonotonicMicroseconds();
+                    pkt_cmd_osread   = (AaruPacketCmdOsRead*)in_buf;
+                    buf_len          = le32toh(pkt_cmd_osread->length);
 
-                    buffer = malloc(le32toh(pkt_cmd_osread->length));
+                    // Offset and length
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdOsRead) - sizeof(AaruPacketHeader));
 
-                    if(!buffer)
+                    out_buf = ArenaAlloc(arena, sizeof(AaruPacketResOsRead) + buf_len);
+
+                    if(!out_buf)
                     {
-                        printf("Fatal error %d allocating memory for buffer, closing connection...\n", errno);
+                        SendOutOfMemory(
+                            cli_ctx, &request, pkt_nop, "Not enough memory for OS read response, skipping...");
+                        continue;
+                    }
+
+                    // Read straight behind the response header
+                    buffer = out_buf + sizeof(AaruPacketResOsRead);
+
+                    request.submitted = GetMonotonicMicroseconds();
+                    ret               = backend->os_read(
+                        device_ctx, buffer, le64toh(pkt_cmd_osread->offset), buf_len, &read_length, &duration);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error     = ret != 0;
+
+                    // Past the end of the device the data is zeroed, the legacy response is always full length
+                    if(read_length < buf_len) memset(buffer + read_length, 0, buf_len - read_length);
+
+                    SetTraceResult(&request, ret, NULL, 0, buffer, read_length);
+
+                    pkt_res_osread = (AaruPacketResOsRead*)out_buf;
+
+                    pkt_res_osread->hdr.len         = htole32(sizeof(AaruPacketResOsRead) + buf_len);
+                    pkt_res_osread->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD;
+                    pkt_res_osread->hdr.version     = AARUREMOTE_PACKET_VERSION;
+                    pkt_res_osread->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+                    pkt_res_osread->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+                    pkt_res_osread->error_no        = htole32(ret);
+                    pkt_res_osread->duration        = htole32(duration);
+
+                    SendResponse(cli_ctx, &request, &pkt_res_osread->hdr, le32toh(pkt_res_osread->hdr.len), NULL, 0);
+
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_VECTOR:
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
+
+                    if(!in_buf)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
-                        free(in_buf);
                         NetClose(cli_ctx);
+                        break;
+                    }
+
+                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+
+                    request.received      = GetMonotonicMicroseconds();
+                    pkt_cmd_osread_vector = (AaruPacketCmdOsReadVector*)in_buf;
+
+                    // Extent count and the first extent
+                    if(le32toh(pkt_hdr->len) > sizeof(AaruPacketHeader))
+                        SetTraceCommand(&request,
+                                        in_buf + sizeof(AaruPacketHeader),
+                                        le32toh(pkt_hdr->len) - (uint32_t)sizeof(AaruPacketHeader));
+
+                    pkt_cmd_osread_vector->extent_count = le64toh(pkt_cmd_osread_vector->extent_count);
+
+                    // Extents must fit in the packet and the data of all of them in a single response
+                    ret = le32toh(pkt_hdr->len) >= sizeof(AaruPacketCmdOsReadVector) &&
+                          pkt_cmd_osread_vector->extent_count <=
+                              (le32toh(pkt_hdr->len) - sizeof(AaruPacketCmdOsReadVector)) / sizeof(AaruCmdOsReadExtent);
+                    extents_len = 0;
+
+                    for(n = 0; ret && n < pkt_cmd_osread_vector->extent_count; n++)
+                    {
+                        pkt_cmd_osread_vector->extents[n].offset = le64toh(pkt_cmd_osread_vector->extents[n].offset);
+                        pkt_cmd_osread_vector->extents[n].length = le32toh(pkt_cmd_osread_vector->extents[n].length);
+                        extents_len += pkt_cmd_osread_vector->extents[n].length;
+                    }
+
+                    if(ret)
+                        extents_len += sizeof(AaruPacketResOsReadVector) +
+                                       sizeof(AaruResOsReadExtent) * pkt_cmd_osread_vector->extent_count;
+
+                    // Timing trailer must still fit in the length field
+                    if(!ret || extents_len > UINT32_MAX - sizeof(AaruResponseTiming))
+                    {
+                        SendInvalidPacket(
+                            cli_ctx, &request, pkt_nop, "Invalid extents in OS read vector packet, skipping...");
                         continue;
                     }
 
-                    memset(buffer, 0, le32toh(pkt_cmd_osread->length));
+                    off = (long)(sizeof(AaruPacketResOsReadVector) +
+                                 sizeof(AaruResOsReadExtent) * pkt_cmd_osread_vector->extent_count);
 
-                    ret = OsRead(device_ctx,
-                                 buffer,
-                                 le64toh(pkt_cmd_osread->offset),
-                                 le32toh(pkt_cmd_osread->length),
-                                 &duration);
+                    out_buf = ArenaAlloc(arena, (size_t)extents_len);
 
-                    out_buf = malloc(sizeof(AaruPacketResOsRead) + le32toh(pkt_cmd_osread->length));
+                    if(!out_buf)
+                    {
+                        SendOutOfMemory(
+                            cli_ctx, &request, pkt_nop, "Not enough memory for OS read vector response, skipping...");
+                        continue;
+                    }
+
+                    pkt_res_osread_vector = (AaruPacketResOsReadVector*)out_buf;
+
+                    request.submitted = GetMonotonicMicroseconds();
+
+                    // Each extent is read straight after the previous one's data, short reads pack tightly
+                    for(n = 0; n < pkt_cmd_osread_vector->extent_count; n++)
+                    {
+                        ret = backend->os_read(device_ctx,
+                                               out_buf + off,
+                                               pkt_cmd_osread_vector->extents[n].offset,
+                                               pkt_cmd_osread_vector->extents[n].length,
+                                               &read_length,
+                                               &duration);
+
+                        pkt_res_osread_vector->results[n].error_no = htole32(ret);
+                        pkt_res_osread_vector->results[n].duration = htole32(duration);
+                        pkt_res_osread_vector->results[n].length   = htole32(read_length);
+                        off += read_length;
+
+                        if(ret)
+                        {
+                            request.error    = 1;
+                            request.error_no = ret;
+                        }
+                    }
+
+                    request.completed = GetMonotonicMicroseconds();
+
+                    data_off = (long)(sizeof(AaruPacketResOsReadVector) +
+                                      sizeof(AaruResOsReadExtent) * pkt_cmd_osread_vector->extent_count);
+                    SetTraceResult(&request, request.error_no, NULL, 0, out_buf + data_off, (uint32_t)(off - data_off));
+
+                    pkt_res_osread_vector->hdr.len         = htole32(off);
+                    pkt_res_osread_vector->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD_VECTOR;
+                    pkt_res_osread_vector->hdr.version     = AARUREMOTE_PACKET_VERSION;
+                    pkt_res_osread_vector->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+                    pkt_res_osread_vector->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+                    pkt_res_osread_vector->extent_count    = htole64(pkt_cmd_osread_vector->extent_count);
+
+                    SendResponse(cli_ctx, &request, &pkt_res_osread_vector->hdr, (uint32_t)off, NULL, 0);
+
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_OSREAD_MAP:
+                    if(le32toh(pkt_hdr->len) < sizeof(AaruPacketCmdOsReadMap))
+                    {
+                        DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
+                        SendInvalidPacket(cli_ctx, &request, pkt_nop, "OS read map packet too short, skipping...");
+                        continue;
+                    }
+
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
+
+                    if(!in_buf)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
+                        free(pkt_hdr);
+                        NetClose(cli_ctx);
+                        break;
+                    }
+
+                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+
+                    request.received   = GetMonotonicMicroseconds();
+                    pkt_cmd_osread_map = (AaruPacketCmdOsReadMap*)in_buf;
+
+                    // Offset, length, block size and flags
+                    SetTraceCommand(&request,
+                                    in_buf + sizeof(AaruPacketHeader),
+                                    sizeof(AaruPacketCmdOsReadMap) - sizeof(AaruPacketHeader));
+
+                    pkt_cmd_osread_map->offset      = le64toh(pkt_cmd_osread_map->offset);
+                    pkt_cmd_osread_map->length      = le64toh(pkt_cmd_osread_map->length);
+                    pkt_cmd_osread_map->block_size  = le32toh(pkt_cmd_osread_map->block_size);
+                    pkt_cmd_osread_map->flags       = le32toh(pkt_cmd_osread_map->flags);
+                    pkt_cmd_osread_map->max_extents = le32toh(pkt_cmd_osread_map->max_extents);
+
+                    if(pkt_cmd_osread_map->block_size == 0)
+                        pkt_cmd_osread_map->block_size = AARUREMOTE_OSREAD_MAP_DEFAULT_BLOCK;
+
+                    if(pkt_cmd_osread_map->max_extents == 0 ||
+                       pkt_cmd_osread_map->max_extents > AARUREMOTE_OSREAD_MAP_MAX_EXTENTS)
+                        pkt_cmd_osread_map->max_extents = AARUREMOTE_OSREAD_MAP_MAX_EXTENTS;
+
+                    if(pkt_cmd_osread_map->block_size > AARUREMOTE_OSREAD_MAP_MAX_BLOCK)
+                    {
+                        SendInvalidPacket(cli_ctx, &request, pkt_nop, "OS read map block too big, skipping...");
+                        continue;
+                    }
+
+                    out_buf = ArenaAlloc(arena,
+                                         sizeof(AaruPacketResOsReadMap) +
+                                             sizeof(AaruOsReadMapExtent) * pkt_cmd_osread_map->max_extents);
 
                     if(!out_buf)
                     {
-                        printf("Fatal error %d allocating memory for packet, continuing...\n", errno);
-                        free(buffer);
+                        SendOutOfMemory(
+                            cli_ctx, &request, pkt_nop, "Not enough memory for OS read map response, skipping...");
+                        continue;
+                    }
+
+                    pkt_res_osread_map = (AaruPacketResOsReadMap*)out_buf;
+
+                    request.submitted = GetMonotonicMicroseconds();
+                    OsReadMap(backend, device_ctx, pkt_cmd_osread_map, pkt_res_osread_map);
+                    request.completed = GetMonotonicMicroseconds();
+                    request.error_no  = (int32_t)le32toh(pkt_res_osread_map->error_no);
+                    request.error     = request.error_no != 0;
+
+                    off = (long)(sizeof(AaruPacketResOsReadMap) +
+                                 sizeof(AaruOsReadMapExtent) * le32toh(pkt_res_osread_map->extent_count));
+
+                    pkt_res_osread_map->hdr.len         = htole32(off);
+                    pkt_res_osread_map->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD_MAP;
+                    pkt_res_osread_map->hdr.version     = AARUREMOTE_PACKET_VERSION;
+                    pkt_res_osread_map->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+                    pkt_res_osread_map->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+
+                    SendResponse(cli_ctx, &request, &pkt_res_osread_map->hdr, (uint32_t)off, NULL, 0);
+
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_GET_STATS:
+                    // Packet only contains header so, dummy
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
+
+                    pkt_res_stats = ArenaAlloc(arena, StatsSize());
+
+                    if(!pkt_res_stats)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
                         free(pkt_hdr);
-                        free(in_buf);
                         NetClose(cli_ctx);
+                        break;
+                    }
+
+                    StatsSnapshot(pkt_res_stats);
+
+                    SendPacket(cli_ctx, &request, pkt_res_stats, le32toh(pkt_res_stats->hdr.len));
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_ECHO:
+                    if(le32toh(pkt_hdr->len) > sizeof(AaruPacketHeader) + AARUREMOTE_DIAGNOSTICS_MAX_CHUNK)
+                    {
+                        DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
+                        SendInvalidPacket(cli_ctx, &request, pkt_nop, "Echo payload too big, skipping...");
                         continue;
                     }
 
-                    pkt_res_osread = (AaruPacketResOsRead*)out_buf;
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
 
-                    pkt_res_osread->hdr.len = htole32(sizeof(AaruPacketResOsRead) + le32toh(pkt_cmd_osread->length));
-                    pkt_res_osread->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_OSREAD;
-                    pkt_res_osread->hdr.version     = AARUREMOTE_PACKET_VERSION;
-                    pkt_res_osread->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
-                    pkt_res_osread->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
-                    pkt_res_osread->error_no        = htole32(ret);
-                    pkt_res_osread->duration        = htole32(duration);
+                    if(!in_buf)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
+                        free(pkt_hdr);
+                        NetClose(cli_ctx);
+                        break;
+                    }
+
+                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+
+                    // Goes back untouched but for the type
+                    ((AaruPacketHeader*)in_buf)->packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_ECHO;
+
+                    SendPacket(cli_ctx, &request, in_buf, le32toh(pkt_hdr->len));
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_SINK:
+                    DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
+
+                    pkt_res_sink = ArenaAlloc(arena, sizeof(AaruPacketResSink));
 
-                    memcpy(out_buf + sizeof(AaruPacketResOsRead), buffer, le32toh(pkt_cmd_osread->length));
+                    if(!pkt_res_sink)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
+                        free(pkt_hdr);
+                        NetClose(cli_ctx);
+                        break;
+                    }
 
-                    NetWrite(cli_ctx, pkt_res_osread, le32toh(pkt_res_osread->hdr.len));
-                    free(buffer);
-                    free(pkt_cmd_osread);
-                    free(pkt_res_osread);
+                    pkt_res_sink->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+                    pkt_res_sink->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+                    pkt_res_sink->hdr.len         = htole32(sizeof(AaruPacketResSink));
+                    pkt_res_sink->hdr.version     = AARUREMOTE_PACKET_VERSION;
+                    pkt_res_sink->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_SINK;
+                    pkt_res_sink->bytes           = htole64(request.bytes_in - sizeof(AaruPacketHeader));
+                    pkt_res_sink->elapsed         = htole64(GetMonotonicMicroseconds() - request.started);
+
+                    SendPacket(cli_ctx, &request, pkt_res_sink, sizeof(AaruPacketResSink));
+                    continue;
+                case AARUREMOTE_PACKET_TYPE_COMMAND_SOURCE:
+                    if(le32toh(pkt_hdr->len) < sizeof(AaruPacketCmdSource))
+                    {
+                        DiscardPacket(cli_ctx, le32toh(pkt_hdr->len));
+                        SendInvalidPacket(cli_ctx, &request, pkt_nop, "Source packet too short, skipping...");
+                        continue;
+                    }
+
+                    in_buf = ArenaAlloc(arena, le32toh(pkt_hdr->len));
+
+                    if(!in_buf)
+                    {
+                        printf("Fatal error %d allocating memory for packet, closing connection...\n", errno);
+                        free(pkt_hdr);
+                        NetClose(cli_ctx);
+                        break;
+                    }
+
+                    NetRecv(cli_ctx, in_buf, le32toh(pkt_hdr->len), 0);
+
+                    request.received = GetMonotonicMicroseconds();
+                    pkt_cmd_source   = (AaruPacketCmdSource*)in_buf;
+                    source_length    = le64toh(pkt_cmd_source->length);
+                    buf_len          = le32toh(pkt_cmd_source->chunk_size);
+
+                    if(buf_len == 0) buf_len = AARUREMOTE_DIAGNOSTICS_DEFAULT_CHUNK;
+
+                    if(buf_len > AARUREMOTE_DIAGNOSTICS_MAX_CHUNK)
+                    {
+                        SendInvalidPacket(cli_ctx, &request, pkt_nop, "Source chunk too big, skipping...");
+                        continue;
+                    }
+
+                    if(buf_len > source_length && source_length > 0) buf_len = (uint32_t)source_length;
+
+                    out_buf = ArenaAlloc(arena, sizeof(AaruPacketResSource) + (size_t)buf_len);
+
+                    if(!out_buf)
+                    {
+                        SendOutOfMemory(
+                            cli_ctx, &request, pkt_nop, "Not enough memory for source response, skipping...");
+                        continue;
+                    }
+
+                    // Every chunk sends the same data, only the header changes
+                    FillGenerated(out_buf + sizeof(AaruPacketResSource), buf_len);
+
+                    pkt_res_source                  = (AaruPacketResSource*)out_buf;
+                    pkt_res_source->hdr.remote_id   = htole32(AARUREMOTE_REMOTE_ID);
+                    pkt_res_source->hdr.packet_id   = htole32(AARUREMOTE_PACKET_ID);
+                    pkt_res_source->hdr.version     = AARUREMOTE_PACKET_VERSION;
+                    pkt_res_source->hdr.packet_type = AARUREMOTE_PACKET_TYPE_RESPONSE_SOURCE;
+                    source_offset                   = 0;
+
+                    // Nothing asked for still gets an empty chunk, so there is always an answer
+                    do
+                    {
+                        if(source_length - source_offset < buf_len) buf_len = (uint32_t)(source_length - source_offset);
+
+                        pkt_res_source->hdr.len = htole32(sizeof(AaruPacketResSource) + buf_len);
+                        pkt_res_source->offset  = htole64(source_offset);
+                        pkt_res_source->elapsed = htole64(GetMonotonicMicroseconds() - request.received);
+
+                        if(NetWrite(cli_ctx, out_buf, (int32_t)(sizeof(AaruPacketResSource) + buf_len)) < 0) break;
+
+                        request.bytes_out += sizeof(AaruPacketResSource) + buf_len;
+                        source_offset += buf_len;
+                    } while(source_offset < source_length);
 
                     continue;
                 default:
@@ -1307,12 +2000,27 @@ void* WorkingLoop(void* arguments)
                              "Received unrecognized packet with type %d, skipping...",
                              pkt_hdr->packet_type);
 #endif
-                    NetWrite(cli_ctx, pkt_nop, sizeof(AaruPacketNop));
+                    SendPacket(cli_ctx, &request, pkt_nop, sizeof(AaruPacketNop));
                     printf("%s...\n", pkt_nop->reason);
                     skip_next_hdr = 1;
                     continue;
             }
+
+            // Only fatal errors leave the switch, the connection is gone already
+            break;
         }
+
+        RecordRequest(&request);
+        TraceFlush();
+        StatsSessionEnded();
+        ArenaFree(arena);
+        arena = NULL;
+
+        PoolGetStats(&pool_stats);
+        printf("Transfer buffers: %lu hits, %lu misses, %lu KiB held at peak.\n",
+               (unsigned long)pool_stats.hits,
+               (unsigned long)pool_stats.misses,
+               (unsigned long)(pool_stats.peak / 1024));
     }
 
     free(pkt_nop);